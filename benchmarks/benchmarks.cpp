@@ -0,0 +1,446 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+
+#include "world.h"
+#include "workloads.h"
+#include "threadPlacement.h"
+#include "bitSlicedWorld.h"
+
+// The ways the simulation can be stepped
+enum class Engine
+{
+	Map, // World, the cells in a map split over its simulation threads
+	BitSliced // BitSlicedWorld, BitSlicedLaneCount variants of the world at once on one thread
+};
+
+// Where the simulation threads and their cells are
+enum class Placement
+{
+	Default, // Wherever the operating system puts them
+	Pinned, // Every thread on its own processor, neighbouring threads on the same NUMA node
+	NodeLocal // Pinned, and every thread allocates the cells it simulates
+};
+
+struct BenchmarkOptions
+{
+	std::vector<Engine> engines{ Engine::Map };
+	std::vector<unsigned int> threadCounts;
+	std::vector<Placement> placements{ Placement::Default };
+	size_t minCells = 10000;
+	size_t maxCells = 1000000;
+	double secondsPerRun = 1.0;
+	unsigned long long warmupGenerations = 8;
+	std::vector<std::string> worldFiles;
+	std::string outputPath;
+};
+
+struct BenchmarkResult
+{
+	std::string engine;
+	std::string workload;
+	size_t cells = 0;
+	unsigned int threads = 0;
+	std::string placement;
+	unsigned int pinFailures = 0; // Threads that stayed wherever the system put them
+	unsigned long long generations = 0;
+	double seconds = 0;
+	double generationsPerSecond = 0;
+	double nsPerCellUpdate = 0;
+	double estimatedBytesPerCell = 0; // From the sizes of the structures, allocator overhead not included
+	double syncNsPerGeneration = 0;
+	double syncFraction = 0;
+	double commitNsPerGeneration = 0;
+};
+
+static const char* GetEngineName(Engine a_engine)
+{
+	switch (a_engine)
+	{
+	case Engine::Map:
+		return "map";
+	case Engine::BitSliced:
+		return "bit-sliced";
+	}
+	return "unknown";
+}
+
+static const char* GetPlacementName(Placement a_placement)
+{
+	switch (a_placement)
+	{
+	case Placement::Default:
+		return "default";
+	case Placement::Pinned:
+		return "pinned";
+	case Placement::NodeLocal:
+		return "node-local";
+	}
+	return "unknown";
+}
+
+static World::ThreadOptions GetThreadOptions(Placement a_placement, unsigned int a_threads)
+{
+	World::ThreadOptions m_options;
+	m_options.threads = a_threads;
+	m_options.pinThreads = a_placement != Placement::Default;
+	m_options.nodeLocalCells = a_placement == Placement::NodeLocal;
+	return m_options;
+}
+
+static void PrintUsage()
+{
+	std::cout << "Usage: benchmarks [--engine <map,bit-sliced>] [--threads <n,n,...>] [--placement <default,pinned,node-local>]" << std::endl;
+	std::cout << "       [--min-cells <count>] [--max-cells <count>] [--seconds <per run>] [--world <file.csv>]... [--out <results.json>]" << std::endl;
+	std::cout << "  Runs every workload from 10^4 cells up to --max-cells (default 10^6, up to 10^8) for every" << std::endl;
+	std::cout << "  engine, thread count and placement. Pass the Wireworld primes computer with --world." << std::endl;
+	std::cout << "  The bit-sliced engine runs on one thread, its ns per cell update is per cell of every variant." << std::endl;
+}
+
+static std::vector<Engine> ParseEngines(const char* a_list)
+{
+	std::vector<Engine> m_engines;
+	std::stringstream m_stream(a_list);
+	std::string m_item;
+	while (std::getline(m_stream, m_item, ','))
+	{
+		if (m_item == "map")
+			m_engines.push_back(Engine::Map);
+		else if (m_item == "bit-sliced")
+			m_engines.push_back(Engine::BitSliced);
+		else
+			std::cerr << "Unknown engine " << m_item << std::endl;
+	}
+	return m_engines;
+}
+
+static std::vector<Placement> ParsePlacements(const char* a_list)
+{
+	std::vector<Placement> m_placements;
+	std::stringstream m_stream(a_list);
+	std::string m_item;
+	while (std::getline(m_stream, m_item, ','))
+	{
+		if (m_item == "default")
+			m_placements.push_back(Placement::Default);
+		else if (m_item == "pinned")
+			m_placements.push_back(Placement::Pinned);
+		else if (m_item == "node-local")
+			m_placements.push_back(Placement::NodeLocal);
+		else
+			std::cerr << "Unknown placement " << m_item << std::endl;
+	}
+	return m_placements;
+}
+
+// How many NUMA nodes the processors are spread over
+static unsigned int GetNodeCount()
+{
+	unsigned int m_nodes = 0;
+	for (unsigned int m_processor : GetProcessorsByNode())
+		m_nodes = std::max(m_nodes, GetProcessorNode(m_processor) + 1);
+	return m_nodes;
+}
+
+static std::vector<unsigned int> ParseThreadCounts(const char* a_list)
+{
+	std::vector<unsigned int> m_counts;
+	std::stringstream m_stream(a_list);
+	std::string m_item;
+	while (std::getline(m_stream, m_item, ','))
+	{
+		unsigned int m_count = (unsigned int)strtoul(m_item.c_str(), nullptr, 10);
+		if (m_count > 0)
+			m_counts.push_back(m_count);
+	}
+	return m_counts;
+}
+
+// 1, 2, 4, ... and the number of processors
+static std::vector<unsigned int> GetDefaultThreadCounts()
+{
+	unsigned int m_processors = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<unsigned int> m_counts;
+	for (unsigned int m_count = 1; m_count < m_processors; m_count *= 2)
+		m_counts.push_back(m_count);
+	m_counts.push_back(m_processors);
+	return m_counts;
+}
+
+// An estimate of what one cell costs in World: the size of the cell itself and of the map node holding it
+// (value and three links plus a color). What the allocator adds on top of every allocation isn't in it.
+static double GetMapBytesPerCell()
+{
+	size_t m_nodeValue = sizeof(std::pair<const std::pair<coordinatePart, coordinatePart>, Cell*>);
+	return (double)(sizeof(Cell) + m_nodeValue + 4 * sizeof(void*));
+}
+
+static BenchmarkResult RunMapEngine(const Workload& a_workload, unsigned int a_threads, Placement a_placement, const BenchmarkOptions& a_options)
+{
+	// Paused, so the timer thread of the world never steps in between
+	World m_world(GetThreadOptions(a_placement, a_threads));
+	LoadWorkload(&m_world, a_workload);
+	size_t m_cellCount = m_world.cells.size();
+
+	for (unsigned long long m_generation = 0; m_generation < a_options.warmupGenerations; m_generation++)
+		m_world.UpdateSimulationWithSingleGeneration();
+
+	World::StepTimings m_before = m_world.GetStepTimings();
+	auto m_start = std::chrono::high_resolution_clock::now();
+	auto m_end = m_start + std::chrono::duration<double>(a_options.secondsPerRun);
+	auto m_now = m_start;
+	unsigned long long m_generations = 0;
+	while (m_now < m_end || m_generations == 0)
+	{
+		m_world.UpdateSimulationWithSingleGeneration();
+		m_generations++;
+		m_now = std::chrono::high_resolution_clock::now();
+	}
+	World::StepTimings m_after = m_world.GetStepTimings();
+
+	BenchmarkResult m_result;
+	m_result.engine = GetEngineName(Engine::Map);
+	m_result.workload = a_workload.name;
+	m_result.cells = m_cellCount;
+	m_result.threads = m_world.GetSimulationThreadCount();
+	m_result.placement = GetPlacementName(a_placement);
+	m_result.pinFailures = m_world.GetPinFailures();
+	m_result.generations = m_generations;
+	m_result.seconds = std::chrono::duration<double>(m_now - m_start).count();
+	m_result.generationsPerSecond = m_generations / m_result.seconds;
+	m_result.nsPerCellUpdate = m_cellCount == 0 ? 0 : m_result.seconds * 1e9 / ((double)m_generations * m_cellCount);
+	m_result.estimatedBytesPerCell = GetMapBytesPerCell();
+	double m_totalNs = (double)(m_after.totalNs - m_before.totalNs);
+	double m_syncNs = (double)(m_after.syncNs - m_before.syncNs);
+	m_result.syncNsPerGeneration = m_syncNs / m_generations;
+	m_result.syncFraction = m_totalNs > 0 ? m_syncNs / m_totalNs : 0;
+	m_result.commitNsPerGeneration = (double)(m_after.commitNs - m_before.commitNs) / m_generations;
+	return m_result;
+}
+
+static BenchmarkResult RunBitSlicedEngine(const Workload& a_workload, const BenchmarkOptions& a_options)
+{
+	// Every lane gets the same world, the work per generation doesn't depend on the electrons
+	BitSlicedWorld m_world;
+	if (!a_workload.filePath.empty())
+		m_world.Open(a_workload.filePath);
+	else
+		m_world.Load(a_workload.cells);
+	size_t m_cellCount = m_world.GetCellCount();
+
+	for (unsigned long long m_generation = 0; m_generation < a_options.warmupGenerations; m_generation++)
+		m_world.Step();
+
+	auto m_start = std::chrono::high_resolution_clock::now();
+	auto m_end = m_start + std::chrono::duration<double>(a_options.secondsPerRun);
+	auto m_now = m_start;
+	unsigned long long m_generations = 0;
+	while (m_now < m_end || m_generations == 0)
+	{
+		m_world.Step();
+		m_generations++;
+		m_now = std::chrono::high_resolution_clock::now();
+	}
+
+	BenchmarkResult m_result;
+	m_result.engine = GetEngineName(Engine::BitSliced);
+	m_result.workload = a_workload.name;
+	m_result.cells = m_cellCount;
+	m_result.threads = 1;
+	m_result.placement = GetPlacementName(Placement::Default);
+	m_result.generations = m_generations;
+	m_result.seconds = std::chrono::duration<double>(m_now - m_start).count();
+	m_result.generationsPerSecond = m_generations / m_result.seconds;
+	m_result.nsPerCellUpdate = m_cellCount == 0 ? 0 : m_result.seconds * 1e9 / ((double)m_generations * m_cellCount * BitSlicedLaneCount);
+	m_result.estimatedBytesPerCell = m_cellCount == 0 ? 0 : (double)m_world.GetMemoryUsage() / m_cellCount;
+	return m_result;
+}
+
+static BenchmarkResult RunEngine(Engine a_engine, const Workload& a_workload, unsigned int a_threads, Placement a_placement, const BenchmarkOptions& a_options)
+{
+	switch (a_engine)
+	{
+	case Engine::BitSliced:
+		return RunBitSlicedEngine(a_workload, a_options);
+	case Engine::Map:
+	default:
+		return RunMapEngine(a_workload, a_threads, a_placement, a_options);
+	}
+}
+
+// Workload names come from file names, which can hold anything
+static std::string EscapeJson(const std::string& a_text)
+{
+	std::string m_escaped;
+	m_escaped.reserve(a_text.size());
+	for (char m_character : a_text)
+	{
+		if (m_character == '"' || m_character == '\\')
+		{
+			m_escaped += '\\';
+			m_escaped += m_character;
+		}
+		else if ((unsigned char)m_character < 0x20)
+		{
+			char m_code[8];
+			snprintf(m_code, sizeof(m_code), "\\u%04x", (unsigned int)(unsigned char)m_character);
+			m_escaped += m_code;
+		}
+		else
+			m_escaped += m_character;
+	}
+	return m_escaped;
+}
+
+static void WriteResults(std::ostream& a_output, const std::vector<BenchmarkResult>& a_results)
+{
+	a_output << "{" << std::endl;
+	a_output << "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << "," << std::endl;
+	a_output << "  \"numaNodes\": " << GetNodeCount() << "," << std::endl;
+	a_output << "  \"bitSlicedLanes\": " << BitSlicedLaneCount << "," << std::endl;
+	a_output << "  \"results\": [" << std::endl;
+	for (size_t m_index = 0; m_index < a_results.size(); m_index++)
+	{
+		const BenchmarkResult& m_result = a_results[m_index];
+		a_output << "    { \"engine\": \"" << m_result.engine << "\", \"workload\": \"" << EscapeJson(m_result.workload) << "\""
+			<< ", \"cells\": " << m_result.cells
+			<< ", \"threads\": " << m_result.threads
+			<< ", \"placement\": \"" << m_result.placement << "\""
+			<< ", \"pinFailures\": " << m_result.pinFailures
+			<< ", \"generations\": " << m_result.generations
+			<< ", \"seconds\": " << m_result.seconds
+			<< ", \"generationsPerSecond\": " << m_result.generationsPerSecond
+			<< ", \"nsPerCellUpdate\": " << m_result.nsPerCellUpdate
+			<< ", \"estimatedBytesPerCell\": " << m_result.estimatedBytesPerCell
+			<< ", \"syncNsPerGeneration\": " << m_result.syncNsPerGeneration
+			<< ", \"syncFraction\": " << m_result.syncFraction
+			<< ", \"commitNsPerGeneration\": " << m_result.commitNsPerGeneration
+			<< " }" << (m_index + 1 < a_results.size() ? "," : "") << std::endl;
+	}
+	a_output << "  ]" << std::endl;
+	a_output << "}" << std::endl;
+}
+
+static void RunWorkloads(const std::vector<Workload>& a_workloads, const BenchmarkOptions& a_options, std::vector<BenchmarkResult>* a_results)
+{
+	for (Engine m_engine : a_options.engines)
+	{
+		for (const Workload& m_workload : a_workloads)
+		{
+			for (unsigned int m_threads : a_options.threadCounts)
+			{
+				for (Placement m_placement : a_options.placements)
+				{
+					// Only the map engine has threads to place
+					bool m_firstConfiguration = m_threads == a_options.threadCounts.front() && m_placement == a_options.placements.front();
+					if (m_engine == Engine::BitSliced && !m_firstConfiguration)
+						continue;
+					BenchmarkResult m_result = RunEngine(m_engine, m_workload, m_threads, m_placement, a_options);
+					std::cerr << m_result.engine << " " << m_result.workload << " " << m_result.cells << " cells, "
+						<< m_result.threads << " threads " << m_result.placement << ": " << m_result.generationsPerSecond << " gen/s, "
+						<< m_result.nsPerCellUpdate << " ns/cell" << std::endl;
+					if (m_result.pinFailures > 0)
+						std::cerr << "  " << m_result.pinFailures << " of the threads could not be pinned" << std::endl;
+					a_results->push_back(m_result);
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions m_options;
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		std::string m_name = argv[m_arg];
+		int m_left = argc - m_arg - 1;
+		if (m_name == "--threads" && m_left >= 1)
+			m_options.threadCounts = ParseThreadCounts(argv[++m_arg]);
+		else if (m_name == "--engine" && m_left >= 1)
+			m_options.engines = ParseEngines(argv[++m_arg]);
+		else if (m_name == "--placement" && m_left >= 1)
+			m_options.placements = ParsePlacements(argv[++m_arg]);
+		else if (m_name == "--min-cells" && m_left >= 1)
+			m_options.minCells = (size_t)strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--max-cells" && m_left >= 1)
+			m_options.maxCells = (size_t)strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--seconds" && m_left >= 1)
+			m_options.secondsPerRun = atof(argv[++m_arg]);
+		else if (m_name == "--world" && m_left >= 1)
+			m_options.worldFiles.push_back(argv[++m_arg]);
+		else if (m_name == "--out" && m_left >= 1)
+			m_options.outputPath = argv[++m_arg];
+		else
+		{
+			PrintUsage();
+			return m_name == "--help" ? 0 : 1;
+		}
+	}
+	if (m_options.threadCounts.empty())
+		m_options.threadCounts = GetDefaultThreadCounts();
+
+	// Generated workloads at every power of ten, then the world files as they are. Only the workloads
+	// of one size are in memory at a time, at 10^8 cells they take gigabytes.
+	std::vector<BenchmarkResult> m_results;
+	for (size_t m_cells = 10000; m_cells <= m_options.maxCells; m_cells *= 10)
+	{
+		if (m_cells < m_options.minCells)
+			continue;
+		std::vector<Workload> m_workloads;
+		m_workloads.push_back(CreateDiodeChains(m_cells));
+		m_workloads.push_back(CreateClocks(m_cells));
+		m_workloads.push_back(CreateRandomFill(m_cells, 1.0, 1));
+		m_workloads.push_back(CreateRandomFill(m_cells, 0.05, 1));
+		RunWorkloads(m_workloads, m_options, &m_results);
+	}
+	std::vector<Workload> m_fileWorkloads;
+	for (const std::string& m_file : m_options.worldFiles)
+		m_fileWorkloads.push_back(CreateFromFile(m_file));
+	RunWorkloads(m_fileWorkloads, m_options, &m_results);
+
+	if (m_options.outputPath.empty())
+	{
+		WriteResults(std::cout, m_results);
+		return 0;
+	}
+	std::ofstream m_output(m_options.outputPath, std::ios::out | std::ios::trunc);
+	if (!m_output.is_open())
+	{
+		std::cerr << "Could not write " << m_options.outputPath << std::endl;
+		return 1;
+	}
+	WriteResults(m_output, m_results);
+	return 0;
+}
@@ -0,0 +1,272 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "world.h"
+#include "workloads.h"
+
+// Times the calls the UI makes on worlds of increasing size, with the simulation paused and running at full speed
+
+struct MicroBenchmarkOptions
+{
+	size_t minCells = 10000;
+	size_t maxCells = 1000000;
+	size_t samples = 2000;
+	size_t fileSamples = 3;
+	std::string worldFilePath = "microbenchmark_world.csv";
+	std::string outputPath;
+};
+
+struct LatencyResult
+{
+	std::string api;
+	std::string scenario;
+	size_t cells = 0;
+	size_t samples = 0;
+	double meanNs = 0;
+	double p50Ns = 0;
+	double p99Ns = 0;
+	double maxNs = 0;
+};
+
+static void PrintUsage()
+{
+	std::cout << "Usage: microbenchmarks [--min-cells <count>] [--max-cells <count>] [--samples <count>]" << std::endl;
+	std::cout << "       [--file-samples <count>] [--world-file <scratch.csv>] [--out <results.json>]" << std::endl;
+	std::cout << "  Times InViewport, StatesInViewport, LoadFile, Save, TryInsertCellAt and TryUpdateCell" << std::endl;
+	std::cout << "  on random worlds from 10^4 cells up to --max-cells, paused and while simulating." << std::endl;
+}
+
+static double GetPercentile(const std::vector<double>& a_sorted, double a_percentile)
+{
+	if (a_sorted.empty())
+		return 0;
+	size_t m_index = (size_t)(a_percentile / 100.0 * (a_sorted.size() - 1) + 0.5);
+	return a_sorted[std::min(m_index, a_sorted.size() - 1)];
+}
+
+static LatencyResult Summarize(std::string a_api, std::string a_scenario, size_t a_cells, std::vector<double>* a_samples)
+{
+	std::sort(a_samples->begin(), a_samples->end());
+	LatencyResult m_result;
+	m_result.api = a_api;
+	m_result.scenario = a_scenario;
+	m_result.cells = a_cells;
+	m_result.samples = a_samples->size();
+	double m_total = 0;
+	for (double m_sample : *a_samples)
+		m_total += m_sample;
+	m_result.meanNs = a_samples->empty() ? 0 : m_total / a_samples->size();
+	m_result.p50Ns = GetPercentile(*a_samples, 50);
+	m_result.p99Ns = GetPercentile(*a_samples, 99);
+	m_result.maxNs = a_samples->empty() ? 0 : a_samples->back();
+	std::cerr << a_api << " (" << a_scenario << ", " << a_cells << " cells): p50 " << m_result.p50Ns << " ns, p99 " << m_result.p99Ns << " ns" << std::endl;
+	return m_result;
+}
+
+// Runs a_call a_samples times and keeps how long every call took
+template <typename Call>
+static std::vector<double> Sample(size_t a_samples, Call a_call)
+{
+	std::vector<double> m_samples;
+	m_samples.reserve(a_samples);
+	for (size_t m_sample = 0; m_sample < a_samples; m_sample++)
+	{
+		auto m_start = std::chrono::high_resolution_clock::now();
+		a_call(m_sample);
+		auto m_end = std::chrono::high_resolution_clock::now();
+		m_samples.push_back(std::chrono::duration<double, std::nano>(m_end - m_start).count());
+	}
+	return m_samples;
+}
+
+static void RunViewportBenchmarks(World* a_world, coordinatePart a_side, const char* a_scenario, const MicroBenchmarkOptions& a_options, std::vector<LatencyResult>* a_results)
+{
+	// A zoomed in screen (1920x1080 at 48px per cell) and a screen at a pixel per cell
+	const unsigned int m_viewports[2][2] = { { 42, 25 }, { 1922, 1082 } };
+	const char* m_names[2] = { "zoomed", "pixel" };
+	size_t m_cells = a_world->cells.size();
+	for (int m_viewport = 0; m_viewport < 2; m_viewport++)
+	{
+		unsigned int m_width = m_viewports[m_viewport][0];
+		unsigned int m_height = m_viewports[m_viewport][1];
+		std::mt19937 m_random(7);
+		std::uniform_int_distribution<coordinatePart> m_originX(-(coordinatePart)m_width / 2, a_side - (coordinatePart)m_width / 2);
+		std::uniform_int_distribution<coordinatePart> m_originY(-(coordinatePart)m_height / 2, a_side - (coordinatePart)m_height / 2);
+
+		std::vector<Cell*> m_cellsInViewport;
+		std::vector<double> m_samples = Sample(a_options.samples, [&](size_t) {
+			m_cellsInViewport.clear();
+			a_world->InViewport(&m_cellsInViewport, m_originX(m_random), m_originY(m_random), m_width, m_height);
+		});
+		a_results->push_back(Summarize(std::string("InViewport/") + m_names[m_viewport], a_scenario, m_cells, &m_samples));
+
+		std::vector<unsigned char> m_states((size_t)m_width * m_height);
+		m_samples = Sample(a_options.samples, [&](size_t) {
+			a_world->StatesInViewport(m_states.data(), m_width, m_originX(m_random), m_originY(m_random), m_width, m_height);
+		});
+		a_results->push_back(Summarize(std::string("StatesInViewport/") + m_names[m_viewport], a_scenario, m_cells, &m_samples));
+	}
+}
+
+static void RunEditBenchmarks(World* a_world, const Workload& a_workload, coordinatePart a_side, const char* a_scenario, const MicroBenchmarkOptions& a_options, std::vector<LatencyResult>* a_results)
+{
+	size_t m_cells = a_world->cells.size();
+	std::mt19937 m_random(11);
+
+	// New cells go next to the world, so every insert adds a cell like a brush stroke on an empty spot
+	std::uniform_int_distribution<coordinatePart> m_position(0, a_side - 1);
+	coordinatePart m_insertOffset = a_side + 2;
+	std::vector<double> m_samples = Sample(a_options.samples, [&](size_t) {
+		a_world->TryInsertCellAt(m_insertOffset + m_position(m_random), m_position(m_random), Conductor);
+	});
+	a_results->push_back(Summarize("TryInsertCellAt", a_scenario, m_cells, &m_samples));
+
+	// Redraw cells that are already there
+	std::uniform_int_distribution<size_t> m_existing(0, a_workload.cells.size() - 1);
+	m_samples = Sample(a_options.samples, [&](size_t) {
+		const CellSnapshot& m_cell = a_workload.cells[m_existing(m_random)];
+		a_world->TryUpdateCell(m_cell.x, m_cell.y, [](Cell* a_cell) {
+			a_cell->cellState = Conductor;
+			a_cell->decayState = Conductor;
+			return true;
+		});
+	});
+	a_results->push_back(Summarize("TryUpdateCell", a_scenario, m_cells, &m_samples));
+}
+
+static void RunFileBenchmarks(World* a_world, const MicroBenchmarkOptions& a_options, std::vector<LatencyResult>* a_results)
+{
+	size_t m_cells = a_world->cells.size();
+	a_world->filePath = a_options.worldFilePath;
+	std::vector<double> m_samples = Sample(a_options.fileSamples, [&](size_t) {
+		a_world->Save();
+		a_world->WaitForSave();
+	});
+	a_results->push_back(Summarize("Save", "paused", m_cells, &m_samples));
+
+	World m_loaded;
+	m_samples = Sample(a_options.fileSamples, [&](size_t) {
+		m_loaded.Open(a_options.worldFilePath);
+	});
+	a_results->push_back(Summarize("LoadFile", "paused", m_cells, &m_samples));
+	remove(a_options.worldFilePath.c_str());
+}
+
+static void WriteResults(std::ostream& a_output, const std::vector<LatencyResult>& a_results)
+{
+	a_output << "{" << std::endl;
+	a_output << "  \"results\": [" << std::endl;
+	for (size_t m_index = 0; m_index < a_results.size(); m_index++)
+	{
+		const LatencyResult& m_result = a_results[m_index];
+		a_output << "    { \"api\": \"" << m_result.api << "\", \"scenario\": \"" << m_result.scenario << "\""
+			<< ", \"cells\": " << m_result.cells
+			<< ", \"samples\": " << m_result.samples
+			<< ", \"meanNs\": " << m_result.meanNs
+			<< ", \"p50Ns\": " << m_result.p50Ns
+			<< ", \"p99Ns\": " << m_result.p99Ns
+			<< ", \"maxNs\": " << m_result.maxNs
+			<< " }" << (m_index + 1 < a_results.size() ? "," : "") << std::endl;
+	}
+	a_output << "  ]" << std::endl;
+	a_output << "}" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	MicroBenchmarkOptions m_options;
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		std::string m_name = argv[m_arg];
+		int m_left = argc - m_arg - 1;
+		if (m_name == "--min-cells" && m_left >= 1)
+			m_options.minCells = (size_t)strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--max-cells" && m_left >= 1)
+			m_options.maxCells = (size_t)strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--samples" && m_left >= 1)
+			m_options.samples = std::max((size_t)strtoull(argv[++m_arg], nullptr, 10), (size_t)1);
+		else if (m_name == "--file-samples" && m_left >= 1)
+			m_options.fileSamples = std::max((size_t)strtoull(argv[++m_arg], nullptr, 10), (size_t)1);
+		else if (m_name == "--world-file" && m_left >= 1)
+			m_options.worldFilePath = argv[++m_arg];
+		else if (m_name == "--out" && m_left >= 1)
+			m_options.outputPath = argv[++m_arg];
+		else
+		{
+			PrintUsage();
+			return m_name == "--help" ? 0 : 1;
+		}
+	}
+
+	std::vector<LatencyResult> m_results;
+	for (size_t m_cellCount = 10000; m_cellCount <= m_options.maxCells; m_cellCount *= 10)
+	{
+		if (m_cellCount < m_options.minCells)
+			continue;
+
+		// A third of the area filled, so viewports see a mix of cells and empty space
+		const double m_density = 0.3;
+		Workload m_workload = CreateRandomFill(m_cellCount, m_density, 3);
+		coordinatePart m_side = (coordinatePart)std::ceil(std::sqrt((double)m_cellCount / m_density));
+
+		World m_world;
+		LoadWorkload(&m_world, m_workload);
+		RunFileBenchmarks(&m_world, m_options, &m_results);
+		RunViewportBenchmarks(&m_world, m_side, "paused", m_options, &m_results);
+		RunEditBenchmarks(&m_world, m_workload, m_side, "paused", m_options, &m_results);
+
+		// Contended, the simulation steps as fast as it can while we query and edit
+		LoadWorkload(&m_world, m_workload);
+		m_world.SetTargetSpeed(1000000.0f);
+		m_world.StartSimulation();
+		RunViewportBenchmarks(&m_world, m_side, "running", m_options, &m_results);
+		RunEditBenchmarks(&m_world, m_workload, m_side, "running", m_options, &m_results);
+		m_world.PauzeSimulation();
+	}
+
+	if (m_options.outputPath.empty())
+	{
+		WriteResults(std::cout, m_results);
+		return 0;
+	}
+	std::ofstream m_output(m_options.outputPath, std::ios::out | std::ios::trunc);
+	if (!m_output.is_open())
+	{
+		std::cerr << "Could not write " << m_options.outputPath << std::endl;
+		return 1;
+	}
+	WriteResults(m_output, m_results);
+	return 0;
+}
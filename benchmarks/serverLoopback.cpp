@@ -0,0 +1,251 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+#include "world.h"
+#include "workloads.h"
+#include "simulationServer.h"
+#include "simulationClient.h"
+
+// Runs a server and two viewers on 127.0.0.1 and checks that both viewers end up with exactly
+// what the server has. The fast viewer takes every frame, the slow one only every other time and
+// keeps moving its viewport, so it gets folded frames and keyframes read while the world steps.
+
+#define LOOPBACK_WIRE_LENGTH 250
+
+struct LoopbackOptions
+{
+	size_t cells = 1000;
+	World::generationType generations = LOOPBACK_WIRE_LENGTH + 8;
+	unsigned int rounds = 20;
+	std::string worldPath;
+};
+
+struct LoopbackViewer
+{
+	std::string name;
+	SimulationClient client;
+	World mirror;
+	coordinatePart x = 0;
+	coordinatePart y = 0;
+	unsigned int width = 0;
+	unsigned int height = 0;
+
+	LoopbackViewer(const World::ThreadOptions& a_options) : mirror(a_options) {};
+};
+
+static void PrintUsage()
+{
+	std::cout << "Usage: serverloopback [--cells <count>] [--generations <count>] [--rounds <count>] [--world <world.csv>]" << std::endl;
+	std::cout << "  Streams a running world to a fast and a slow viewer over 127.0.0.1, reloaded every round," << std::endl;
+	std::cout << "  and exits with 1 when a viewer doesn't end up with the same cells as the server." << std::endl;
+}
+
+// Straight wires with one electron each that runs off the end. Every cell goes through its cycle once
+// and then stays a conductor, so a viewer left with a head or tail never gets it fixed.
+static Workload CreateElectronWires(size_t a_cellCount)
+{
+	Workload m_workload;
+	m_workload.name = "electronWires";
+	m_workload.cells.reserve(a_cellCount + LOOPBACK_WIRE_LENGTH);
+	for (coordinatePart m_y = 0; m_workload.cells.size() < a_cellCount; m_y += 2)
+	{
+		for (coordinatePart m_x = 0; m_x < LOOPBACK_WIRE_LENGTH; m_x++)
+		{
+			CellState m_state = m_x == 1 ? Head : (m_x == 0 ? Tail : Conductor);
+			m_workload.cells.push_back(CellSnapshot{ m_x, m_y, m_state });
+		}
+	}
+	return m_workload;
+}
+
+static bool SetViewport(LoopbackViewer* a_viewer, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height)
+{
+	a_viewer->x = a_x;
+	a_viewer->y = a_y;
+	a_viewer->width = a_width;
+	a_viewer->height = a_height;
+	return a_viewer->client.SetViewport(a_x, a_y, a_width, a_height);
+}
+
+// The number of positions in the viewer's viewport where its mirror differs from the server
+static size_t CountDifferences(World* a_server, LoopbackViewer* a_viewer)
+{
+	size_t m_size = (size_t)a_viewer->width * a_viewer->height;
+	std::vector<unsigned char> m_expected(m_size, Background);
+	std::vector<unsigned char> m_actual(m_size, Background);
+	// The viewport bounds are exclusive
+	a_server->StatesInViewport(m_expected.data(), a_viewer->width, a_viewer->x - 1, a_viewer->y - 1, a_viewer->width + 1, a_viewer->height + 1);
+	a_viewer->mirror.StatesInViewport(m_actual.data(), a_viewer->width, a_viewer->x - 1, a_viewer->y - 1, a_viewer->width + 1, a_viewer->height + 1);
+
+	size_t m_differences = 0;
+	for (size_t m_index = 0; m_index < m_size; m_index++)
+		if (m_expected[m_index] != m_actual[m_index])
+			m_differences++;
+	return m_differences;
+}
+
+// Applies frames until the viewer reached the server's generation and nothing came in for a while
+static bool CatchUp(World* a_server, LoopbackViewer* a_viewer)
+{
+	std::chrono::steady_clock::time_point m_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	int m_quietRounds = 0;
+	while (std::chrono::steady_clock::now() < m_deadline)
+	{
+		if (a_viewer->client.ApplyTo(&a_viewer->mirror) || a_viewer->client.GetGeneration() != a_server->GetDisplayGeneration())
+			m_quietRounds = 0;
+		else if (++m_quietRounds >= 20)
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+static bool Check(World* a_server, LoopbackViewer* a_viewer)
+{
+	if (!CatchUp(a_server, a_viewer))
+	{
+		std::cerr << a_viewer->name << " viewer is still at generation " << a_viewer->client.GetGeneration()
+			<< ", the server at " << a_server->GetDisplayGeneration() << std::endl;
+		return false;
+	}
+	size_t m_differences = CountDifferences(a_server, a_viewer);
+	std::cout << a_viewer->name << " viewer: " << a_viewer->client.GetFramesReceived() << " frames, "
+		<< a_viewer->client.GetGenerationsSkipped() << " generations folded, " << m_differences << " cells differ" << std::endl;
+	return m_differences == 0;
+}
+
+int main(int argc, char** argv)
+{
+	LoopbackOptions m_options;
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		std::string m_name = argv[m_arg];
+		int m_left = argc - m_arg - 1;
+		if (m_name == "--cells" && m_left >= 1)
+			m_options.cells = std::max((size_t)strtoull(argv[++m_arg], nullptr, 10), (size_t)LOOPBACK_WIRE_LENGTH);
+		else if (m_name == "--generations" && m_left >= 1)
+			m_options.generations = (World::generationType)strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--rounds" && m_left >= 1)
+			m_options.rounds = std::max((unsigned int)strtoul(argv[++m_arg], nullptr, 10), 1u);
+		else if (m_name == "--world" && m_left >= 1)
+			m_options.worldPath = argv[++m_arg];
+		else
+		{
+			PrintUsage();
+			return m_name == "--help" ? 0 : 1;
+		}
+	}
+
+	// The check steps the world itself, one generation after the other as fast as it can
+	World::ThreadOptions m_threadOptions;
+	m_threadOptions.stepOnCaller = true;
+	World m_world(m_threadOptions);
+	Workload m_workload = m_options.worldPath.empty() ? CreateElectronWires(m_options.cells) : CreateFromFile(m_options.worldPath);
+	LoadWorkload(&m_world, m_workload);
+
+	// A listener ahead of the server that now and then takes its time, like a recorder writing to disk.
+	// The server then hears of a generation a while after it can be read, and of the next ones right
+	// after, so keyframes see cells that are further along than the changes the server was told about.
+	unsigned long long m_notifications = 0;
+	m_world.AddChangeListener([&m_notifications](World::generationType, World::ChangeSource, const std::vector<CellChange>&)
+	{
+		if (++m_notifications % 3 == 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+	});
+
+	SimulationServer m_server;
+	if (!m_server.Start(&m_world, 0, false))
+	{
+		std::cerr << "Could not start the server" << std::endl;
+		return 1;
+	}
+
+	LoopbackViewer m_fast(m_threadOptions);
+	LoopbackViewer m_slow(m_threadOptions);
+	m_fast.name = "fast";
+	m_slow.name = "slow";
+	if (!m_fast.client.Connect("127.0.0.1", m_server.GetPort(), 2000) || !m_slow.client.Connect("127.0.0.1", m_server.GetPort(), 2000))
+	{
+		std::cerr << "Could not connect to the server on port " << m_server.GetPort() << std::endl;
+		return 1;
+	}
+	unsigned int m_height = (unsigned int)((m_options.cells + LOOPBACK_WIRE_LENGTH - 1) / LOOPBACK_WIRE_LENGTH) * 2;
+	SetViewport(&m_fast, 0, 0, LOOPBACK_WIRE_LENGTH, m_height);
+	SetViewport(&m_slow, 0, 0, 50, m_height);
+
+	bool m_matches = true;
+	for (unsigned int m_round = 0; m_round < m_options.rounds && m_matches; m_round++)
+	{
+		if (m_round > 0)
+			LoadWorkload(&m_world, m_workload);
+
+		World::generationType m_startGeneration = m_world.GetDisplayGeneration();
+		World::generationType m_endGeneration = m_startGeneration + m_options.generations;
+		std::thread m_simulation([&m_world, &m_options]()
+		{
+			for (World::generationType m_generation = 0; m_generation < m_options.generations; m_generation++)
+				m_world.UpdateSimulationWithSingleGeneration();
+		});
+
+		// Every new viewport of the slow viewer gets a keyframe, read while the electrons in it move on.
+		// The viewport follows them, so there are always cells that change during the read.
+		unsigned int m_step = 0;
+		while (m_world.GetDisplayGeneration() < m_endGeneration)
+		{
+			m_fast.client.ApplyTo(&m_fast.mirror);
+			if (++m_step % 2 == 0)
+			{
+				m_slow.client.ApplyTo(&m_slow.mirror);
+				coordinatePart m_front = (coordinatePart)(m_world.GetDisplayGeneration() - m_startGeneration);
+				SetViewport(&m_slow, m_front - 25 + (coordinatePart)(m_step % 4), 0, 50, m_height);
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+		m_simulation.join();
+
+		m_matches = Check(&m_world, &m_fast);
+		m_matches = Check(&m_world, &m_slow) && m_matches;
+	}
+
+	// Edits from a viewer go through the server and come back to every viewer that can see them
+	m_slow.client.SendEdits({ CellSnapshot{ 5, 5, Head }, CellSnapshot{ 6, 5, Conductor }, CellSnapshot{ 7, 5, Background } });
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	m_matches = Check(&m_world, &m_fast) && m_matches;
+	m_matches = Check(&m_world, &m_slow) && m_matches;
+	std::cout << "server: " << m_server.GetFramesSent() << " frames, " << m_server.GetEditsReceived() << " edits, "
+		<< m_server.GetBytesSent() << " bytes" << std::endl;
+
+	m_fast.client.Disconnect();
+	m_slow.client.Disconnect();
+	m_server.Stop();
+	return m_matches ? 0 : 1;
+}
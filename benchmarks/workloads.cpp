@@ -0,0 +1,141 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <cmath>
+#include <random>
+
+#include "workloads.h"
+
+// A clock is a ring of conductors around a row of nothing, with one electron going round.
+// The corners are left out, so every cell of the ring touches exactly two others and the electron never splits.
+// Its output wire starts to the right of the ring, on the middle row
+//  ####
+// #    #
+//  ####
+static void AddClock(std::vector<CellSnapshot>* a_output, coordinatePart a_x, coordinatePart a_y, coordinatePart a_width)
+{
+	for (coordinatePart m_x = 1; m_x < a_width; m_x++)
+	{
+		a_output->push_back(CellSnapshot{ a_x + m_x, a_y - 1, m_x == 2 ? Head : (m_x == 1 ? Tail : Conductor) });
+		a_output->push_back(CellSnapshot{ a_x + m_x, a_y + 1, Conductor });
+	}
+	a_output->push_back(CellSnapshot{ a_x, a_y, Conductor });
+	a_output->push_back(CellSnapshot{ a_x + a_width, a_y, Conductor });
+}
+
+Workload CreateDiodeChains(size_t a_cellCount)
+{
+	const coordinatePart m_clockWidth = 5;
+	const coordinatePart m_diodeSpacing = 6;
+	const coordinatePart m_diodesPerChain = 256;
+
+	Workload m_workload;
+	m_workload.name = "diodeChains";
+	m_workload.cells.reserve(a_cellCount + 1024);
+	for (coordinatePart m_y = 1; m_workload.cells.size() < a_cellCount; m_y += 4)
+	{
+		AddClock(&m_workload.cells, 0, m_y, m_clockWidth);
+
+		// The wire goes through the gap in the middle of every diode, the diode only lets electrons go right
+		//  ##
+		// ## ####
+		//  ##
+		coordinatePart m_wireStart = m_clockWidth + 1;
+		coordinatePart m_wireLength = m_diodeSpacing * m_diodesPerChain;
+		for (coordinatePart m_x = 0; m_x < m_wireLength; m_x++)
+		{
+			coordinatePart m_offset = m_x % m_diodeSpacing;
+			if (m_offset == 1 || m_offset == 2)
+			{
+				m_workload.cells.push_back(CellSnapshot{ m_wireStart + m_x, m_y - 1, Conductor });
+				m_workload.cells.push_back(CellSnapshot{ m_wireStart + m_x, m_y + 1, Conductor });
+			}
+			if (m_offset != 2)
+				m_workload.cells.push_back(CellSnapshot{ m_wireStart + m_x, m_y, Conductor });
+		}
+	}
+	return m_workload;
+}
+
+Workload CreateClocks(size_t a_cellCount)
+{
+	const coordinatePart m_wireLength = 32;
+	const coordinatePart m_tileWidth = 64;
+	const coordinatePart m_tilesPerRow = 256;
+
+	Workload m_workload;
+	m_workload.name = "clocks";
+	m_workload.cells.reserve(a_cellCount + 1024);
+	for (size_t m_tile = 0; m_workload.cells.size() < a_cellCount; m_tile++)
+	{
+		coordinatePart m_x = (coordinatePart)(m_tile % m_tilesPerRow) * m_tileWidth;
+		coordinatePart m_y = (coordinatePart)(m_tile / m_tilesPerRow) * 4 + 1;
+
+		// Widths 3 to 18, so the clocks run at different periods
+		coordinatePart m_clockWidth = 3 + (coordinatePart)(m_tile % 16);
+		AddClock(&m_workload.cells, m_x, m_y, m_clockWidth);
+		for (coordinatePart m_wire = 1; m_wire <= m_wireLength; m_wire++)
+			m_workload.cells.push_back(CellSnapshot{ m_x + m_clockWidth + m_wire, m_y, Conductor });
+	}
+	return m_workload;
+}
+
+Workload CreateRandomFill(size_t a_cellCount, double a_density, unsigned int a_seed)
+{
+	Workload m_workload;
+	m_workload.name = a_density >= 0.5 ? "randomDense" : "randomSparse";
+	m_workload.cells.reserve(a_cellCount);
+
+	std::mt19937 m_random(a_seed);
+	std::uniform_real_distribution<double> m_chance(0.0, 1.0);
+	coordinatePart m_side = (coordinatePart)std::ceil(std::sqrt((double)a_cellCount / a_density));
+	for (coordinatePart m_y = 0; m_y < m_side && m_workload.cells.size() < a_cellCount; m_y++)
+	{
+		for (coordinatePart m_x = 0; m_x < m_side && m_workload.cells.size() < a_cellCount; m_x++)
+		{
+			if (m_chance(m_random) >= a_density)
+				continue;
+			double m_state = m_chance(m_random);
+			m_workload.cells.push_back(CellSnapshot{ m_x, m_y, m_state < 0.05 ? Head : (m_state < 0.1 ? Tail : Conductor) });
+		}
+	}
+	return m_workload;
+}
+
+Workload CreateFromFile(std::string a_filePath)
+{
+	Workload m_workload;
+	size_t m_nameStart = a_filePath.find_last_of("/\\");
+	m_workload.name = m_nameStart == std::string::npos ? a_filePath : a_filePath.substr(m_nameStart + 1);
+	m_workload.filePath = a_filePath;
+	return m_workload;
+}
+
+void LoadWorkload(World* a_world, const Workload& a_workload)
+{
+	if (!a_workload.filePath.empty())
+		a_world->Open(a_workload.filePath);
+	else
+		a_world->LoadSnapshot(a_workload.cells, 0);
+}
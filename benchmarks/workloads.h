@@ -0,0 +1,54 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+
+#include "cell.h"
+#include "world.h"
+
+#ifndef __WORKLOADS__
+#define __WORKLOADS__
+
+// A world to benchmark, either generated cells or a world file
+struct Workload
+{
+	std::string name;
+	std::vector<CellSnapshot> cells;
+	std::string filePath;
+};
+
+// Rows of wire with a diode every few cells, each fed by its own clock
+Workload CreateDiodeChains(size_t a_cellCount);
+// Loops with a single electron that emit one into a short wire every lap, with different periods
+Workload CreateClocks(size_t a_cellCount);
+// A square where every position holds a cell with a chance of a_density, a tenth of them electrons
+Workload CreateRandomFill(size_t a_cellCount, double a_density, unsigned int a_seed);
+// A world file, like the Wireworld primes computer
+Workload CreateFromFile(std::string a_filePath);
+
+// Replaces the contents of a_world with the workload
+void LoadWorkload(World* a_world, const Workload& a_workload);
+
+#endif // !__WORKLOADS__
@@ -0,0 +1,330 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+
+#include "batchRunner.h"
+#include "bitSlicedWorld.h"
+#include "fileUtils.h"
+#include "profiler.h"
+
+// Worlds that are stepped by the pool thread that runs them, without simulation threads or a timer
+static World::ThreadOptions GetBatchThreadOptions()
+{
+	World::ThreadOptions m_options;
+	m_options.stepOnCaller = true;
+	return m_options;
+}
+
+BatchRunner::BatchRunner(unsigned int a_poolThreads)
+{
+	this->poolThreads = a_poolThreads;
+	if (this->poolThreads == 0)
+		this->poolThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	this->nextWorkItem.store(0);
+	this->jobsDone.store(0);
+}
+
+void BatchRunner::Add(BatchJob a_job)
+{
+	this->jobs.push_back(std::move(a_job));
+}
+
+const std::vector<BatchResult>& BatchRunner::Run()
+{
+	this->results.clear();
+	this->results.resize(this->jobs.size());
+	this->GroupJobs();
+	this->nextWorkItem.store(0);
+	this->jobsDone.store(0);
+
+	// No more threads than there is work
+	unsigned int m_threadCount = (unsigned int)std::min<size_t>(this->poolThreads, this->workItems.size());
+	std::vector<std::thread> m_threads;
+	for (unsigned int m_thread = 0; m_thread < m_threadCount; m_thread++)
+		m_threads.emplace_back(&BatchRunner::PoolThread, this);
+	for (std::thread& m_thread : m_threads)
+		m_thread.join();
+	return this->results;
+}
+
+void BatchRunner::PoolThread()
+{
+	PROFILE_THREAD("batch worker");
+	// Every job has its own result slot, so the threads never write to the same one
+	size_t m_workItem = this->nextWorkItem.fetch_add(1);
+	while (m_workItem < this->workItems.size())
+	{
+		const std::vector<size_t>& m_jobIndices = this->workItems[m_workItem];
+		if (this->engine == BatchEngine::BitSliced && this->FitsInLanes(this->jobs[m_jobIndices[0]]))
+			this->RunLanes(m_jobIndices);
+		else
+		{
+			this->results[m_jobIndices[0]] = this->RunJob(this->jobs[m_jobIndices[0]]);
+			this->jobsDone.fetch_add(1);
+		}
+		m_workItem = this->nextWorkItem.fetch_add(1);
+	}
+}
+
+bool BatchRunner::FitsInLanes(const BatchJob& a_job)
+{
+	// The lanes all run the same number of generations and can't be looked at as a World
+	return a_job.baseCells && a_job.generations > 0 && !a_job.stopWhen;
+}
+
+void BatchRunner::GroupJobs()
+{
+	this->workItems.clear();
+	for (size_t m_job = 0; m_job < this->jobs.size(); m_job++)
+	{
+		const BatchJob& m_current = this->jobs[m_job];
+		bool m_lanes = this->engine == BatchEngine::BitSliced && this->FitsInLanes(m_current);
+		// Joins the previous group when it has the same base and generations and a lane is left
+		if (m_lanes && !this->workItems.empty())
+		{
+			std::vector<size_t>& m_group = this->workItems.back();
+			const BatchJob& m_first = this->jobs[m_group[0]];
+			if (this->FitsInLanes(m_first) && m_first.baseCells == m_current.baseCells &&
+				m_first.generations == m_current.generations && m_group.size() < BitSlicedLaneCount)
+			{
+				m_group.push_back(m_job);
+				continue;
+			}
+		}
+		this->workItems.push_back(std::vector<size_t>(1, m_job));
+	}
+}
+
+BatchResult BatchRunner::RunJob(const BatchJob& a_job)
+{
+	PROFILE_ZONE("batch world");
+	BatchResult m_result;
+	m_result.name = a_job.name;
+	if (a_job.generations == 0 && !a_job.stopWhen && !this->stopWhenIdle)
+	{
+		// It would never end
+		m_result.stopReason = "no stop condition";
+		return m_result;
+	}
+
+	World m_world(GetBatchThreadOptions());
+	if (a_job.baseCells)
+		m_world.LoadSnapshot(*a_job.baseCells, 0);
+	else if (FileExists(a_job.worldFile))
+		m_world.Open(a_job.worldFile);
+	else
+	{
+		m_result.stopReason = "not loaded";
+		return m_result;
+	}
+
+	// Lay the variant over the base
+	for (const CellSnapshot& m_cell : a_job.overlay)
+	{
+		CellState m_state = m_cell.state;
+		if (m_state == Background)
+			m_world.TryDeleteCell(m_cell.x, m_cell.y);
+		else if (!m_world.TryInsertCellAt(m_cell.x, m_cell.y, m_state))
+		{
+			m_world.TryUpdateCell(m_cell.x, m_cell.y, [m_state](Cell* a_cell) {
+				a_cell->cellState = m_state;
+				a_cell->decayState = m_state;
+				return true;
+			});
+		}
+	}
+
+	auto m_start = std::chrono::steady_clock::now();
+	World::Metrics m_metrics = m_world.GetMetrics();
+	m_result.stopReason = "generations";
+	m_result.probeHeadGenerations.assign(this->probes.size(), 0);
+	while (a_job.generations == 0 || m_result.generations < a_job.generations)
+	{
+		m_world.UpdateSimulationWithSingleGeneration();
+		m_result.generations++;
+		m_metrics = m_world.GetMetrics();
+		for (size_t m_probe = 0; m_probe < this->probes.size(); m_probe++)
+		{
+			// The viewport starts after its corner, so this is only the probed cell
+			unsigned char m_state = Background;
+			m_world.StatesInViewport(&m_state, 1, this->probes[m_probe].first - 1, this->probes[m_probe].second - 1, 2, 2);
+			m_result.probeHeadGenerations[m_probe] += m_state == Head;
+		}
+		if (a_job.stopWhen && a_job.stopWhen(m_world))
+		{
+			m_result.stopReason = "condition";
+			break;
+		}
+		if (this->stopWhenIdle && m_metrics.heads == 0 && m_metrics.tails == 0)
+		{
+			m_result.stopReason = "idle";
+			break;
+		}
+	}
+	m_result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+	m_result.generationsPerSecond = m_result.seconds > 0 ? m_result.generations / m_result.seconds : 0;
+	// Counted from the cells, the statistics of World count the tails and conductors of the generation before
+	std::vector<CellSnapshot> m_cells;
+	World::generationType m_generation = 0;
+	m_world.TakeSnapshot(&m_cells, &m_generation);
+	for (const CellSnapshot& m_cell : m_cells)
+	{
+		m_result.heads += m_cell.state == Head;
+		m_result.tails += m_cell.state == Tail;
+		m_result.conductors += m_cell.state == Conductor;
+	}
+	m_result.cells = m_metrics.cells;
+	return m_result;
+}
+
+void BatchRunner::RunLanes(const std::vector<size_t>& a_jobIndices)
+{
+	PROFILE_ZONE("batch lanes");
+	const BatchJob& m_first = this->jobs[a_jobIndices[0]];
+	BitSlicedWorld m_world;
+	m_world.Load(*m_first.baseCells);
+	// Probes off the circuit never see a head
+	std::vector<long long> m_probeIndices;
+	for (const auto& m_probe : this->probes)
+		m_probeIndices.push_back(m_world.AddProbe(m_probe.first, m_probe.second) ? (long long)m_world.GetProbeCount() - 1 : -1);
+
+	// Variants that add or remove cells change the circuit, those run as a World afterwards
+	std::vector<size_t> m_offCircuit;
+	std::vector<size_t> m_lanes;
+	for (size_t m_job : a_jobIndices)
+	{
+		bool m_removes = false;
+		for (const CellSnapshot& m_cell : this->jobs[m_job].overlay)
+			m_removes |= m_cell.state == Background;
+		if (m_removes || m_world.SetLane((unsigned int)m_lanes.size(), this->jobs[m_job].overlay) > 0)
+		{
+			m_world.SetLane((unsigned int)m_lanes.size(), std::vector<CellSnapshot>());
+			m_offCircuit.push_back(m_job);
+		}
+		else
+			m_lanes.push_back(m_job);
+	}
+
+	auto m_start = std::chrono::steady_clock::now();
+	for (World::generationType m_generation = 0; m_generation < m_first.generations && !m_lanes.empty(); m_generation++)
+		m_world.Step();
+	double m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+
+	for (unsigned int m_lane = 0; m_lane < m_lanes.size(); m_lane++)
+	{
+		BatchResult& m_result = this->results[m_lanes[m_lane]];
+		m_result.name = this->jobs[m_lanes[m_lane]].name;
+		m_result.stopReason = "generations";
+		m_result.generations = m_world.GetGeneration();
+		m_world.CountStates(m_lane, &m_result.heads, &m_result.tails, &m_result.conductors);
+		m_result.cells = m_world.GetCellCount();
+		// The lanes share the time
+		m_result.seconds = m_seconds;
+		m_result.generationsPerSecond = m_seconds > 0 ? m_result.generations / m_seconds : 0;
+		m_result.probeHeadGenerations.clear();
+		for (long long m_probe : m_probeIndices)
+			m_result.probeHeadGenerations.push_back(m_probe < 0 ? 0 : m_world.GetProbeHeadGenerations((size_t)m_probe, m_lane));
+		this->jobsDone.fetch_add(1);
+	}
+
+	for (size_t m_job : m_offCircuit)
+	{
+		this->results[m_job] = this->RunJob(this->jobs[m_job]);
+		this->jobsDone.fetch_add(1);
+	}
+}
+
+std::shared_ptr<const std::vector<CellSnapshot>> BatchRunner::LoadBase(std::string a_worldFile)
+{
+	std::shared_ptr<std::vector<CellSnapshot>> m_cells = std::make_shared<std::vector<CellSnapshot>>();
+	if (!FileExists(a_worldFile))
+		return m_cells;
+	World m_world(GetBatchThreadOptions());
+	m_world.Open(a_worldFile);
+	World::generationType m_generation = 0;
+	m_world.TakeSnapshot(m_cells.get(), &m_generation);
+	return m_cells;
+}
+
+std::vector<CellSnapshot> BatchRunner::LoadOverlay(std::string a_worldFile)
+{
+	std::vector<CellSnapshot> m_cells;
+	std::ifstream m_in(a_worldFile, std::ios::in);
+	if (!m_in.is_open())
+		return m_cells;
+
+	// Skip the header, every other line is x,y,state
+	std::string m_buffer;
+	std::getline(m_in, m_buffer);
+	while (std::getline(m_in, m_buffer))
+	{
+		const char* m_part = m_buffer.c_str();
+		char* m_end = nullptr;
+		coordinatePart m_x = strtoll(m_part, &m_end, 10);
+		if (*m_end != ',')
+			continue;
+		coordinatePart m_y = strtoll(m_end + 1, &m_end, 10);
+		if (*m_end != ',')
+			continue;
+		long m_state = strtol(m_end + 1, nullptr, 10);
+		if (m_state < Conductor || m_state > Background)
+			m_state = Background;
+		m_cells.push_back(CellSnapshot{ m_x, m_y, (CellState)m_state });
+	}
+	return m_cells;
+}
+
+bool BatchRunner::WriteResults(std::string a_filePath)
+{
+	// Written next to the target first, so a failed write doesn't leave half a file
+	std::string m_tempPath = a_filePath + ".tmp";
+	FILE* m_file = fopen(m_tempPath.c_str(), "wb");
+	if (m_file == nullptr)
+		return false;
+	bool m_success = fprintf(m_file, "name,stopReason,generations,heads,tails,conductors,cells,seconds,generationsPerSecond") > 0;
+	for (const auto& m_probe : this->probes)
+		m_success &= fprintf(m_file, ",probe %lld %lld", m_probe.first, m_probe.second) > 0;
+	m_success &= fprintf(m_file, "\n") > 0;
+	for (const BatchResult& m_result : this->results)
+	{
+		m_success &= fprintf(m_file, "%s,%s,%llu,%llu,%llu,%llu,%llu,%f,%f", m_result.name.c_str(), m_result.stopReason.c_str(),
+			(unsigned long long)m_result.generations, (unsigned long long)m_result.heads, (unsigned long long)m_result.tails,
+			(unsigned long long)m_result.conductors, (unsigned long long)m_result.cells, m_result.seconds, m_result.generationsPerSecond) > 0;
+		for (size_t m_probe = 0; m_probe < this->probes.size(); m_probe++)
+			m_success &= fprintf(m_file, ",%llu", m_probe < m_result.probeHeadGenerations.size() ? m_result.probeHeadGenerations[m_probe] : 0ull) > 0;
+		m_success &= fprintf(m_file, "\n") > 0;
+	}
+	m_success &= SyncAndCloseFile(m_file);
+	if (!m_success)
+	{
+		remove(m_tempPath.c_str());
+		return false;
+	}
+	return ReplaceFileWith(a_filePath, m_tempPath);
+}
@@ -0,0 +1,119 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+
+#include "cell.h"
+#include "world.h"
+
+#ifndef __BATCHRUNNER__
+#define __BATCHRUNNER__
+
+enum class BatchEngine
+{
+	Map, // Every world in its own World
+	BitSliced // Variants of the same base world share a BitSlicedWorld, BitSlicedLaneCount at a time
+};
+
+// One world of a batch, a world file or a base world with some cells laid over it
+struct BatchJob
+{
+	std::string name;
+	std::string worldFile; // Used when there are no base cells
+	std::shared_ptr<const std::vector<CellSnapshot>> baseCells; // Shared by all variants of one circuit
+	std::vector<CellSnapshot> overlay; // Replaces, adds or (Background) removes cells, like the input pattern of a variant
+	World::generationType generations = 0; // Stops after this many generations, 0 to only stop on a condition
+	std::function<bool (World&)> stopWhen; // Checked after every generation, stops the world when it returns true
+};
+
+struct BatchResult
+{
+	std::string name;
+	std::string stopReason; // generations, condition, idle, not loaded or no stop condition
+	World::generationType generations = 0; // Generations this run, not counting the generation of the world file
+	cellCountType heads = 0;
+	cellCountType tails = 0;
+	cellCountType conductors = 0;
+	cellCountType cells = 0;
+	double seconds = 0;
+	double generationsPerSecond = 0;
+	std::vector<unsigned long long> probeHeadGenerations; // For every probe, the generations it was a head
+};
+
+// Runs many worlds on one pool of threads. The worlds don't get threads of their own: every pool
+// thread takes the next world, loads it, steps it to its end and throws it away. So there are never
+// more threads busy than the pool has, and only as many worlds in memory.
+class BatchRunner
+{
+private:
+	unsigned int poolThreads = 1;
+	bool stopWhenIdle = true;
+	BatchEngine engine = BatchEngine::Map;
+	std::vector<BatchJob> jobs;
+	std::vector<BatchResult> results;
+	std::vector<std::pair<coordinatePart, coordinatePart>> probes;
+	// What the pool threads take, one job or a group of variants that run in the lanes of one BitSlicedWorld
+	std::vector<std::vector<size_t>> workItems;
+	std::atomic<size_t> nextWorkItem;
+	std::atomic<size_t> jobsDone;
+
+public:
+	// 0 uses a thread for every logical processor
+	BatchRunner(unsigned int a_poolThreads = 0);
+
+	void Add(BatchJob a_job);
+	// Without heads and tails nothing changes anymore, by default such a world is stopped
+	void SetStopWhenIdle(bool a_stopWhenIdle) { this->stopWhenIdle = a_stopWhenIdle; };
+	// With BitSliced, variants of the same base with a number of generations and without stop condition share
+	// one pass over the circuit. Worlds that don't fit (or that place cells off the circuit) run as a World.
+	void SetEngine(BatchEngine a_engine) { this->engine = a_engine; };
+	// Counts the generations the cell is a head in every world, the output of the circuit
+	void AddProbe(coordinatePart a_x, coordinatePart a_y) { this->probes.push_back(std::make_pair(a_x, a_y)); };
+	// Blocks until every world has run, the results are in the order the jobs were added
+	const std::vector<BatchResult>& Run();
+	size_t GetJobCount() { return this->jobs.size(); };
+	size_t GetJobsDone() { return this->jobsDone.load(); };
+	unsigned int GetPoolThreadCount() { return this->poolThreads; };
+
+	// The cells of a world file, to share between the variants of it. Empty when it couldn't be read.
+	static std::shared_ptr<const std::vector<CellSnapshot>> LoadBase(std::string a_worldFile);
+	// Every cell of a world file as written, Background cells included so a variant can remove cells
+	static std::vector<CellSnapshot> LoadOverlay(std::string a_worldFile);
+	// One CSV line per world of the last run, with a column per probe
+	bool WriteResults(std::string a_filePath);
+
+private:
+	bool FitsInLanes(const BatchJob& a_job);
+	void GroupJobs();
+	void PoolThread();
+	BatchResult RunJob(const BatchJob& a_job);
+	void RunLanes(const std::vector<size_t>& a_jobIndices);
+};
+
+#endif // !__BATCHRUNNER__
@@ -0,0 +1,226 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <algorithm>
+
+#include "bitSlicedWorld.h"
+#include "batchRunner.h"
+#include "profiler.h"
+
+bool BitSlicedWorld::Open(std::string a_filePath)
+{
+	std::shared_ptr<const std::vector<CellSnapshot>> m_cells = BatchRunner::LoadBase(a_filePath);
+	this->Load(*m_cells);
+	return !this->positions.empty();
+}
+
+void BitSlicedWorld::Load(const std::vector<CellSnapshot>& a_cells)
+{
+	PROFILE_ZONE("bit-sliced load");
+	// Background cells never change and never count as a neighbour, they are left out
+	this->positions.clear();
+	this->baseElectrons.clear();
+	for (const CellSnapshot& m_cell : a_cells)
+	{
+		if (m_cell.state == Background)
+			continue;
+		this->positions.push_back(std::make_pair(m_cell.x, m_cell.y));
+		if (m_cell.state == Head || m_cell.state == Tail)
+			this->baseElectrons.push_back(m_cell);
+	}
+	std::sort(this->positions.begin(), this->positions.end());
+	this->positions.erase(std::unique(this->positions.begin(), this->positions.end()), this->positions.end());
+
+	// The Moore neighbours, found once for all lanes
+	this->neighborStart.assign(1, 0);
+	this->neighbors.clear();
+	for (const auto& m_position : this->positions)
+	{
+		for (int m_xOffset = -1; m_xOffset < 2; m_xOffset++)
+		{
+			for (int m_yOffset = -1; m_yOffset < 2; m_yOffset++)
+			{
+				if (m_xOffset == 0 && m_yOffset == 0)
+					continue;
+				long long m_neighbor = this->FindCell(m_position.first + m_xOffset, m_position.second + m_yOffset);
+				if (m_neighbor >= 0)
+					this->neighbors.push_back((unsigned int)m_neighbor);
+			}
+		}
+		this->neighborStart.push_back((unsigned int)this->neighbors.size());
+	}
+
+	LaneBits m_empty = {};
+	this->heads.assign(this->positions.size(), m_empty);
+	this->tails.assign(this->positions.size(), m_empty);
+	this->nextHeads.assign(this->positions.size(), m_empty);
+	this->nextTails.assign(this->positions.size(), m_empty);
+	for (unsigned int m_lane = 0; m_lane < BitSlicedLaneCount; m_lane++)
+	{
+		for (const CellSnapshot& m_cell : this->baseElectrons)
+			this->SetState((unsigned int)this->FindCell(m_cell.x, m_cell.y), m_lane, m_cell.state);
+	}
+	this->probes.clear();
+	this->generation = 0;
+}
+
+size_t BitSlicedWorld::SetLane(unsigned int a_lane, const std::vector<CellSnapshot>& a_overlay)
+{
+	for (unsigned int m_cell = 0; m_cell < this->positions.size(); m_cell++)
+		this->SetState(m_cell, a_lane, Conductor);
+	for (const CellSnapshot& m_cell : this->baseElectrons)
+		this->SetState((unsigned int)this->FindCell(m_cell.x, m_cell.y), a_lane, m_cell.state);
+
+	size_t m_skipped = 0;
+	for (const CellSnapshot& m_cell : a_overlay)
+	{
+		long long m_found = this->FindCell(m_cell.x, m_cell.y);
+		if (m_found < 0 || m_cell.state == Background)
+			m_skipped++;
+		else
+			this->SetState((unsigned int)m_found, a_lane, m_cell.state);
+	}
+	return m_skipped;
+}
+
+void BitSlicedWorld::Step()
+{
+	PROFILE_ZONE("bit-sliced generation");
+	size_t m_cellCount = this->positions.size();
+	for (size_t m_cell = 0; m_cell < m_cellCount; m_cell++)
+	{
+		// Count the head neighbours of every lane at once: bit 0 and bit 1 of the count, and whether it went past 3
+		uint64_t m_ones[BitSlicedLaneWords] = {};
+		uint64_t m_twos[BitSlicedLaneWords] = {};
+		uint64_t m_more[BitSlicedLaneWords] = {};
+		unsigned int m_end = this->neighborStart[m_cell + 1];
+		for (unsigned int m_neighbor = this->neighborStart[m_cell]; m_neighbor < m_end; m_neighbor++)
+		{
+			const LaneBits& m_head = this->heads[this->neighbors[m_neighbor]];
+			for (int m_word = 0; m_word < BitSlicedLaneWords; m_word++)
+			{
+				uint64_t m_carry = m_ones[m_word] & m_head.words[m_word];
+				m_ones[m_word] ^= m_head.words[m_word];
+				m_more[m_word] |= m_twos[m_word] & m_carry;
+				m_twos[m_word] ^= m_carry;
+			}
+		}
+
+		// A conductor with 1 or 2 head neighbours becomes a head, heads become tails and tails conductors
+		const LaneBits& m_head = this->heads[m_cell];
+		const LaneBits& m_tail = this->tails[m_cell];
+		LaneBits& m_nextHead = this->nextHeads[m_cell];
+		LaneBits& m_nextTail = this->nextTails[m_cell];
+		for (int m_word = 0; m_word < BitSlicedLaneWords; m_word++)
+		{
+			uint64_t m_excited = (m_ones[m_word] ^ m_twos[m_word]) & ~m_more[m_word];
+			m_nextHead.words[m_word] = m_excited & ~(m_head.words[m_word] | m_tail.words[m_word]);
+			m_nextTail.words[m_word] = m_head.words[m_word];
+		}
+	}
+	this->heads.swap(this->nextHeads);
+	this->tails.swap(this->nextTails);
+	this->generation++;
+
+	for (Probe& m_probe : this->probes)
+	{
+		const LaneBits& m_head = this->heads[m_probe.cell];
+		for (unsigned int m_lane = 0; m_lane < BitSlicedLaneCount; m_lane++)
+			m_probe.headGenerations[m_lane] += (m_head.words[m_lane / 64] >> (m_lane % 64)) & 1;
+	}
+}
+
+size_t BitSlicedWorld::GetMemoryUsage()
+{
+	return this->positions.capacity() * sizeof(std::pair<coordinatePart, coordinatePart>)
+		+ (this->neighborStart.capacity() + this->neighbors.capacity()) * sizeof(unsigned int)
+		+ (this->heads.capacity() + this->tails.capacity() + this->nextHeads.capacity() + this->nextTails.capacity()) * sizeof(LaneBits)
+		+ this->baseElectrons.capacity() * sizeof(CellSnapshot);
+}
+
+bool BitSlicedWorld::AddProbe(coordinatePart a_x, coordinatePart a_y)
+{
+	long long m_found = this->FindCell(a_x, a_y);
+	if (m_found < 0)
+		return false;
+	this->probes.push_back(Probe{ a_x, a_y, (unsigned int)m_found, std::vector<unsigned long long>(BitSlicedLaneCount, 0) });
+	return true;
+}
+
+CellState BitSlicedWorld::GetState(unsigned int a_lane, coordinatePart a_x, coordinatePart a_y)
+{
+	long long m_found = this->FindCell(a_x, a_y);
+	if (m_found < 0)
+		return Background;
+	return this->GetCellState((unsigned int)m_found, a_lane);
+}
+
+void BitSlicedWorld::CountStates(unsigned int a_lane, cellCountType* a_heads, cellCountType* a_tails, cellCountType* a_conductors)
+{
+	*a_heads = 0;
+	*a_tails = 0;
+	*a_conductors = 0;
+	for (unsigned int m_cell = 0; m_cell < this->positions.size(); m_cell++)
+	{
+		CellState m_state = this->GetCellState(m_cell, a_lane);
+		*a_heads += m_state == Head;
+		*a_tails += m_state == Tail;
+		*a_conductors += m_state == Conductor;
+	}
+}
+
+void BitSlicedWorld::TakeLaneSnapshot(unsigned int a_lane, std::vector<CellSnapshot>* a_output)
+{
+	a_output->clear();
+	a_output->reserve(this->positions.size());
+	for (unsigned int m_cell = 0; m_cell < this->positions.size(); m_cell++)
+		a_output->push_back(CellSnapshot{ this->positions[m_cell].first, this->positions[m_cell].second, this->GetCellState(m_cell, a_lane) });
+}
+
+long long BitSlicedWorld::FindCell(coordinatePart a_x, coordinatePart a_y)
+{
+	auto m_found = std::lower_bound(this->positions.begin(), this->positions.end(), std::make_pair(a_x, a_y));
+	if (m_found == this->positions.end() || m_found->first != a_x || m_found->second != a_y)
+		return -1;
+	return m_found - this->positions.begin();
+}
+
+void BitSlicedWorld::SetState(unsigned int a_cell, unsigned int a_lane, CellState a_state)
+{
+	uint64_t m_bit = 1ull << (a_lane % 64);
+	uint64_t& m_head = this->heads[a_cell].words[a_lane / 64];
+	uint64_t& m_tail = this->tails[a_cell].words[a_lane / 64];
+	m_head = a_state == Head ? m_head | m_bit : m_head & ~m_bit;
+	m_tail = a_state == Tail ? m_tail | m_bit : m_tail & ~m_bit;
+}
+
+CellState BitSlicedWorld::GetCellState(unsigned int a_cell, unsigned int a_lane)
+{
+	uint64_t m_bit = 1ull << (a_lane % 64);
+	if (this->heads[a_cell].words[a_lane / 64] & m_bit)
+		return Head;
+	if (this->tails[a_cell].words[a_lane / 64] & m_bit)
+		return Tail;
+	return Conductor;
+}
@@ -0,0 +1,112 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "cell.h"
+#include "coordinateType.h"
+
+#ifndef __BITSLICEDWORLD__
+#define __BITSLICEDWORLD__
+
+// 64 variants per word. Built with AVX2 every cell holds four words, the loops over them become single instructions.
+#ifdef __AVX2__
+#define BitSlicedLaneWords 4
+#else
+#define BitSlicedLaneWords 1
+#endif
+#define BitSlicedLaneCount (BitSlicedLaneWords * 64)
+
+// One bit for every variant
+struct LaneBits
+{
+	uint64_t words[BitSlicedLaneWords];
+};
+
+// Simulates BitSlicedLaneCount variants of one circuit at once. The conductors are the same for every
+// variant, only the electrons differ, so the cells and their neighbours are stored once and every cell
+// has a head and a tail bit per variant (lane). One pass over the cells advances all lanes.
+// Follows the same rule as World, so every lane steps exactly like a World loaded with that variant.
+class BitSlicedWorld
+{
+private:
+	struct Probe
+	{
+		coordinatePart x;
+		coordinatePart y;
+		unsigned int cell;
+		std::vector<unsigned long long> headGenerations; // Per lane, the generations the probe was a head
+	};
+
+	// Sorted like the map of World, neighbours are found by binary search when loading
+	std::vector<std::pair<coordinatePart, coordinatePart>> positions;
+	// The neighbours of cell i are neighbors[neighborStart[i]] up to neighbors[neighborStart[i + 1]]
+	std::vector<unsigned int> neighborStart;
+	std::vector<unsigned int> neighbors;
+
+	std::vector<LaneBits> heads;
+	std::vector<LaneBits> tails;
+	std::vector<LaneBits> nextHeads;
+	std::vector<LaneBits> nextTails;
+	// The electrons of the base world, every lane starts with them
+	std::vector<CellSnapshot> baseElectrons;
+
+	std::vector<Probe> probes;
+	unsigned long long generation = 0;
+
+public:
+	// Loads the conductors and electrons of a world file into every lane, false when it has no cells
+	bool Open(std::string a_filePath);
+	void Load(const std::vector<CellSnapshot>& a_cells);
+	// Resets a lane to the base world and lays the electrons over it. Conductor cells clear an electron.
+	// Returns how many cells of the overlay aren't on the circuit, those are skipped.
+	size_t SetLane(unsigned int a_lane, const std::vector<CellSnapshot>& a_overlay);
+
+	void Step();
+	unsigned long long GetGeneration() { return this->generation; };
+	size_t GetCellCount() { return this->positions.size(); };
+	size_t GetMemoryUsage();
+
+	// Counts how many generations the cell was a head in every lane (like an output wire of the circuit). Returns false when there is no cell.
+	bool AddProbe(coordinatePart a_x, coordinatePart a_y);
+	size_t GetProbeCount() { return this->probes.size(); };
+	coordinatePart GetProbeX(size_t a_probe) { return this->probes[a_probe].x; };
+	coordinatePart GetProbeY(size_t a_probe) { return this->probes[a_probe].y; };
+	unsigned long long GetProbeHeadGenerations(size_t a_probe, unsigned int a_lane) { return this->probes[a_probe].headGenerations[a_lane]; };
+
+	// Background when there is no cell
+	CellState GetState(unsigned int a_lane, coordinatePart a_x, coordinatePart a_y);
+	void CountStates(unsigned int a_lane, cellCountType* a_heads, cellCountType* a_tails, cellCountType* a_conductors);
+	// The cells of one lane, to load into a World
+	void TakeLaneSnapshot(unsigned int a_lane, std::vector<CellSnapshot>* a_output);
+
+private:
+	long long FindCell(coordinatePart a_x, coordinatePart a_y);
+	void SetState(unsigned int a_cell, unsigned int a_lane, CellState a_state);
+	CellState GetCellState(unsigned int a_cell, unsigned int a_lane);
+};
+
+#endif // !__BITSLICEDWORLD__
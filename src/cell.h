@@ -25,11 +25,6 @@ SOFTWARE.
 #include <iostream>
 #include <atomic>
 
-#include <glad/glad.h>
-#include <glm/glm.hpp>
-#include <glm\gtx\transform.hpp>
-
-#include "shader.h"
 #include "coordinateType.h"
 
 #ifndef __CELL__
@@ -54,22 +49,16 @@ public:
 	
 	std::atomic<unsigned char> atomic_neighborCount;
 
-private:
-	GLuint vaoBuffer = -1;
-	Shader shader;
-
-public:
 	Cell(coordinatePart x, coordinatePart y, CellState state) : Cell()
 	{
 		this->x = x;
 		this->y = y;
 		this->cellState = state;
 		this->decayState = state;
-		this->shader = Shader();
 		this->atomic_neighborCount.store(0);
 	}
 
-	Cell() : shader()
+	Cell()
 	{
 		this->decayState = Background;
 		this->cellState = Background;
@@ -77,9 +66,23 @@ public:
 		this->y = 0;
 		this->atomic_neighborCount.store(0);
 	}
+};
+
+// A plain copy of a cell, safe to use after the cells edit lock has been released
+struct CellSnapshot
+{
+	coordinatePart x;
+	coordinatePart y;
+	CellState state;
+};
 
-	void InitRender(Shader a_shader);
-	void Render(int a_cellSizeInPx, coordinatePart a_scrollOffsetX, coordinatePart a_scrollOffsetY, glm::vec2* a_offset, glm::vec3* a_color);
+// A single cell state transition, used to tell others what changed in the world
+struct CellChange
+{
+	coordinatePart x;
+	coordinatePart y;
+	CellState oldState;
+	CellState newState;
 };
 
 #endif // __CELL__
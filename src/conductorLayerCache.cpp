@@ -0,0 +1,264 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include "conductorLayerCache.h"
+#include "profiler.h"
+#include "viewportQuery.h"
+
+ConductorLayerCache::~ConductorLayerCache()
+{
+	this->Detach();
+}
+
+void ConductorLayerCache::Attach(World* a_world)
+{
+	this->Detach();
+	this->world = a_world;
+	this->LoadElectronsFromWorld();
+	this->listenerId = a_world->AddChangeListener(
+		[this](World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+		{
+			this->OnWorldChanged(a_generation, a_source, a_changes);
+		}
+	);
+}
+
+void ConductorLayerCache::Detach()
+{
+	if (this->world == nullptr)
+		return;
+	this->world->RemoveChangeListener(this->listenerId);
+	this->world = nullptr;
+}
+
+void ConductorLayerCache::Dispose()
+{
+	for (auto& m_chunk : this->chunks)
+	{
+		if (m_chunk.second.buffer != 0)
+			glDeleteBuffers(1, &m_chunk.second.buffer);
+	}
+	this->chunks.clear();
+	this->emptyChunks.clear();
+	std::lock_guard<std::mutex> m_lk(this->changesLock);
+	this->allChunksDirty = true;
+}
+
+coordinatePart ConductorLayerCache::ChunkOf(coordinatePart a_coordinate)
+{
+	// Round down, also for negative coordinates
+	if (a_coordinate >= 0)
+		return a_coordinate / ConductorChunkSize;
+	return (a_coordinate - (ConductorChunkSize - 1)) / ConductorChunkSize;
+}
+
+void ConductorLayerCache::LoadElectronsFromWorld()
+{
+	std::vector<CellSnapshot> m_cells;
+	World::generationType m_generation;
+	this->world->TakeSnapshot(&m_cells, &m_generation);
+
+	std::lock_guard<std::mutex> m_lk(this->changesLock);
+	this->electrons.clear();
+	for (const CellSnapshot& m_cell : m_cells)
+	{
+		if (m_cell.state == Head || m_cell.state == Tail)
+			this->electrons.emplace_hint(this->electrons.end(), std::make_pair(m_cell.x, m_cell.y), m_cell.state);
+	}
+	this->allChunksDirty = true;
+}
+
+void ConductorLayerCache::OnWorldChanged(World::generationType, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+{
+	if (a_source == World::ChangeSource::Reset)
+	{
+		this->LoadElectronsFromWorld();
+		return;
+	}
+
+	std::lock_guard<std::mutex> m_lk(this->changesLock);
+	for (const CellChange& m_change : a_changes)
+	{
+		std::pair<coordinatePart, coordinatePart> m_key(m_change.x, m_change.y);
+		if (m_change.newState == Head || m_change.newState == Tail)
+			this->electrons[m_key] = m_change.newState;
+		else
+			this->electrons.erase(m_key);
+
+		// Only adding or removing a cell changes the conductor layer
+		if (m_change.oldState == Background || m_change.newState == Background)
+			this->dirtyChunks.insert(std::make_pair(ChunkOf(m_change.x), ChunkOf(m_change.y)));
+	}
+}
+
+void ConductorLayerCache::GetChunksInViewport(std::vector<ConductorChunkDraw>* a_output, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height)
+{
+	PROFILE_ZONE("render prep");
+	this->frame++;
+	this->lastUploadBytes = 0;
+
+	// Take over what changed since the last frame
+	{
+		std::lock_guard<std::mutex> m_lk(this->changesLock);
+		if (this->allChunksDirty)
+		{
+			for (auto& m_chunk : this->chunks)
+				m_chunk.second.dirty = true;
+			this->emptyChunks.clear();
+			this->allChunksDirty = false;
+		}
+		for (auto& m_key : this->dirtyChunks)
+		{
+			auto m_chunk = this->chunks.find(m_key);
+			if (m_chunk != this->chunks.end())
+				m_chunk->second.dirty = true;
+			else
+				this->emptyChunks.erase(m_key);
+		}
+		this->dirtyChunks.clear();
+	}
+
+	coordinatePart m_firstChunkX = ChunkOf(a_x);
+	coordinatePart m_firstChunkY = ChunkOf(a_y);
+	coordinatePart m_lastChunkX = ChunkOf(a_x + a_width);
+	coordinatePart m_lastChunkY = ChunkOf(a_y + a_height);
+	for (coordinatePart m_chunkX = m_firstChunkX; m_chunkX <= m_lastChunkX; m_chunkX++)
+	{
+		for (coordinatePart m_chunkY = m_firstChunkY; m_chunkY <= m_lastChunkY; m_chunkY++)
+		{
+			std::pair<coordinatePart, coordinatePart> m_key(m_chunkX, m_chunkY);
+			auto m_empty = this->emptyChunks.find(m_key);
+			if (m_empty != this->emptyChunks.end())
+			{
+				m_empty->second = this->frame;
+				continue;
+			}
+
+			auto m_found = this->chunks.find(m_key);
+			if (m_found == this->chunks.end())
+				m_found = this->chunks.emplace(m_key, Chunk()).first;
+			Chunk* m_chunk = &m_found->second;
+			if (m_chunk->dirty)
+				this->BuildChunk(m_chunkX, m_chunkY, m_chunk);
+			if (m_chunk->cellCount == 0)
+			{
+				// Nothing to draw, only remember that it is empty
+				if (m_chunk->buffer != 0)
+					glDeleteBuffers(1, &m_chunk->buffer);
+				this->chunks.erase(m_found);
+				this->emptyChunks[m_key] = this->frame;
+				continue;
+			}
+			m_chunk->lastUsedFrame = this->frame;
+			a_output->push_back(ConductorChunkDraw{ m_chunk->buffer, m_chunk->cellCount, m_chunkX * ConductorChunkSize, m_chunkY * ConductorChunkSize });
+		}
+	}
+
+	// Forget the chunks that have been out of view the longest when there are too many
+	if (this->chunks.size() + this->emptyChunks.size() > this->maxCachedChunks)
+		this->EvictChunksOutOfView();
+}
+
+void ConductorLayerCache::EvictChunksOutOfView()
+{
+	for (auto m_chunk = this->chunks.begin(); m_chunk != this->chunks.end();)
+	{
+		if (m_chunk->second.lastUsedFrame != this->frame)
+		{
+			if (m_chunk->second.buffer != 0)
+				glDeleteBuffers(1, &m_chunk->second.buffer);
+			m_chunk = this->chunks.erase(m_chunk);
+		}
+		else
+			m_chunk++;
+	}
+	for (auto m_empty = this->emptyChunks.begin(); m_empty != this->emptyChunks.end();)
+	{
+		if (m_empty->second != this->frame)
+			m_empty = this->emptyChunks.erase(m_empty);
+		else
+			m_empty++;
+	}
+}
+
+void ConductorLayerCache::Compact()
+{
+	this->EvictChunksOutOfView();
+}
+
+size_t ConductorLayerCache::GetMemoryUsage()
+{
+	typedef std::pair<coordinatePart, coordinatePart> ChunkKey;
+	size_t m_usage = this->chunks.size() * (sizeof(std::pair<ChunkKey, Chunk>) + MapNodeOverhead);
+	m_usage += this->emptyChunks.size() * (sizeof(std::pair<ChunkKey, unsigned long long>) + MapNodeOverhead);
+	std::lock_guard<std::mutex> m_lk(this->changesLock);
+	m_usage += this->dirtyChunks.size() * (sizeof(ChunkKey) + MapNodeOverhead);
+	m_usage += this->electrons.size() * (sizeof(std::pair<ChunkKey, CellState>) + MapNodeOverhead);
+	return m_usage;
+}
+
+void ConductorLayerCache::BuildChunk(coordinatePart a_chunkX, coordinatePart a_chunkY, Chunk* a_chunk)
+{
+	coordinatePart m_originX = a_chunkX * ConductorChunkSize;
+	coordinatePart m_originY = a_chunkY * ConductorChunkSize;
+
+	static std::vector<unsigned char> m_states;
+	static std::vector<CellInstance> m_instances;
+	m_states.assign(ConductorChunkSize * ConductorChunkSize, (unsigned char)Background);
+	m_instances.clear();
+	this->world->StatesInViewport(m_states.data(), ConductorChunkSize, m_originX - 1, m_originY - 1, ConductorChunkSize + 1, ConductorChunkSize + 1);
+
+	// Every cell is a conductor underneath its electron
+	for (int m_y = 0; m_y < ConductorChunkSize; m_y++)
+	{
+		for (int m_x = 0; m_x < ConductorChunkSize; m_x++)
+		{
+			if (m_states[m_y * ConductorChunkSize + m_x] != Background)
+				m_instances.push_back(CellInstance{ (short)m_x, (short)m_y, (unsigned char)Conductor });
+		}
+	}
+
+	a_chunk->cellCount = (int)m_instances.size();
+	a_chunk->dirty = false;
+	if (m_instances.empty())
+		return;
+
+	PROFILE_ZONE("upload");
+	if (a_chunk->buffer == 0)
+		glGenBuffers(1, &a_chunk->buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, a_chunk->buffer);
+	glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(CellInstance), m_instances.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	this->lastUploadBytes += m_instances.size() * sizeof(CellInstance);
+}
+
+void ConductorLayerCache::GetElectronsInViewport(std::vector<CellInstance>* a_output, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height)
+{
+	PROFILE_ZONE("render prep");
+	std::lock_guard<std::mutex> m_lk(this->changesLock);
+
+	ForEachInViewport(this->electrons, a_x, a_y, a_width, a_height, [a_output, a_x, a_y](coordinatePart a_cellX, coordinatePart a_cellY, CellState a_state) {
+		a_output->push_back(CellInstance{ (short)(a_cellX - a_x), (short)(a_cellY - a_y), (unsigned char)a_state });
+	});
+}
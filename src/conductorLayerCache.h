@@ -0,0 +1,116 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+
+#include <glad\glad.h>
+
+#include "cell.h"
+#include "world.h"
+
+#ifndef __CONDUCTORLAYERCACHE__
+#define __CONDUCTORLAYERCACHE__
+
+// Cells per side of a cached chunk
+#define ConductorChunkSize 128
+
+// The data of a cell as the GPU gets it, the shader turns it into a position and color
+struct CellInstance
+{
+	short x; // Relative to an origin, like the viewport or a chunk
+	short y;
+	unsigned char state;
+};
+
+// A chunk of the conductor layer that can be drawn straight from its buffer
+struct ConductorChunkDraw
+{
+	GLuint buffer;
+	int cellCount;
+	coordinatePart originX;
+	coordinatePart originY;
+};
+
+// Keeps every cell of the world as a conductor in static GPU buffers, one per chunk of the world.
+// Which cells exist only changes with edits, so a chunk is only uploaded again after an edit in it.
+// The heads and tails are tracked from the changes of every generation, so only they 
+// have to be sent to the GPU every frame and drawn on top of the conductors.
+class ConductorLayerCache
+{
+private:
+	struct Chunk
+	{
+		GLuint buffer = 0;
+		int cellCount = 0;
+		bool dirty = true;
+		unsigned long long lastUsedFrame = 0;
+	};
+
+	World* world = nullptr;
+	unsigned int listenerId = 0;
+
+	std::map<std::pair<coordinatePart, coordinatePart>, Chunk> chunks;
+	// Chunks in view without cells, they need no buffer. With the frame they were last in view.
+	std::map<std::pair<coordinatePart, coordinatePart>, unsigned long long> emptyChunks;
+	unsigned long long frame = 0;
+	size_t maxCachedChunks = 4096;
+
+	// Written by the thread that changes the world, read when rendering
+	std::mutex changesLock;
+	std::set<std::pair<coordinatePart, coordinatePart>> dirtyChunks;
+	bool allChunksDirty = true;
+	std::map<std::pair<coordinatePart, coordinatePart>, CellState> electrons;
+
+	size_t lastUploadBytes = 0;
+
+public:
+	~ConductorLayerCache();
+
+	void Attach(World* a_world);
+	void Detach();
+	// Deletes all buffers, must be called while the OpenGL context still exists
+	void Dispose();
+
+	// Gives the chunks that overlap the viewport, uploading the ones that changed
+	void GetChunksInViewport(std::vector<ConductorChunkDraw>* a_output, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height);
+	// Gives the heads and tails in the viewport (same bounds as World::InViewport), relative to a_x and a_y
+	void GetElectronsInViewport(std::vector<CellInstance>* a_output, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height);
+	size_t GetLastUploadBytes() { return this->lastUploadBytes; };
+	// The bookkeeping in main memory, the chunk buffers live on the GPU
+	size_t GetMemoryUsage();
+	// Forgets every chunk that wasn't in view in the last frame
+	void Compact();
+
+private:
+	void OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes);
+	void LoadElectronsFromWorld();
+	void BuildChunk(coordinatePart a_chunkX, coordinatePart a_chunkY, Chunk* a_chunk);
+	void EvictChunksOutOfView();
+	static coordinatePart ChunkOf(coordinatePart a_coordinate);
+};
+
+#endif // !__CONDUCTORLAYERCACHE__
@@ -36,6 +36,12 @@ public:
 	glm::vec3 headColor = glm::vec3(1.0f, 0.0f, 0.0f); // Color of a head, default red
 	glm::vec3 tailColor = glm::vec3(0.0f, 0.0f, 1.0f); // Color of a tail, default blue
 	std::string templateFolder = "/templates";
+	std::string autosaveFolder = "autosave"; // Where the edit journal and its checkpoints are kept
+	unsigned int journalGroupCommitIntervalInMs = 100; // Edits that come in within this time are written and synced together
+	unsigned int autosaveCheckpointIntervalInSeconds = 60; // How often the journal is compacted into a checkpoint
+	unsigned int traceKeyframeInterval = 256; // Generations between two keyframes in a recorded run
+	std::string shaderCacheFolder = "shadercache"; // Where linked shader programs are kept between runs
+	unsigned int memoryBudgetInMB = 4096; // Above this the render caches are compacted and a warning is shown, 0 turns it off
 	
 private:
 	const ImVec4 activeWindowTitleBgColor = ImVec4(1.0f, 0.0f, 0.0f, 1.0f);
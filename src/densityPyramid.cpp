@@ -0,0 +1,214 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <unordered_map>
+#include <algorithm>
+
+#include "densityPyramid.h"
+
+DensityPyramid::DensityPyramid()
+{
+	// Where each level starts in the counts of a chunk
+	this->blocksPerChunk = 0;
+	for (unsigned int m_level = DensityFirstLevel; m_level <= DensityChunkLevel; m_level++)
+	{
+		this->levelOffsets[m_level] = this->blocksPerChunk;
+		size_t m_blocksPerSide = DensityChunkSize >> m_level;
+		this->blocksPerChunk += m_blocksPerSide * m_blocksPerSide;
+	}
+}
+
+DensityPyramid::~DensityPyramid()
+{
+	this->Detach();
+}
+
+void DensityPyramid::Attach(World* a_world)
+{
+	this->Detach();
+	this->world = a_world;
+	this->LoadFromWorld();
+	this->listenerId = a_world->AddChangeListener(
+		[this](World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+		{
+			this->OnWorldChanged(a_generation, a_source, a_changes);
+		}
+	);
+}
+
+void DensityPyramid::Detach()
+{
+	if (this->world == nullptr)
+		return;
+	this->world->RemoveChangeListener(this->listenerId);
+	this->world = nullptr;
+}
+
+coordinatePart DensityPyramid::FloorDivide(coordinatePart a_value, coordinatePart a_divisor)
+{
+	if (a_value >= 0)
+		return a_value / a_divisor;
+	return (a_value - (a_divisor - 1)) / a_divisor;
+}
+
+void DensityPyramid::LoadFromWorld()
+{
+	std::vector<CellSnapshot> m_cells;
+	World::generationType m_generation;
+	this->world->TakeSnapshot(&m_cells, &m_generation);
+
+	std::lock_guard<std::mutex> m_lk(this->chunksLock);
+	this->chunks.clear();
+	for (const CellSnapshot& m_cell : m_cells)
+		this->UpdateCell(m_cell.x, m_cell.y, Background, m_cell.state);
+}
+
+void DensityPyramid::OnWorldChanged(World::generationType, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+{
+	if (a_source == World::ChangeSource::Reset)
+	{
+		this->LoadFromWorld();
+		return;
+	}
+
+	std::lock_guard<std::mutex> m_lk(this->chunksLock);
+	for (const CellChange& m_change : a_changes)
+		this->UpdateCell(m_change.x, m_change.y, m_change.oldState, m_change.newState);
+}
+
+void DensityPyramid::UpdateCell(coordinatePart a_x, coordinatePart a_y, CellState a_oldState, CellState a_newState)
+{
+	int m_cellsDelta = (a_newState != Background) - (a_oldState != Background);
+	int m_headsDelta = (a_newState == Head) - (a_oldState == Head);
+	int m_tailsDelta = (a_newState == Tail) - (a_oldState == Tail);
+	if (m_cellsDelta == 0 && m_headsDelta == 0 && m_tailsDelta == 0)
+		return;
+
+	coordinatePart m_chunkX = FloorDivide(a_x, DensityChunkSize);
+	coordinatePart m_chunkY = FloorDivide(a_y, DensityChunkSize);
+	auto m_chunk = this->chunks.find(std::make_pair(m_chunkX, m_chunkY));
+	if (m_chunk == this->chunks.end())
+	{
+		m_chunk = this->chunks.emplace(std::make_pair(m_chunkX, m_chunkY), Chunk()).first;
+		m_chunk->second.counts.assign(this->blocksPerChunk * 3, 0);
+	}
+
+	unsigned int m_localX = (unsigned int)(a_x - m_chunkX * DensityChunkSize);
+	unsigned int m_localY = (unsigned int)(a_y - m_chunkY * DensityChunkSize);
+	unsigned short* m_counts = m_chunk->second.counts.data();
+	for (unsigned int m_level = DensityFirstLevel; m_level <= DensityChunkLevel; m_level++)
+	{
+		size_t m_block = this->levelOffsets[m_level] + (m_localY >> m_level) * (DensityChunkSize >> m_level) + (m_localX >> m_level);
+		m_counts[m_block * 3] += m_cellsDelta;
+		m_counts[m_block * 3 + 1] += m_headsDelta;
+		m_counts[m_block * 3 + 2] += m_tailsDelta;
+	}
+
+	// The last level is the whole chunk, an empty chunk isn't kept
+	if (m_counts[this->levelOffsets[DensityChunkLevel] * 3] == 0)
+		this->chunks.erase(m_chunk);
+}
+
+void DensityPyramid::WriteTexel(unsigned long long a_cells, unsigned long long a_heads, unsigned long long a_tails, unsigned int a_level, unsigned char* a_texel)
+{
+	if (a_cells == 0)
+		return;
+	unsigned long long m_blockCells = 1ull << (2 * a_level);
+	a_texel[0] = (unsigned char)(a_heads * 255 / a_cells);
+	a_texel[1] = (unsigned char)(a_tails * 255 / a_cells);
+	a_texel[2] = (unsigned char)std::max(a_cells * 255 / m_blockCells, 1ull);
+	a_texel[3] = 255;
+}
+
+void DensityPyramid::FillDensityImage(unsigned int a_level, coordinatePart a_blockX, coordinatePart a_blockY, unsigned int a_width, unsigned int a_height, unsigned char* a_output)
+{
+	unsigned int m_level = std::max(a_level, (unsigned int)DensityFirstLevel);
+	std::fill(a_output, a_output + (size_t)a_width * a_height * 4, (unsigned char)0);
+
+	// The chunks that overlap the image
+	coordinatePart m_blockSize = (coordinatePart)1 << m_level;
+	coordinatePart m_firstChunkX = FloorDivide(a_blockX * m_blockSize, DensityChunkSize);
+	coordinatePart m_firstChunkY = FloorDivide(a_blockY * m_blockSize, DensityChunkSize);
+	coordinatePart m_lastChunkX = FloorDivide((a_blockX + a_width) * m_blockSize - 1, DensityChunkSize);
+	coordinatePart m_lastChunkY = FloorDivide((a_blockY + a_height) * m_blockSize - 1, DensityChunkSize);
+
+	std::lock_guard<std::mutex> m_lk(this->chunksLock);
+	auto m_chunk = this->chunks.lower_bound(std::make_pair(m_firstChunkX, m_firstChunkY));
+	auto m_end = this->chunks.upper_bound(std::make_pair(m_lastChunkX, m_lastChunkY));
+
+	if (m_level <= DensityChunkLevel)
+	{
+		// Every block of this level is one texel
+		unsigned int m_blocksPerSide = DensityChunkSize >> m_level;
+		for (; m_chunk != m_end; m_chunk++)
+		{
+			if (m_chunk->first.second < m_firstChunkY || m_chunk->first.second > m_lastChunkY)
+				continue;
+			const unsigned short* m_counts = m_chunk->second.counts.data() + this->levelOffsets[m_level] * 3;
+			coordinatePart m_chunkBlockX = m_chunk->first.first * m_blocksPerSide - a_blockX;
+			coordinatePart m_chunkBlockY = m_chunk->first.second * m_blocksPerSide - a_blockY;
+			for (unsigned int m_y = 0; m_y < m_blocksPerSide; m_y++)
+			{
+				coordinatePart m_texelY = m_chunkBlockY + m_y;
+				if (m_texelY < 0 || m_texelY >= (coordinatePart)a_height)
+					continue;
+				for (unsigned int m_x = 0; m_x < m_blocksPerSide; m_x++)
+				{
+					coordinatePart m_texelX = m_chunkBlockX + m_x;
+					if (m_texelX < 0 || m_texelX >= (coordinatePart)a_width)
+						continue;
+					const unsigned short* m_block = m_counts + (m_y * m_blocksPerSide + m_x) * 3;
+					this->WriteTexel(m_block[0], m_block[1], m_block[2], m_level, a_output + ((size_t)m_texelY * a_width + m_texelX) * 4);
+				}
+			}
+		}
+		return;
+	}
+
+	// Coarser than a chunk, add up the chunks that fall in the same texel
+	std::unordered_map<size_t, std::array<unsigned long long, 3>> m_texels;
+	coordinatePart m_chunksPerBlock = (coordinatePart)1 << (m_level - DensityChunkLevel);
+	for (; m_chunk != m_end; m_chunk++)
+	{
+		if (m_chunk->first.second < m_firstChunkY || m_chunk->first.second > m_lastChunkY)
+			continue;
+		coordinatePart m_texelX = FloorDivide(m_chunk->first.first, m_chunksPerBlock) - a_blockX;
+		coordinatePart m_texelY = FloorDivide(m_chunk->first.second, m_chunksPerBlock) - a_blockY;
+		if (m_texelX < 0 || m_texelY < 0 || m_texelX >= (coordinatePart)a_width || m_texelY >= (coordinatePart)a_height)
+			continue;
+		const unsigned short* m_total = m_chunk->second.counts.data() + this->levelOffsets[DensityChunkLevel] * 3;
+		std::array<unsigned long long, 3>& m_sum = m_texels[(size_t)m_texelY * a_width + m_texelX];
+		m_sum[0] += m_total[0];
+		m_sum[1] += m_total[1];
+		m_sum[2] += m_total[2];
+	}
+	for (auto& m_texel : m_texels)
+		this->WriteTexel(m_texel.second[0], m_texel.second[1], m_texel.second[2], m_level, a_output + m_texel.first * 4);
+}
+
+size_t DensityPyramid::GetMemoryUsage()
+{
+	std::lock_guard<std::mutex> m_lk(this->chunksLock);
+	return this->chunks.size() * (sizeof(Chunk) + this->blocksPerChunk * 3 * sizeof(unsigned short));
+}
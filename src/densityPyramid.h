@@ -0,0 +1,83 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include "cell.h"
+#include "world.h"
+
+#ifndef __DENSITYPYRAMID__
+#define __DENSITYPYRAMID__
+
+// Cells per side of a chunk, the coarsest level inside a chunk is one block for the whole chunk
+#define DensityChunkSize 128
+#define DensityChunkLevel 7
+// Blocks of 2x2 cells are not kept, level 2 (4x4 cells) is the finest
+#define DensityFirstLevel 2
+
+// A level of detail overview of the world, for when it is zoomed out too far to draw every cell.
+// Per chunk of the world it counts the cells, heads and tails in blocks of 2^level by 2^level cells,
+// for every level up to the whole chunk. The counts follow the changes of the world, so keeping
+// them up to date costs a few additions per changed cell and never a rescan.
+class DensityPyramid
+{
+private:
+	struct Chunk
+	{
+		// Cells, heads and tails of every block of every level, finest level first
+		std::vector<unsigned short> counts;
+	};
+
+	World* world = nullptr;
+	unsigned int listenerId = 0;
+
+	std::mutex chunksLock;
+	std::map<std::pair<coordinatePart, coordinatePart>, Chunk> chunks;
+	size_t levelOffsets[DensityChunkLevel + 1];
+	size_t blocksPerChunk = 0;
+
+public:
+	DensityPyramid();
+	~DensityPyramid();
+
+	void Attach(World* a_world);
+	void Detach();
+
+	// Fills a_output with one RGBA texel per block of 2^a_level cells, starting at block a_blockX, a_blockY.
+	// Red and green are the fraction of the cells in the block that are heads and tails, blue is how much
+	// of the block is covered by cells (at least 1 when it holds any). Levels below the first are not kept.
+	void FillDensityImage(unsigned int a_level, coordinatePart a_blockX, coordinatePart a_blockY, unsigned int a_width, unsigned int a_height, unsigned char* a_output);
+	size_t GetMemoryUsage();
+
+private:
+	void OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes);
+	void LoadFromWorld();
+	void UpdateCell(coordinatePart a_x, coordinatePart a_y, CellState a_oldState, CellState a_newState);
+	static void WriteTexel(unsigned long long a_cells, unsigned long long a_heads, unsigned long long a_tails, unsigned int a_level, unsigned char* a_texel);
+	static coordinatePart FloorDivide(coordinatePart a_value, coordinatePart a_divisor);
+};
+
+#endif // !__DENSITYPYRAMID__
@@ -0,0 +1,410 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include "domainCoordinator.h"
+#include "domainWorker.h"
+#include "profiler.h"
+
+// How long a worker gets to quit before it is killed
+#define DomainQuitTimeoutMs 5000
+
+DomainCoordinator::DomainCoordinator(unsigned int a_columns, unsigned int a_rows, TransportSettings a_settings, std::string a_program)
+{
+	this->columns = std::max(a_columns, 1u);
+	this->rows = std::max(a_rows, 1u);
+	this->settings = a_settings;
+	this->program = a_program;
+	this->stopWatchdog.store(false);
+	// The shared memory names of different runs must not collide
+	if (this->settings.session.empty())
+	{
+#ifdef _WIN32
+		unsigned long long m_process = GetCurrentProcessId();
+#else
+		unsigned long long m_process = getpid();
+#endif
+		this->settings.session = std::to_string(m_process) + "-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count() % 1000000);
+	}
+}
+
+DomainCoordinator::~DomainCoordinator()
+{
+	this->Stop();
+}
+
+bool DomainCoordinator::Load(std::string a_worldFile)
+{
+	PROFILE_ZONE("domain load");
+	if (!this->workers.empty())
+		return false;
+	std::vector<CellSnapshot> m_cells;
+	World::generationType m_generation = 0;
+	{
+		World::ThreadOptions m_options;
+		m_options.stepOnCaller = true;
+		World m_world(m_options);
+		m_world.Open(a_worldFile);
+		m_world.TakeSnapshot(&m_cells, &m_generation);
+		this->name = m_world.name;
+		this->author = m_world.author;
+		this->description = m_world.description;
+	}
+	this->layout = DomainLayout::Split(m_cells, this->columns, this->rows);
+	if (!this->StartWorkers())
+		return false;
+
+	// Every domain gets its own cells and the ring of cells around it
+	std::vector<MessageWriter> m_messages(this->GetDomainCount());
+	std::vector<unsigned long long> m_counts(this->GetDomainCount(), 0);
+	std::vector<DomainRect> m_seen;
+	for (unsigned int m_domain = 0; m_domain < this->GetDomainCount(); m_domain++)
+	{
+		m_messages[m_domain].PutU8((uint8_t)DomainCommand::Load);
+		this->layout.Write(&m_messages[m_domain]);
+		m_messages[m_domain].PutU64(m_generation);
+		m_messages[m_domain].PutU64(0);
+		m_seen.push_back(this->layout.GetRect(m_domain).Expanded());
+	}
+	for (const CellSnapshot& m_cell : m_cells)
+	{
+		for (unsigned int m_domain = 0; m_domain < this->GetDomainCount(); m_domain++)
+		{
+			if (!m_seen[m_domain].Contains(m_cell.x, m_cell.y))
+				continue;
+			m_messages[m_domain].PutI64(m_cell.x);
+			m_messages[m_domain].PutI64(m_cell.y);
+			m_messages[m_domain].PutU8((uint8_t)m_cell.state);
+			m_counts[m_domain]++;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> m_lk(this->sendLock);
+		for (unsigned int m_domain = 0; m_domain < this->GetDomainCount(); m_domain++)
+		{
+			// The number of cells goes right before them
+			std::vector<unsigned char>& m_data = m_messages[m_domain].data;
+			size_t m_countAt = m_data.size() - m_counts[m_domain] * 17 - 8;
+			for (int m_byte = 0; m_byte < 8; m_byte++)
+				m_data[m_countAt + m_byte] = (unsigned char)(m_counts[m_domain] >> (m_byte * 8));
+			if (this->quitSent || !this->toWorkers[m_domain]->Send(m_data))
+				return false;
+		}
+	}
+	std::vector<std::vector<unsigned char>> m_replies;
+	return this->ReceiveFromAll(&m_replies);
+}
+
+bool DomainCoordinator::Step(World::generationType a_generations, DomainStats* a_stats, std::vector<DomainStats>* a_perDomain)
+{
+	PROFILE_ZONE("domain step");
+	MessageWriter m_message;
+	m_message.PutU8((uint8_t)DomainCommand::Step);
+	m_message.PutU64(a_generations);
+	std::vector<std::vector<unsigned char>> m_replies;
+	if (!this->SendToAll(m_message) || !this->ReceiveFromAll(&m_replies))
+		return false;
+
+	DomainStats m_total;
+	if (a_perDomain != nullptr)
+		a_perDomain->clear();
+	for (std::vector<unsigned char>& m_reply : m_replies)
+	{
+		MessageReader m_reader(m_reply);
+		DomainStats m_stats;
+		m_stats.generation = m_reader.GetU64();
+		m_stats.heads = (cellCountType)m_reader.GetU64();
+		m_stats.tails = (cellCountType)m_reader.GetU64();
+		m_stats.conductors = (cellCountType)m_reader.GetU64();
+		m_stats.cells = (cellCountType)m_reader.GetU64();
+		m_stats.workSeconds = m_reader.GetU64() / 1e9;
+		m_stats.haloSeconds = m_reader.GetU64() / 1e9;
+		m_stats.haloBytes = m_reader.GetU64();
+		if (m_reader.Failed())
+			return false;
+		m_total.generation = std::max(m_total.generation, m_stats.generation);
+		m_total.heads += m_stats.heads;
+		m_total.tails += m_stats.tails;
+		m_total.conductors += m_stats.conductors;
+		m_total.cells += m_stats.cells;
+		m_total.workSeconds = std::max(m_total.workSeconds, m_stats.workSeconds);
+		m_total.haloSeconds = std::max(m_total.haloSeconds, m_stats.haloSeconds);
+		m_total.haloBytes += m_stats.haloBytes;
+		if (a_perDomain != nullptr)
+			a_perDomain->push_back(m_stats);
+	}
+	if (a_stats != nullptr)
+		*a_stats = m_total;
+	return true;
+}
+
+bool DomainCoordinator::Save(std::string a_filePath)
+{
+	PROFILE_ZONE("domain save");
+	MessageWriter m_message;
+	m_message.PutU8((uint8_t)DomainCommand::Snapshot);
+	std::vector<std::vector<unsigned char>> m_replies;
+	if (!this->SendToAll(m_message) || !this->ReceiveFromAll(&m_replies))
+		return false;
+
+	std::vector<CellSnapshot> m_cells;
+	World::generationType m_generation = 0;
+	for (std::vector<unsigned char>& m_reply : m_replies)
+	{
+		MessageReader m_reader(m_reply);
+		m_generation = m_reader.GetU64();
+		unsigned long long m_count = m_reader.GetU64();
+		if (m_count > m_reader.GetRemaining() / 17)
+			return false;
+		for (unsigned long long m_cell = 0; m_cell < m_count; m_cell++)
+		{
+			coordinatePart m_x = m_reader.GetI64();
+			coordinatePart m_y = m_reader.GetI64();
+			m_cells.push_back(CellSnapshot{ m_x, m_y, (CellState)(m_reader.GetU8() & 3) });
+		}
+		if (m_reader.Failed())
+			return false;
+	}
+
+	World::ThreadOptions m_options;
+	m_options.stepOnCaller = true;
+	World m_world(m_options);
+	m_world.LoadSnapshot(m_cells, m_generation);
+	m_world.name = this->name;
+	m_world.author = this->author;
+	m_world.description = this->description;
+	m_world.filePath = a_filePath;
+	if (!m_world.Save())
+		return false;
+	m_world.WaitForSave();
+	return m_world.GetLastSaveSucceeded();
+}
+
+void DomainCoordinator::Stop()
+{
+	this->stopWatchdog.store(true);
+	if (this->watchdogThread.joinable())
+		this->watchdogThread.join();
+	if (this->workers.empty())
+		return;
+	{
+		std::lock_guard<std::mutex> m_lk(this->sendLock);
+		this->SendQuit();
+	}
+
+	// Give them a moment to quit, then make sure they are gone
+	auto m_giveUp = std::chrono::steady_clock::now() + std::chrono::milliseconds(DomainQuitTimeoutMs);
+	for (processHandle m_worker : this->workers)
+	{
+#ifdef _WIN32
+		DWORD m_left = (DWORD)std::max<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(m_giveUp - std::chrono::steady_clock::now()).count(), 0);
+		if (WaitForSingleObject(m_worker, m_left) != WAIT_OBJECT_0)
+			TerminateProcess(m_worker, 1);
+		CloseHandle(m_worker);
+#else
+		while (waitpid(m_worker, nullptr, WNOHANG) == 0)
+		{
+			if (std::chrono::steady_clock::now() > m_giveUp)
+			{
+				kill(m_worker, SIGKILL);
+				waitpid(m_worker, nullptr, 0);
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+#endif
+	}
+	this->workers.clear();
+	this->toWorkers.clear();
+	this->fromWorkers.clear();
+	this->quitSent = false;
+
+	// A worker that was killed leaves its shared memory behind
+	unsigned int m_domains = this->GetDomainCount();
+	for (unsigned int m_from = 0; m_from <= m_domains; m_from++)
+	{
+		for (unsigned int m_to = 0; m_to <= m_domains; m_to++)
+			RemoveChannel(this->settings, GetDomainChannel(m_from, m_to, m_domains));
+	}
+}
+
+std::vector<std::string> DomainCoordinator::GetWorkerArguments(unsigned int a_index, unsigned int a_domains, const TransportSettings& a_settings)
+{
+	return std::vector<std::string>{ "--domain-worker", std::to_string(a_index), std::to_string(a_domains),
+		"--session", a_settings.session, "--transport", GetTransportName(a_settings.type),
+		"--host", a_settings.host, "--port", std::to_string(a_settings.basePort) };
+}
+
+bool DomainCoordinator::StartWorkers()
+{
+	unsigned int m_domains = this->GetDomainCount();
+	// Listen before starting them, they connect to us right away
+	for (unsigned int m_domain = 0; m_domain < m_domains; m_domain++)
+	{
+		this->fromWorkers.push_back(OpenReceivingChannel(this->settings, GetDomainChannel(m_domain, m_domains, m_domains), DomainConnectTimeoutMs));
+		if (!this->fromWorkers.back())
+			return false;
+	}
+
+	for (unsigned int m_domain = 0; m_domain < m_domains; m_domain++)
+	{
+		std::vector<std::string> m_arguments = GetWorkerArguments(m_domain, m_domains, this->settings);
+#ifdef _WIN32
+		char m_path[MAX_PATH];
+		GetModuleFileNameA(nullptr, m_path, MAX_PATH);
+		std::string m_commandLine = std::string("\"") + m_path + "\"";
+		for (std::string& m_argument : m_arguments)
+			m_commandLine += " \"" + m_argument + "\"";
+		STARTUPINFOA m_startup = {};
+		m_startup.cb = sizeof(m_startup);
+		PROCESS_INFORMATION m_process = {};
+		if (!CreateProcessA(m_path, &m_commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &m_startup, &m_process))
+		{
+			std::cout << "Could not start domain worker " << m_domain << std::endl;
+			return false;
+		}
+		CloseHandle(m_process.hThread);
+		this->workers.push_back(m_process.hProcess);
+#else
+		std::vector<char*> m_argv;
+		m_argv.push_back(&this->program[0]);
+		for (std::string& m_argument : m_arguments)
+			m_argv.push_back(&m_argument[0]);
+		m_argv.push_back(nullptr);
+		pid_t m_child = fork();
+		if (m_child == 0)
+		{
+			execvp(m_argv[0], m_argv.data());
+			_exit(127);
+		}
+		if (m_child < 0)
+		{
+			std::cout << "Could not start domain worker " << m_domain << std::endl;
+			return false;
+		}
+		this->workers.push_back(m_child);
+#endif
+	}
+
+	this->watchdogThread = std::thread(&DomainCoordinator::Watchdog, this);
+
+	std::lock_guard<std::mutex> m_lk(this->sendLock);
+	for (unsigned int m_domain = 0; m_domain < m_domains; m_domain++)
+	{
+		this->toWorkers.push_back(OpenSendingChannel(this->settings, GetDomainChannel(m_domains, m_domain, m_domains), DomainConnectTimeoutMs));
+		if (!this->toWorkers.back())
+		{
+			std::cout << "Domain worker " << m_domain << " did not start" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+void DomainCoordinator::Watchdog()
+{
+	PROFILE_THREAD("domain watchdog");
+	unsigned int m_domains = this->GetDomainCount();
+	while (!this->stopWatchdog.load())
+	{
+		for (unsigned int m_domain = 0; m_domain < this->workers.size(); m_domain++)
+		{
+#ifdef _WIN32
+			bool m_exited = WaitForSingleObject(this->workers[m_domain], 0) == WAIT_OBJECT_0;
+#else
+			bool m_exited = waitpid(this->workers[m_domain], nullptr, WNOHANG) != 0;
+#endif
+			if (!m_exited)
+				continue;
+
+			// Shared memory doesn't notice a process is gone, so the waiting sides are told here
+			for (auto& m_channel : this->fromWorkers)
+				m_channel->Close();
+			// Its neighbours wait for its borders or for room to send it theirs, and so may a send of ours
+			for (unsigned int m_other = 0; m_other <= m_domains; m_other++)
+			{
+				if (m_other == m_domain)
+					continue;
+				CloseChannel(this->settings, GetDomainChannel(m_domain, m_other, m_domains));
+				CloseChannel(this->settings, GetDomainChannel(m_other, m_domain, m_domains));
+			}
+			// The others that are waiting for a command quit right away
+			std::lock_guard<std::mutex> m_lk(this->sendLock);
+			this->SendQuit();
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+}
+
+void DomainCoordinator::SendQuit()
+{
+	if (this->quitSent)
+		return;
+	this->quitSent = true;
+	MessageWriter m_message;
+	m_message.PutU8((uint8_t)DomainCommand::Quit);
+	for (auto& m_channel : this->toWorkers)
+	{
+		if (m_channel)
+			m_channel->Send(m_message.data);
+	}
+}
+
+bool DomainCoordinator::SendToAll(const MessageWriter& a_message)
+{
+	std::lock_guard<std::mutex> m_lk(this->sendLock);
+	if (this->quitSent || this->toWorkers.size() != this->GetDomainCount())
+		return false;
+	for (auto& m_channel : this->toWorkers)
+	{
+		if (!m_channel->Send(a_message.data))
+			return false;
+	}
+	return true;
+}
+
+bool DomainCoordinator::ReceiveFromAll(std::vector<std::vector<unsigned char>>* a_replies)
+{
+	a_replies->resize(this->fromWorkers.size());
+	for (size_t m_domain = 0; m_domain < this->fromWorkers.size(); m_domain++)
+	{
+		if (!this->fromWorkers[m_domain]->Receive(&(*a_replies)[m_domain]))
+			return false;
+	}
+	return true;
+}
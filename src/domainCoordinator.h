@@ -0,0 +1,112 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include "cell.h"
+#include "world.h"
+#include "haloTransport.h"
+#include "domainLayout.h"
+
+#ifndef __DOMAINCOORDINATOR__
+#define __DOMAINCOORDINATOR__
+
+#ifdef _WIN32
+typedef void* processHandle; // HANDLE
+#else
+typedef int processHandle; // pid_t
+#endif
+
+// Added up over the domains of a run, or of one domain
+struct DomainStats
+{
+	World::generationType generation = 0;
+	cellCountType heads = 0;
+	cellCountType tails = 0;
+	cellCountType conductors = 0;
+	cellCountType cells = 0;
+	double workSeconds = 0; // Of the slowest domain, that is the one the others wait for
+	double haloSeconds = 0; // Sending and waiting for borders, of the slowest domain
+	unsigned long long haloBytes = 0;
+};
+
+// Splits a world over worker processes, one per domain of a grid over the world. The workers exchange
+// the cells along their borders between themselves, the coordinator only hands out the world, tells
+// them how far to go and collects the results. All processes run on the machine of the coordinator.
+class DomainCoordinator
+{
+private:
+	unsigned int columns;
+	unsigned int rows;
+	TransportSettings settings;
+	std::string program;
+	std::vector<processHandle> workers;
+	std::thread watchdogThread;
+	std::atomic<bool> stopWatchdog;
+	// Held while sending to the workers, the watchdog sends too when one of them dies
+	std::mutex sendLock;
+	bool quitSent = false;
+	std::vector<std::unique_ptr<HaloTransport>> toWorkers;
+	std::vector<std::unique_ptr<HaloTransport>> fromWorkers;
+	DomainLayout layout;
+	std::string name;
+	std::string author;
+	std::string description;
+
+public:
+	// a_program is the path of this program, the workers are started with it in domain worker mode
+	DomainCoordinator(unsigned int a_columns, unsigned int a_rows, TransportSettings a_settings, std::string a_program);
+	~DomainCoordinator();
+
+	// Starts a worker for every domain and hands it its part of the world
+	bool Load(std::string a_worldFile);
+	// Every domain goes a_generations further, a_perDomain gets the statistics of each domain
+	bool Step(World::generationType a_generations, DomainStats* a_stats, std::vector<DomainStats>* a_perDomain = nullptr);
+	// Collects the cells of every domain and saves them as one world file
+	bool Save(std::string a_filePath);
+	// Tells the workers to quit and waits for them, also called by the destructor
+	void Stop();
+
+	unsigned int GetDomainCount() { return this->columns * this->rows; };
+	const DomainLayout& GetLayout() { return this->layout; };
+
+	// The arguments a worker process understands, for the command line of it
+	static std::vector<std::string> GetWorkerArguments(unsigned int a_index, unsigned int a_domains, const TransportSettings& a_settings);
+
+private:
+	bool StartWorkers();
+	// Closes the channels when a worker dies and tells the others to quit, so nobody waits for it forever
+	void Watchdog();
+	// Sends quit to every worker once, the caller holds sendLock
+	void SendQuit();
+	bool SendToAll(const MessageWriter& a_message);
+	bool ReceiveFromAll(std::vector<std::vector<unsigned char>>* a_replies);
+};
+
+#endif // !__DOMAINCOORDINATOR__
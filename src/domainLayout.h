@@ -0,0 +1,165 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <vector>
+#include <algorithm>
+
+#include "cell.h"
+#include "coordinateType.h"
+#include "messageBuffer.h"
+
+#ifndef __DOMAINLAYOUT__
+#define __DOMAINLAYOUT__
+
+// What the coordinator asks a domain worker, the first byte of every message to it
+enum class DomainCommand : unsigned char
+{
+	Load = 1, // The layout and the cells of the domain and the ring around it, answered with an empty message
+	Step = 2, // A number of generations, answered with the statistics of the domain
+	Snapshot = 3, // Answered with the cells of the domain
+	Quit = 4
+};
+
+// Inclusive on every side, empty when max is below min
+struct DomainRect
+{
+	coordinatePart minX = 0;
+	coordinatePart minY = 0;
+	coordinatePart maxX = -1;
+	coordinatePart maxY = -1;
+
+	bool IsEmpty() const { return this->maxX < this->minX || this->maxY < this->minY; };
+	bool Contains(coordinatePart a_x, coordinatePart a_y) const { return a_x >= this->minX && a_x <= this->maxX && a_y >= this->minY && a_y <= this->maxY; };
+	// The rect with the ring of cells around it that its cells see
+	DomainRect Expanded() const { return DomainRect{ this->minX - 1, this->minY - 1, this->maxX + 1, this->maxY + 1 }; };
+	bool Intersects(const DomainRect& a_other) const
+	{
+		return !this->IsEmpty() && !a_other.IsEmpty() && a_other.minX <= this->maxX && a_other.maxX >= this->minX && a_other.minY <= this->maxY && a_other.maxY >= this->minY;
+	};
+};
+
+// A grid of columns and rows over the world. The lines are put so every column and every row holds about
+// the same number of cells, so the domains get a fair share of a world that isn't spread out evenly.
+struct DomainLayout
+{
+	unsigned int columns = 1;
+	unsigned int rows = 1;
+	std::vector<coordinatePart> columnStarts{ 0 }; // The first x of every column
+	std::vector<coordinatePart> rowStarts{ 0 }; // The first y of every row
+	coordinatePart lastX = 0;
+	coordinatePart lastY = 0;
+
+	unsigned int GetCount() const { return this->columns * this->rows; };
+
+	DomainRect GetRect(unsigned int a_domain) const
+	{
+		unsigned int m_column = a_domain % this->columns;
+		unsigned int m_row = a_domain / this->columns;
+		DomainRect m_rect;
+		m_rect.minX = this->columnStarts[m_column];
+		m_rect.maxX = m_column + 1 < this->columns ? this->columnStarts[m_column + 1] - 1 : this->lastX;
+		m_rect.minY = this->rowStarts[m_row];
+		m_rect.maxY = m_row + 1 < this->rows ? this->rowStarts[m_row + 1] - 1 : this->lastY;
+		return m_rect;
+	};
+
+	// The domain that simulates a cell, the outer domains reach as far as needed
+	unsigned int GetOwner(coordinatePart a_x, coordinatePart a_y) const
+	{
+		auto m_column = std::upper_bound(this->columnStarts.begin(), this->columnStarts.end(), a_x);
+		auto m_row = std::upper_bound(this->rowStarts.begin(), this->rowStarts.end(), a_y);
+		unsigned int m_columnIndex = m_column == this->columnStarts.begin() ? 0 : (unsigned int)(m_column - this->columnStarts.begin() - 1);
+		unsigned int m_rowIndex = m_row == this->rowStarts.begin() ? 0 : (unsigned int)(m_row - this->rowStarts.begin() - 1);
+		return m_rowIndex * this->columns + m_columnIndex;
+	};
+
+	void Write(MessageWriter* a_writer) const
+	{
+		a_writer->PutU32(this->columns);
+		a_writer->PutU32(this->rows);
+		for (coordinatePart m_start : this->columnStarts)
+			a_writer->PutI64(m_start);
+		for (coordinatePart m_start : this->rowStarts)
+			a_writer->PutI64(m_start);
+		a_writer->PutI64(this->lastX);
+		a_writer->PutI64(this->lastY);
+	};
+
+	bool Read(MessageReader* a_reader)
+	{
+		this->columns = a_reader->GetU32();
+		this->rows = a_reader->GetU32();
+		if (this->columns == 0 || this->rows == 0 || ((unsigned long long)this->columns + this->rows) * 8 > a_reader->GetRemaining())
+			return false;
+		this->columnStarts.resize(this->columns);
+		this->rowStarts.resize(this->rows);
+		for (coordinatePart& m_start : this->columnStarts)
+			m_start = a_reader->GetI64();
+		for (coordinatePart& m_start : this->rowStarts)
+			m_start = a_reader->GetI64();
+		this->lastX = a_reader->GetI64();
+		this->lastY = a_reader->GetI64();
+		return !a_reader->Failed();
+	};
+
+	static DomainLayout Split(const std::vector<CellSnapshot>& a_cells, unsigned int a_columns, unsigned int a_rows)
+	{
+		DomainLayout m_layout;
+		m_layout.columns = std::max(a_columns, 1u);
+		m_layout.rows = std::max(a_rows, 1u);
+		m_layout.columnStarts = SplitAxis(a_cells, m_layout.columns, true, &m_layout.lastX);
+		m_layout.rowStarts = SplitAxis(a_cells, m_layout.rows, false, &m_layout.lastY);
+		return m_layout;
+	};
+
+private:
+	static std::vector<coordinatePart> SplitAxis(const std::vector<CellSnapshot>& a_cells, unsigned int a_parts, bool a_onX, coordinatePart* a_last)
+	{
+		std::vector<coordinatePart> m_values;
+		m_values.reserve(a_cells.size());
+		for (const CellSnapshot& m_cell : a_cells)
+			m_values.push_back(a_onX ? m_cell.x : m_cell.y);
+		std::sort(m_values.begin(), m_values.end());
+		std::vector<coordinatePart> m_starts(a_parts, 0);
+		if (m_values.empty())
+		{
+			*a_last = 0;
+			return m_starts;
+		}
+		// Parts can end up empty when many cells share a line, their start is then the start of the next part
+		for (unsigned int m_part = 0; m_part < a_parts; m_part++)
+			m_starts[m_part] = m_part == 0 ? m_values.front() : std::max(m_starts[m_part - 1], m_values[m_values.size() * m_part / a_parts]);
+		*a_last = m_values.back();
+		return m_starts;
+	};
+};
+
+// Every process of a run has a channel to every other, numbered from the sender and receiver.
+// The domains are 0 to a_domains - 1 and the coordinator is a_domains.
+inline unsigned int GetDomainChannel(unsigned int a_from, unsigned int a_to, unsigned int a_domains)
+{
+	return a_from * (a_domains + 1) + a_to;
+}
+
+#endif // !__DOMAINLAYOUT__
@@ -0,0 +1,278 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <iostream>
+#include <chrono>
+#include <thread>
+
+#include "domainWorker.h"
+#include "profiler.h"
+
+// Bigger borders are sent from a second thread, two neighbours sending large borders to each other
+// at the same time could otherwise both wait for the other to make room in the channel
+#define DomainInlineHaloBytes (32 * 1024)
+
+DomainWorker::DomainWorker(unsigned int a_index, unsigned int a_domains, TransportSettings a_settings)
+{
+	this->index = a_index;
+	this->domains = a_domains;
+	this->settings = a_settings;
+}
+
+int DomainWorker::Run()
+{
+	this->fromCoordinator = OpenReceivingChannel(this->settings, GetDomainChannel(this->domains, this->index, this->domains), DomainConnectTimeoutMs);
+	if (this->fromCoordinator)
+		this->toCoordinator = OpenSendingChannel(this->settings, GetDomainChannel(this->index, this->domains, this->domains), DomainConnectTimeoutMs);
+	if (!this->toCoordinator)
+	{
+		std::cout << "Domain " << this->index << " could not reach the coordinator" << std::endl;
+		return 1;
+	}
+
+	std::vector<unsigned char> m_message;
+	MessageWriter m_reply;
+	while (this->fromCoordinator->Receive(&m_message))
+	{
+		MessageReader m_reader(m_message);
+		DomainCommand m_command = (DomainCommand)m_reader.GetU8();
+		m_reply.Clear();
+		if (m_command == DomainCommand::Load)
+		{
+			if (!this->Load(&m_reader) || !this->ConnectNeighbors())
+			{
+				std::cout << "Domain " << this->index << " could not load its part of the world" << std::endl;
+				return 1;
+			}
+		}
+		else if (m_command == DomainCommand::Step && this->world)
+		{
+			unsigned long long m_generations = m_reader.GetU64();
+			unsigned long long m_workNs = 0;
+			for (unsigned long long m_generation = 0; m_generation < m_generations; m_generation++)
+			{
+				if (!this->ExchangeHalo())
+					return 1;
+				auto m_start = std::chrono::steady_clock::now();
+				this->world->UpdateSimulationWithSingleGeneration();
+				m_workNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+			}
+			this->WriteStatistics(&m_reply, m_workNs);
+		}
+		else if (m_command == DomainCommand::Snapshot && this->world)
+			this->WriteSnapshot(&m_reply);
+		else if (m_command == DomainCommand::Quit)
+			return 0;
+		else
+			return 1;
+
+		if (!this->toCoordinator->Send(m_reply.data))
+			return 1;
+	}
+	// The coordinator went away without saying quit
+	return 1;
+}
+
+bool DomainWorker::Load(MessageReader* a_message)
+{
+	if (this->world || !this->layout.Read(a_message) || this->index >= this->layout.GetCount())
+		return false;
+	World::generationType m_generation = a_message->GetU64();
+	unsigned long long m_count = a_message->GetU64();
+	if (m_count > a_message->GetRemaining() / 17)
+		return false;
+	std::vector<CellSnapshot> m_cells((size_t)m_count);
+	for (CellSnapshot& m_cell : m_cells)
+	{
+		m_cell.x = a_message->GetI64();
+		m_cell.y = a_message->GetI64();
+		m_cell.state = (CellState)(a_message->GetU8() & 3);
+	}
+	if (a_message->Failed())
+		return false;
+
+	World::ThreadOptions m_options;
+	m_options.stepOnCaller = true;
+	this->world.reset(new World(m_options));
+	this->world->LoadSnapshot(m_cells, m_generation);
+	this->rect = this->layout.GetRect(this->index);
+
+	// Every domain next to this one, also diagonally
+	DomainRect m_seen = this->rect.Expanded();
+	for (unsigned int m_domain = 0; m_domain < this->layout.GetCount(); m_domain++)
+	{
+		if (m_domain != this->index && this->layout.GetRect(m_domain).Intersects(m_seen))
+		{
+			this->neighbors.emplace_back();
+			this->neighbors.back().domain = m_domain;
+		}
+	}
+	if (this->neighbors.empty())
+		return true;
+
+	// The map is sorted the same way in every domain, so both sides of a border list its cells in the same order
+	std::vector<DomainRect> m_neighborSeen;
+	for (Neighbor& m_neighbor : this->neighbors)
+		m_neighborSeen.push_back(this->layout.GetRect(m_neighbor.domain).Expanded());
+	for (auto& m_cellPair : this->world->cells)
+	{
+		Cell* m_cell = m_cellPair.second;
+		if (this->rect.Contains(m_cell->x, m_cell->y))
+		{
+			for (size_t m_neighbor = 0; m_neighbor < this->neighbors.size(); m_neighbor++)
+			{
+				if (m_neighborSeen[m_neighbor].Contains(m_cell->x, m_cell->y))
+					this->neighbors[m_neighbor].border.push_back(m_cell);
+			}
+		}
+		else
+		{
+			unsigned int m_owner = this->layout.GetOwner(m_cell->x, m_cell->y);
+			for (Neighbor& m_neighbor : this->neighbors)
+			{
+				if (m_neighbor.domain == m_owner)
+					m_neighbor.ghosts.push_back(CellSnapshot{ m_cell->x, m_cell->y, m_cell->cellState });
+			}
+		}
+	}
+	return true;
+}
+
+bool DomainWorker::ConnectNeighbors()
+{
+	// Everyone opens its receiving ends first, so nobody waits for a sending end that waits for them
+	for (Neighbor& m_neighbor : this->neighbors)
+	{
+		m_neighbor.incoming = OpenReceivingChannel(this->settings, GetDomainChannel(m_neighbor.domain, this->index, this->domains), DomainConnectTimeoutMs);
+		if (!m_neighbor.incoming)
+			return false;
+	}
+	for (Neighbor& m_neighbor : this->neighbors)
+	{
+		m_neighbor.outgoing = OpenSendingChannel(this->settings, GetDomainChannel(this->index, m_neighbor.domain, this->domains), DomainConnectTimeoutMs);
+		if (!m_neighbor.outgoing)
+			return false;
+	}
+	return true;
+}
+
+bool DomainWorker::ExchangeHalo()
+{
+	PROFILE_ZONE("halo exchange");
+	auto m_start = std::chrono::steady_clock::now();
+	// Four states to a byte
+	size_t m_bytes = 0;
+	for (Neighbor& m_neighbor : this->neighbors)
+	{
+		m_neighbor.sendBuffer.assign((m_neighbor.border.size() + 3) / 4, 0);
+		for (size_t m_cell = 0; m_cell < m_neighbor.border.size(); m_cell++)
+			m_neighbor.sendBuffer[m_cell / 4] |= (unsigned char)((m_neighbor.border[m_cell]->cellState & 3) << ((m_cell % 4) * 2));
+		m_bytes += m_neighbor.sendBuffer.size();
+	}
+
+	bool m_sent = true;
+	std::thread m_sender;
+	auto m_sendAll = [this, &m_sent]() {
+		for (Neighbor& m_neighbor : this->neighbors)
+			m_sent = m_sent && m_neighbor.outgoing->Send(m_neighbor.sendBuffer);
+	};
+	if (m_bytes > DomainInlineHaloBytes)
+		m_sender = std::thread(m_sendAll);
+	else
+		m_sendAll();
+
+	bool m_received = true;
+	for (Neighbor& m_neighbor : this->neighbors)
+	{
+		if (!m_neighbor.incoming->Receive(&m_neighbor.receiveBuffer) || m_neighbor.receiveBuffer.size() != (m_neighbor.ghosts.size() + 3) / 4)
+		{
+			m_received = false;
+			break;
+		}
+		for (size_t m_cell = 0; m_cell < m_neighbor.ghosts.size(); m_cell++)
+			m_neighbor.ghosts[m_cell].state = (CellState)((m_neighbor.receiveBuffer[m_cell / 4] >> ((m_cell % 4) * 2)) & 3);
+		this->world->SetStates(m_neighbor.ghosts);
+	}
+	if (m_sender.joinable())
+	{
+		// A sender that waits for a neighbour that is gone would never finish
+		if (!m_received)
+		{
+			for (Neighbor& m_neighbor : this->neighbors)
+				m_neighbor.outgoing->Close();
+		}
+		m_sender.join();
+	}
+	this->haloBytes += m_bytes;
+	this->haloNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+	return m_sent && m_received;
+}
+
+void DomainWorker::WriteStatistics(MessageWriter* a_reply, unsigned long long a_workNs)
+{
+	// Only the own cells, the copies are counted by their own domain
+	unsigned long long m_counts[4] = { 0, 0, 0, 0 };
+	unsigned long long m_cells = 0;
+	for (auto& m_cellPair : this->world->cells)
+	{
+		if (this->rect.Contains(m_cellPair.first.first, m_cellPair.first.second))
+		{
+			m_counts[m_cellPair.second->cellState & 3] += 1;
+			m_cells += 1;
+		}
+	}
+	a_reply->PutU64(this->world->GetDisplayGeneration());
+	a_reply->PutU64(m_counts[Head]);
+	a_reply->PutU64(m_counts[Tail]);
+	a_reply->PutU64(m_counts[Conductor]);
+	a_reply->PutU64(m_cells);
+	a_reply->PutU64(a_workNs);
+	a_reply->PutU64(this->haloNs);
+	a_reply->PutU64(this->haloBytes);
+	this->haloNs = 0;
+	this->haloBytes = 0;
+}
+
+void DomainWorker::WriteSnapshot(MessageWriter* a_reply)
+{
+	std::vector<CellSnapshot> m_cells;
+	World::generationType m_generation = 0;
+	this->world->TakeSnapshot(&m_cells, &m_generation);
+	size_t m_countAt = a_reply->data.size() + 8;
+	a_reply->PutU64(m_generation);
+	a_reply->PutU64(0);
+	unsigned long long m_count = 0;
+	for (const CellSnapshot& m_cell : m_cells)
+	{
+		if (!this->rect.Contains(m_cell.x, m_cell.y))
+			continue;
+		a_reply->PutI64(m_cell.x);
+		a_reply->PutI64(m_cell.y);
+		a_reply->PutU8((uint8_t)m_cell.state);
+		m_count++;
+	}
+	// The number of cells is only known now
+	for (int m_byte = 0; m_byte < 8; m_byte++)
+		a_reply->data[m_countAt + m_byte] = (unsigned char)(m_count >> (m_byte * 8));
+}
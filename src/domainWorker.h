@@ -0,0 +1,82 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <memory>
+#include <vector>
+
+#include "cell.h"
+#include "world.h"
+#include "haloTransport.h"
+#include "domainLayout.h"
+
+#ifndef __DOMAINWORKER__
+#define __DOMAINWORKER__
+
+// How long the processes of a run wait for each other to start
+#define DomainConnectTimeoutMs 30000
+
+// One domain of a world that is split over processes. It simulates its own cells together with a ring of
+// copies of the cells of its neighbours around them. Before every generation the neighbours send each
+// other the states of the cells along their borders, so the copies are up to date when they are needed.
+class DomainWorker
+{
+private:
+	struct Neighbor
+	{
+		unsigned int domain = 0;
+		std::unique_ptr<HaloTransport> incoming;
+		std::unique_ptr<HaloTransport> outgoing;
+		std::vector<Cell*> border; // Own cells the neighbour has a copy of
+		std::vector<CellSnapshot> ghosts; // The copies of its cells, in the order it sends them
+		std::vector<unsigned char> sendBuffer;
+		std::vector<unsigned char> receiveBuffer;
+	};
+
+	unsigned int index;
+	unsigned int domains;
+	TransportSettings settings;
+	std::unique_ptr<HaloTransport> fromCoordinator;
+	std::unique_ptr<HaloTransport> toCoordinator;
+	std::unique_ptr<World> world;
+	DomainLayout layout;
+	DomainRect rect;
+	std::vector<Neighbor> neighbors;
+	unsigned long long haloNs = 0;
+	unsigned long long haloBytes = 0;
+
+public:
+	DomainWorker(unsigned int a_index, unsigned int a_domains, TransportSettings a_settings);
+
+	// Does what the coordinator asks until it says quit, returns the exit code for the process
+	int Run();
+
+private:
+	bool Load(MessageReader* a_message);
+	bool ConnectNeighbors();
+	bool ExchangeHalo();
+	void WriteStatistics(MessageWriter* a_reply, unsigned long long a_workNs);
+	void WriteSnapshot(MessageWriter* a_reply);
+};
+
+#endif // !__DOMAINWORKER__
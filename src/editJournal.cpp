@@ -0,0 +1,455 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <cstring>
+#include <algorithm>
+
+#include "editJournal.h"
+#include "fileUtils.h"
+#include "config.h"
+
+// Markers at the start of the files and journal batches, to detect garbage and torn writes
+const unsigned int checkpointMagic = 0x50435757; // "WWCP"
+const unsigned int journalBatchMagic = 0x424A5757; // "WWJB"
+const unsigned int checkpointVersion = 1;
+const size_t journalRecordSize = sizeof(unsigned long long) + 2 * sizeof(coordinatePart) + 1;
+const size_t checkpointRecordSize = 2 * sizeof(coordinatePart) + 1;
+
+template<typename T>
+static void AppendValue(std::vector<unsigned char>* a_buffer, T a_value)
+{
+	const unsigned char* m_bytes = (const unsigned char*)&a_value;
+	a_buffer->insert(a_buffer->end(), m_bytes, m_bytes + sizeof(T));
+}
+
+template<typename T>
+static T ReadValue(const unsigned char* a_data)
+{
+	T m_value;
+	memcpy(&m_value, a_data, sizeof(T));
+	return m_value;
+}
+
+EditJournal::EditJournal(std::string a_directory)
+{
+	CreateDirectoryIfMissing(a_directory);
+	this->journalPath = a_directory + "/journal.bin";
+	this->checkpointPath = a_directory + "/checkpoint.bin";
+	this->groupCommitInterval = std::chrono::milliseconds(Config::instance->journalGroupCommitIntervalInMs);
+	this->checkpointInterval = std::chrono::seconds(Config::instance->autosaveCheckpointIntervalInSeconds);
+	this->recoveryInProgress.store(false);
+	this->lastRecoverySucceeded.store(false);
+	this->recoveryGenerationsDone.store(0);
+	this->recoveryGenerationsTotal.store(0);
+}
+
+EditJournal::~EditJournal()
+{
+	this->FinishRecovery();
+	this->Detach();
+}
+
+void EditJournal::Attach(World* a_world)
+{
+	this->Detach();
+	this->world = a_world;
+	this->journalFile = fopen(this->journalPath.c_str(), "ab");
+	this->stopWriter = false;
+	this->checkpointRequested = true; // Start from a known state
+	this->writerThread = std::thread(&EditJournal::WriterThread, this);
+	this->listenerId = a_world->AddChangeListener(
+		[this](World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+		{
+			this->OnWorldChanged(a_generation, a_source, a_changes);
+		}
+	);
+}
+
+void EditJournal::Detach()
+{
+	if (this->world == nullptr)
+		return;
+
+	this->world->RemoveChangeListener(this->listenerId);
+	{
+		std::lock_guard<std::mutex> m_lk(this->pendingLock);
+		this->stopWriter = true;
+	}
+	this->pendingCv.notify_all();
+	if (this->writerThread.joinable())
+		this->writerThread.join();
+
+	if (this->journalFile != nullptr)
+		SyncAndCloseFile(this->journalFile);
+	this->journalFile = nullptr;
+	this->world = nullptr;
+}
+
+size_t EditJournal::GetMemoryUsage()
+{
+	std::lock_guard<std::mutex> m_lk(this->pendingLock);
+	return this->pendingRecords.capacity() * sizeof(JournalRecord) + this->batchBytes + this->resetSnapshot.capacity() * sizeof(CellSnapshot);
+}
+
+void EditJournal::RequestCheckpoint()
+{
+	{
+		std::lock_guard<std::mutex> m_lk(this->pendingLock);
+		this->checkpointRequested = true;
+	}
+	this->pendingCv.notify_all();
+}
+
+bool EditJournal::HasRecoveryData()
+{
+	return FileExists(this->checkpointPath) || FileExists(this->journalPath);
+}
+
+void EditJournal::Discard()
+{
+	this->Detach();
+	std::remove(this->journalPath.c_str());
+	std::remove(this->checkpointPath.c_str());
+}
+
+void EditJournal::OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+{
+	// The simulation itself is reproducible, only the edits have to be journaled
+	if (a_source == World::ChangeSource::Simulation)
+		return;
+
+	if (a_source == World::ChangeSource::Reset)
+	{
+		// The world can't change while we are told about a reset, so its cells are read now. The edits
+		// before it belong to the old world, the ones after it are only written after this checkpoint.
+		std::vector<CellSnapshot> m_snapshot;
+		World::generationType m_generation = 0;
+		this->world->TakeSnapshot(&m_snapshot, &m_generation);
+		{
+			std::lock_guard<std::mutex> m_lk(this->pendingLock);
+			this->resetSnapshot.swap(m_snapshot);
+			this->resetGeneration = m_generation;
+			this->resetPending = true;
+			this->pendingRecords.clear();
+		}
+		this->pendingCv.notify_all();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> m_lk(this->pendingLock);
+		for (const CellChange& m_change : a_changes)
+			this->pendingRecords.push_back(JournalRecord{ a_generation, m_change.x, m_change.y, m_change.newState });
+	}
+	this->pendingCv.notify_all();
+}
+
+void EditJournal::WriterThread()
+{
+	auto m_lastCheckpoint = std::chrono::steady_clock::now();
+	std::vector<JournalRecord> m_batch;
+	std::unique_lock<std::mutex> m_lk(this->pendingLock);
+	while (true)
+	{
+		// Sleep until there is something to do, an idle journal never wakes up
+		this->pendingCv.wait(m_lk, [this] {
+			return this->stopWriter || this->checkpointRequested || this->resetPending || !this->pendingRecords.empty();
+		});
+
+		// Group commit, give the user a moment to draw more cells so they all share one disk sync
+		if (!this->stopWriter && !this->checkpointRequested && !this->resetPending)
+		{
+			this->pendingCv.wait_for(m_lk, this->groupCommitInterval, [this] {
+				return this->stopWriter || this->checkpointRequested || this->resetPending;
+			});
+		}
+
+		m_batch.clear();
+		m_batch.swap(this->pendingRecords);
+		this->batchBytes = m_batch.capacity() * sizeof(JournalRecord);
+		bool m_checkpoint = this->checkpointRequested;
+		bool m_stop = this->stopWriter;
+		bool m_reset = this->resetPending;
+		std::vector<CellSnapshot> m_resetSnapshot;
+		m_resetSnapshot.swap(this->resetSnapshot);
+		World::generationType m_resetGeneration = this->resetGeneration;
+		this->checkpointRequested = false;
+		this->resetPending = false;
+		m_lk.unlock();
+
+		// The old journal goes first, a crash before the new checkpoint is in place leaves the old
+		// world as it was at its last checkpoint instead of edits on top of the wrong world
+		if (m_reset && this->TruncateJournal())
+		{
+			this->WriteCheckpoint(m_resetSnapshot, m_resetGeneration);
+			m_lastCheckpoint = std::chrono::steady_clock::now();
+		}
+		m_resetSnapshot = std::vector<CellSnapshot>();
+
+		if (!m_batch.empty())
+			this->WriteBatch(m_batch);
+
+		if (!m_stop && !m_reset && (m_checkpoint || std::chrono::steady_clock::now() - m_lastCheckpoint >= this->checkpointInterval))
+		{
+			std::vector<CellSnapshot> m_snapshot;
+			World::generationType m_generation = 0;
+			this->world->TakeSnapshot(&m_snapshot, &m_generation);
+			this->WriteCheckpoint(m_snapshot, m_generation);
+			m_lastCheckpoint = std::chrono::steady_clock::now();
+		}
+
+		m_lk.lock();
+		if (m_stop && this->pendingRecords.empty())
+			break;
+	}
+}
+
+bool EditJournal::WriteBatch(const std::vector<JournalRecord>& a_records)
+{
+	if (this->journalFile == nullptr)
+		return false;
+
+	std::vector<unsigned char> m_payload;
+	m_payload.reserve(a_records.size() * journalRecordSize);
+	for (const JournalRecord& m_record : a_records)
+	{
+		AppendValue<unsigned long long>(&m_payload, m_record.generation);
+		AppendValue<coordinatePart>(&m_payload, m_record.x);
+		AppendValue<coordinatePart>(&m_payload, m_record.y);
+		AppendValue<unsigned char>(&m_payload, (unsigned char)m_record.state);
+	}
+
+	std::vector<unsigned char> m_header;
+	AppendValue<unsigned int>(&m_header, journalBatchMagic);
+	AppendValue<unsigned int>(&m_header, (unsigned int)a_records.size());
+	AppendValue<unsigned int>(&m_header, HashBytes(m_payload.data(), m_payload.size()));
+
+	bool m_success = fwrite(m_header.data(), 1, m_header.size(), this->journalFile) == m_header.size();
+	m_success = m_success && fwrite(m_payload.data(), 1, m_payload.size(), this->journalFile) == m_payload.size();
+	// One sync for the whole batch
+	return m_success && SyncFile(this->journalFile);
+}
+
+bool EditJournal::WriteCheckpoint(const std::vector<CellSnapshot>& a_snapshot, World::generationType a_generation)
+{
+	std::vector<unsigned char> m_payload;
+	m_payload.reserve(a_snapshot.size() * checkpointRecordSize);
+	for (const CellSnapshot& m_cell : a_snapshot)
+	{
+		AppendValue<coordinatePart>(&m_payload, m_cell.x);
+		AppendValue<coordinatePart>(&m_payload, m_cell.y);
+		AppendValue<unsigned char>(&m_payload, (unsigned char)m_cell.state);
+	}
+
+	std::vector<unsigned char> m_header;
+	AppendValue<unsigned int>(&m_header, checkpointMagic);
+	AppendValue<unsigned int>(&m_header, checkpointVersion);
+	AppendValue<unsigned long long>(&m_header, a_generation);
+	AppendValue<unsigned long long>(&m_header, (unsigned long long)a_snapshot.size());
+	AppendValue<unsigned int>(&m_header, HashBytes(m_payload.data(), m_payload.size()));
+
+	std::string m_tempPath = this->checkpointPath + ".tmp";
+	FILE* m_out = fopen(m_tempPath.c_str(), "wb");
+	if (m_out == nullptr)
+		return false;
+	bool m_success = fwrite(m_header.data(), 1, m_header.size(), m_out) == m_header.size();
+	m_success = m_success && fwrite(m_payload.data(), 1, m_payload.size(), m_out) == m_payload.size();
+	m_success = SyncAndCloseFile(m_out) && m_success;
+	if (!m_success || !ReplaceFileWith(this->checkpointPath, m_tempPath))
+	{
+		std::remove(m_tempPath.c_str());
+		return false;
+	}
+
+	// Everything in the journal is now part of the checkpoint, start over with an empty journal.
+	// Should we crash before this, recovery skips the records that are older than the checkpoint.
+	return this->TruncateJournal();
+}
+
+bool EditJournal::TruncateJournal()
+{
+	if (this->journalFile != nullptr)
+		fclose(this->journalFile);
+	this->journalFile = fopen(this->journalPath.c_str(), "wb");
+	return this->journalFile != nullptr;
+}
+
+bool EditJournal::ReadCheckpoint(std::vector<CellSnapshot>* a_output, World::generationType* a_generation)
+{
+	FILE* m_in = fopen(this->checkpointPath.c_str(), "rb");
+	if (m_in == nullptr)
+		return false;
+
+	const size_t m_headerSize = 2 * sizeof(unsigned int) + 2 * sizeof(unsigned long long) + sizeof(unsigned int);
+	unsigned char m_header[m_headerSize];
+	bool m_success = fread(m_header, 1, m_headerSize, m_in) == m_headerSize;
+	m_success = m_success && ReadValue<unsigned int>(m_header) == checkpointMagic;
+	m_success = m_success && ReadValue<unsigned int>(m_header + 4) == checkpointVersion;
+	if (m_success)
+	{
+		World::generationType m_generation = ReadValue<unsigned long long>(m_header + 8);
+		unsigned long long m_count = ReadValue<unsigned long long>(m_header + 16);
+		unsigned int m_checksum = ReadValue<unsigned int>(m_header + 24);
+
+		std::vector<unsigned char> m_payload(m_count * checkpointRecordSize);
+		m_success = fread(m_payload.data(), 1, m_payload.size(), m_in) == m_payload.size();
+		m_success = m_success && HashBytes(m_payload.data(), m_payload.size()) == m_checksum;
+		if (m_success)
+		{
+			a_output->reserve(m_count);
+			for (unsigned long long m_index = 0; m_index < m_count; m_index++)
+			{
+				const unsigned char* m_record = m_payload.data() + m_index * checkpointRecordSize;
+				a_output->push_back(CellSnapshot{
+					ReadValue<coordinatePart>(m_record),
+					ReadValue<coordinatePart>(m_record + sizeof(coordinatePart)),
+					(CellState)m_record[2 * sizeof(coordinatePart)]
+				});
+			}
+			*a_generation = m_generation;
+		}
+	}
+	fclose(m_in);
+	return m_success;
+}
+
+void EditJournal::ReadJournal(std::vector<JournalRecord>* a_output)
+{
+	FILE* m_in = fopen(this->journalPath.c_str(), "rb");
+	if (m_in == nullptr)
+		return;
+
+	const size_t m_headerSize = 3 * sizeof(unsigned int);
+	unsigned char m_header[m_headerSize];
+	std::vector<unsigned char> m_payload;
+	while (fread(m_header, 1, m_headerSize, m_in) == m_headerSize)
+	{
+		if (ReadValue<unsigned int>(m_header) != journalBatchMagic)
+			break;
+		unsigned int m_count = ReadValue<unsigned int>(m_header + 4);
+		unsigned int m_checksum = ReadValue<unsigned int>(m_header + 8);
+		m_payload.resize((size_t)m_count * journalRecordSize);
+
+		// A batch that was only partly written when we crashed ends the journal
+		if (fread(m_payload.data(), 1, m_payload.size(), m_in) != m_payload.size() ||
+			HashBytes(m_payload.data(), m_payload.size()) != m_checksum)
+			break;
+
+		for (unsigned int m_index = 0; m_index < m_count; m_index++)
+		{
+			const unsigned char* m_record = m_payload.data() + (size_t)m_index * journalRecordSize;
+			a_output->push_back(JournalRecord{
+				ReadValue<unsigned long long>(m_record),
+				ReadValue<coordinatePart>(m_record + 8),
+				ReadValue<coordinatePart>(m_record + 8 + sizeof(coordinatePart)),
+				(CellState)m_record[8 + 2 * sizeof(coordinatePart)]
+			});
+		}
+	}
+	fclose(m_in);
+}
+
+void EditJournal::ApplyRecord(World* a_world, const JournalRecord& a_record)
+{
+	CellState m_state = a_record.state;
+	if (m_state == Background)
+		a_world->TryDeleteCell(a_record.x, a_record.y);
+	else if (!a_world->TryInsertCellAt(a_record.x, a_record.y, m_state))
+	{
+		a_world->TryUpdateCell(a_record.x, a_record.y, [m_state](Cell* a_cell) {
+			a_cell->cellState = m_state;
+			a_cell->decayState = m_state;
+			return true;
+		});
+	}
+}
+
+bool EditJournal::Recover(World* a_world)
+{
+	std::vector<CellSnapshot> m_checkpoint;
+	World::generationType m_generation = 0;
+	bool m_hasCheckpoint = this->ReadCheckpoint(&m_checkpoint, &m_generation);
+
+	std::vector<JournalRecord> m_records;
+	this->ReadJournal(&m_records);
+	if (!m_hasCheckpoint && m_records.empty())
+		return false;
+	// Without a checkpoint the edits were made to an empty world
+	if (!m_hasCheckpoint)
+		m_generation = m_records.front().generation;
+
+	a_world->LoadSnapshot(m_checkpoint, m_generation);
+	m_checkpoint.clear();
+	m_checkpoint.shrink_to_fit();
+
+	World::generationType m_lastGeneration = m_generation;
+	for (const JournalRecord& m_record : m_records)
+		m_lastGeneration = std::max(m_lastGeneration, m_record.generation);
+	this->recoveryGenerationsDone.store(0);
+	this->recoveryGenerationsTotal.store(m_lastGeneration - m_generation);
+
+	// Every edit was made to the world as it was after its generation, so the world has to be
+	// simulated that far first. The simulation is reproducible, that gives the same world again.
+	// The journal only holds edits of the world of the checkpoint, a reset starts both over.
+	for (const JournalRecord& m_record : m_records)
+	{
+		// Edits older than the checkpoint are already in it
+		if (m_record.generation < m_generation)
+			continue;
+		while (a_world->GetDisplayGeneration() < m_record.generation)
+		{
+			a_world->UpdateSimulationWithSingleGeneration();
+			this->recoveryGenerationsDone.store(a_world->GetDisplayGeneration() - m_generation);
+		}
+		this->ApplyRecord(a_world, m_record);
+	}
+	return true;
+}
+
+void EditJournal::StartRecovery(World* a_world)
+{
+	this->FinishRecovery();
+	this->recoveryInProgress.store(true);
+	this->recoveryGenerationsDone.store(0);
+	this->recoveryGenerationsTotal.store(0);
+	this->recoveryThread = std::thread([this, a_world]() {
+		this->lastRecoverySucceeded.store(this->Recover(a_world));
+		this->recoveryInProgress.store(false);
+	});
+}
+
+float EditJournal::GetRecoveryProgress()
+{
+	World::generationType m_total = this->recoveryGenerationsTotal.load();
+	if (m_total == 0)
+		return this->recoveryInProgress.load() ? 0.0f : 1.0f;
+	return (float)this->recoveryGenerationsDone.load() / (float)m_total;
+}
+
+bool EditJournal::FinishRecovery()
+{
+	if (this->recoveryThread.joinable())
+		this->recoveryThread.join();
+	return this->lastRecoverySucceeded.load();
+}
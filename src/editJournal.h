@@ -0,0 +1,124 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+#include "cell.h"
+#include "world.h"
+
+#ifndef __EDITJOURNAL__
+#define __EDITJOURNAL__
+
+// Crash safe autosave of the edits made to a world.
+// Every edit is appended to a binary journal by a background writer that groups all
+// edits that came in during one commit interval into a single write and disk sync.
+// Every so often a compact checkpoint of the whole world is written, after which the
+// journal can start over. Recovering is loading the checkpoint and replaying the journal,
+// simulating up to the generation of every edit before making it. When the world is replaced
+// its checkpoint is written before any edit made after it, so the journal always goes with
+// the checkpoint on disk.
+class EditJournal
+{
+private:
+	struct JournalRecord
+	{
+		World::generationType generation;
+		coordinatePart x;
+		coordinatePart y;
+		CellState state;
+	};
+
+	World* world = nullptr;
+	unsigned int listenerId = 0;
+
+	std::string journalPath;
+	std::string checkpointPath;
+	FILE* journalFile = nullptr;
+
+	std::thread writerThread;
+	std::mutex pendingLock;
+	std::condition_variable pendingCv;
+	std::vector<JournalRecord> pendingRecords;
+	size_t batchBytes = 0; // The records the writer thread holds on to, the last batch it wrote
+	bool checkpointRequested = false;
+	bool stopWriter = false;
+	// The world was replaced, its cells as they were right after
+	bool resetPending = false;
+	std::vector<CellSnapshot> resetSnapshot;
+	World::generationType resetGeneration = 0;
+
+	// Background recovery
+	std::thread recoveryThread;
+	std::atomic<bool> recoveryInProgress;
+	std::atomic<bool> lastRecoverySucceeded;
+	std::atomic<World::generationType> recoveryGenerationsDone;
+	std::atomic<World::generationType> recoveryGenerationsTotal;
+
+	std::chrono::milliseconds groupCommitInterval;
+	std::chrono::seconds checkpointInterval;
+
+public:
+	EditJournal(std::string a_directory);
+	~EditJournal();
+
+	// Starts journaling all edits made to the world
+	void Attach(World* a_world);
+	// Stops journaling and flushes everything that was still pending
+	void Detach();
+	bool IsAttached() { return this->world != nullptr; };
+	void RequestCheckpoint();
+	// The bytes of the edits that are waiting to be written and of the batch that was written last
+	size_t GetMemoryUsage();
+
+	bool HasRecoveryData();
+	// Rebuilds the world from the last checkpoint and the journal after it. This runs every
+	// generation between the checkpoint and the last edit, call it before attaching.
+	bool Recover(World* a_world);
+	// Recover on a background thread, FinishRecovery waits for it and tells whether it succeeded
+	void StartRecovery(World* a_world);
+	bool IsRecovering() { return this->recoveryInProgress.load(); };
+	float GetRecoveryProgress();
+	bool FinishRecovery();
+	// Removes the journal and checkpoint (after a clean exit nothing has to be recovered)
+	void Discard();
+
+private:
+	void OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes);
+	void WriterThread();
+	bool WriteBatch(const std::vector<JournalRecord>& a_records);
+	bool WriteCheckpoint(const std::vector<CellSnapshot>& a_snapshot, World::generationType a_generation);
+	bool TruncateJournal();
+	bool ReadCheckpoint(std::vector<CellSnapshot>* a_output, World::generationType* a_generation);
+	void ReadJournal(std::vector<JournalRecord>* a_output);
+	void ApplyRecord(World* a_world, const JournalRecord& a_record);
+};
+
+#endif // !__EDITJOURNAL__
@@ -0,0 +1,175 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <cstdio>
+#include <string>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <direct.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#include "fileUtils.h"
+
+bool SyncFile(FILE* a_file)
+{
+	if (fflush(a_file) != 0)
+		return false;
+#ifdef _WIN32
+	return _commit(_fileno(a_file)) == 0;
+#else
+	return fsync(fileno(a_file)) == 0;
+#endif
+}
+
+bool SyncAndCloseFile(FILE* a_file)
+{
+	if (a_file == nullptr)
+		return false;
+
+	bool m_result = SyncFile(a_file);
+	m_result = (fclose(a_file) == 0) && m_result;
+	return m_result;
+}
+
+bool ReplaceFileWith(const std::string& a_targetPath, const std::string& a_sourcePath)
+{
+#ifdef _WIN32
+	return MoveFileExA(a_sourcePath.c_str(), a_targetPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	// rename is atomic on POSIX, the target is either the old or the new file
+	return std::rename(a_sourcePath.c_str(), a_targetPath.c_str()) == 0;
+#endif
+}
+
+bool CreateDirectoryIfMissing(const std::string& a_path)
+{
+#ifdef _WIN32
+	_mkdir(a_path.c_str());
+#else
+	mkdir(a_path.c_str(), 0755);
+#endif
+	struct stat m_info;
+	return stat(a_path.c_str(), &m_info) == 0 && (m_info.st_mode & S_IFDIR) != 0;
+}
+
+bool FileExists(const std::string& a_path)
+{
+	struct stat m_info;
+	return stat(a_path.c_str(), &m_info) == 0;
+}
+
+unsigned int HashBytes(const void* a_data, size_t a_size, unsigned int a_hash)
+{
+	const unsigned char* m_bytes = (const unsigned char*)a_data;
+	for (size_t m_index = 0; m_index < a_size; m_index++)
+	{
+		a_hash ^= m_bytes[m_index];
+		a_hash *= 16777619u;
+	}
+	return a_hash;
+}
+
+MappedFile::~MappedFile()
+{
+	this->Close();
+}
+
+bool MappedFile::Open(const std::string& a_path)
+{
+	this->Close();
+#ifdef _WIN32
+	HANDLE m_file = CreateFileA(a_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER m_size;
+	if (!GetFileSizeEx(m_file, &m_size) || m_size.QuadPart == 0)
+	{
+		CloseHandle(m_file);
+		return false;
+	}
+	HANDLE m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr)
+	{
+		CloseHandle(m_file);
+		return false;
+	}
+	this->data = (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (this->data == nullptr)
+	{
+		CloseHandle(m_mapping);
+		CloseHandle(m_file);
+		return false;
+	}
+	this->fileHandle = m_file;
+	this->mappingHandle = m_mapping;
+	this->size = (size_t)m_size.QuadPart;
+#else
+	int m_file = open(a_path.c_str(), O_RDONLY);
+	if (m_file < 0)
+		return false;
+	struct stat m_info;
+	if (fstat(m_file, &m_info) != 0 || m_info.st_size == 0)
+	{
+		close(m_file);
+		return false;
+	}
+	void* m_data = mmap(nullptr, (size_t)m_info.st_size, PROT_READ, MAP_SHARED, m_file, 0);
+	if (m_data == MAP_FAILED)
+	{
+		close(m_file);
+		return false;
+	}
+	this->fileDescriptor = m_file;
+	this->data = (const unsigned char*)m_data;
+	this->size = (size_t)m_info.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (this->data == nullptr)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(this->data);
+	CloseHandle((HANDLE)this->mappingHandle);
+	CloseHandle((HANDLE)this->fileHandle);
+	this->mappingHandle = nullptr;
+	this->fileHandle = nullptr;
+#else
+	munmap((void*)this->data, this->size);
+	close(this->fileDescriptor);
+	this->fileDescriptor = -1;
+#endif
+	this->data = nullptr;
+	this->size = 0;
+}
@@ -0,0 +1,75 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <cstdio>
+#include <string>
+
+#ifndef __FILEUTILS__
+#define __FILEUTILS__
+
+// Flushes the file all the way down to the disk
+bool SyncFile(FILE* a_file);
+
+// Flushes the file all the way down to the disk and closes it.
+// Returns false if either the flush or the close failed.
+bool SyncAndCloseFile(FILE* a_file);
+
+// Replaces the target file with the source file (used to swap in a fully written temporary file)
+bool ReplaceFileWith(const std::string& a_targetPath, const std::string& a_sourcePath);
+
+// Creates the directory, returns true if it exists afterwards
+bool CreateDirectoryIfMissing(const std::string& a_path);
+
+bool FileExists(const std::string& a_path);
+
+// 32 bit FNV-1a hash, used as checksum for the binary files we write
+unsigned int HashBytes(const void* a_data, size_t a_size, unsigned int a_hash = 2166136261u);
+
+// A read only view of a whole file mapped into memory
+class MappedFile
+{
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+
+public:
+	MappedFile() {};
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool Open(const std::string& a_path);
+	void Close();
+	bool IsOpen() { return this->data != nullptr; };
+	const unsigned char* GetData() { return this->data; };
+	size_t GetSize() { return this->size; };
+};
+
+#endif // !__FILEUTILS__
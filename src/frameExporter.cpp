@@ -0,0 +1,339 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <cstring>
+#include <algorithm>
+
+#include "frameExporter.h"
+#include "config.h"
+
+static unsigned char ColorToByte(float a_value)
+{
+	return (unsigned char)(std::min(std::max(a_value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+FrameExporter::FrameExporter()
+{
+	this->framesWritten.store(0);
+	this->writeFailed.store(false);
+}
+
+FrameExporter::~FrameExporter()
+{
+	this->Finish();
+}
+
+bool FrameExporter::Start(World* a_world, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height,
+	unsigned int a_cellSizeInPx, FrameExportFormat a_format, std::string a_outputPath, unsigned int a_encoderThreads)
+{
+	this->Finish();
+	this->regionX = a_x;
+	this->regionY = a_y;
+	this->regionWidth = std::max(a_width, 1u);
+	this->regionHeight = std::max(a_height, 1u);
+	this->cellSizeInPx = std::max(a_cellSizeInPx, 1u);
+	this->format = a_format;
+	this->outputPath = a_outputPath;
+	this->imageWidth = this->regionWidth * this->cellSizeInPx;
+	this->imageHeight = this->regionHeight * this->cellSizeInPx;
+
+	// Take the colors from the config, the background for empty cells
+	const glm::vec3 m_colors[4] = {
+		Config::instance->conductorColor,
+		Config::instance->headColor,
+		Config::instance->tailColor,
+		glm::vec3(Config::instance->backgroundColor)
+	};
+	for (int m_state = 0; m_state < 4; m_state++)
+	{
+		float m_r = m_colors[m_state].r;
+		float m_g = m_colors[m_state].g;
+		float m_b = m_colors[m_state].b;
+		this->rgbPalette[m_state][0] = ColorToByte(m_r);
+		this->rgbPalette[m_state][1] = ColorToByte(m_g);
+		this->rgbPalette[m_state][2] = ColorToByte(m_b);
+		// Full range BT.601, as y4m C420jpeg expects
+		this->yuvPalette[m_state][0] = ColorToByte(0.299f * m_r + 0.587f * m_g + 0.114f * m_b);
+		this->yuvPalette[m_state][1] = ColorToByte(0.5f - 0.168736f * m_r - 0.331264f * m_g + 0.5f * m_b);
+		this->yuvPalette[m_state][2] = ColorToByte(0.5f + 0.5f * m_r - 0.418688f * m_g - 0.081312f * m_b);
+	}
+
+	if (this->format == FrameExportFormat::Y4m)
+	{
+		// 4:2:0 needs an even size, the extra row or column is background
+		this->imageWidth += this->imageWidth % 2;
+		this->imageHeight += this->imageHeight % 2;
+		this->videoFile = fopen(this->outputPath.c_str(), "wb");
+		if (this->videoFile == nullptr)
+			return false;
+		setvbuf(this->videoFile, nullptr, _IOFBF, 1 << 22);
+		std::string m_header = "YUV4MPEG2 W" + std::to_string(this->imageWidth) + " H" + std::to_string(this->imageHeight) + " F30:1 Ip A1:1 C420jpeg\n";
+		fwrite(m_header.data(), 1, m_header.size(), this->videoFile);
+	}
+
+	this->world = a_world;
+	this->nextSequence = 0;
+	this->nextFrameToWrite = 0;
+	this->framesWritten.store(0);
+	this->writeFailed.store(false);
+	this->stopEncoders = false;
+
+	unsigned int m_threadCount = std::max(a_encoderThreads, 1u);
+	this->maxQueuedJobs = m_threadCount * 2;
+	for (unsigned int m_thread = 0; m_thread < m_threadCount; m_thread++)
+		this->encoderThreads.emplace_back(&FrameExporter::EncoderThread, this);
+
+	this->LoadRegionFromWorld();
+	this->listenerId = a_world->AddChangeListener(
+		[this](World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+		{
+			this->OnWorldChanged(a_generation, a_source, a_changes);
+		}
+	);
+
+	// The first frame is the world as it is now
+	this->QueueFrame(a_world->GetDisplayGeneration());
+	return true;
+}
+
+bool FrameExporter::Finish()
+{
+	if (this->world == nullptr)
+		return !this->writeFailed.load();
+
+	this->world->RemoveChangeListener(this->listenerId);
+	{
+		std::lock_guard<std::mutex> m_lk(this->jobsLock);
+		this->stopEncoders = true;
+	}
+	this->jobsCv.notify_all();
+	for (std::thread& m_thread : this->encoderThreads)
+		m_thread.join();
+	this->encoderThreads.clear();
+
+	if (this->videoFile != nullptr)
+	{
+		if (fclose(this->videoFile) != 0)
+			this->writeFailed.store(true);
+		this->videoFile = nullptr;
+	}
+	this->encodedFrames.clear();
+	this->world = nullptr;
+	return !this->writeFailed.load();
+}
+
+void FrameExporter::LoadRegionFromWorld()
+{
+	this->regionStates.assign((size_t)this->regionWidth * this->regionHeight, (unsigned char)Background);
+	this->world->StatesInViewport(this->regionStates.data(), this->regionWidth, this->regionX - 1, this->regionY - 1, this->regionWidth + 1, this->regionHeight + 1);
+}
+
+void FrameExporter::OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+{
+	if (a_source == World::ChangeSource::Reset)
+	{
+		this->LoadRegionFromWorld();
+		return;
+	}
+
+	for (const CellChange& m_change : a_changes)
+	{
+		coordinatePart m_x = m_change.x - this->regionX;
+		coordinatePart m_y = m_change.y - this->regionY;
+		if (m_x >= 0 && m_y >= 0 && m_x < (coordinatePart)this->regionWidth && m_y < (coordinatePart)this->regionHeight)
+			this->regionStates[(size_t)m_y * this->regionWidth + (size_t)m_x] = (unsigned char)m_change.newState;
+	}
+
+	// Every generation is a frame, edits show up in the next one
+	if (a_source == World::ChangeSource::Simulation)
+		this->QueueFrame(a_generation);
+}
+
+void FrameExporter::QueueFrame(World::generationType a_generation)
+{
+	std::unique_lock<std::mutex> m_lk(this->jobsLock);
+	// When the encoders fall behind the simulation waits, so no generation is ever skipped
+	this->jobsSpaceCv.wait(m_lk, [this] { return this->jobs.size() < this->maxQueuedJobs || this->stopEncoders; });
+	this->jobs.push_back(FrameJob{ this->nextSequence++, a_generation, this->regionStates });
+	m_lk.unlock();
+	this->jobsCv.notify_one();
+}
+
+void FrameExporter::EncoderThread()
+{
+	std::vector<unsigned char> m_image;
+	while (true)
+	{
+		FrameJob m_job;
+		{
+			std::unique_lock<std::mutex> m_lk(this->jobsLock);
+			this->jobsCv.wait(m_lk, [this] { return this->stopEncoders || !this->jobs.empty(); });
+			if (this->jobs.empty())
+				return;
+			m_job = std::move(this->jobs.front());
+			this->jobs.pop_front();
+		}
+		this->jobsSpaceCv.notify_one();
+
+		if (this->format == FrameExportFormat::PpmSequence)
+		{
+			this->RasterizeRgb(m_job.states, &m_image);
+			char m_fileName[32];
+			snprintf(m_fileName, sizeof(m_fileName), "/frame_%010llu.ppm", m_job.generation);
+			FILE* m_out = fopen((this->outputPath + m_fileName).c_str(), "wb");
+			bool m_success = m_out != nullptr;
+			if (m_success)
+			{
+				std::string m_header = "P6\n" + std::to_string(this->imageWidth) + " " + std::to_string(this->imageHeight) + "\n255\n";
+				m_success = fwrite(m_header.data(), 1, m_header.size(), m_out) == m_header.size();
+				m_success = m_success && fwrite(m_image.data(), 1, m_image.size(), m_out) == m_image.size();
+				m_success = (fclose(m_out) == 0) && m_success;
+			}
+			if (!m_success)
+				this->writeFailed.store(true);
+			this->framesWritten.fetch_add(1);
+		}
+		else
+		{
+			this->RasterizeYuv(m_job.states, &m_image);
+			this->WriteVideoFrame(m_job.sequence, m_image);
+		}
+	}
+}
+
+void FrameExporter::RasterizeRgb(const std::vector<unsigned char>& a_states, std::vector<unsigned char>* a_output)
+{
+	const size_t m_rowBytes = (size_t)this->imageWidth * 3;
+	a_output->resize(m_rowBytes * this->imageHeight);
+	unsigned char* m_pixels = a_output->data();
+
+	for (unsigned int m_cellY = 0; m_cellY < this->regionHeight; m_cellY++)
+	{
+		// Draw the first pixel row of this row of cells, the others are the same
+		unsigned char* m_row = m_pixels + (size_t)m_cellY * this->cellSizeInPx * m_rowBytes;
+		const unsigned char* m_states = a_states.data() + (size_t)m_cellY * this->regionWidth;
+		unsigned char* m_pixel = m_row;
+		for (unsigned int m_cellX = 0; m_cellX < this->regionWidth; m_cellX++)
+		{
+			const unsigned char* m_color = this->rgbPalette[m_states[m_cellX] & 3];
+			for (unsigned int m_repeat = 0; m_repeat < this->cellSizeInPx; m_repeat++)
+			{
+				m_pixel[0] = m_color[0];
+				m_pixel[1] = m_color[1];
+				m_pixel[2] = m_color[2];
+				m_pixel += 3;
+			}
+		}
+		for (unsigned int m_repeat = 1; m_repeat < this->cellSizeInPx; m_repeat++)
+			memcpy(m_row + m_repeat * m_rowBytes, m_row, m_rowBytes);
+	}
+}
+
+void FrameExporter::ExpandPixelRow(const std::vector<unsigned char>& a_states, unsigned int a_pixelY, unsigned char* a_output)
+{
+	// The state under every pixel of a row, the padding outside the region is background
+	unsigned int m_cellY = a_pixelY / this->cellSizeInPx;
+	unsigned int m_x = 0;
+	if (m_cellY < this->regionHeight)
+	{
+		const unsigned char* m_states = a_states.data() + (size_t)m_cellY * this->regionWidth;
+		for (unsigned int m_cellX = 0; m_cellX < this->regionWidth; m_cellX++)
+		{
+			memset(a_output + m_x, m_states[m_cellX] & 3, this->cellSizeInPx);
+			m_x += this->cellSizeInPx;
+		}
+	}
+	memset(a_output + m_x, Background, this->imageWidth - m_x);
+}
+
+void FrameExporter::RasterizeYuv(const std::vector<unsigned char>& a_states, std::vector<unsigned char>* a_output)
+{
+	const unsigned int m_chromaWidth = this->imageWidth / 2;
+	const unsigned int m_chromaHeight = this->imageHeight / 2;
+	const size_t m_lumaSize = (size_t)this->imageWidth * this->imageHeight;
+	const size_t m_chromaSize = (size_t)m_chromaWidth * m_chromaHeight;
+	a_output->resize(m_lumaSize + 2 * m_chromaSize);
+	unsigned char* m_luma = a_output->data();
+	unsigned char* m_cb = m_luma + m_lumaSize;
+	unsigned char* m_cr = m_cb + m_chromaSize;
+
+	std::vector<unsigned char> m_rows(this->imageWidth * 2);
+	unsigned char* m_pixelRows[2] = { m_rows.data(), m_rows.data() + this->imageWidth };
+
+	// Work on two pixel rows at a time, they share a row of chroma
+	for (unsigned int m_chromaY = 0; m_chromaY < m_chromaHeight; m_chromaY++)
+	{
+		for (unsigned int m_sub = 0; m_sub < 2; m_sub++)
+		{
+			unsigned int m_y = m_chromaY * 2 + m_sub;
+			unsigned char* m_lumaRow = m_luma + (size_t)m_y * this->imageWidth;
+			// Rows within the same cell are identical
+			if (m_y > 0 && m_y / this->cellSizeInPx == (m_y - 1) / this->cellSizeInPx)
+			{
+				if (m_sub == 1)
+					memcpy(m_pixelRows[1], m_pixelRows[0], this->imageWidth);
+				else
+					memcpy(m_pixelRows[0], m_pixelRows[1], this->imageWidth);
+				memcpy(m_lumaRow, m_lumaRow - this->imageWidth, this->imageWidth);
+				continue;
+			}
+			this->ExpandPixelRow(a_states, m_y, m_pixelRows[m_sub]);
+			for (unsigned int m_x = 0; m_x < this->imageWidth; m_x++)
+				m_lumaRow[m_x] = this->yuvPalette[m_pixelRows[m_sub][m_x]][0];
+		}
+
+		// Chroma is the average of each 2x2 block of pixels
+		unsigned char* m_cbRow = m_cb + (size_t)m_chromaY * m_chromaWidth;
+		unsigned char* m_crRow = m_cr + (size_t)m_chromaY * m_chromaWidth;
+		for (unsigned int m_x = 0; m_x < m_chromaWidth; m_x++)
+		{
+			const unsigned char* m_a = this->yuvPalette[m_pixelRows[0][m_x * 2]];
+			const unsigned char* m_b = this->yuvPalette[m_pixelRows[0][m_x * 2 + 1]];
+			const unsigned char* m_c = this->yuvPalette[m_pixelRows[1][m_x * 2]];
+			const unsigned char* m_d = this->yuvPalette[m_pixelRows[1][m_x * 2 + 1]];
+			m_cbRow[m_x] = (unsigned char)((m_a[1] + m_b[1] + m_c[1] + m_d[1] + 2) / 4);
+			m_crRow[m_x] = (unsigned char)((m_a[2] + m_b[2] + m_c[2] + m_d[2] + 2) / 4);
+		}
+	}
+}
+
+void FrameExporter::WriteVideoFrame(unsigned long long a_sequence, std::vector<unsigned char>& a_frame)
+{
+	std::lock_guard<std::mutex> m_lk(this->videoLock);
+	this->encodedFrames[a_sequence].swap(a_frame);
+
+	// Write everything that is next in line, the frames of slower encoders are written by whoever comes after
+	auto m_next = this->encodedFrames.find(this->nextFrameToWrite);
+	while (m_next != this->encodedFrames.end())
+	{
+		bool m_success = fwrite("FRAME\n", 1, 6, this->videoFile) == 6;
+		m_success = m_success && fwrite(m_next->second.data(), 1, m_next->second.size(), this->videoFile) == m_next->second.size();
+		if (!m_success)
+			this->writeFailed.store(true);
+		this->encodedFrames.erase(m_next);
+		this->framesWritten.fetch_add(1);
+		this->nextFrameToWrite++;
+		m_next = this->encodedFrames.find(this->nextFrameToWrite);
+	}
+}
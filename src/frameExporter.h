@@ -0,0 +1,122 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+
+#include "cell.h"
+#include "world.h"
+
+#ifndef __FRAMEEXPORTER__
+#define __FRAMEEXPORTER__
+
+enum class FrameExportFormat
+{
+	PpmSequence,	// One binary PPM image per generation
+	Y4m				// A single YUV4MPEG2 video stream, readable by ffmpeg and most players
+};
+
+// Turns every generation of a region of the world into an image, without OpenGL.
+// The exporter keeps the cell states of the region up to date from the changes of every 
+// generation, hands a copy to a pool of encoder threads that rasterize and encode it with
+// the colors from the config, while the simulation already works on the next generation.
+class FrameExporter
+{
+private:
+	struct FrameJob
+	{
+		unsigned long long sequence;
+		World::generationType generation;
+		std::vector<unsigned char> states;
+	};
+
+	World* world = nullptr;
+	unsigned int listenerId = 0;
+
+	// The exported region in cells
+	coordinatePart regionX = 0;
+	coordinatePart regionY = 0;
+	unsigned int regionWidth = 0;
+	unsigned int regionHeight = 0;
+	unsigned int cellSizeInPx = 1;
+	unsigned int imageWidth = 0;
+	unsigned int imageHeight = 0;
+
+	FrameExportFormat format = FrameExportFormat::PpmSequence;
+	std::string outputPath;
+	FILE* videoFile = nullptr;
+
+	// Cell states of the region, one byte per cell
+	std::vector<unsigned char> regionStates;
+	unsigned long long nextSequence = 0;
+
+	// The RGB and YUV color of each cell state
+	unsigned char rgbPalette[4][3];
+	unsigned char yuvPalette[4][3];
+
+	std::vector<std::thread> encoderThreads;
+	std::mutex jobsLock;
+	std::condition_variable jobsCv;
+	std::condition_variable jobsSpaceCv;
+	std::deque<FrameJob> jobs;
+	size_t maxQueuedJobs = 8;
+	bool stopEncoders = false;
+
+	// Y4m frames have to be written in order, encoded frames wait here for their turn
+	std::mutex videoLock;
+	std::map<unsigned long long, std::vector<unsigned char>> encodedFrames;
+	unsigned long long nextFrameToWrite = 0;
+
+	std::atomic<unsigned long long> framesWritten;
+	std::atomic<bool> writeFailed;
+
+public:
+	FrameExporter();
+	~FrameExporter();
+
+	bool Start(World* a_world, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height,
+		unsigned int a_cellSizeInPx, FrameExportFormat a_format, std::string a_outputPath, unsigned int a_encoderThreads);
+	// Waits until every frame is written and stops the encoders, returns false if anything failed to write
+	bool Finish();
+	unsigned long long GetFramesWritten() { return this->framesWritten.load(); };
+
+private:
+	void OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes);
+	void LoadRegionFromWorld();
+	void QueueFrame(World::generationType a_generation);
+	void EncoderThread();
+	void RasterizeRgb(const std::vector<unsigned char>& a_states, std::vector<unsigned char>* a_output);
+	void ExpandPixelRow(const std::vector<unsigned char>& a_states, unsigned int a_pixelY, unsigned char* a_output);
+	void RasterizeYuv(const std::vector<unsigned char>& a_states, std::vector<unsigned char>* a_output);
+	void WriteVideoFrame(unsigned long long a_sequence, std::vector<unsigned char>& a_frame);
+};
+
+#endif // !__FRAMEEXPORTER__
@@ -0,0 +1,337 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+#include "haloTransport.h"
+#include "socketUtils.h"
+
+// Bytes in a shared memory ring, larger messages are streamed through it
+#define HaloRingBytes (4 << 20)
+
+// Waits a little longer every time, a halo usually arrives within microseconds
+static void WaitABit(unsigned int* a_spins)
+{
+	if (*a_spins < 256)
+		std::this_thread::yield();
+	else
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	(*a_spins)++;
+}
+
+#ifndef _WIN32
+// At the start of the shared memory, zero filled by ftruncate which is a valid empty ring
+struct RingHeader
+{
+	std::atomic<uint64_t> written;
+	std::atomic<uint64_t> read;
+	std::atomic<uint32_t> closed;
+};
+
+class SharedMemoryTransport : public HaloTransport
+{
+private:
+	std::string name;
+	bool receiving;
+	int timeoutInMs;
+	void* memory = nullptr;
+	RingHeader* header = nullptr;
+	unsigned char* bytes = nullptr;
+
+public:
+	SharedMemoryTransport(std::string a_name, bool a_receiving, int a_timeoutInMs) : name(a_name), receiving(a_receiving), timeoutInMs(a_timeoutInMs) {};
+
+	~SharedMemoryTransport()
+	{
+		if (this->memory != nullptr)
+		{
+			this->Close();
+			munmap(this->memory, sizeof(RingHeader) + HaloRingBytes);
+		}
+		// Both ends have it mapped by now (or never will), the name isn't needed anymore
+		if (this->receiving)
+			shm_unlink(this->name.c_str());
+	};
+
+	bool Open()
+	{
+		// Whichever end comes first makes it, both give it the same size
+		int m_file = shm_open(this->name.c_str(), O_CREAT | O_RDWR, 0600);
+		if (m_file < 0)
+			return false;
+		size_t m_size = sizeof(RingHeader) + HaloRingBytes;
+		if (ftruncate(m_file, m_size) != 0)
+		{
+			close(m_file);
+			return false;
+		}
+		this->memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+		close(m_file);
+		if (this->memory == MAP_FAILED)
+		{
+			this->memory = nullptr;
+			return false;
+		}
+		this->header = (RingHeader*)this->memory;
+		this->bytes = (unsigned char*)this->memory + sizeof(RingHeader);
+		return true;
+	};
+
+	bool Send(const std::vector<unsigned char>& a_message) override
+	{
+		uint64_t m_size = a_message.size();
+		return this->Write(&m_size, sizeof(m_size)) && this->Write(a_message.data(), a_message.size());
+	};
+
+	bool Receive(std::vector<unsigned char>* a_message) override
+	{
+		uint64_t m_size = 0;
+		if (!this->Read(&m_size, sizeof(m_size)))
+			return false;
+		a_message->resize((size_t)m_size);
+		return this->Read(a_message->data(), a_message->size());
+	};
+
+	void Close() override
+	{
+		this->header->closed.store(1);
+	};
+
+private:
+	bool Write(const void* a_data, size_t a_size)
+	{
+		const unsigned char* m_data = (const unsigned char*)a_data;
+		unsigned int m_spins = 0;
+		while (a_size > 0)
+		{
+			uint64_t m_written = this->header->written.load(std::memory_order_relaxed);
+			uint64_t m_free = HaloRingBytes - (m_written - this->header->read.load(std::memory_order_acquire));
+			if (m_free == 0)
+			{
+				if (this->header->closed.load())
+					return false;
+				WaitABit(&m_spins);
+				continue;
+			}
+			// Up to the end of the ring at once, the rest goes to the start the next round
+			size_t m_offset = (size_t)(m_written % HaloRingBytes);
+			size_t m_count = (size_t)std::min<uint64_t>({ m_free, (uint64_t)a_size, (uint64_t)(HaloRingBytes - m_offset) });
+			memcpy(this->bytes + m_offset, m_data, m_count);
+			this->header->written.store(m_written + m_count, std::memory_order_release);
+			m_data += m_count;
+			a_size -= m_count;
+			m_spins = 0;
+		}
+		return true;
+	};
+
+	bool Read(void* a_output, size_t a_size)
+	{
+		unsigned char* m_output = (unsigned char*)a_output;
+		unsigned int m_spins = 0;
+		auto m_giveUp = std::chrono::steady_clock::now() + std::chrono::milliseconds(this->timeoutInMs);
+		while (a_size > 0)
+		{
+			uint64_t m_read = this->header->read.load(std::memory_order_relaxed);
+			uint64_t m_available = this->header->written.load(std::memory_order_acquire) - m_read;
+			if (m_available == 0)
+			{
+				if (this->header->closed.load())
+					return false;
+				// Only the first message can be late, the other side may still be starting
+				if (m_read == 0 && std::chrono::steady_clock::now() > m_giveUp)
+					return false;
+				WaitABit(&m_spins);
+				continue;
+			}
+			size_t m_offset = (size_t)(m_read % HaloRingBytes);
+			size_t m_count = (size_t)std::min<uint64_t>({ m_available, (uint64_t)a_size, (uint64_t)(HaloRingBytes - m_offset) });
+			memcpy(m_output, this->bytes + m_offset, m_count);
+			this->header->read.store(m_read + m_count, std::memory_order_release);
+			m_output += m_count;
+			a_size -= m_count;
+			m_spins = 0;
+		}
+		return true;
+	};
+};
+#endif
+
+class TcpTransport : public HaloTransport
+{
+private:
+	socketHandle listener = InvalidSocket;
+	socketHandle connection = InvalidSocket;
+	int timeoutInMs;
+
+public:
+	TcpTransport(socketHandle a_listener, socketHandle a_connection, int a_timeoutInMs) : listener(a_listener), connection(a_connection), timeoutInMs(a_timeoutInMs) {};
+
+	~TcpTransport()
+	{
+		CloseSocket(this->connection);
+		CloseSocket(this->listener);
+	};
+
+	bool Send(const std::vector<unsigned char>& a_message) override
+	{
+		uint64_t m_size = a_message.size();
+		return this->connection != InvalidSocket && SendAll(this->connection, &m_size, sizeof(m_size)) && SendAll(this->connection, a_message.data(), a_message.size());
+	};
+
+	bool Receive(std::vector<unsigned char>* a_message) override
+	{
+		// The sender connects to us after we started listening
+		if (this->connection == InvalidSocket && this->listener != InvalidSocket)
+		{
+			this->connection = AcceptConnection(this->listener, this->timeoutInMs);
+			CloseSocket(this->listener);
+			this->listener = InvalidSocket;
+		}
+		uint64_t m_size = 0;
+		if (this->connection == InvalidSocket || !ReceiveAll(this->connection, &m_size, sizeof(m_size)))
+			return false;
+		a_message->resize((size_t)m_size);
+		return ReceiveAll(this->connection, a_message->data(), a_message->size());
+	};
+
+	void Close() override
+	{
+		ShutdownSocket(this->connection);
+	};
+};
+
+static std::string GetSharedMemoryName(const TransportSettings& a_settings, unsigned int a_channel)
+{
+	return "/wireworld-" + a_settings.session + "-" + std::to_string(a_channel);
+}
+
+std::unique_ptr<HaloTransport> OpenReceivingChannel(const TransportSettings& a_settings, unsigned int a_channel, int a_timeoutInMs)
+{
+	if (a_settings.type == TransportType::Tcp)
+	{
+		InitializeSockets();
+		socketHandle m_listener = ListenOnPort((unsigned short)(a_settings.basePort + a_channel), a_settings.host != "127.0.0.1");
+		if (m_listener == InvalidSocket)
+		{
+			std::cout << "Could not listen on port " << a_settings.basePort + a_channel << std::endl;
+			return nullptr;
+		}
+		return std::unique_ptr<HaloTransport>(new TcpTransport(m_listener, InvalidSocket, a_timeoutInMs));
+	}
+#ifdef _WIN32
+	std::cout << "Shared memory channels need POSIX shared memory, use TCP" << std::endl;
+	return nullptr;
+#else
+	SharedMemoryTransport* m_transport = new SharedMemoryTransport(GetSharedMemoryName(a_settings, a_channel), true, a_timeoutInMs);
+	std::unique_ptr<HaloTransport> m_result(m_transport);
+	if (!m_transport->Open())
+		return nullptr;
+	return m_result;
+#endif
+}
+
+std::unique_ptr<HaloTransport> OpenSendingChannel(const TransportSettings& a_settings, unsigned int a_channel, int a_timeoutInMs)
+{
+	if (a_settings.type == TransportType::Tcp)
+	{
+		InitializeSockets();
+		socketHandle m_connection = ConnectToHost(a_settings.host, (unsigned short)(a_settings.basePort + a_channel), a_timeoutInMs);
+		if (m_connection == InvalidSocket)
+			return nullptr;
+		SetNoDelay(m_connection);
+		return std::unique_ptr<HaloTransport>(new TcpTransport(InvalidSocket, m_connection, a_timeoutInMs));
+	}
+#ifdef _WIN32
+	return nullptr;
+#else
+	SharedMemoryTransport* m_transport = new SharedMemoryTransport(GetSharedMemoryName(a_settings, a_channel), false, a_timeoutInMs);
+	std::unique_ptr<HaloTransport> m_result(m_transport);
+	if (!m_transport->Open())
+		return nullptr;
+	return m_result;
+#endif
+}
+
+void RemoveChannel(const TransportSettings& a_settings, unsigned int a_channel)
+{
+#ifndef _WIN32
+	if (a_settings.type == TransportType::SharedMemory)
+		shm_unlink(GetSharedMemoryName(a_settings, a_channel).c_str());
+#endif
+}
+
+void CloseChannel(const TransportSettings& a_settings, unsigned int a_channel)
+{
+#ifndef _WIN32
+	if (a_settings.type != TransportType::SharedMemory)
+		return;
+	// Only a channel that is there, a new one would be closed before its ends ever open it
+	int m_file = shm_open(GetSharedMemoryName(a_settings, a_channel).c_str(), O_RDWR, 0600);
+	if (m_file < 0)
+		return;
+	size_t m_size = sizeof(RingHeader) + HaloRingBytes;
+	void* m_memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+	close(m_file);
+	if (m_memory == MAP_FAILED)
+		return;
+	((RingHeader*)m_memory)->closed.store(1);
+	munmap(m_memory, m_size);
+#endif
+}
+
+const char* GetTransportName(TransportType a_type)
+{
+	switch (a_type)
+	{
+	case TransportType::SharedMemory:
+		return "shm";
+	case TransportType::Tcp:
+		return "tcp";
+	}
+	return "unknown";
+}
+
+bool ParseTransportType(const std::string& a_name, TransportType* a_type)
+{
+	if (a_name == "shm")
+		*a_type = TransportType::SharedMemory;
+	else if (a_name == "tcp")
+		*a_type = TransportType::Tcp;
+	else
+		return false;
+	return true;
+}
@@ -0,0 +1,73 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+#include <memory>
+
+#ifndef __HALOTRANSPORT__
+#define __HALOTRANSPORT__
+
+// Shared memory only between processes on one machine, TCP also across machines
+enum class TransportType
+{
+	SharedMemory, // A POSIX shared memory ring per channel
+	Tcp // A TCP connection per channel, port basePort + channel
+};
+
+// Where the channels of one run are found, the same for every process of the run
+struct TransportSettings
+{
+	TransportType type = TransportType::SharedMemory;
+	std::string session; // Names the shared memory of this run
+	std::string host = "127.0.0.1";
+	unsigned short basePort = 47000;
+};
+
+// One way from one process to another, messages arrive whole and in the order they were sent
+class HaloTransport
+{
+public:
+	virtual ~HaloTransport() {};
+	// Both block until done, false when the other side closed or the channel broke
+	virtual bool Send(const std::vector<unsigned char>& a_message) = 0;
+	virtual bool Receive(std::vector<unsigned char>* a_message) = 0;
+	// Makes the other side stop waiting
+	virtual void Close() = 0;
+};
+
+// Open the receiving end first, it makes the ring or listens on the port. The sending end waits up
+// to a_timeoutInMs for the receiver, the receiver waits that long for the sender on its first Receive.
+std::unique_ptr<HaloTransport> OpenReceivingChannel(const TransportSettings& a_settings, unsigned int a_channel, int a_timeoutInMs);
+std::unique_ptr<HaloTransport> OpenSendingChannel(const TransportSettings& a_settings, unsigned int a_channel, int a_timeoutInMs);
+// Removes what is left of a channel after a run (the shared memory name)
+void RemoveChannel(const TransportSettings& a_settings, unsigned int a_channel);
+// Makes both ends of a channel stop waiting, from a process that isn't one of them. Only shared memory
+// needs it, a TCP connection already breaks when the process on the other side dies.
+void CloseChannel(const TransportSettings& a_settings, unsigned int a_channel);
+
+const char* GetTransportName(TransportType a_type);
+bool ParseTransportType(const std::string& a_name, TransportType* a_type);
+
+#endif // !__HALOTRANSPORT__
@@ -0,0 +1,550 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+
+#include "headless.h"
+#include "world.h"
+#include "frameExporter.h"
+#include "fileUtils.h"
+#include "profiler.h"
+#include "lockStats.h"
+#include "batchRunner.h"
+#include "domainCoordinator.h"
+#include "domainWorker.h"
+#include "simulationServer.h"
+
+static void PrintUsage()
+{
+	std::cout << "Usage:" << std::endl;
+	std::cout << "  --export <world.csv> --out <file or folder> --generations <count>" << std::endl;
+	std::cout << "      [--format ppm|y4m] [--region <x> <y> <width> <height>] [--cell-size <px>] [--threads <count>]" << std::endl;
+	std::cout << "      [--profile <trace.json>] [--metrics <file.jsonl or file.csv>] [--metrics-interval <seconds>]" << std::endl;
+	std::cout << "      [--lock-stats <file.csv>] [--sim-threads <count>] [--pin] [--node-local]" << std::endl;
+	std::cout << "  Without a region the whole world is exported. --threads is for writing the frames," << std::endl;
+	std::cout << "  --sim-threads for the simulation, --pin and --node-local place those on the processors." << std::endl;
+	std::cout << "  --batch <list.txt> --out <results.csv> [--generations <count>] [--threads <count>]" << std::endl;
+	std::cout << "      [--base <world.csv>] [--keep-idle] [--bit-sliced] [--probe <x> <y>]..." << std::endl;
+	std::cout << "  Runs every world file in the list on one pool of threads, with --base every file is laid" << std::endl;
+	std::cout << "  over the base world as a variant. Worlds without electrons stop early unless --keep-idle." << std::endl;
+	std::cout << "  --bit-sliced runs the variants of the base many at once, every probe adds the number of" << std::endl;
+	std::cout << "  generations that cell was a head to the results." << std::endl;
+	std::cout << "  --domains <columns> <rows> --world <world.csv> --generations <count> [--transport shm|tcp]" << std::endl;
+	std::cout << "      [--port <first port>] [--out <world.csv>] [--stats <file.csv>] [--stats-interval <generations>]" << std::endl;
+	std::cout << "  Splits the world in a grid of domains that each run in their own process and exchange the" << std::endl;
+	std::cout << "  cells along their borders every generation, over shared memory or TCP on this machine." << std::endl;
+	std::cout << "  --serve <world.csv> [--port <port>] [--any-interface] [--speed <generations per second>]" << std::endl;
+	std::cout << "      [--generations <count>] [--sim-threads <count>]" << std::endl;
+	std::cout << "  Runs the world and streams the changes in view to every viewer that connects, viewers can" << std::endl;
+	std::cout << "  edit the world. Without --speed it runs as fast as it can, without --generations forever." << std::endl;
+}
+
+static int RunExport(int argc, char** argv)
+{
+	std::string m_worldFile;
+	std::string m_output;
+	std::string m_profilePath;
+	std::string m_metricsPath;
+	std::string m_lockStatsPath;
+	float m_metricsInterval = 1.0f;
+	unsigned long long m_generations = 0;
+	FrameExportFormat m_format = FrameExportFormat::PpmSequence;
+	bool m_hasRegion = false;
+	coordinatePart m_regionX = 0;
+	coordinatePart m_regionY = 0;
+	unsigned int m_regionWidth = 0;
+	unsigned int m_regionHeight = 0;
+	unsigned int m_cellSize = 1;
+	unsigned int m_threads = std::max(std::thread::hardware_concurrency() / 2, 1u);
+	World::ThreadOptions m_threadOptions;
+
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		std::string m_name = argv[m_arg];
+		int m_left = argc - m_arg - 1;
+		if (m_name == "--export" && m_left >= 1)
+			m_worldFile = argv[++m_arg];
+		else if (m_name == "--out" && m_left >= 1)
+			m_output = argv[++m_arg];
+		else if (m_name == "--generations" && m_left >= 1)
+			m_generations = strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--format" && m_left >= 1)
+			m_format = strcmp(argv[++m_arg], "y4m") == 0 ? FrameExportFormat::Y4m : FrameExportFormat::PpmSequence;
+		else if (m_name == "--cell-size" && m_left >= 1)
+			m_cellSize = (unsigned int)atoi(argv[++m_arg]);
+		else if (m_name == "--threads" && m_left >= 1)
+			m_threads = (unsigned int)atoi(argv[++m_arg]);
+		else if (m_name == "--profile" && m_left >= 1)
+			m_profilePath = argv[++m_arg];
+		else if (m_name == "--metrics" && m_left >= 1)
+			m_metricsPath = argv[++m_arg];
+		else if (m_name == "--metrics-interval" && m_left >= 1)
+			m_metricsInterval = (float)atof(argv[++m_arg]);
+		else if (m_name == "--lock-stats" && m_left >= 1)
+			m_lockStatsPath = argv[++m_arg];
+		else if (m_name == "--sim-threads" && m_left >= 1)
+			m_threadOptions.threads = (unsigned int)atoi(argv[++m_arg]);
+		else if (m_name == "--pin")
+			m_threadOptions.pinThreads = true;
+		else if (m_name == "--node-local")
+		{
+			m_threadOptions.pinThreads = true;
+			m_threadOptions.nodeLocalCells = true;
+		}
+		else if (m_name == "--region" && m_left >= 4)
+		{
+			m_hasRegion = true;
+			m_regionX = strtoll(argv[++m_arg], nullptr, 10);
+			m_regionY = strtoll(argv[++m_arg], nullptr, 10);
+			m_regionWidth = (unsigned int)atoi(argv[++m_arg]);
+			m_regionHeight = (unsigned int)atoi(argv[++m_arg]);
+		}
+		else
+		{
+			std::cout << "Unknown or incomplete argument: " << m_name << std::endl;
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (m_worldFile.empty() || m_output.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+	if (m_format == FrameExportFormat::PpmSequence && !CreateDirectoryIfMissing(m_output))
+	{
+		std::cout << "Could not create the output folder " << m_output << std::endl;
+		return 1;
+	}
+
+	World m_world(m_threadOptions);
+	m_world.Open(m_worldFile);
+
+	if (!m_hasRegion)
+	{
+		// Use the bounding box of all cells
+		std::vector<CellSnapshot> m_cells;
+		World::generationType m_generation;
+		m_world.TakeSnapshot(&m_cells, &m_generation);
+		if (m_cells.empty())
+		{
+			std::cout << "The world " << m_worldFile << " has no cells" << std::endl;
+			return 1;
+		}
+		coordinatePart m_minX = m_cells[0].x, m_maxX = m_cells[0].x;
+		coordinatePart m_minY = m_cells[0].y, m_maxY = m_cells[0].y;
+		for (const CellSnapshot& m_cell : m_cells)
+		{
+			m_minX = std::min(m_minX, m_cell.x);
+			m_maxX = std::max(m_maxX, m_cell.x);
+			m_minY = std::min(m_minY, m_cell.y);
+			m_maxY = std::max(m_maxY, m_cell.y);
+		}
+		m_regionX = m_minX;
+		m_regionY = m_minY;
+		m_regionWidth = (unsigned int)(m_maxX - m_minX + 1);
+		m_regionHeight = (unsigned int)(m_maxY - m_minY + 1);
+	}
+
+	FrameExporter m_exporter;
+	if (!m_exporter.Start(&m_world, m_regionX, m_regionY, m_regionWidth, m_regionHeight, m_cellSize, m_format, m_output, m_threads))
+	{
+		std::cout << "Could not open " << m_output << std::endl;
+		return 1;
+	}
+
+	// CSV when the file name asks for it, JSON lines otherwise
+	if (!m_metricsPath.empty())
+	{
+		bool m_csv = m_metricsPath.size() >= 4 && m_metricsPath.compare(m_metricsPath.size() - 4, 4, ".csv") == 0;
+		if (!m_world.StartMetricsStream(m_metricsPath, m_csv ? World::MetricsFormat::Csv : World::MetricsFormat::JsonLines, m_metricsInterval))
+			std::cout << "Could not open " << m_metricsPath << " for the metrics" << std::endl;
+	}
+
+	auto m_start = std::chrono::steady_clock::now();
+	for (unsigned long long m_generation = 0; m_generation < m_generations; m_generation++)
+		m_world.UpdateSimulationWithSingleGeneration();
+	bool m_success = m_exporter.Finish();
+	m_world.StopMetricsStream();
+	double m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+
+	std::cout << "Exported " << m_exporter.GetFramesWritten() << " frames of " << m_regionWidth << "x" << m_regionHeight
+		<< " cells in " << m_seconds << "s (" << (m_seconds > 0 ? m_exporter.GetFramesWritten() / m_seconds : 0) << " frames/s)" << std::endl;
+	if (!m_success)
+		std::cout << "Not every frame could be written" << std::endl;
+	if (m_world.GetPinFailures() > 0)
+		std::cout << m_world.GetPinFailures() << " of the " << m_world.GetSimulationThreadCount() << " simulation threads could not be pinned" << std::endl;
+
+	// Where the time went, for about:tracing or Perfetto
+	if (!m_profilePath.empty())
+	{
+		if (!Profiler::IsEnabled())
+			std::cout << "Built without ENABLE_PROFILER, the profile has no zones" << std::endl;
+		if (!Profiler::WriteChromeTrace(m_profilePath))
+			std::cout << "Could not write the profile to " << m_profilePath << std::endl;
+	}
+	if (!m_lockStatsPath.empty() && !LockSite::WriteCsv(m_lockStatsPath))
+		std::cout << "Could not write the lock statistics to " << m_lockStatsPath << std::endl;
+	return m_success ? 0 : 1;
+}
+
+static std::string GetFileName(const std::string& a_path)
+{
+	size_t m_nameStart = a_path.find_last_of("/\\");
+	return m_nameStart == std::string::npos ? a_path : a_path.substr(m_nameStart + 1);
+}
+
+static int RunBatch(int argc, char** argv)
+{
+	std::string m_listFile;
+	std::string m_output;
+	std::string m_baseFile;
+	unsigned long long m_generations = 0;
+	unsigned int m_threads = 0;
+	bool m_keepIdle = false;
+	bool m_bitSliced = false;
+	std::vector<std::pair<coordinatePart, coordinatePart>> m_probes;
+
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		std::string m_name = argv[m_arg];
+		int m_left = argc - m_arg - 1;
+		if (m_name == "--batch" && m_left >= 1)
+			m_listFile = argv[++m_arg];
+		else if (m_name == "--out" && m_left >= 1)
+			m_output = argv[++m_arg];
+		else if (m_name == "--base" && m_left >= 1)
+			m_baseFile = argv[++m_arg];
+		else if (m_name == "--generations" && m_left >= 1)
+			m_generations = strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--threads" && m_left >= 1)
+			m_threads = (unsigned int)atoi(argv[++m_arg]);
+		else if (m_name == "--keep-idle")
+			m_keepIdle = true;
+		else if (m_name == "--bit-sliced")
+			m_bitSliced = true;
+		else if (m_name == "--probe" && m_left >= 2)
+		{
+			coordinatePart m_x = strtoll(argv[++m_arg], nullptr, 10);
+			coordinatePart m_y = strtoll(argv[++m_arg], nullptr, 10);
+			m_probes.push_back(std::make_pair(m_x, m_y));
+		}
+		else
+		{
+			std::cout << "Unknown or incomplete argument: " << m_name << std::endl;
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (m_listFile.empty() || m_output.empty() || (m_generations == 0 && m_keepIdle))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	std::ifstream m_list(m_listFile, std::ios::in);
+	if (!m_list.is_open())
+	{
+		std::cout << "Could not open " << m_listFile << std::endl;
+		return 1;
+	}
+
+	// The base is read once and shared by all variants
+	std::shared_ptr<const std::vector<CellSnapshot>> m_base;
+	if (!m_baseFile.empty())
+	{
+		m_base = BatchRunner::LoadBase(m_baseFile);
+		if (m_base->empty())
+		{
+			std::cout << "The base world " << m_baseFile << " has no cells" << std::endl;
+			return 1;
+		}
+	}
+
+	BatchRunner m_runner(m_threads);
+	m_runner.SetStopWhenIdle(!m_keepIdle);
+	m_runner.SetEngine(m_bitSliced ? BatchEngine::BitSliced : BatchEngine::Map);
+	for (const auto& m_probe : m_probes)
+		m_runner.AddProbe(m_probe.first, m_probe.second);
+	std::string m_line;
+	while (std::getline(m_list, m_line))
+	{
+		if (!m_line.empty() && m_line.back() == '\r')
+			m_line.pop_back();
+		if (m_line.empty())
+			continue;
+		BatchJob m_job;
+		m_job.name = GetFileName(m_line);
+		m_job.generations = m_generations;
+		if (m_base)
+		{
+			m_job.baseCells = m_base;
+			m_job.overlay = BatchRunner::LoadOverlay(m_line);
+		}
+		else
+			m_job.worldFile = m_line;
+		m_runner.Add(std::move(m_job));
+	}
+
+	auto m_start = std::chrono::steady_clock::now();
+	const std::vector<BatchResult>& m_results = m_runner.Run();
+	double m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+	std::cout << "Ran " << m_results.size() << " worlds on " << m_runner.GetPoolThreadCount() << " threads in " << m_seconds << "s" << std::endl;
+	if (!m_runner.WriteResults(m_output))
+	{
+		std::cout << "Could not write " << m_output << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+static int RunDomains(int argc, char** argv)
+{
+	std::string m_worldFile;
+	std::string m_output;
+	std::string m_statsPath;
+	unsigned int m_columns = 0;
+	unsigned int m_rows = 0;
+	unsigned long long m_generations = 0;
+	unsigned long long m_statsInterval = 0;
+	TransportSettings m_settings;
+
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		std::string m_name = argv[m_arg];
+		int m_left = argc - m_arg - 1;
+		if (m_name == "--domains" && m_left >= 2)
+		{
+			m_columns = (unsigned int)atoi(argv[++m_arg]);
+			m_rows = (unsigned int)atoi(argv[++m_arg]);
+		}
+		else if (m_name == "--world" && m_left >= 1)
+			m_worldFile = argv[++m_arg];
+		else if (m_name == "--out" && m_left >= 1)
+			m_output = argv[++m_arg];
+		else if (m_name == "--stats" && m_left >= 1)
+			m_statsPath = argv[++m_arg];
+		else if (m_name == "--generations" && m_left >= 1)
+			m_generations = strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--stats-interval" && m_left >= 1)
+			m_statsInterval = strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--port" && m_left >= 1)
+			m_settings.basePort = (unsigned short)atoi(argv[++m_arg]);
+		else if (m_name == "--transport" && m_left >= 1 && ParseTransportType(argv[m_arg + 1], &m_settings.type))
+			m_arg++;
+		else
+		{
+			std::cout << "Unknown or incomplete argument: " << m_name << std::endl;
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (m_columns == 0 || m_rows == 0 || m_worldFile.empty() || m_generations == 0)
+	{
+		PrintUsage();
+		return 1;
+	}
+	if (!FileExists(m_worldFile))
+	{
+		std::cout << "Could not open " << m_worldFile << std::endl;
+		return 1;
+	}
+	std::ofstream m_stats;
+	if (!m_statsPath.empty())
+	{
+		m_stats.open(m_statsPath, std::ios::out | std::ios::trunc);
+		if (!m_stats.is_open())
+		{
+			std::cout << "Could not open " << m_statsPath << std::endl;
+			return 1;
+		}
+		m_stats << "generation,heads,tails,conductors,cells,workSeconds,haloSeconds,haloBytes" << std::endl;
+	}
+
+	DomainCoordinator m_coordinator(m_columns, m_rows, m_settings, argv[0]);
+	if (!m_coordinator.Load(m_worldFile))
+	{
+		std::cout << "Could not start the domains" << std::endl;
+		return 1;
+	}
+	std::cout << "Running " << m_coordinator.GetDomainCount() << " domains over " << GetTransportName(m_settings.type) << std::endl;
+
+	// Without statistics in between the domains run all generations in one go
+	if (m_statsInterval == 0 || m_statsPath.empty())
+		m_statsInterval = m_generations;
+	auto m_start = std::chrono::steady_clock::now();
+	DomainStats m_total;
+	for (unsigned long long m_done = 0; m_done < m_generations;)
+	{
+		unsigned long long m_step = std::min(m_statsInterval, m_generations - m_done);
+		if (!m_coordinator.Step(m_step, &m_total))
+		{
+			std::cout << "A domain stopped after generation " << m_done << std::endl;
+			return 1;
+		}
+		m_done += m_step;
+		if (m_stats.is_open())
+		{
+			m_stats << m_total.generation << "," << m_total.heads << "," << m_total.tails << "," << m_total.conductors << "," << m_total.cells << ","
+				<< m_total.workSeconds << "," << m_total.haloSeconds << "," << m_total.haloBytes << std::endl;
+		}
+	}
+	double m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+	std::cout << "Ran " << m_generations << " generations of " << m_total.cells << " cells in " << m_seconds << "s" << std::endl;
+
+	if (!m_output.empty() && !m_coordinator.Save(m_output))
+	{
+		std::cout << "Could not write " << m_output << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Started by RunDomains for every domain, not meant to be started by hand
+static int RunDomainWorker(int argc, char** argv)
+{
+	unsigned int m_index = 0;
+	unsigned int m_domains = 0;
+	TransportSettings m_settings;
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		std::string m_name = argv[m_arg];
+		int m_left = argc - m_arg - 1;
+		if (m_name == "--domain-worker" && m_left >= 2)
+		{
+			m_index = (unsigned int)atoi(argv[++m_arg]);
+			m_domains = (unsigned int)atoi(argv[++m_arg]);
+		}
+		else if (m_name == "--session" && m_left >= 1)
+			m_settings.session = argv[++m_arg];
+		else if (m_name == "--host" && m_left >= 1)
+			m_settings.host = argv[++m_arg];
+		else if (m_name == "--port" && m_left >= 1)
+			m_settings.basePort = (unsigned short)atoi(argv[++m_arg]);
+		else if (m_name == "--transport" && m_left >= 1 && ParseTransportType(argv[m_arg + 1], &m_settings.type))
+			m_arg++;
+		else
+			return 1;
+	}
+	if (m_index >= m_domains)
+		return 1;
+	DomainWorker m_worker(m_index, m_domains, m_settings);
+	return m_worker.Run();
+}
+
+static int RunServer(int argc, char** argv)
+{
+	std::string m_worldFile;
+	unsigned short m_port = ServerDefaultPort;
+	bool m_anyInterface = false;
+	double m_speed = 0;
+	unsigned long long m_generations = 0;
+	World::ThreadOptions m_threadOptions;
+
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		std::string m_name = argv[m_arg];
+		int m_left = argc - m_arg - 1;
+		if (m_name == "--serve" && m_left >= 1)
+			m_worldFile = argv[++m_arg];
+		else if (m_name == "--port" && m_left >= 1)
+			m_port = (unsigned short)atoi(argv[++m_arg]);
+		else if (m_name == "--any-interface")
+			m_anyInterface = true;
+		else if (m_name == "--speed" && m_left >= 1)
+			m_speed = atof(argv[++m_arg]);
+		else if (m_name == "--generations" && m_left >= 1)
+			m_generations = strtoull(argv[++m_arg], nullptr, 10);
+		else if (m_name == "--sim-threads" && m_left >= 1)
+			m_threadOptions.threads = (unsigned int)atoi(argv[++m_arg]);
+		else
+		{
+			std::cout << "Unknown or incomplete argument: " << m_name << std::endl;
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (m_worldFile.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+	if (!FileExists(m_worldFile))
+	{
+		std::cout << "Could not open " << m_worldFile << std::endl;
+		return 1;
+	}
+
+	World m_world(m_threadOptions);
+	m_world.Open(m_worldFile);
+	SimulationServer m_server;
+	if (!m_server.Start(&m_world, m_port, m_anyInterface))
+	{
+		std::cout << "Could not listen on port " << m_port << std::endl;
+		return 1;
+	}
+	std::cout << "Serving " << m_worldFile << " on port " << m_server.GetPort() << std::endl;
+
+	auto m_start = std::chrono::steady_clock::now();
+	for (unsigned long long m_generation = 0; m_generations == 0 || m_generation < m_generations; m_generation++)
+	{
+		m_world.UpdateSimulationWithSingleGeneration();
+		if (m_speed > 0)
+			std::this_thread::sleep_until(m_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((m_generation + 1) / m_speed)));
+	}
+	m_server.Stop();
+	std::cout << "Sent " << m_server.GetFramesSent() << " frames (" << m_server.GetBytesSent() << " bytes), skipped " << m_server.GetGenerationsSkipped()
+		<< " generations for slow viewers, received " << m_server.GetEditsReceived() << " edits" << std::endl;
+	return 0;
+}
+
+int RunHeadless(int argc, char** argv)
+{
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		if (strcmp(argv[m_arg], "--export") == 0)
+			return RunExport(argc, argv);
+		if (strcmp(argv[m_arg], "--batch") == 0)
+			return RunBatch(argc, argv);
+		if (strcmp(argv[m_arg], "--domains") == 0)
+			return RunDomains(argc, argv);
+		if (strcmp(argv[m_arg], "--domain-worker") == 0)
+			return RunDomainWorker(argc, argv);
+		if (strcmp(argv[m_arg], "--serve") == 0)
+			return RunServer(argc, argv);
+	}
+	PrintUsage();
+	return 0;
+}
@@ -0,0 +1,52 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <cstring>
+
+#ifndef __HEADLESS__
+#define __HEADLESS__
+
+// The program without GLFW or OpenGL, next to the app which hands it the runs without a window
+#ifdef _WIN32
+#define HeadlessProgramName "headless.exe"
+#else
+#define HeadlessProgramName "headless"
+#endif
+
+// Returns true when the arguments ask for a run without a window
+inline bool IsHeadlessRun(int argc, char** argv)
+{
+	for (int m_arg = 1; m_arg < argc; m_arg++)
+	{
+		if (strcmp(argv[m_arg], "--export") == 0 || strcmp(argv[m_arg], "--batch") == 0 || strcmp(argv[m_arg], "--help") == 0 ||
+			strcmp(argv[m_arg], "--domains") == 0 || strcmp(argv[m_arg], "--domain-worker") == 0 || strcmp(argv[m_arg], "--serve") == 0)
+			return true;
+	}
+	return false;
+}
+
+// Runs the simulator without a window or OpenGL context, returns the exit code. Only in the headless program.
+int RunHeadless(int argc, char** argv);
+
+#endif // !__HEADLESS__
@@ -1,5 +1,5 @@
 /*
-MIT License 
+MIT License
 
 Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
 
@@ -22,32 +22,12 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 
 */
+#include "headless.h"
+#include "profiler.h"
 
-#include "cell.h"
-#include "coordinateType.h"
-#include "config.h"
-
-void Cell::InitRender(Shader a_shader)
+// Exports, batch runs, domains and the server, without GLFW or OpenGL so it runs on machines without a display
+int main(int argc, char** argv)
 {
-	this->shader = a_shader;
+	PROFILE_THREAD("main");
+	return RunHeadless(argc, argv);
 }
-
-void Cell::Render(int a_cellSizeInPx, coordinatePart a_scrollOffsetX, coordinatePart a_scrollOffsetY, glm::vec2* a_offset, glm::vec3* a_color)
-{	
-	// Give the cell the appropriate color based on the cell state
-	switch (this->cellState)
-	{
-	case CellState::Conductor:
-		*a_color = Config::instance->conductorColor;
-		break;
-	case CellState::Head:
-		*a_color = Config::instance->headColor;
-		break;
-	case CellState::Tail:
-		*a_color = Config::instance->tailColor;
-		break;
-	}
-
-	a_offset->x = (this->x + a_scrollOffsetX) * a_cellSizeInPx;
-	a_offset->y = (this->y + a_scrollOffsetY) * a_cellSizeInPx;
-}
\ No newline at end of file
@@ -49,7 +49,9 @@ Page* HomePage::Run()
 
 	while (!this->closeThisPage && !glfwWindowShouldClose(this->window))
 	{
-		glfwPollEvents();
+		// Nothing on this page moves by itself, so only input makes it draw
+		if (!this->WaitForFrame(false, IdleWaitTimeoutInSeconds))
+			continue;
 
 		// Clear the screen
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
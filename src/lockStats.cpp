@@ -0,0 +1,127 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <mutex>
+#include <cstdio>
+
+#include "lockStats.h"
+#include "fileUtils.h"
+
+// Function statics, so sites in other files can register before main
+static std::mutex& GetRegistryLock()
+{
+	static std::mutex s_lock;
+	return s_lock;
+}
+
+static std::vector<LockSite*>& GetRegistry()
+{
+	static std::vector<LockSite*> s_registry;
+	return s_registry;
+}
+
+static void StoreMax(std::atomic<unsigned long long>& a_max, unsigned long long a_value)
+{
+	unsigned long long m_current = a_max.load(std::memory_order_relaxed);
+	while (a_value > m_current && !a_max.compare_exchange_weak(m_current, a_value, std::memory_order_relaxed));
+}
+
+LockSite::LockSite(const char* a_lockName, const char* a_siteName) : lockName(a_lockName), siteName(a_siteName)
+{
+	this->acquisitions.store(0);
+	this->contentions.store(0);
+	this->waitNs.store(0);
+	this->maxWaitNs.store(0);
+	this->holdNs.store(0);
+	this->maxHoldNs.store(0);
+	std::lock_guard<std::mutex> m_lk(GetRegistryLock());
+	GetRegistry().push_back(this);
+}
+
+void LockSite::RecordAcquire(unsigned long long a_waitNs, bool a_contended)
+{
+	this->acquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (a_contended)
+	{
+		this->contentions.fetch_add(1, std::memory_order_relaxed);
+		this->waitNs.fetch_add(a_waitNs, std::memory_order_relaxed);
+		StoreMax(this->maxWaitNs, a_waitNs);
+	}
+}
+
+void LockSite::RecordRelease(unsigned long long a_holdNs)
+{
+	this->holdNs.fetch_add(a_holdNs, std::memory_order_relaxed);
+	StoreMax(this->maxHoldNs, a_holdNs);
+}
+
+void LockSite::GetAll(std::vector<LockSiteStats>* a_output)
+{
+	a_output->clear();
+	std::lock_guard<std::mutex> m_lk(GetRegistryLock());
+	for (LockSite* m_site : GetRegistry())
+	{
+		a_output->push_back(LockSiteStats{ m_site->lockName, m_site->siteName,
+			m_site->acquisitions.load(std::memory_order_relaxed), m_site->contentions.load(std::memory_order_relaxed),
+			m_site->waitNs.load(std::memory_order_relaxed), m_site->maxWaitNs.load(std::memory_order_relaxed),
+			m_site->holdNs.load(std::memory_order_relaxed), m_site->maxHoldNs.load(std::memory_order_relaxed) });
+	}
+}
+
+void LockSite::ResetAll()
+{
+	std::lock_guard<std::mutex> m_lk(GetRegistryLock());
+	for (LockSite* m_site : GetRegistry())
+	{
+		m_site->acquisitions.store(0);
+		m_site->contentions.store(0);
+		m_site->waitNs.store(0);
+		m_site->maxWaitNs.store(0);
+		m_site->holdNs.store(0);
+		m_site->maxHoldNs.store(0);
+	}
+}
+
+bool LockSite::WriteCsv(std::string a_filePath)
+{
+	std::vector<LockSiteStats> m_sites;
+	LockSite::GetAll(&m_sites);
+
+	std::string m_tempPath = a_filePath + ".tmp";
+	FILE* m_out = fopen(m_tempPath.c_str(), "wb");
+	if (m_out == nullptr)
+		return false;
+	bool m_success = fputs("lock,site,acquisitions,contentions,waitNs,maxWaitNs,holdNs,maxHoldNs\n", m_out) >= 0;
+	for (const LockSiteStats& m_site : m_sites)
+	{
+		m_success = m_success && fprintf(m_out, "%s,%s,%llu,%llu,%llu,%llu,%llu,%llu\n", m_site.lockName.c_str(), m_site.siteName.c_str(),
+			m_site.acquisitions, m_site.contentions, m_site.waitNs, m_site.maxWaitNs, m_site.holdNs, m_site.maxHoldNs) > 0;
+	}
+	m_success = SyncAndCloseFile(m_out) && m_success;
+	if (m_success)
+		m_success = ReplaceFileWith(a_filePath, m_tempPath);
+	else
+		std::remove(m_tempPath.c_str());
+	return m_success;
+}
@@ -0,0 +1,173 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifndef __LOCK_STATS__
+#define __LOCK_STATS__
+
+// A copy of the counters of one LockSite
+struct LockSiteStats
+{
+	std::string lockName;
+	std::string siteName;
+	unsigned long long acquisitions;
+	unsigned long long contentions;	// Acquisitions that had to wait for another thread
+	unsigned long long waitNs;
+	unsigned long long maxWaitNs;
+	unsigned long long holdNs;
+	unsigned long long maxHoldNs;
+};
+
+// One place in the code where a lock is taken. Sites live as long as the program and are shared by every world.
+class LockSite
+{
+public:
+	const char* lockName;
+	const char* siteName;
+	std::atomic<unsigned long long> acquisitions;
+	std::atomic<unsigned long long> contentions;
+	std::atomic<unsigned long long> waitNs;
+	std::atomic<unsigned long long> maxWaitNs;
+	std::atomic<unsigned long long> holdNs;
+	std::atomic<unsigned long long> maxHoldNs;
+
+	// Both names have to be string literals, only the pointers are kept
+	LockSite(const char* a_lockName, const char* a_siteName);
+
+	void RecordAcquire(unsigned long long a_waitNs, bool a_contended);
+	void RecordRelease(unsigned long long a_holdNs);
+
+	static unsigned long long GetTimeNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	};
+	static void GetAll(std::vector<LockSiteStats>* a_output);
+	static void ResetAll();
+	// Writes every site as a CSV row, returns false when the file couldn't be written
+	static bool WriteCsv(std::string a_filePath);
+};
+
+// Takes a_mutex exclusively like std::unique_lock and records the wait and hold time at a_site
+template <class Mutex>
+class TimedLock
+{
+private:
+	Mutex& mutex;
+	LockSite& site;
+	unsigned long long lockedAt = 0;
+	unsigned long long lastWaitNs = 0;
+	bool owns = false;
+public:
+	TimedLock(Mutex& a_mutex, LockSite& a_site) : mutex(a_mutex), site(a_site)
+	{
+		this->lock();
+	};
+	~TimedLock()
+	{
+		if (this->owns)
+			this->unlock();
+	};
+	TimedLock(const TimedLock&) = delete;
+	TimedLock& operator=(const TimedLock&) = delete;
+
+	void lock()
+	{
+		// Only read the clock twice when nobody else has the lock
+		bool m_contended = !this->mutex.try_lock();
+		this->lastWaitNs = 0;
+		if (m_contended)
+		{
+			unsigned long long m_waitStart = LockSite::GetTimeNs();
+			this->mutex.lock();
+			this->lockedAt = LockSite::GetTimeNs();
+			this->lastWaitNs = this->lockedAt - m_waitStart;
+		}
+		else
+			this->lockedAt = LockSite::GetTimeNs();
+		this->owns = true;
+		this->site.RecordAcquire(this->lastWaitNs, m_contended);
+	};
+	void unlock()
+	{
+		this->site.RecordRelease(LockSite::GetTimeNs() - this->lockedAt);
+		this->owns = false;
+		this->mutex.unlock();
+	};
+	// How long the last lock had to wait for other threads
+	unsigned long long GetWaitNs() { return this->lastWaitNs; };
+};
+
+// Same as TimedLock but with a shared lock
+template <class Mutex>
+class TimedSharedLock
+{
+private:
+	Mutex& mutex;
+	LockSite& site;
+	unsigned long long lockedAt = 0;
+	unsigned long long lastWaitNs = 0;
+	bool owns = false;
+public:
+	TimedSharedLock(Mutex& a_mutex, LockSite& a_site) : mutex(a_mutex), site(a_site)
+	{
+		this->lock();
+	};
+	~TimedSharedLock()
+	{
+		if (this->owns)
+			this->unlock();
+	};
+	TimedSharedLock(const TimedSharedLock&) = delete;
+	TimedSharedLock& operator=(const TimedSharedLock&) = delete;
+
+	void lock()
+	{
+		bool m_contended = !this->mutex.try_lock_shared();
+		this->lastWaitNs = 0;
+		if (m_contended)
+		{
+			unsigned long long m_waitStart = LockSite::GetTimeNs();
+			this->mutex.lock_shared();
+			this->lockedAt = LockSite::GetTimeNs();
+			this->lastWaitNs = this->lockedAt - m_waitStart;
+		}
+		else
+			this->lockedAt = LockSite::GetTimeNs();
+		this->owns = true;
+		this->site.RecordAcquire(this->lastWaitNs, m_contended);
+	};
+	void unlock()
+	{
+		this->site.RecordRelease(LockSite::GetTimeNs() - this->lockedAt);
+		this->owns = false;
+		this->mutex.unlock_shared();
+	};
+	unsigned long long GetWaitNs() { return this->lastWaitNs; };
+};
+
+#endif // !__LOCK_STATS__
@@ -27,7 +27,14 @@ SOFTWARE.
 #include <thread>
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <vector>
 #include <direct.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 #include <glad\glad.h>
 #include <GLFW\glfw3.h>
@@ -52,6 +59,8 @@ SOFTWARE.
 #include "homepage.h"
 #include "simulatorPage.h"
 #include "resources.h"
+#include "headless.h"
+#include "profiler.h"
 
 // References.
 void Framebuffer_size_callback(GLFWwindow* a_window, int a_width, int a_height);
@@ -68,15 +77,23 @@ void MouseHover(GLFWwindow* a_window, double a_posX, double a_posY);
 void MouseClick(GLFWwindow* a_window, int a_button, int a_action, int a_mods);
 void MouseScroll(GLFWwindow* a_window, double a_xOffset, double a_yOffset);
 void KeyPress(GLFWwindow* a_window, int a_key, int a_scancode, int a_action, int a_mods);
+void WindowRefresh(GLFWwindow* a_window);
 
 void CreateResources();
+int ForwardToHeadless(int argc, char** argv);
 
 Page* nextPage = nullptr;
 int screenWidth = 1920;
 int screenHeight = 1080;
 
-int main()
+int main(int argc, char** argv)
 {
+	PROFILE_THREAD("main");
+
+	// Exports and other runs without a window never touch GLFW or OpenGL
+	if (IsHeadlessRun(argc, argv))
+		return ForwardToHeadless(argc, argv);
+
 	CreateResources();
 
 	InitGLFW();
@@ -105,6 +122,7 @@ int main()
 	glfwSetCursorPosCallback(window, MouseHover); // Catches the mouse move event
 	glfwSetScrollCallback(window, MouseScroll);
 	glfwSetKeyCallback(window, KeyPress);
+	glfwSetWindowRefreshCallback(window, WindowRefresh); // The window has to be drawn again, e.g. after being uncovered
 
 	nextPage = new HomePage(window);
 
@@ -124,6 +142,7 @@ int main()
 void Framebuffer_size_callback(GLFWwindow* a_window, int a_width, int a_height)
 {
 	nextPage->UpdateScreenSize(a_width, a_height);
+	nextPage->RequestRedraw();
 
 	// Update the view port
 	glViewport(0, 0, a_width, a_height);
@@ -244,25 +263,43 @@ unsigned int CreateVAO()
 void MouseHover(GLFWwindow* a_window, double a_posX, double a_posY)
 {
 	if (nextPage != nullptr)
+	{
+		nextPage->RequestRedraw();
 		nextPage->MouseHover(a_window, a_posX, a_posY);
+	}
 }
 
 void MouseClick(GLFWwindow* a_window, int a_button, int a_action, int a_mods)
 {
 	if (nextPage != nullptr)
+	{
+		nextPage->RequestRedraw();
 		nextPage->MouseClick(a_window, a_button, a_action, a_mods);
+	}
 }
 
 void MouseScroll(GLFWwindow* a_window, double a_xOffset, double a_yOffset)
 {
 	if (nextPage != nullptr)
+	{
+		nextPage->RequestRedraw();
 		nextPage->MouseScroll(a_window, a_xOffset, a_yOffset);
+	}
 }
 
 void KeyPress(GLFWwindow* a_window, int a_key, int a_scancode, int a_action, int a_mods)
 {
 	if (nextPage != nullptr)
+	{
+		nextPage->RequestRedraw();
 		nextPage->KeyPress(a_window, a_key, a_scancode, a_action, a_mods);
+	}
+}
+
+void WindowRefresh(GLFWwindow* a_window)
+{
+	if (nextPage != nullptr)
+		nextPage->RequestRedraw();
 }
 
 void CreateResources()
@@ -293,3 +330,36 @@ void CreateResources()
 		}
 	}
 }
+
+int ForwardToHeadless(int argc, char** argv)
+{
+	// The headless program is built next to this one
+	std::string m_program = argv[0];
+	size_t m_slash = m_program.find_last_of("/\\");
+	m_program = (m_slash == std::string::npos ? std::string() : m_program.substr(0, m_slash + 1)) + HeadlessProgramName;
+
+	std::vector<std::string> m_arguments(argv, argv + argc);
+	m_arguments[0] = m_program;
+	std::vector<char*> m_argv;
+#ifdef _WIN32
+	// The arguments are put together into one command line again, quote them so spaces survive
+	for (std::string& m_argument : m_arguments)
+		m_argument = "\"" + m_argument + "\"";
+#endif
+	for (std::string& m_argument : m_arguments)
+		m_argv.push_back(&m_argument[0]);
+	m_argv.push_back(nullptr);
+
+#ifdef _WIN32
+	intptr_t m_result = _spawnv(_P_WAIT, m_program.c_str(), m_argv.data());
+#else
+	execv(m_program.c_str(), m_argv.data());
+	int m_result = -1;
+#endif
+	if (m_result == -1)
+	{
+		std::cout << "Could not start " << m_program << std::endl;
+		return 1;
+	}
+	return (int)m_result;
+}
@@ -0,0 +1,134 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+#ifndef __MESSAGEBUFFER__
+#define __MESSAGEBUFFER__
+
+// Builds a binary message for another process or machine, numbers are little endian whatever the machine is
+class MessageWriter
+{
+public:
+	std::vector<unsigned char> data;
+
+	void Clear() { this->data.clear(); };
+	void PutU8(uint8_t a_value) { this->data.push_back(a_value); };
+	void PutU32(uint32_t a_value)
+	{
+		for (int m_byte = 0; m_byte < 4; m_byte++)
+			this->data.push_back((unsigned char)(a_value >> (m_byte * 8)));
+	};
+	void PutU64(uint64_t a_value)
+	{
+		for (int m_byte = 0; m_byte < 8; m_byte++)
+			this->data.push_back((unsigned char)(a_value >> (m_byte * 8)));
+	};
+	void PutI64(int64_t a_value) { this->PutU64((uint64_t)a_value); };
+	void PutBytes(const void* a_bytes, size_t a_size)
+	{
+		const unsigned char* m_bytes = (const unsigned char*)a_bytes;
+		this->data.insert(this->data.end(), m_bytes, m_bytes + a_size);
+	};
+	void PutString(const std::string& a_value)
+	{
+		this->PutU32((uint32_t)a_value.size());
+		this->PutBytes(a_value.data(), a_value.size());
+	};
+};
+
+// Reads what a MessageWriter wrote. Reading past the end gives zeros and sets Failed, so a broken
+// message can be read to the end and checked once.
+class MessageReader
+{
+private:
+	const unsigned char* data;
+	size_t size;
+	size_t position = 0;
+	bool failed = false;
+
+	bool Take(size_t a_size)
+	{
+		if (this->failed || this->size - this->position < a_size)
+		{
+			this->failed = true;
+			return false;
+		}
+		return true;
+	};
+
+public:
+	MessageReader(const std::vector<unsigned char>& a_message) : data(a_message.data()), size(a_message.size()) {};
+	MessageReader(const unsigned char* a_data, size_t a_size) : data(a_data), size(a_size) {};
+
+	bool Failed() { return this->failed; };
+	size_t GetRemaining() { return this->failed ? 0 : this->size - this->position; };
+	uint8_t GetU8()
+	{
+		if (!this->Take(1))
+			return 0;
+		return this->data[this->position++];
+	};
+	uint32_t GetU32()
+	{
+		if (!this->Take(4))
+			return 0;
+		uint32_t m_value = 0;
+		for (int m_byte = 0; m_byte < 4; m_byte++)
+			m_value |= (uint32_t)this->data[this->position++] << (m_byte * 8);
+		return m_value;
+	};
+	uint64_t GetU64()
+	{
+		if (!this->Take(8))
+			return 0;
+		uint64_t m_value = 0;
+		for (int m_byte = 0; m_byte < 8; m_byte++)
+			m_value |= (uint64_t)this->data[this->position++] << (m_byte * 8);
+		return m_value;
+	};
+	int64_t GetI64() { return (int64_t)this->GetU64(); };
+	bool GetBytes(void* a_output, size_t a_size)
+	{
+		if (!this->Take(a_size))
+			return false;
+		memcpy(a_output, this->data + this->position, a_size);
+		this->position += a_size;
+		return true;
+	};
+	std::string GetString()
+	{
+		uint32_t m_size = this->GetU32();
+		if (!this->Take(m_size))
+			return std::string();
+		std::string m_value((const char*)this->data + this->position, m_size);
+		this->position += m_size;
+		return m_value;
+	};
+};
+
+#endif // !__MESSAGEBUFFER__
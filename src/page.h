@@ -30,6 +30,10 @@ SOFTWARE.
 
 #ifndef __PAGE__
 #define __PAGE__
+// Frames drawn after any input, ImGui needs a few to settle hover states and popups
+#define FramesAfterInput 3
+// Longest time a page sleeps without input, so a status that changes in the background still shows up
+#define IdleWaitTimeoutInSeconds 0.5
 
 class Page
 {
@@ -42,6 +46,8 @@ public:
 protected:
 	Page* nextPage = nullptr;
 	bool closeThisPage = false;
+	// Frames that still have to be drawn before the page waits for input again
+	int framesToDraw = FramesAfterInput;
 private:
 	unsigned int lastLineNumber = 0;
 public:
@@ -59,6 +65,12 @@ public:
 		this->screenWidth = a_newWidth;
 	}
 
+	// Something on screen changed, draw it instead of waiting for input
+	void RequestRedraw()
+	{
+		this->framesToDraw = FramesAfterInput;
+	}
+
 	virtual void GetError(int a_line)
 	{
 		GLenum m_error = glGetError();
@@ -69,6 +81,25 @@ public:
 		}
 		this->lastLineNumber = a_line;
 	}
+protected:
+	// Handles the window events. Without anything to draw it sleeps until input arrives,
+	// a_timeoutInSeconds passes or another thread posts an empty event, instead of spinning.
+	// Returns true if a frame should be drawn
+	bool WaitForFrame(bool a_animating, double a_timeoutInSeconds)
+	{
+		if (a_animating || this->framesToDraw > 0)
+			glfwPollEvents();
+		else
+			glfwWaitEventsTimeout(a_timeoutInSeconds);
+
+		if (this->framesToDraw > 0)
+		{
+			this->framesToDraw--;
+			return true;
+		}
+		return a_animating;
+	}
+public:
 	virtual void MouseHover(GLFWwindow* a_window, double a_posX, double a_posY) {};
 	virtual void MouseClick(GLFWwindow* a_window, int a_button, int a_action, int a_mods) {};
 	virtual void MouseScroll(GLFWwindow* a_window, double a_xOffset, double a_yOffset) {};
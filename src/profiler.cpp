@@ -0,0 +1,165 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+
+#include "profiler.h"
+#include "fileUtils.h"
+
+std::atomic<bool> Profiler::recording{ true };
+
+static std::mutex registryLock;
+static std::vector<ProfilerThreadBuffer*> registry;
+static unsigned int nextThreadId = 1;
+
+// Hands the ring back when its thread ends, the events stay until the ring is reused
+struct ProfilerThreadHolder
+{
+	ProfilerThreadBuffer* buffer = nullptr;
+	~ProfilerThreadHolder()
+	{
+		if (this->buffer != nullptr)
+			this->buffer->inUse.store(false);
+	}
+};
+static thread_local ProfilerThreadHolder threadHolder;
+
+static ProfilerThreadBuffer* GetThreadBuffer()
+{
+	if (threadHolder.buffer != nullptr)
+		return threadHolder.buffer;
+
+	std::lock_guard<std::mutex> m_lk(registryLock);
+	ProfilerThreadBuffer* m_buffer = nullptr;
+	if (registry.size() >= ProfilerMaxThreads)
+	{
+		for (ProfilerThreadBuffer* m_candidate : registry)
+		{
+			if (!m_candidate->inUse.load())
+			{
+				m_buffer = m_candidate;
+				m_buffer->written.store(0);
+				m_buffer->inUse.store(true);
+				break;
+			}
+		}
+	}
+	if (m_buffer == nullptr)
+	{
+		// Too many threads at once, their events are not kept
+		if (registry.size() >= ProfilerMaxThreads * 2)
+			return nullptr;
+		m_buffer = new ProfilerThreadBuffer();
+		registry.push_back(m_buffer);
+	}
+	m_buffer->threadId = nextThreadId++;
+	m_buffer->threadName = "thread " + std::to_string(m_buffer->threadId);
+	threadHolder.buffer = m_buffer;
+	return m_buffer;
+}
+
+unsigned long long Profiler::GetTimeNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::Record(const char* a_name, unsigned long long a_startNs, unsigned long long a_endNs)
+{
+	ProfilerThreadBuffer* m_buffer = GetThreadBuffer();
+	if (m_buffer == nullptr)
+		return;
+
+	// Write the event first and publish it after, a reader never sees a half written event as new
+	unsigned long long m_index = m_buffer->written.load(std::memory_order_relaxed);
+	ProfileEvent& m_event = m_buffer->events[m_index % ProfilerRingSize];
+	m_event.name = a_name;
+	m_event.startNs = a_startNs;
+	m_event.durationNs = a_endNs - a_startNs;
+	m_buffer->written.store(m_index + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(std::string a_name)
+{
+	ProfilerThreadBuffer* m_buffer = GetThreadBuffer();
+	if (m_buffer == nullptr)
+		return;
+	std::lock_guard<std::mutex> m_lk(registryLock);
+	m_buffer->threadName = a_name;
+}
+
+bool Profiler::IsEnabled()
+{
+#ifdef ENABLE_PROFILER
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Profiler::WriteChromeTrace(std::string a_filePath)
+{
+	std::string m_tempPath = a_filePath + ".tmp";
+	FILE* m_file = fopen(m_tempPath.c_str(), "wb");
+	if (m_file == nullptr)
+		return false;
+
+	fprintf(m_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	bool m_first = true;
+	std::vector<ProfileEvent> m_events;
+	std::lock_guard<std::mutex> m_lk(registryLock);
+	for (ProfilerThreadBuffer* m_buffer : registry)
+	{
+		// Copy the ring, events its thread wrote over while we copied are dropped
+		unsigned long long m_end = m_buffer->written.load(std::memory_order_acquire);
+		unsigned long long m_begin = m_end > ProfilerRingSize ? m_end - ProfilerRingSize : 0;
+		m_events.clear();
+		for (unsigned long long m_index = m_begin; m_index < m_end; m_index++)
+			m_events.push_back(m_buffer->events[m_index % ProfilerRingSize]);
+		unsigned long long m_endAfterCopy = m_buffer->written.load(std::memory_order_acquire);
+		size_t m_overwritten = m_endAfterCopy > ProfilerRingSize + m_begin ? (size_t)(m_endAfterCopy - ProfilerRingSize - m_begin) : 0;
+		m_overwritten = std::min(m_overwritten, m_events.size());
+
+		fprintf(m_file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			m_first ? "" : ",\n", m_buffer->threadId, m_buffer->threadName.c_str());
+		m_first = false;
+		for (size_t m_index = m_overwritten; m_index < m_events.size(); m_index++)
+		{
+			const ProfileEvent& m_event = m_events[m_index];
+			fprintf(m_file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				m_event.name, m_buffer->threadId, m_event.startNs / 1000.0, m_event.durationNs / 1000.0);
+		}
+	}
+	fprintf(m_file, "\n]}\n");
+
+	if (!SyncAndCloseFile(m_file) || !ReplaceFileWith(a_filePath, m_tempPath))
+	{
+		remove(m_tempPath.c_str());
+		return false;
+	}
+	return true;
+}
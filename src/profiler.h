@@ -0,0 +1,103 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <atomic>
+
+#ifndef __PROFILER__
+#define __PROFILER__
+// Events kept per thread, older ones are overwritten
+#define ProfilerRingSize 65536
+// Threads that get a ring of their own, after that the rings of finished threads are reused
+#define ProfilerMaxThreads 64
+
+struct ProfileEvent
+{
+	const char* name; // Has to be a string literal, only the pointer is kept
+	unsigned long long startNs;
+	unsigned long long durationNs;
+};
+
+// The ring of a single thread. Only its own thread writes to it, so no locks are needed to record
+class ProfilerThreadBuffer
+{
+public:
+	unsigned int threadId = 0;
+	std::string threadName;
+	std::atomic<unsigned long long> written{ 0 };
+	std::atomic<bool> inUse{ true };
+	ProfileEvent events[ProfilerRingSize];
+};
+
+// Records timed zones of every thread and writes them as a Chrome trace (about:tracing or Perfetto).
+// Use the PROFILE_ macros, they compile to nothing unless ENABLE_PROFILER is defined
+class Profiler
+{
+private:
+	static std::atomic<bool> recording;
+
+public:
+	static unsigned long long GetTimeNs();
+	static void Record(const char* a_name, unsigned long long a_startNs, unsigned long long a_endNs);
+	static void SetThreadName(std::string a_name);
+	static void SetRecording(bool a_recording) { recording.store(a_recording); };
+	static bool IsRecording() { return recording.load(std::memory_order_relaxed); };
+	// Writes the events still in the rings, returns false if the file could not be written
+	static bool WriteChromeTrace(std::string a_filePath);
+	static bool IsEnabled();
+};
+
+// Records the time between its construction and destruction
+class ProfileZone
+{
+private:
+	const char* name;
+	unsigned long long startNs;
+
+public:
+	ProfileZone(const char* a_name)
+	{
+		this->name = a_name;
+		this->startNs = Profiler::IsRecording() ? Profiler::GetTimeNs() : 0;
+	}
+	~ProfileZone()
+	{
+		if (this->startNs != 0)
+			Profiler::Record(this->name, this->startNs, Profiler::GetTimeNs());
+	}
+};
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// Times the rest of the scope
+#define PROFILE_ZONE(a_name) ProfileZone PROFILE_CONCAT(m_profileZone, __LINE__)(a_name)
+// Names the current thread in the trace
+#define PROFILE_THREAD(a_name) Profiler::SetThreadName(a_name)
+#else
+#define PROFILE_ZONE(a_name)
+#define PROFILE_THREAD(a_name)
+#endif
+
+#endif // !__PROFILER__
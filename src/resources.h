@@ -76,21 +76,87 @@ void main()
 
 const std::string gridCellVertexShaderGlsl = R"(#version 330 core
 layout (location = 0) in vec2 aPos;
-layout (location = 2) in vec2 aInstanceOffset;
-layout (location = 3) in vec3 aColor;
+layout (location = 2) in ivec2 aCellPosition;
+layout (location = 3) in uint aState;
 
-uniform mat4 u_ModelMatrix;
 uniform mat4 u_ProjectionMatrix;
+uniform int u_CellSizeInPx;
+// Where the cell positions are relative to, in cells from the top left of the screen
+uniform ivec2 u_Origin;
+// Colors of a conductor, head and tail
+uniform vec3 u_Palette[3];
 out vec3 Color;
 
 void main()
 {
-	// Render cells
-	vec4 m_newPosition = u_ModelMatrix * vec4(aPos.x, aPos.y, 1.0, 1.0);
-	float m_newX = m_newPosition.x + aInstanceOffset.x;
-	float m_newY = m_newPosition.y + aInstanceOffset.y;
-	gl_Position = u_ProjectionMatrix * vec4(m_newX, m_newY, m_newPosition.z, m_newPosition.w);
-	Color = aColor;
+	vec2 m_position = (aPos + vec2(aCellPosition + u_Origin)) * float(u_CellSizeInPx);
+	gl_Position = u_ProjectionMatrix * vec4(m_position, 0.0, 1.0);
+	Color = u_Palette[min(aState, 2u)];
+})";
+
+const std::string cellTextureVertexShaderGlsl = R"(#version 330 core
+
+void main()
+{
+	// One triangle that covers the whole screen, no vertex buffer needed
+	vec2 m_position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(m_position * 2.0 - 1.0, 0.0, 1.0);
+})";
+
+const std::string cellTextureFragmentShaderGlsl = R"(#version 330 core
+out vec4 FragColor;
+
+// The visible cells, one state per texel
+uniform usampler2D u_CellStates;
+// Colors of a conductor, head and tail
+uniform vec3 u_Palette[3];
+uniform vec4 u_GridColor;
+uniform int u_CellSizeInPx;
+uniform int u_GridLineSizeInPx;
+uniform int u_ScreenHeight;
+
+void main()
+{
+	// Pixel position with the origin in the top left, like the rest of the grid
+	ivec2 m_pixel = ivec2(int(gl_FragCoord.x), u_ScreenHeight - 1 - int(gl_FragCoord.y));
+
+	// Grid lines are centered on the cell borders
+	ivec2 m_inCell = (m_pixel + u_GridLineSizeInPx / 2) % u_CellSizeInPx;
+	if (u_GridLineSizeInPx > 0 && (m_inCell.x < u_GridLineSizeInPx || m_inCell.y < u_GridLineSizeInPx))
+	{
+		FragColor = u_GridColor;
+		return;
+	}
+
+	// The texture starts one cell before the left and top of the screen
+	uint m_state = texelFetch(u_CellStates, m_pixel / u_CellSizeInPx + 1, 0).r;
+	if (m_state > 2u)
+		discard;
+	FragColor = vec4(u_Palette[m_state], 1.0);
+})";
+
+const std::string densityFragmentShaderGlsl = R"(#version 330 core
+out vec4 FragColor;
+
+// One texel per block of cells: the head fraction, tail fraction and how much of the block has cells
+uniform sampler2D u_Density;
+// Colors of a conductor, head and tail
+uniform vec3 u_Palette[3];
+uniform int u_BlockSizeInPx;
+uniform int u_ScreenHeight;
+
+void main()
+{
+	// Pixel position with the origin in the top left, like the rest of the grid
+	ivec2 m_pixel = ivec2(int(gl_FragCoord.x), u_ScreenHeight - 1 - int(gl_FragCoord.y));
+	vec4 m_density = texelFetch(u_Density, m_pixel / u_BlockSizeInPx, 0);
+	if (m_density.b <= 0.0)
+		discard;
+
+	// Mix the colors by how many of the cells have each state, sparse blocks are darker
+	float m_conductors = max(1.0 - m_density.r - m_density.g, 0.0);
+	vec3 m_color = m_density.r * u_Palette[1] + m_density.g * u_Palette[2] + m_conductors * u_Palette[0];
+	FragColor = vec4(m_color * (0.25 + 0.75 * m_density.b), 1.0);
 })";
 
 const std::string imguiIni = R"([Window][Debug##Default]
@@ -134,6 +200,9 @@ std::map<std::string, std::map<std::string, std::string>> GetResources()
 	m_shaders.emplace(std::make_pair("gridLineVertexShader.glsl", gridLineVertexShaderGlsl));
 	m_shaders.emplace(std::make_pair("gridCellFragmentShader.glsl", gridCellFragmentShaderGlsl));
 	m_shaders.emplace(std::make_pair("gridCellVertexShader.glsl", gridCellVertexShaderGlsl));
+	m_shaders.emplace(std::make_pair("cellTextureVertexShader.glsl", cellTextureVertexShaderGlsl));
+	m_shaders.emplace(std::make_pair("cellTextureFragmentShader.glsl", cellTextureFragmentShaderGlsl));
+	m_shaders.emplace(std::make_pair("densityFragmentShader.glsl", densityFragmentShaderGlsl));
 	
 	std::map<std::string, std::string> m_inRoot;
 	m_inRoot.emplace(std::make_pair("imgui.ini", imguiIni));
@@ -0,0 +1,54 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include "traceFormat.h"
+
+#ifndef __SERVERPROTOCOL__
+#define __SERVERPROTOCOL__
+
+// What a simulation server and its viewers send each other over one TCP connection.
+//
+// Every message has its size in front (see SendSizedMessage) and starts with its type.
+// A viewer sends ViewerMessage::Viewport with the region it shows: x and y (i64), width and
+// height (u32). Until it did, it gets nothing. ViewerMessage::Edit holds a count (u32) and that
+// many cells: x and y (i64) and the new state (u8), Background erases the cell.
+// The server sends frames: the TraceFrameType, the generation (u64), the number of generations
+// that were folded into this frame because the viewer was still busy with the previous one (u64),
+// the region of the frame x, y (i64), width, height (u32), the number of changes (u32) and the
+// changes encoded like a trace (EncodeCellChanges). A keyframe replaces every cell in its region,
+// a delta only holds the cells in the region that changed since the previous frame.
+// All numbers are little endian.
+
+#define ServerDefaultPort 47500
+// A bigger viewport is cut off at the bottom, that is more than a screen can show anyway
+#define ServerMaxViewportCells (16 << 20)
+#define ServerMaxMessageBytes (256 << 20)
+
+enum class ViewerMessage : unsigned char
+{
+	Viewport = 1,
+	Edit = 2
+};
+
+#endif // !__SERVERPROTOCOL__
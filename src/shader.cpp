@@ -26,90 +26,221 @@ SOFTWARE.
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "shader.h"
+#include "config.h"
+#include "fileUtils.h"
+
+unsigned int Shader::activeProgram = 0;
 
 // Sets the vertex shader of this program.
 bool Shader::SetVertexShader(std::string a_pathToShaderSourceFile)
 {
-    std::string shaderSource = this->LoadShaderSource(a_pathToShaderSourceFile);
-    this->vertexShaderSource = shaderSource.c_str();
-
-    // Create the new vertex shader.
-    this->vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-
-    // Add the shader code to the shader.
-    glShaderSource(this->vertexShaderID, 1, &this->vertexShaderSource, NULL);
-    glCompileShader(this->vertexShaderID);
-
-    if(!this->ShaderCompiled(this->vertexShaderID))
-        return false;
-
-    return true;
+    // The shader is compiled when the program is linked, unless the linked program is in the cache
+    this->vertexShaderSource = this->LoadShaderSource(a_pathToShaderSourceFile);
+    return !this->vertexShaderSource.empty();
 }
 
 bool Shader::SetFragmentShader(std::string a_pathToShaderSourceFile)
 {
-    std::string shaderSource = this->LoadShaderSource(a_pathToShaderSourceFile);
-    this->fragmentShaderSource = shaderSource.c_str();
+    this->fragmentShaderSource = this->LoadShaderSource(a_pathToShaderSourceFile);
+    return !this->fragmentShaderSource.empty();
+}
 
-    // Create the new vertex shader.
-    this->fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+unsigned int Shader::CompileShader(GLenum a_type, const std::string& a_source)
+{
+    unsigned int m_shaderId = glCreateShader(a_type);
 
     // Add the shader code to the shader.
-    glShaderSource(this->fragmentShaderID, 1, &this->fragmentShaderSource, NULL);
-    glCompileShader(this->fragmentShaderID);
+    const char* m_source = a_source.c_str();
+    glShaderSource(m_shaderId, 1, &m_source, NULL);
+    glCompileShader(m_shaderId);
 
-    if(!this->ShaderCompiled(this->fragmentShaderID))
-        return false;
-
-    return true;
+    this->ShaderCompiled(m_shaderId);
+    return m_shaderId;
 }
 
 int Shader::Compile()
 {
     this->shaderProgram = glCreateProgram();
+    this->uniformLocations.clear();
+
+    // Linking is the slow part of starting a page, skip it when this program was linked before
+    if (this->TryLoadProgramBinary())
+    {
+        this->compiledShaderProgram = true;
+        this->CacheUniformLocations();
+        return this->shaderProgram;
+    }
+
+    unsigned int m_vertexShaderId = this->CompileShader(GL_VERTEX_SHADER, this->vertexShaderSource);
+    unsigned int m_fragmentShaderId = this->CompileShader(GL_FRAGMENT_SHADER, this->fragmentShaderSource);
 
     // Attach the vertex and fragment shader.
-    glAttachShader(this->shaderProgram, this->vertexShaderID);
-    glAttachShader(this->shaderProgram, this->fragmentShaderID);
+    glAttachShader(this->shaderProgram, m_vertexShaderId);
+    glAttachShader(this->shaderProgram, m_fragmentShaderId);
+    if (this->ProgramBinariesSupported())
+        glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     
     // Compile the shader.
     glLinkProgram(this->shaderProgram);
 
-    int compiled;
-    char infoLog[512];
-
-    // Get the Compile status.
-    glGetProgramiv(this->shaderProgram, GL_LINK_STATUS, &compiled);
+    // Delete the shaders.
+    glDeleteShader(m_vertexShaderId);
+    glDeleteShader(m_fragmentShaderId);
 
-    if(!compiled)
+    if (!this->ProgramLinked())
     {
-        glGetShaderInfoLog(this->shaderProgram, 512, NULL, infoLog);
+        char infoLog[512];
+        glGetProgramInfoLog(this->shaderProgram, 512, NULL, infoLog);
         std::cerr << "ERROR: Could not compile shader program: " << infoLog << std::endl; 
     
         return -1;
     }
 
-    // Delete the shaders.
-    glDeleteShader(this->vertexShaderID);
-    glDeleteShader(this->fragmentShaderID);
-
+    this->compiledShaderProgram = true;
+    this->CacheUniformLocations();
+    this->SaveProgramBinary();
     return this->shaderProgram;
 }
 
-GLint Shader::GetUniformLocation(std::string a_uniformName)
+bool Shader::ProgramLinked()
 {
-	GLint m_location = glGetUniformLocation(this->shaderProgram, a_uniformName.c_str());
+    int m_linked = 0;
+    glGetProgramiv(this->shaderProgram, GL_LINK_STATUS, &m_linked);
+    return m_linked != 0;
+}
 
-    return m_location;
+void Shader::CacheUniformLocations()
+{
+    int m_uniformCount = 0;
+    glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &m_uniformCount);
+    for (int m_uniform = 0; m_uniform < m_uniformCount; m_uniform++)
+    {
+        char m_name[256];
+        GLsizei m_length = 0;
+        GLint m_size = 0;
+        GLenum m_type = 0;
+        glGetActiveUniform(this->shaderProgram, m_uniform, sizeof(m_name), &m_length, &m_size, &m_type, m_name);
+
+        // Arrays are reported as "name[0]", they are set by their plain name
+        std::string m_uniformName(m_name, m_length);
+        if (m_uniformName.size() > 3 && m_uniformName.compare(m_uniformName.size() - 3, 3, "[0]") == 0)
+            m_uniformName.resize(m_uniformName.size() - 3);
+        this->uniformLocations[m_uniformName] = glGetUniformLocation(this->shaderProgram, m_name);
+    }
+}
+
+GLint Shader::GetUniformLocation(const char* a_uniformName)
+{
+    auto m_location = this->uniformLocations.find(a_uniformName);
+    if (m_location == this->uniformLocations.end())
+        return -1;
+    return m_location->second;
+}
+
+bool Shader::ProgramBinariesSupported()
+{
+    // Program binaries are core since OpenGL 4.1, most drivers give us that for a 3.3 core context
+    if (!GLAD_GL_VERSION_4_1)
+        return false;
+    int m_formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &m_formatCount);
+    return m_formatCount > 0;
+}
+
+std::string Shader::GetProgramBinaryPath()
+{
+    // A binary only works on the driver that made it, so that is part of the key too
+    unsigned int m_hash = HashBytes(this->vertexShaderSource.data(), this->vertexShaderSource.size());
+    m_hash = HashBytes(this->fragmentShaderSource.data(), this->fragmentShaderSource.size(), m_hash);
+    const char* m_renderer = (const char*)glGetString(GL_RENDERER);
+    const char* m_version = (const char*)glGetString(GL_VERSION);
+    if (m_renderer != nullptr)
+        m_hash = HashBytes(m_renderer, strlen(m_renderer), m_hash);
+    if (m_version != nullptr)
+        m_hash = HashBytes(m_version, strlen(m_version), m_hash);
+
+    char m_fileName[16];
+    snprintf(m_fileName, sizeof(m_fileName), "%08x.bin", m_hash);
+    return Config::instance->shaderCacheFolder + "/" + m_fileName;
+}
+
+bool Shader::TryLoadProgramBinary()
+{
+    if (!this->ProgramBinariesSupported())
+        return false;
+
+    FILE* m_file = fopen(this->GetProgramBinaryPath().c_str(), "rb");
+    if (m_file == nullptr)
+        return false;
+
+    // The file is the binary format followed by the binary itself
+    GLenum m_format = 0;
+    std::vector<char> m_binary;
+    bool m_read = fread(&m_format, sizeof(m_format), 1, m_file) == 1;
+    if (m_read && fseek(m_file, 0, SEEK_END) == 0)
+    {
+        long m_size = ftell(m_file) - (long)sizeof(m_format);
+        if (m_size > 0)
+        {
+            m_binary.resize(m_size);
+            fseek(m_file, sizeof(m_format), SEEK_SET);
+            m_read = fread(m_binary.data(), 1, m_binary.size(), m_file) == m_binary.size();
+        }
+        else
+            m_read = false;
+    }
+    fclose(m_file);
+    if (!m_read)
+        return false;
+
+    // A driver update can reject an old binary, then it is simply compiled again
+    glProgramBinary(this->shaderProgram, m_format, m_binary.data(), (GLsizei)m_binary.size());
+    return this->ProgramLinked();
+}
+
+void Shader::SaveProgramBinary()
+{
+    if (!this->ProgramBinariesSupported())
+        return;
+
+    int m_length = 0;
+    glGetProgramiv(this->shaderProgram, GL_PROGRAM_BINARY_LENGTH, &m_length);
+    if (m_length <= 0)
+        return;
+
+    GLenum m_format = 0;
+    std::vector<char> m_binary(m_length);
+    glGetProgramBinary(this->shaderProgram, m_length, &m_length, &m_format, m_binary.data());
+
+    // Written to a temporary file first, so a half written binary is never loaded
+    CreateDirectoryIfMissing(Config::instance->shaderCacheFolder);
+    std::string m_path = this->GetProgramBinaryPath();
+    std::string m_tempPath = m_path + ".tmp";
+    FILE* m_file = fopen(m_tempPath.c_str(), "wb");
+    if (m_file == nullptr)
+        return;
+    bool m_written = fwrite(&m_format, sizeof(m_format), 1, m_file) == 1;
+    m_written = m_written && fwrite(m_binary.data(), 1, m_length, m_file) == (size_t)m_length;
+    m_written = (fclose(m_file) == 0) && m_written;
+    if (m_written)
+        ReplaceFileWith(m_path, m_tempPath);
+    else
+        remove(m_tempPath.c_str());
 }
 
 void Shader::Use()
 {
+    if (Shader::activeProgram == this->shaderProgram)
+        return;
     glUseProgram(this->shaderProgram);
+    Shader::activeProgram = this->shaderProgram;
 }
 
 std::string Shader::LoadShaderSource(std::string a_pathToShaderSourceFile)
@@ -120,19 +251,11 @@ std::string Shader::LoadShaderSource(std::string a_pathToShaderSourceFile)
     // Make sure to check that the file is open.
     if(fileReader.is_open())
     {
-        // Set the 'cursor' at the beginning of the file.
+        // Read the whole file at once
+        fileReader.seekg(0, std::ios::end);
+        std::string output((size_t)fileReader.tellg(), '\0');
         fileReader.seekg(0, std::ios::beg);
-
-        std::string line;
-        std::string output;
-        while (std::getline(fileReader, line))
-        {
-            output.append(line);
-            output.append("\n");
-        }
-
-        // Add a null terminator at the end of the string.
-        output.append("\0");
+        fileReader.read(&output[0], output.size());
 
         return output;
     }
@@ -171,8 +294,32 @@ unsigned int Shader::GetProgramId()
 		return this->shaderProgram;
 }
 
-void Shader::SetMatrixValue(std::string a_uniformname, const GLfloat* a_data)
+void Shader::SetMatrixValue(const char* a_uniformName, const GLfloat* a_data)
+{
+    this->Use();
+    glUniformMatrix4fv(this->GetUniformLocation(a_uniformName), 1, GL_FALSE, a_data);
+}
+
+void Shader::SetInt(const char* a_uniformName, int a_value)
+{
+    this->Use();
+    glUniform1i(this->GetUniformLocation(a_uniformName), a_value);
+}
+
+void Shader::SetIVec2(const char* a_uniformName, int a_x, int a_y)
+{
+    this->Use();
+    glUniform2i(this->GetUniformLocation(a_uniformName), a_x, a_y);
+}
+
+void Shader::SetVec4(const char* a_uniformName, const glm::vec4& a_value)
+{
+    this->Use();
+    glUniform4f(this->GetUniformLocation(a_uniformName), a_value.x, a_value.y, a_value.z, a_value.w);
+}
+
+void Shader::SetVec3Array(const char* a_uniformName, const glm::vec3* a_values, int a_count)
 {
     this->Use();
-    glUniformMatrix4fv(this->GetUniformLocation(a_uniformname), 1, GL_FALSE, a_data);
+    glUniform3fv(this->GetUniformLocation(a_uniformName), a_count, &a_values[0][0]);
 }
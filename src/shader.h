@@ -24,7 +24,10 @@ SOFTWARE.
 */
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
 #include <iostream>
+#include <string>
+#include <map>
 
 #ifndef __SHADER__
 #define __SHADER__
@@ -33,29 +36,47 @@ SOFTWARE.
 class Shader
 {
 private:
-    unsigned int shaderProgram;
+    unsigned int shaderProgram = 0;
 
-    unsigned int vertexShaderID;
-    const char* vertexShaderSource;
+    std::string vertexShaderSource;
+    std::string fragmentShaderSource;
 
-    unsigned int fragmentShaderID;
-    const char* fragmentShaderSource;
+	bool compiledShaderProgram = false;
 
-	bool compiledShaderProgram;
+    // Uniform locations are looked up once after linking, the transparent comparison
+    // lets a const char* find its location without building a std::string
+    std::map<std::string, GLint, std::less<>> uniformLocations;
+
+    // The program that is in use, so switching to it again can be skipped
+    static unsigned int activeProgram;
 
 public:
     // Sets the vertex shader of this program.
     bool SetVertexShader(std::string a_vertexShaderSource);
     bool SetFragmentShader(std::string a_fragmentShaderSource);
-	GLint GetUniformLocation(std::string a_uniformName);
+	GLint GetUniformLocation(const char* a_uniformName);
+    // Links the program, from the program binary cache when these sources were linked before
     int Compile();
     void Use();
 	unsigned int GetProgramId();
-    void SetMatrixValue(std::string a_uniformname, const GLfloat* a_data);
+
+    // Typed setters, these make the program the active one
+    void SetMatrixValue(const char* a_uniformName, const GLfloat* a_data);
+    void SetInt(const char* a_uniformName, int a_value);
+    void SetIVec2(const char* a_uniformName, int a_x, int a_y);
+    void SetVec4(const char* a_uniformName, const glm::vec4& a_value);
+    void SetVec3Array(const char* a_uniformName, const glm::vec3* a_values, int a_count);
 
 private:
     std::string LoadShaderSource(std::string a_pathToShaderSourceFile);
     bool ShaderCompiled(unsigned int a_id);
+    unsigned int CompileShader(GLenum a_type, const std::string& a_source);
+    bool ProgramLinked();
+    void CacheUniformLocations();
+    bool ProgramBinariesSupported();
+    std::string GetProgramBinaryPath();
+    bool TryLoadProgramBinary();
+    void SaveProgramBinary();
 };
 
 #endif // !__SHADER__
@@ -0,0 +1,31 @@
+#version 330 core
+out vec4 FragColor;
+
+// The visible cells, one state per texel
+uniform usampler2D u_CellStates;
+// Colors of a conductor, head and tail
+uniform vec3 u_Palette[3];
+uniform vec4 u_GridColor;
+uniform int u_CellSizeInPx;
+uniform int u_GridLineSizeInPx;
+uniform int u_ScreenHeight;
+
+void main()
+{
+	// Pixel position with the origin in the top left, like the rest of the grid
+	ivec2 m_pixel = ivec2(int(gl_FragCoord.x), u_ScreenHeight - 1 - int(gl_FragCoord.y));
+
+	// Grid lines are centered on the cell borders
+	ivec2 m_inCell = (m_pixel + u_GridLineSizeInPx / 2) % u_CellSizeInPx;
+	if (u_GridLineSizeInPx > 0 && (m_inCell.x < u_GridLineSizeInPx || m_inCell.y < u_GridLineSizeInPx))
+	{
+		FragColor = u_GridColor;
+		return;
+	}
+
+	// The texture starts one cell before the left and top of the screen
+	uint m_state = texelFetch(u_CellStates, m_pixel / u_CellSizeInPx + 1, 0).r;
+	if (m_state > 2u)
+		discard;
+	FragColor = vec4(u_Palette[m_state], 1.0);
+}
\ No newline at end of file
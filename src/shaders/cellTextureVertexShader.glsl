@@ -0,0 +1,8 @@
+#version 330 core
+
+void main()
+{
+	// One triangle that covers the whole screen, no vertex buffer needed
+	vec2 m_position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(m_position * 2.0 - 1.0, 0.0, 1.0);
+}
\ No newline at end of file
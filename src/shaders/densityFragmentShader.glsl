@@ -0,0 +1,23 @@
+#version 330 core
+out vec4 FragColor;
+
+// One texel per block of cells: the head fraction, tail fraction and how much of the block has cells
+uniform sampler2D u_Density;
+// Colors of a conductor, head and tail
+uniform vec3 u_Palette[3];
+uniform int u_BlockSizeInPx;
+uniform int u_ScreenHeight;
+
+void main()
+{
+	// Pixel position with the origin in the top left, like the rest of the grid
+	ivec2 m_pixel = ivec2(int(gl_FragCoord.x), u_ScreenHeight - 1 - int(gl_FragCoord.y));
+	vec4 m_density = texelFetch(u_Density, m_pixel / u_BlockSizeInPx, 0);
+	if (m_density.b <= 0.0)
+		discard;
+
+	// Mix the colors by how many of the cells have each state, sparse blocks are darker
+	float m_conductors = max(1.0 - m_density.r - m_density.g, 0.0);
+	vec3 m_color = m_density.r * u_Palette[1] + m_density.g * u_Palette[2] + m_conductors * u_Palette[0];
+	FragColor = vec4(m_color * (0.25 + 0.75 * m_density.b), 1.0);
+}
\ No newline at end of file
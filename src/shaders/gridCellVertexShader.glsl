@@ -1,18 +1,19 @@
 #version 330 core
 layout (location = 0) in vec2 aPos;
-layout (location = 2) in vec2 aInstanceOffset;
-layout (location = 3) in vec3 aColor;
+layout (location = 2) in ivec2 aCellPosition;
+layout (location = 3) in uint aState;
 
-uniform mat4 u_ModelMatrix;
 uniform mat4 u_ProjectionMatrix;
+uniform int u_CellSizeInPx;
+// Where the cell positions are relative to, in cells from the top left of the screen
+uniform ivec2 u_Origin;
+// Colors of a conductor, head and tail
+uniform vec3 u_Palette[3];
 out vec3 Color;
 
 void main()
 {
-	// Render cells
-	vec4 m_newPosition = u_ModelMatrix * vec4(aPos.x, aPos.y, 1.0, 1.0);
-	float m_newX = m_newPosition.x + aInstanceOffset.x;
-	float m_newY = m_newPosition.y + aInstanceOffset.y;
-	gl_Position = u_ProjectionMatrix * vec4(m_newX, m_newY, m_newPosition.z, m_newPosition.w);
-	Color = aColor;
+	vec2 m_position = (aPos + vec2(aCellPosition + u_Origin)) * float(u_CellSizeInPx);
+	gl_Position = u_ProjectionMatrix * vec4(m_position, 0.0, 1.0);
+	Color = u_Palette[min(aState, 2u)];
 }
\ No newline at end of file
@@ -0,0 +1,209 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include "simulationClient.h"
+#include "messageBuffer.h"
+#include "profiler.h"
+
+// Frames that may wait for ApplyTo before the client stops reading from the server
+#define ClientMaxQueuedFrames 64
+
+SimulationClient::SimulationClient()
+{
+	this->connected.store(false);
+	this->generation.store(0);
+	this->framesReceived.store(0);
+	this->generationsSkipped.store(0);
+	this->bytesReceived.store(0);
+}
+
+SimulationClient::~SimulationClient()
+{
+	this->Disconnect();
+}
+
+bool SimulationClient::Connect(const std::string& a_host, unsigned short a_port, int a_timeoutInMs)
+{
+	this->Disconnect();
+	if (!InitializeSockets())
+		return false;
+	this->connection = ConnectToHost(a_host, a_port, a_timeoutInMs);
+	if (this->connection == InvalidSocket)
+		return false;
+	SetNoDelay(this->connection);
+	this->hasViewport = false;
+	this->frames.clear();
+	this->connected.store(true);
+	this->receiveThread = std::thread(&SimulationClient::ReceiveThread, this);
+	return true;
+}
+
+void SimulationClient::Disconnect()
+{
+	if (this->connection == InvalidSocket)
+		return;
+	{
+		std::lock_guard<std::mutex> m_lk(this->framesLock);
+		this->connected.store(false);
+	}
+	this->framesCv.notify_all();
+	ShutdownSocket(this->connection);
+	if (this->receiveThread.joinable())
+		this->receiveThread.join();
+	CloseSocket(this->connection);
+	this->connection = InvalidSocket;
+}
+
+bool SimulationClient::SetViewport(coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height)
+{
+	if (this->hasViewport && a_x == this->viewportX && a_y == this->viewportY && a_width == this->viewportWidth && a_height == this->viewportHeight)
+		return true;
+	this->hasViewport = true;
+	this->viewportX = a_x;
+	this->viewportY = a_y;
+	this->viewportWidth = a_width;
+	this->viewportHeight = a_height;
+
+	MessageWriter m_message;
+	m_message.PutU8((uint8_t)ViewerMessage::Viewport);
+	m_message.PutI64(a_x);
+	m_message.PutI64(a_y);
+	m_message.PutU32(a_width);
+	m_message.PutU32(a_height);
+	std::lock_guard<std::mutex> m_lk(this->sendLock);
+	return this->connected.load() && SendSizedMessage(this->connection, m_message.data);
+}
+
+bool SimulationClient::SendEdits(const std::vector<CellSnapshot>& a_cells)
+{
+	MessageWriter m_message;
+	m_message.PutU8((uint8_t)ViewerMessage::Edit);
+	m_message.PutU32((uint32_t)a_cells.size());
+	for (const CellSnapshot& m_cell : a_cells)
+	{
+		m_message.PutI64(m_cell.x);
+		m_message.PutI64(m_cell.y);
+		m_message.PutU8((uint8_t)m_cell.state);
+	}
+	std::lock_guard<std::mutex> m_lk(this->sendLock);
+	return this->connected.load() && SendSizedMessage(this->connection, m_message.data);
+}
+
+bool SimulationClient::ApplyTo(World* a_world)
+{
+	std::vector<Frame> m_frames;
+	{
+		std::lock_guard<std::mutex> m_lk(this->framesLock);
+		m_frames.swap(this->frames);
+	}
+	this->framesCv.notify_all();
+	if (m_frames.empty())
+		return false;
+
+	PROFILE_ZONE("apply server frames");
+	std::vector<CellSnapshot> m_updates;
+	std::vector<unsigned char> m_current;
+	std::vector<unsigned char> m_target;
+	for (Frame& m_frame : m_frames)
+	{
+		m_updates.clear();
+		if (m_frame.type == TraceFrameType::Keyframe)
+		{
+			// Only what differs from what is in the world already is changed
+			size_t m_cells = (size_t)m_frame.width * m_frame.height;
+			m_current.assign(m_cells, Background);
+			m_target.assign(m_cells, Background);
+			a_world->StatesInViewport(m_current.data(), m_frame.width, m_frame.x - 1, m_frame.y - 1, m_frame.width + 1, m_frame.height + 1);
+			for (const CellChange& m_change : m_frame.changes)
+			{
+				if (m_change.x >= m_frame.x && m_change.x < m_frame.x + m_frame.width && m_change.y >= m_frame.y && m_change.y < m_frame.y + m_frame.height)
+					m_target[(size_t)(m_change.y - m_frame.y) * m_frame.width + (size_t)(m_change.x - m_frame.x)] = (unsigned char)m_change.newState;
+			}
+			for (size_t m_index = 0; m_index < m_cells; m_index++)
+			{
+				if (m_current[m_index] == m_target[m_index])
+					continue;
+				coordinatePart m_x = m_frame.x + (coordinatePart)(m_index % m_frame.width);
+				coordinatePart m_y = m_frame.y + (coordinatePart)(m_index / m_frame.width);
+				if (m_target[m_index] == Background)
+					a_world->TryDeleteCell(m_x, m_y);
+				else if (m_current[m_index] == Background)
+					a_world->TryInsertCellAt(m_x, m_y, (CellState)m_target[m_index]);
+				else
+					m_updates.push_back(CellSnapshot{ m_x, m_y, (CellState)m_target[m_index] });
+			}
+		}
+		else
+		{
+			for (const CellChange& m_change : m_frame.changes)
+			{
+				if (m_change.newState == Background)
+					a_world->TryDeleteCell(m_change.x, m_change.y);
+				else if (!a_world->TryInsertCellAt(m_change.x, m_change.y, m_change.newState))
+					m_updates.push_back(CellSnapshot{ m_change.x, m_change.y, m_change.newState });
+			}
+		}
+		a_world->SetStates(m_updates);
+	}
+	return true;
+}
+
+void SimulationClient::ReceiveThread()
+{
+	PROFILE_THREAD("server connection");
+	std::vector<unsigned char> m_message;
+	while (ReceiveSizedMessage(this->connection, &m_message, ServerMaxMessageBytes))
+	{
+		MessageReader m_reader(m_message);
+		Frame m_frame;
+		m_frame.type = (TraceFrameType)m_reader.GetU8();
+		m_frame.generation = m_reader.GetU64();
+		unsigned long long m_skipped = m_reader.GetU64();
+		m_frame.x = m_reader.GetI64();
+		m_frame.y = m_reader.GetI64();
+		m_frame.width = m_reader.GetU32();
+		m_frame.height = m_reader.GetU32();
+		unsigned int m_count = m_reader.GetU32();
+		if (m_reader.Failed() || (m_frame.type != TraceFrameType::Keyframe && m_frame.type != TraceFrameType::Delta) ||
+			(unsigned long long)m_frame.width * m_frame.height > ServerMaxViewportCells)
+			break;
+		size_t m_headerSize = m_message.size() - m_reader.GetRemaining();
+		if (!DecodeCellChanges(m_message.data() + m_headerSize, m_reader.GetRemaining(), m_count, &m_frame.changes))
+			break;
+
+		this->generation.store(m_frame.generation);
+		this->framesReceived.fetch_add(1);
+		this->generationsSkipped.fetch_add(m_skipped);
+		this->bytesReceived.fetch_add(m_message.size() + 4);
+		std::unique_lock<std::mutex> m_lk(this->framesLock);
+		// A keyframe replaces everything in view, what came before it doesn't have to be applied anymore
+		if (m_frame.type == TraceFrameType::Keyframe)
+			this->frames.clear();
+		this->framesCv.wait(m_lk, [this]() { return this->frames.size() < ClientMaxQueuedFrames || !this->connected.load(); });
+		if (!this->connected.load())
+			break;
+		this->frames.push_back(std::move(m_frame));
+	}
+	this->connected.store(false);
+}
@@ -0,0 +1,101 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "cell.h"
+#include "world.h"
+#include "socketUtils.h"
+#include "serverProtocol.h"
+
+#ifndef __SIMULATIONCLIENT__
+#define __SIMULATIONCLIENT__
+
+// The viewer side of a SimulationServer. The frames of the server are kept until the UI puts them
+// in its own world with ApplyTo, which then only holds the cells in view. When the UI falls behind
+// the client stops reading, so the server starts folding generations together for it.
+class SimulationClient
+{
+private:
+	struct Frame
+	{
+		TraceFrameType type;
+		World::generationType generation;
+		coordinatePart x;
+		coordinatePart y;
+		unsigned int width;
+		unsigned int height;
+		std::vector<CellChange> changes;
+	};
+
+	socketHandle connection = InvalidSocket;
+	std::thread receiveThread;
+	std::mutex framesLock;
+	std::condition_variable framesCv;
+	std::vector<Frame> frames;
+	std::mutex sendLock;
+	std::atomic<bool> connected;
+
+	bool hasViewport = false;
+	coordinatePart viewportX = 0;
+	coordinatePart viewportY = 0;
+	unsigned int viewportWidth = 0;
+	unsigned int viewportHeight = 0;
+
+	std::atomic<World::generationType> generation;
+	std::atomic<unsigned long long> framesReceived;
+	std::atomic<unsigned long long> generationsSkipped;
+	std::atomic<unsigned long long> bytesReceived;
+
+public:
+	SimulationClient();
+	~SimulationClient();
+
+	bool Connect(const std::string& a_host, unsigned short a_port, int a_timeoutInMs);
+	void Disconnect();
+	bool IsConnected() { return this->connected.load(); };
+
+	// Tells the server what is in view, only sends anything when that changed
+	bool SetViewport(coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height);
+	// Background erases the cell, the server sends the edits back like any other change
+	bool SendEdits(const std::vector<CellSnapshot>& a_cells);
+	// Puts every frame that came in since the last call in a_world, false when nothing came in
+	bool ApplyTo(World* a_world);
+
+	World::generationType GetGeneration() { return this->generation.load(); };
+	unsigned long long GetFramesReceived() { return this->framesReceived.load(); };
+	// Generations the server folded into later frames because this viewer was behind
+	unsigned long long GetGenerationsSkipped() { return this->generationsSkipped.load(); };
+	unsigned long long GetBytesReceived() { return this->bytesReceived.load(); };
+
+private:
+	void ReceiveThread();
+};
+
+#endif // !__SIMULATIONCLIENT__
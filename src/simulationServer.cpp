@@ -0,0 +1,334 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <algorithm>
+
+#include "simulationServer.h"
+#include "profiler.h"
+
+// How often the accept thread looks if it has to stop
+#define ServerAcceptPollMs 200
+
+SimulationServer::SimulationServer()
+{
+	this->stopping.store(false);
+	this->framesSent.store(0);
+	this->generationsSkipped.store(0);
+	this->bytesSent.store(0);
+	this->editsReceived.store(0);
+}
+
+SimulationServer::~SimulationServer()
+{
+	this->Stop();
+}
+
+bool SimulationServer::Start(World* a_world, unsigned short a_port, bool a_anyInterface)
+{
+	if (this->listener != InvalidSocket || !InitializeSockets())
+		return false;
+	this->listener = ListenOnPort(a_port, a_anyInterface);
+	if (this->listener == InvalidSocket)
+		return false;
+	this->world = a_world;
+	this->stopping.store(false);
+	this->listenerId = a_world->AddChangeListener(
+		[this](World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+		{
+			this->OnWorldChanged(a_generation, a_source, a_changes);
+		}
+	);
+	this->acceptThread = std::thread(&SimulationServer::AcceptThread, this);
+	return true;
+}
+
+void SimulationServer::Stop()
+{
+	if (this->listener == InvalidSocket)
+		return;
+	this->world->RemoveChangeListener(this->listenerId);
+	this->stopping.store(true);
+	if (this->acceptThread.joinable())
+		this->acceptThread.join();
+	CloseSocket(this->listener);
+	this->listener = InvalidSocket;
+
+	std::vector<std::unique_ptr<Viewer>> m_viewers;
+	{
+		std::lock_guard<std::mutex> m_lk(this->viewersLock);
+		m_viewers.swap(this->viewers);
+	}
+	for (auto& m_viewer : m_viewers)
+	{
+		this->CloseViewer(m_viewer.get());
+		this->JoinViewer(m_viewer.get());
+	}
+}
+
+size_t SimulationServer::GetViewerCount()
+{
+	std::lock_guard<std::mutex> m_lk(this->viewersLock);
+	return this->viewers.size();
+}
+
+void SimulationServer::OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+{
+	PROFILE_ZONE("server changes");
+	std::lock_guard<std::mutex> m_lk(this->viewersLock);
+	for (auto& m_viewer : this->viewers)
+	{
+		std::lock_guard<std::mutex> m_viewerLk(m_viewer->lock);
+		if (m_viewer->closed || !m_viewer->hasViewport)
+			continue;
+		if (a_source == World::ChangeSource::Reset)
+		{
+			m_viewer->needsKeyframe = true;
+			m_viewer->pending.clear();
+		}
+		else if (!m_viewer->needsKeyframe)
+		{
+			coordinatePart m_endX = m_viewer->x + m_viewer->width;
+			coordinatePart m_endY = m_viewer->y + m_viewer->height;
+			for (const CellChange& m_change : a_changes)
+			{
+				if (m_change.x < m_viewer->x || m_change.x >= m_endX || m_change.y < m_viewer->y || m_change.y >= m_endY)
+					continue;
+				auto m_found = m_viewer->pending.insert(std::make_pair(std::make_pair(m_change.x, m_change.y), m_change));
+				if (!m_found.second)
+					m_found.first->second.newState = m_change.newState;
+			}
+			// A viewer that fell this far behind is better off with a keyframe
+			if (m_viewer->pending.size() > ((size_t)m_viewer->width * m_viewer->height) / 4)
+			{
+				m_viewer->needsKeyframe = true;
+				m_viewer->pending.clear();
+			}
+		}
+		if (a_source == World::ChangeSource::Simulation)
+			m_viewer->pendingGenerations++;
+		m_viewer->generation = a_generation;
+		m_viewer->wake.notify_one();
+	}
+}
+
+void SimulationServer::AcceptThread()
+{
+	PROFILE_THREAD("server accept");
+	while (!this->stopping.load())
+	{
+		socketHandle m_connection = AcceptConnection(this->listener, ServerAcceptPollMs);
+
+		// Clean up after the viewers that left, outside the lock so the simulation doesn't wait for it
+		std::vector<std::unique_ptr<Viewer>> m_left;
+		{
+			std::lock_guard<std::mutex> m_lk(this->viewersLock);
+			for (auto m_viewer = this->viewers.begin(); m_viewer != this->viewers.end();)
+			{
+				bool m_closed = false;
+				{
+					std::lock_guard<std::mutex> m_viewerLk((*m_viewer)->lock);
+					m_closed = (*m_viewer)->closed;
+				}
+				if (m_closed)
+				{
+					m_left.push_back(std::move(*m_viewer));
+					m_viewer = this->viewers.erase(m_viewer);
+				}
+				else
+					m_viewer++;
+			}
+		}
+		for (auto& m_viewer : m_left)
+			this->JoinViewer(m_viewer.get());
+
+		if (m_connection == InvalidSocket)
+			continue;
+		SetNoDelay(m_connection);
+		std::unique_ptr<Viewer> m_viewer(new Viewer());
+		m_viewer->connection = m_connection;
+		m_viewer->sendThread = std::thread(&SimulationServer::SendThread, this, m_viewer.get());
+		m_viewer->receiveThread = std::thread(&SimulationServer::ReceiveThread, this, m_viewer.get());
+		std::lock_guard<std::mutex> m_lk(this->viewersLock);
+		this->viewers.push_back(std::move(m_viewer));
+	}
+}
+
+void SimulationServer::SendThread(Viewer* a_viewer)
+{
+	PROFILE_THREAD("server viewer");
+	std::vector<CellChange> m_changes;
+	std::vector<unsigned char> m_states;
+	MessageWriter m_message;
+	while (true)
+	{
+		bool m_keyframe = false;
+		World::generationType m_generation = 0;
+		unsigned long long m_skipped = 0;
+		coordinatePart m_x = 0;
+		coordinatePart m_y = 0;
+		unsigned int m_width = 0;
+		unsigned int m_height = 0;
+		m_changes.clear();
+		{
+			std::unique_lock<std::mutex> m_lk(a_viewer->lock);
+			a_viewer->wake.wait(m_lk, [a_viewer]() {
+				return a_viewer->closed || (a_viewer->hasViewport && (a_viewer->needsKeyframe || a_viewer->pendingGenerations > 0 || !a_viewer->pending.empty()));
+			});
+			if (a_viewer->closed)
+				break;
+			m_keyframe = a_viewer->needsKeyframe;
+			m_generation = a_viewer->generation;
+			m_skipped = a_viewer->pendingGenerations > 1 ? a_viewer->pendingGenerations - 1 : 0;
+			m_x = a_viewer->x;
+			m_y = a_viewer->y;
+			m_width = a_viewer->width;
+			m_height = a_viewer->height;
+			if (!m_keyframe)
+			{
+				// A cell that changed back to what the viewer has isn't sent
+				for (auto& m_pending : a_viewer->pending)
+				{
+					if (a_viewer->afterKeyframe || m_pending.second.oldState != m_pending.second.newState)
+						m_changes.push_back(m_pending.second);
+				}
+			}
+			a_viewer->afterKeyframe = m_keyframe;
+			a_viewer->needsKeyframe = false;
+			a_viewer->pendingGenerations = 0;
+			a_viewer->pending.clear();
+		}
+
+		PROFILE_ZONE("server frame");
+		if (m_keyframe)
+		{
+			// Changes that come in while this is read are all sent again in the next frame, that does no harm
+			m_generation = this->world->GetDisplayGeneration();
+			m_states.assign((size_t)m_width * m_height, Background);
+			this->world->StatesInViewport(m_states.data(), m_width, m_x - 1, m_y - 1, m_width + 1, m_height + 1);
+			// Sorted on x and then y like the changes of a generation
+			for (unsigned int m_column = 0; m_column < m_width; m_column++)
+			{
+				for (unsigned int m_row = 0; m_row < m_height; m_row++)
+				{
+					CellState m_state = (CellState)m_states[(size_t)m_row * m_width + m_column];
+					if (m_state != Background)
+						m_changes.push_back(CellChange{ m_x + m_column, m_y + m_row, Background, m_state });
+				}
+			}
+		}
+
+		m_message.Clear();
+		m_message.PutU8((uint8_t)(m_keyframe ? TraceFrameType::Keyframe : TraceFrameType::Delta));
+		m_message.PutU64(m_generation);
+		m_message.PutU64(m_skipped);
+		m_message.PutI64(m_x);
+		m_message.PutI64(m_y);
+		m_message.PutU32(m_width);
+		m_message.PutU32(m_height);
+		m_message.PutU32((uint32_t)m_changes.size());
+		EncodeCellChanges(m_changes, &m_message.data);
+		if (!SendSizedMessage(a_viewer->connection, m_message.data))
+			break;
+		this->framesSent.fetch_add(1);
+		this->generationsSkipped.fetch_add(m_skipped);
+		this->bytesSent.fetch_add(m_message.data.size() + 4);
+	}
+	this->CloseViewer(a_viewer);
+}
+
+void SimulationServer::ReceiveThread(Viewer* a_viewer)
+{
+	PROFILE_THREAD("server viewer input");
+	std::vector<unsigned char> m_message;
+	while (ReceiveSizedMessage(a_viewer->connection, &m_message, ServerMaxMessageBytes))
+	{
+		MessageReader m_reader(m_message);
+		ViewerMessage m_type = (ViewerMessage)m_reader.GetU8();
+		if (m_type == ViewerMessage::Viewport)
+		{
+			coordinatePart m_x = m_reader.GetI64();
+			coordinatePart m_y = m_reader.GetI64();
+			unsigned int m_width = std::min<unsigned int>(m_reader.GetU32(), ServerMaxViewportCells);
+			unsigned int m_height = m_reader.GetU32();
+			if (m_reader.Failed())
+				break;
+			if (m_width > 0 && (unsigned long long)m_width * m_height > ServerMaxViewportCells)
+				m_height = ServerMaxViewportCells / m_width;
+			std::lock_guard<std::mutex> m_lk(a_viewer->lock);
+			a_viewer->x = m_x;
+			a_viewer->y = m_y;
+			a_viewer->width = m_width;
+			a_viewer->height = m_height;
+			a_viewer->hasViewport = m_width > 0 && m_height > 0;
+			a_viewer->needsKeyframe = true;
+			a_viewer->pending.clear();
+			a_viewer->wake.notify_one();
+		}
+		else if (m_type != ViewerMessage::Edit || !this->ApplyEdits(&m_reader))
+			break;
+	}
+	this->CloseViewer(a_viewer);
+}
+
+bool SimulationServer::ApplyEdits(MessageReader* a_message)
+{
+	PROFILE_ZONE("server edits");
+	unsigned int m_count = a_message->GetU32();
+	if (a_message->Failed() || m_count > a_message->GetRemaining() / 17)
+		return false;
+	// The edits come back to every viewer that sees them as changes of the world
+	std::vector<CellSnapshot> m_updates;
+	for (unsigned int m_edit = 0; m_edit < m_count; m_edit++)
+	{
+		coordinatePart m_x = a_message->GetI64();
+		coordinatePart m_y = a_message->GetI64();
+		CellState m_state = (CellState)(a_message->GetU8() & 3);
+		if (m_state == Background)
+			this->world->TryDeleteCell(m_x, m_y);
+		else if (!this->world->TryInsertCellAt(m_x, m_y, m_state))
+			m_updates.push_back(CellSnapshot{ m_x, m_y, m_state });
+	}
+	this->world->SetStates(m_updates);
+	this->editsReceived.fetch_add(m_count);
+	return true;
+}
+
+void SimulationServer::CloseViewer(Viewer* a_viewer)
+{
+	std::lock_guard<std::mutex> m_lk(a_viewer->lock);
+	a_viewer->closed = true;
+	// Wakes up the other thread of the viewer, whether it waits for the viewer or for work
+	ShutdownSocket(a_viewer->connection);
+	a_viewer->wake.notify_one();
+}
+
+void SimulationServer::JoinViewer(Viewer* a_viewer)
+{
+	if (a_viewer->sendThread.joinable())
+		a_viewer->sendThread.join();
+	if (a_viewer->receiveThread.joinable())
+		a_viewer->receiveThread.join();
+	CloseSocket(a_viewer->connection);
+	a_viewer->connection = InvalidSocket;
+}
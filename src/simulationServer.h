@@ -0,0 +1,114 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "cell.h"
+#include "world.h"
+#include "socketUtils.h"
+#include "serverProtocol.h"
+#include "messageBuffer.h"
+
+#ifndef __SIMULATIONSERVER__
+#define __SIMULATIONSERVER__
+
+// Streams a running world to viewers over TCP (see serverProtocol.h) and takes their edits.
+// The simulation only hands the changed cells to every viewer that can see them. Each viewer has
+// its own thread that encodes and sends them, so a slow viewer never holds up the simulation:
+// while it is busy sending, the changes of the next generations are folded together and it
+// gets one frame for all of them. When that would be more than its viewport holds, a keyframe
+// of its viewport is sent instead.
+class SimulationServer
+{
+private:
+	struct Viewer
+	{
+		socketHandle connection = InvalidSocket;
+		std::thread sendThread;
+		std::thread receiveThread;
+		std::mutex lock;
+		std::condition_variable wake;
+		bool closed = false;
+		bool hasViewport = false;
+		bool needsKeyframe = true;
+		// The keyframe was read after the pending changes were taken, so the first delta after it can't
+		// leave out cells that changed back: the viewer may have a state from the middle of that change
+		bool afterKeyframe = false;
+		coordinatePart x = 0;
+		coordinatePart y = 0;
+		unsigned int width = 0;
+		unsigned int height = 0;
+		// The first old and the last new state of every cell in view that changed since the last frame
+		std::map<std::pair<coordinatePart, coordinatePart>, CellChange> pending;
+		unsigned long long pendingGenerations = 0;
+		World::generationType generation = 0;
+	};
+
+	World* world = nullptr;
+	unsigned int listenerId = 0;
+	socketHandle listener = InvalidSocket;
+	std::thread acceptThread;
+	std::atomic<bool> stopping;
+	std::mutex viewersLock;
+	std::vector<std::unique_ptr<Viewer>> viewers;
+
+	std::atomic<unsigned long long> framesSent;
+	std::atomic<unsigned long long> generationsSkipped;
+	std::atomic<unsigned long long> bytesSent;
+	std::atomic<unsigned long long> editsReceived;
+
+public:
+	SimulationServer();
+	~SimulationServer();
+
+	// Listens on 127.0.0.1, or on every interface with a_anyInterface. Port 0 picks a free port.
+	bool Start(World* a_world, unsigned short a_port, bool a_anyInterface);
+	void Stop();
+	unsigned short GetPort() { return GetSocketPort(this->listener); };
+
+	size_t GetViewerCount();
+	unsigned long long GetFramesSent() { return this->framesSent.load(); };
+	// Generations that slow viewers never got a frame of, because they were folded into the next one
+	unsigned long long GetGenerationsSkipped() { return this->generationsSkipped.load(); };
+	unsigned long long GetBytesSent() { return this->bytesSent.load(); };
+	unsigned long long GetEditsReceived() { return this->editsReceived.load(); };
+
+private:
+	void OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes);
+	void AcceptThread();
+	void SendThread(Viewer* a_viewer);
+	void ReceiveThread(Viewer* a_viewer);
+	// False when the message is broken
+	bool ApplyEdits(MessageReader* a_message);
+	void CloseViewer(Viewer* a_viewer);
+	void JoinViewer(Viewer* a_viewer);
+};
+
+#endif // !__SIMULATIONSERVER__
@@ -25,8 +25,12 @@ SOFTWARE.
 // Standard system libraries
 #include <string>
 #include <array>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
 #include "simulatorPage.h"
 #include "homepage.h"
+#include "profiler.h"
 
 SimulatorPage::SimulatorPage(GLFWwindow* a_window) : Page(a_window, "SimulatorPage")
 {
@@ -45,6 +49,38 @@ SimulatorPage::SimulatorPage(GLFWwindow* a_window) : Page(a_window, "SimulatorPa
 	this->gridCellShader.SetFragmentShader("shaders/gridCellFragmentShader.glsl");
 	this->gridCellShader.Compile();
 	this->GetError(__LINE__);
+
+	// Compile the cellTexture shader, this shader draws the cells and grid lines from a texture of cell states
+	this->cellTextureShader.SetVertexShader("shaders/cellTextureVertexShader.glsl");
+	this->cellTextureShader.SetFragmentShader("shaders/cellTextureFragmentShader.glsl");
+	this->cellTextureShader.Compile();
+	this->GetError(__LINE__);
+
+	// Compile the density shader, this shader draws the overview when zoomed out past a pixel per cell
+	this->densityShader.SetVertexShader("shaders/cellTextureVertexShader.glsl");
+	this->densityShader.SetFragmentShader("shaders/densityFragmentShader.glsl");
+	this->densityShader.Compile();
+	this->GetError(__LINE__);
+
+	// Left over autosave data means we crashed last time, ask before journaling over it
+	if (this->editJournal.HasRecoveryData())
+	{
+		this->askForRecovery = true;
+		this->recoveryPending = true;
+	}
+	else
+		this->editJournal.Attach(&this->worldCells);
+
+	this->conductorLayer.Attach(&this->worldCells);
+	this->densityPyramid.Attach(&this->worldCells);
+
+	// Wake the render loop for every generation and edit, but post only one event until it has drawn
+	this->worldListenerId = this->worldCells.AddChangeListener(
+		[this](World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes) {
+			this->worldVersion.fetch_add(1);
+			if (!this->redrawPosted.exchange(true))
+				glfwPostEmptyEvent();
+		});
 }
 
 Page* SimulatorPage::Run()
@@ -54,7 +90,10 @@ Page* SimulatorPage::Run()
 	
 	while (!this->closeThisPage && !glfwWindowShouldClose(this->window))
 	{
-		glfwPollEvents();
+		// Only draw when the view, the world or the GUI changed, a paused world with no input costs nothing
+		bool m_animating = this->worldVersion.load() != this->drawnWorldVersion || this->tracePlayer.GetIsPlaying() || this->worldCells.IsSaving() || this->editJournal.IsRecovering() || this->remoteClient.IsConnected();
+		if (!this->WaitForFrame(m_animating, IdleWaitTimeoutInSeconds) && this->worldVersion.load() == this->drawnWorldVersion)
+			continue;
 
 		// Clear the screen
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -65,27 +104,39 @@ Page* SimulatorPage::Run()
 		this->RenderImGui();
 
 		glfwSwapBuffers(this->window);
+
+		if (this->performancePanelOpen)
+			this->frameTimes.Push((float)((glfwGetTime() - this->lastFrameTime) * 1000.0));
+		this->lastFrameTime = glfwGetTime();
 	}
 
 	this->DisposeOpenGL();
 	this->DisposeImGui();
+
+	// A clean exit, there is nothing to recover next time
+	this->editJournal.Discard();
 	return this->nextPage;
 }
 
 void SimulatorPage::DisposeOpenGL()
 {
 	this->GetError(__LINE__);
-	glDeleteBuffers(1, &this->cellColorBuffer);
+	this->worldCells.RemoveChangeListener(this->worldListenerId);
+	this->conductorLayer.Dispose();
 	glDeleteBuffers(1, &this->cellEboBuffer);
-	glDeleteBuffers(1, &this->cellOffsetBuffer);
+	glDeleteBuffers(1, &this->cellInstanceBuffer);
 	glDeleteBuffers(1, &this->cellVboBuffer);
 	glDeleteBuffers(1, &this->gridVerticalLineVaoBuffer);
 	glDeleteBuffers(1, &this->gridVerticalLineVboBuffer);
+	glDeleteBuffers(1, &this->cellStatePixelBuffer);
+	glDeleteTextures(1, &this->cellStateTexture);
+	glDeleteTextures(1, &this->densityTexture);
 	this->GetError(__LINE__);
 	
 	glDeleteVertexArrays(1, &this->cellVaoBuffer);
 	glDeleteVertexArrays(1, &this->gridHorizontalLineVaoBuffer);
 	glDeleteVertexArrays(1, &this->gridVerticalLineVaoBuffer);
+	glDeleteVertexArrays(1, &this->cellTextureVaoBuffer);
 	this->GetError(__LINE__);
 }
 
@@ -106,8 +157,7 @@ void SimulatorPage::InitOpenGL()
 	glGenVertexArrays(1, &this->cellVaoBuffer);
 	glGenBuffers(1, &this->cellVboBuffer);
 	glGenBuffers(1, &this->cellEboBuffer);
-	glGenBuffers(1, &this->cellOffsetBuffer);
-	glGenBuffers(1, &this->cellColorBuffer);
+	glGenBuffers(1, &this->cellInstanceBuffer);
 	
 	glBindVertexArray(this->cellVaoBuffer);
 	
@@ -121,18 +171,19 @@ void SimulatorPage::InitOpenGL()
 	// Define the data layout for the GPU
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
 
-	// Define instance data
-	glBindBuffer(GL_ARRAY_BUFFER, this->cellOffsetBuffer);
+	// Define instance data, the pointers are moved along the ring buffer with every draw
+	glBindBuffer(GL_ARRAY_BUFFER, this->cellInstanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, InstanceRingBufferSize, nullptr, GL_STREAM_DRAW);
+	this->cellInstanceBufferOffset = 0;
+
 	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (GLvoid*)0); // Each element is a GL_FLOAT, they make a glm::vec2 with 2 elements, and the pointer
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glVertexAttribDivisor(2, 1); // One vec2 at a time
+	glVertexAttribIPointer(2, 2, GL_SHORT, sizeof(CellInstance), (GLvoid*)offsetof(CellInstance, x));
+	glVertexAttribDivisor(2, 1); // One position per cell
 	
-	glBindBuffer(GL_ARRAY_BUFFER, this->cellColorBuffer);
 	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (GLvoid*)0); // Each element is a GL_FLOAT, they make a glm::vec2 with 2 elements, and the pointer
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, sizeof(CellInstance), (GLvoid*)offsetof(CellInstance, state));
+	glVertexAttribDivisor(3, 1); // One state per cell
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glVertexAttribDivisor(3, 1); // One vec2 at a time
 
 	glEnableVertexAttribArray(0);
 
@@ -166,6 +217,32 @@ void SimulatorPage::InitOpenGL()
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
 	glEnableVertexAttribArray(0);
 
+	// Initialize the cell state texture, the screen covering triangle needs no vertex data
+	glGenVertexArrays(1, &this->cellTextureVaoBuffer);
+	glGenBuffers(1, &this->cellStatePixelBuffer);
+	glGenTextures(1, &this->cellStateTexture);
+
+	glBindTexture(GL_TEXTURE_2D, this->cellStateTexture);
+	// Integer textures can't be filtered
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	this->cellStateTextureWidth = 0;
+	this->cellStateTextureHeight = 0;
+
+	// Initialize the overview texture
+	glGenTextures(1, &this->densityTexture);
+	glBindTexture(GL_TEXTURE_2D, this->densityTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	this->densityTextureWidth = 0;
+	this->densityTextureHeight = 0;
+
 	//this->InitGrid();
 }
 
@@ -199,10 +276,47 @@ void SimulatorPage::InitSimulator()
 
 void SimulatorPage::RenderOpenGL()
 {
+	PROFILE_ZONE("render");
 	// Renders graphics through OpenGL
+	this->frameUploadBytes = 0;
+	this->frameDrawCalls = 0;
+
+	// Move the replay along, if one is open
+	this->tracePlayer.Update(this->imguiIO->DeltaTime);
+
+	// Take over what the server sent, and tell it what is in view now
+	if (this->remoteClient.IsConnected())
+	{
+		int m_remoteCellSize = this->pixeledView ? 1 : this->cellSizeInPx;
+		this->remoteClient.SetViewport(-1 - this->scrollOffsetX, -1 - this->scrollOffsetY, (this->screenWidth / m_remoteCellSize) + 2, (this->screenHeight / m_remoteCellSize) + 2);
+		this->remoteClient.ApplyTo(&this->worldCells);
+	}
+
+	// When neither the world nor the view changed since the last frame, its buffers and textures are drawn again
+	this->redrawPosted.store(false);
+	unsigned long long m_worldVersion = this->worldVersion.load();
+	RenderedView m_view{ this->scrollOffsetX, this->scrollOffsetY, this->cellSizeInPx, this->pixeledView, this->overviewLevel, this->textureRendering,
+		this->screenWidth, this->screenHeight, this->tracePlayer.IsOpen() ? this->tracePlayer.GetPosition() : (World::generationType)-1 };
+	bool m_reuseRenderData = m_worldVersion == this->drawnWorldVersion && m_view == this->renderedView;
+	this->drawnWorldVersion = m_worldVersion;
+	this->renderedView = m_view;
+
+	// Zoomed out past a pixel per cell, the overview is drawn instead of the cells. A replay has no overview
+	if (this->pixeledView && this->overviewLevel > 0 && !this->tracePlayer.IsOpen())
+	{
+		this->RenderOverview(m_reuseRenderData);
+		return;
+	}
 	
+	if (this->textureRendering)
+	{
+		// Cells and grid lines in a single pass
+		this->RenderCellsAsTexture(m_reuseRenderData);
+		return;
+	}
+
 	// Render all the cells within the view port
-	this->RenderCells();
+	this->RenderCells(m_reuseRenderData);
 
 	// Render the grid lines
 	this->RenderGrid();
@@ -227,6 +341,14 @@ void SimulatorPage::RenderImGui()
 				ImGuiFileDialog::Instance()->OpenDialog("chooseWorldFile", "Choose world file", ".csv", "");
 			if (ImGui::MenuItem("Save"))
 				ImGuiFileDialog::Instance()->OpenDialog("saveWorldFile", "Save world file", ".csv", "");
+			if (!this->traceRecorder.IsRecording() && ImGui::MenuItem("Start recording"))
+				ImGuiFileDialog::Instance()->OpenDialog("recordTraceFile", "Record run to file", ".trace", "");
+			if (this->traceRecorder.IsRecording() && ImGui::MenuItem("Stop recording"))
+				this->traceRecorder.Stop();
+			if (ImGui::MenuItem("Open recording"))
+				ImGuiFileDialog::Instance()->OpenDialog("openTraceFile", "Open recorded run", ".trace", "");
+			if (ImGui::MenuItem("Connect to server"))
+				this->serverWindowOpen = true;
 			if (ImGui::MenuItem("Exit to menu")) 
 			{
 				this->nextPage = new HomePage(this->window);
@@ -245,6 +367,7 @@ void SimulatorPage::RenderImGui()
 			ImGui::MenuItem("Debug window", nullptr, &this->debugWindowOpen);
 			ImGui::MenuItem("Brushes window", nullptr, &this->brushWindowOpen);
 			ImGui::MenuItem("worldDetailsWindowOpen", nullptr, &this->worldDetailsWindowOpen);
+			ImGui::MenuItem("Texture rendering", nullptr, &this->textureRendering);
 			ImGui::EndMenu();
 		}
 		ImGui::EndMainMenuBar();
@@ -260,11 +383,12 @@ void SimulatorPage::RenderImGui()
 		}
 		else
 		{
-			if (ImGui::Button("Start"))
+			// The world of a server runs on the server
+			if (ImGui::Button("Start") && !this->remoteClient.IsConnected())
 				this->worldCells.StartSimulation();
 			ImGui::Text("Stop");
 		}
-		if (ImGui::Button("Reset"))
+		if (ImGui::Button("Reset") && !this->remoteClient.IsConnected())
 			this->worldCells.ResetSimulation();
 
 		if (ImGui::Button("Clear head and tails to conductors"))
@@ -272,6 +396,12 @@ void SimulatorPage::RenderImGui()
 
 		if (ImGui::SliderFloat("Target speed", &this->targetSimulationSpeed, 0.01f, 256, "%.2f", 5.0f))
 			this->worldCells.SetTargetSpeed(this->targetSimulationSpeed);
+
+		// The save runs in the background, show how far along it is
+		if (this->worldCells.IsSaving())
+			ImGui::ProgressBar(this->worldCells.GetSaveProgress(), ImVec2(-1.0f, 0.0f), "Saving...");
+		else if (this->saveStarted)
+			ImGui::Text(this->worldCells.GetLastSaveSucceeded() ? "World saved" : "Saving the world failed");
 	}
 	// Legacy API style not yet fixed by ImGui
 	ImGui::End();
@@ -320,6 +450,8 @@ void SimulatorPage::RenderImGui()
 		ImGui::End();
 	}
 
+	this->CheckMemoryBudget();
+	bool m_performancePanelOpen = false;
 	if (this->debugWindowOpen)
 	{
 		if (ImGui::Begin("Debug", false, m_defaultWindowArgs))
@@ -335,23 +467,58 @@ void SimulatorPage::RenderImGui()
 			ImGui::Text("Last update cycle time (ms): ");
 			ImGui::Text("FPS:");
 			ImGui::Text("Generation:");
+			ImGui::Text("Cell upload (KB) / draws:");
+			if (this->pixeledView && this->overviewLevel > 0)
+				ImGui::Text("Cells per pixel:");
+			if (this->traceRecorder.IsRecording() || this->traceRecorder.GetWriteFailed())
+				ImGui::Text("Recorded (gens / KB):");
 			ImGui::NextColumn();
 			if (this->worldCells.GetIsRunning())
 				ImGui::Text("Running");
 			else
 				ImGui::Text("Paused");
 
-			auto m_cellStats = this->worldCells.GetStatistics();
+			auto m_cellStats = this->tracePlayer.IsOpen() ? this->tracePlayer.GetStatistics() : this->worldCells.GetStatistics();
 			ImGui::Text("%i", m_cellStats[2]); //Conductor count
 			ImGui::Text("%i", m_cellStats[0]); // Head count
 			ImGui::Text("%i", m_cellStats[1]); // Tail count
 			ImGui::Text("%.4f", this->worldCells.lastUpdateDuration);
 			ImGui::Text("%.4f", this->imguiIO->Framerate);
-			ImGui::Text("%i", this->worldCells.GetDisplayGeneration());
+			ImGui::Text("%llu", this->tracePlayer.IsOpen() ? this->tracePlayer.GetGeneration() : this->worldCells.GetDisplayGeneration());
+			ImGui::Text("%zu / %i", this->frameUploadBytes / 1024, this->frameDrawCalls);
+			if (this->pixeledView && this->overviewLevel > 0)
+				ImGui::Text("%llu", 1ull << (2 * this->overviewLevel));
+			if (this->traceRecorder.IsRecording() || this->traceRecorder.GetWriteFailed())
+				ImGui::Text(this->traceRecorder.GetWriteFailed() ? "%llu / %llu, writing failed" : "%llu / %llu", this->traceRecorder.GetRecordedGenerations(), this->traceRecorder.GetRecordedBytes() / 1024);
+
+			// The last zones of every thread, only when built with ENABLE_PROFILER
+			ImGui::Columns(1);
+			if (Profiler::IsEnabled() && ImGui::Button("Save profile"))
+				ImGuiFileDialog::Instance()->OpenDialog("saveProfileFile", "Save profile as Chrome trace", ".json", "");
+
+			m_performancePanelOpen = ImGui::CollapsingHeader("Performance");
+			if (m_performancePanelOpen)
+				this->RenderPerformancePanel();
+
+			// Who waits for whom on the locks of the simulation
+			if (ImGui::CollapsingHeader("Locks"))
+				this->RenderLockPanel();
+
+			if (this->memoryOverBudget)
+				ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Over the memory budget of %u MB", Config::instance->memoryBudgetInMB);
+			if (ImGui::CollapsingHeader("Memory"))
+				this->RenderMemoryPanel();
 		}
 		// Legacy API style not yet fixed by ImGui
 		ImGui::End();
 	}
+	if (m_performancePanelOpen != this->performancePanelOpen)
+	{
+		this->performancePanelOpen = m_performancePanelOpen;
+		this->worldCells.SetCollectStepStats(m_performancePanelOpen);
+		this->frameTimes.Clear();
+		this->workerBusyNs.clear();
+	}
 	this->isInImguiWindow = ImGui::IsAnyWindowHovered();
 
 	if (this->worldDetailsWindowOpen)
@@ -377,11 +544,15 @@ void SimulatorPage::RenderImGui()
 
 			// Open the file
 			if (m_filePathName != "")
+			{
 				this->worldCells.Open(m_filePathName);
-
-			// Initialize the rendering of all the newly added cells
-			for (auto m_cell : this->worldCells.cells)
-				m_cell.second->InitRender(this->gridCellShader);
+				// A world of the user's own again
+				if (!this->remoteClient.IsConnected())
+				{
+					this->mirroredWorld = false;
+					this->AttachJournal();
+				}
+			}
 
 			auto m_topLeft = this->worldCells.GetCenterCoordinates();
 			this->scrollOffsetX = -(m_topLeft.first - 1);
@@ -402,10 +573,10 @@ void SimulatorPage::RenderImGui()
 			std::string m_filePathName = ImGuiFileDialog::Instance()->GetFilepathName();
 
 			// Save the file
-			if (m_filePathName != "")
+			if (m_filePathName != "" && !this->worldCells.IsSaving())
 			{
 				this->worldCells.filePath = m_filePathName;
-				this->worldCells.Save();
+				this->saveStarted = this->worldCells.Save();
 			}
 		}
 
@@ -413,6 +584,78 @@ void SimulatorPage::RenderImGui()
 		ImGuiFileDialog::Instance()->CloseDialog("saveWorldFile");
 	}
 
+	// Display the save profile file dialog
+	if (ImGuiFileDialog::Instance()->FileDialog("saveProfileFile"))
+	{
+		if (ImGuiFileDialog::Instance()->IsOk == true)
+		{
+			std::string m_filePathName = ImGuiFileDialog::Instance()->GetFilepathName();
+			if (m_filePathName != "" && !Profiler::WriteChromeTrace(m_filePathName))
+				std::cout << "Could not write the profile to " << m_filePathName << std::endl;
+		}
+
+		// close
+		ImGuiFileDialog::Instance()->CloseDialog("saveProfileFile");
+	}
+
+	// Display the save lock statistics file dialog
+	if (ImGuiFileDialog::Instance()->FileDialog("saveLockStatsFile"))
+	{
+		if (ImGuiFileDialog::Instance()->IsOk == true)
+		{
+			std::string m_filePathName = ImGuiFileDialog::Instance()->GetFilepathName();
+			if (m_filePathName != "" && !LockSite::WriteCsv(m_filePathName))
+				std::cout << "Could not write the lock statistics to " << m_filePathName << std::endl;
+		}
+
+		// close
+		ImGuiFileDialog::Instance()->CloseDialog("saveLockStatsFile");
+	}
+
+	// Display the open recording file dialog
+	if (ImGuiFileDialog::Instance()->FileDialog("openTraceFile"))
+	{
+		if (ImGuiFileDialog::Instance()->IsOk == true)
+		{
+			std::string m_filePathName = ImGuiFileDialog::Instance()->GetFilepathName();
+			if (m_filePathName != "" && this->tracePlayer.Open(m_filePathName))
+			{
+				this->worldCells.PauzeSimulation();
+				auto m_center = this->tracePlayer.GetCenterCoordinates();
+				this->scrollOffsetX = -(m_center.first - 1);
+				this->scrollOffsetY = -(m_center.second - 2);
+			}
+		}
+
+		// close
+		ImGuiFileDialog::Instance()->CloseDialog("openTraceFile");
+	}
+
+	// Display the record trace file dialog
+	if (ImGuiFileDialog::Instance()->FileDialog("recordTraceFile"))
+	{
+		if (ImGuiFileDialog::Instance()->IsOk == true)
+		{
+			std::string m_filePathName = ImGuiFileDialog::Instance()->GetFilepathName();
+			if (m_filePathName != "" && !this->traceRecorder.Start(&this->worldCells, m_filePathName, Config::instance->traceKeyframeInterval))
+				std::cout << "Could not record to " << m_filePathName << std::endl;
+		}
+
+		// close
+		ImGuiFileDialog::Instance()->CloseDialog("recordTraceFile");
+	}
+
+	// A recording that can't be written anymore is stopped, the Debug window keeps showing that it failed
+	if (this->traceRecorder.IsRecording() && this->traceRecorder.GetWriteFailed())
+	{
+		this->traceRecorder.Stop();
+		std::cout << "Recording stopped, the trace could not be written" << std::endl;
+	}
+
+	this->RenderRecoveryPopup();
+	this->RenderReplayWindow();
+	this->RenderServerWindow();
+
 	ImGui::Render();
 
 	ImGui::EndFrame();	
@@ -420,11 +663,424 @@ void SimulatorPage::RenderImGui()
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+void SimulatorPage::RenderRecoveryPopup()
+{
+	const char* m_popupName = "Recover unsaved work";
+	if (this->askForRecovery)
+	{
+		ImGui::OpenPopup(m_popupName);
+		this->askForRecovery = false;
+	}
+
+	if (ImGui::BeginPopupModal(m_popupName, nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+	{
+		ImGui::Text("The editor was not closed properly last time.");
+		ImGui::Text("Do you want to recover the unsaved work?");
+		// Replaying runs every generation up to the last edit, so it runs in the background
+		if (this->recoveryStarted)
+		{
+			if (this->editJournal.IsRecovering())
+				ImGui::ProgressBar(this->editJournal.GetRecoveryProgress(), ImVec2(-1.0f, 0.0f), "Recovering...");
+			else
+			{
+				this->recoveryStarted = false;
+				if (this->editJournal.FinishRecovery())
+				{
+					auto m_center = this->worldCells.GetCenterCoordinates();
+					this->scrollOffsetX = -(m_center.first - 1);
+					this->scrollOffsetY = -(m_center.second - 2);
+				}
+				this->recoveryPending = false;
+				this->AttachJournal();
+				ImGui::CloseCurrentPopup();
+			}
+		}
+		else
+		{
+			if (ImGui::Button("Recover"))
+			{
+				this->editJournal.StartRecovery(&this->worldCells);
+				this->recoveryStarted = true;
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Discard"))
+			{
+				this->editJournal.Discard();
+				this->recoveryPending = false;
+				this->AttachJournal();
+				ImGui::CloseCurrentPopup();
+			}
+		}
+		ImGui::EndPopup();
+	}
+}
+
+void SimulatorPage::RenderPerformancePanel()
+{
+	// Achieved speed and the busy time of every worker, sampled twice a second so the numbers can be read
+	double m_now = glfwGetTime();
+	if (this->workerBusyNs.empty() || m_now - this->workerSampleTime >= 0.5)
+	{
+		std::vector<unsigned long long> m_busyNs;
+		this->worldCells.GetWorkerBusyNs(&m_busyNs);
+		World::generationType m_generation = this->worldCells.GetDisplayGeneration();
+		if (!this->workerBusyNs.empty() && m_busyNs.size() == this->workerBusyNs.size())
+		{
+			double m_elapsedNs = (m_now - this->workerSampleTime) * 1000000000.0;
+			this->workerBusyRatios.resize(m_busyNs.size());
+			for (size_t m_i = 0; m_i < m_busyNs.size(); m_i++)
+				this->workerBusyRatios[m_i] = (float)std::min(1.0, (m_busyNs[m_i] - this->workerBusyNs[m_i]) / m_elapsedNs);
+			this->achievedSimulationSpeed = (float)((m_generation - this->workerSampleGeneration) / (m_now - this->workerSampleTime));
+		}
+		this->workerBusyNs = m_busyNs;
+		this->workerSampleGeneration = m_generation;
+		this->workerSampleTime = m_now;
+	}
+
+	ImGui::Text("Generations/s: %.1f of %.1f", this->worldCells.GetIsRunning() ? this->achievedSimulationSpeed : 0.0f, this->worldCells.GetTargetSpeed());
+
+	// The phases of the last generations
+	this->worldCells.GetStepStats(&this->scatterSamples, &this->syncSamples, &this->commitSamples, &this->stepSamples);
+	this->RenderPhaseStats("Scatter (ms)", this->scatterSamples);
+	this->RenderPhaseStats("Barrier wait (ms)", this->syncSamples);
+	this->RenderPhaseStats("Commit (ms)", this->commitSamples);
+	this->RenderPhaseStats("Generation (ms)", this->stepSamples);
+
+	// How much of the time every simulation thread was working, the last one processes the last part
+	for (size_t m_i = 0; m_i < this->workerBusyRatios.size(); m_i++)
+	{
+		char m_overlay[32];
+		snprintf(m_overlay, sizeof(m_overlay), "%.0f%% busy / %.0f%% idle", this->workerBusyRatios[m_i] * 100.0f, (1.0f - this->workerBusyRatios[m_i]) * 100.0f);
+		ImGui::ProgressBar(this->workerBusyRatios[m_i], ImVec2(-1, 0), m_overlay);
+	}
+
+	// Frame times
+	this->frameTimes.CopyTo(&this->frameSamples);
+	if (!this->frameSamples.empty())
+	{
+		this->sortedSamples = this->frameSamples;
+		std::sort(this->sortedSamples.begin(), this->sortedSamples.end());
+		char m_overlay[64];
+		snprintf(m_overlay, sizeof(m_overlay), "p50 %.2f p99 %.2f", GetPercentile(this->sortedSamples, 0.5f), GetPercentile(this->sortedSamples, 0.99f));
+		ImGui::PlotLines("Frame (ms)", this->frameSamples.data(), (int)this->frameSamples.size(), 0, m_overlay, 0.0f, FLT_MAX, ImVec2(0, 60));
+	}
+}
+
+void SimulatorPage::RenderPhaseStats(const char* a_label, const std::vector<float>& a_samples)
+{
+	if (a_samples.empty())
+	{
+		ImGui::Text("%s: no generations yet", a_label);
+		return;
+	}
+
+	this->sortedSamples = a_samples;
+	std::sort(this->sortedSamples.begin(), this->sortedSamples.end());
+	float m_min = this->sortedSamples.front();
+	float m_max = this->sortedSamples.back();
+
+	// Spread the samples over the bins between the fastest and the slowest generation
+	const int m_binCount = 32;
+	this->histogramBins.assign(m_binCount, 0.0f);
+	float m_binWidth = (m_max - m_min) / m_binCount;
+	for (float m_sample : this->sortedSamples)
+	{
+		int m_bin = m_binWidth > 0.0f ? (int)((m_sample - m_min) / m_binWidth) : 0;
+		this->histogramBins[std::min(m_bin, m_binCount - 1)] += 1.0f;
+	}
+
+	char m_overlay[96];
+	snprintf(m_overlay, sizeof(m_overlay), "p50 %.3f p95 %.3f p99 %.3f (%.3f - %.3f)",
+		GetPercentile(this->sortedSamples, 0.5f), GetPercentile(this->sortedSamples, 0.95f), GetPercentile(this->sortedSamples, 0.99f), m_min, m_max);
+	ImGui::PlotHistogram(a_label, this->histogramBins.data(), m_binCount, 0, m_overlay, 0.0f, FLT_MAX, ImVec2(0, 50));
+}
+
+void SimulatorPage::RenderLockPanel()
+{
+	if (ImGui::Button("Reset"))
+		LockSite::ResetAll();
+	ImGui::SameLine();
+	if (ImGui::Button("Export"))
+		ImGuiFileDialog::Instance()->OpenDialog("saveLockStatsFile", "Save lock statistics", ".csv", "");
+
+	// The sites that waited the longest first
+	LockSite::GetAll(&this->lockSites);
+	std::sort(this->lockSites.begin(), this->lockSites.end(), [](const LockSiteStats& a_left, const LockSiteStats& a_right) {
+		return a_left.waitNs > a_right.waitNs;
+	});
+
+	ImGui::Columns(6, "locks");
+	ImGui::Text("Site");
+	ImGui::NextColumn();
+	ImGui::Text("Count");
+	ImGui::NextColumn();
+	ImGui::Text("Contended");
+	ImGui::NextColumn();
+	ImGui::Text("Wait avg/max (us)");
+	ImGui::NextColumn();
+	ImGui::Text("Hold avg/max (us)");
+	ImGui::NextColumn();
+	ImGui::Text("Lock");
+	ImGui::NextColumn();
+	ImGui::Separator();
+	for (const LockSiteStats& m_site : this->lockSites)
+	{
+		if (m_site.acquisitions == 0)
+			continue;
+		ImGui::Text("%s", m_site.siteName.c_str());
+		ImGui::NextColumn();
+		ImGui::Text("%llu", m_site.acquisitions);
+		ImGui::NextColumn();
+		ImGui::Text("%llu", m_site.contentions);
+		ImGui::NextColumn();
+		ImGui::Text("%.1f / %.1f", m_site.contentions > 0 ? m_site.waitNs / 1000.0 / m_site.contentions : 0.0, m_site.maxWaitNs / 1000.0);
+		ImGui::NextColumn();
+		ImGui::Text("%.1f / %.1f", m_site.holdNs / 1000.0 / m_site.acquisitions, m_site.maxHoldNs / 1000.0);
+		ImGui::NextColumn();
+		ImGui::Text("%s", m_site.lockName.c_str());
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+}
+
+void SimulatorPage::UpdateMemoryAccounts()
+{
+	World::MemoryUsage m_world = this->worldCells.GetMemoryUsage();
+	size_t m_renderStaging = this->cellInstances.capacity() * sizeof(CellInstance) + this->conductorChunks.capacity() * sizeof(ConductorChunkDraw) +
+		this->densityTexels.capacity() + this->viewportStager.GetMemoryUsage() + this->conductorLayer.GetMemoryUsage() + this->densityPyramid.GetMemoryUsage();
+
+	this->memoryAccounts.clear();
+	this->memoryAccounts.push_back(MemoryAccount{ "Cell storage", m_world.cellStorage });
+	this->memoryAccounts.push_back(MemoryAccount{ "Map nodes", m_world.mapNodes });
+	this->memoryAccounts.push_back(MemoryAccount{ "Snapshots", m_world.snapshots });
+	this->memoryAccounts.push_back(MemoryAccount{ "Traces", this->traceRecorder.GetMemoryUsage() + this->tracePlayer.GetMemoryUsage() });
+	this->memoryAccounts.push_back(MemoryAccount{ "Render staging", m_renderStaging });
+	this->memoryAccounts.push_back(MemoryAccount{ "Edit journal", this->editJournal.GetMemoryUsage() });
+
+	this->memoryTotal = 0;
+	for (const MemoryAccount& m_account : this->memoryAccounts)
+		this->memoryTotal += m_account.bytes;
+	this->memoryCells = m_world.cells;
+}
+
+void SimulatorPage::CheckMemoryBudget()
+{
+	double m_now = glfwGetTime();
+	if (this->memoryCheckTime >= 0 && m_now - this->memoryCheckTime < 1.0)
+		return;
+	this->memoryCheckTime = m_now;
+	this->UpdateMemoryAccounts();
+
+	size_t m_budget = (size_t)Config::instance->memoryBudgetInMB * 1024 * 1024;
+	bool m_overBudget = m_budget > 0 && this->memoryTotal > m_budget;
+	if (m_overBudget && !this->memoryOverBudget)
+	{
+		// Only the caches can go, the cells themselves are the world
+		this->CompactMemory();
+		this->UpdateMemoryAccounts();
+		m_overBudget = this->memoryTotal > m_budget;
+		if (m_overBudget)
+			std::cout << "Using " << this->memoryTotal / (1024 * 1024) << " MB, over the budget of " << Config::instance->memoryBudgetInMB << " MB" << std::endl;
+	}
+	this->memoryOverBudget = m_overBudget;
+}
+
+void SimulatorPage::CompactMemory()
+{
+	this->cellInstances.clear();
+	this->cellInstances.shrink_to_fit();
+	this->conductorChunks.clear();
+	this->conductorChunks.shrink_to_fit();
+	this->densityTexels.clear();
+	this->densityTexels.shrink_to_fit();
+	this->conductorLayer.Compact();
+	// Makes the next frame query and upload everything again
+	this->drawnWorldVersion = (unsigned long long)-1;
+}
+
+void SimulatorPage::RenderMemoryPanel()
+{
+	if (ImGui::Button("Compact"))
+	{
+		this->CompactMemory();
+		this->memoryCheckTime = -1;
+	}
+	ImGui::SameLine();
+	int m_budget = (int)Config::instance->memoryBudgetInMB;
+	ImGui::PushItemWidth(100);
+	if (ImGui::InputInt("Budget (MB)", &m_budget, 256, 1024))
+		Config::instance->memoryBudgetInMB = (unsigned int)std::max(m_budget, 0);
+	ImGui::PopItemWidth();
+
+	ImGui::Columns(3, "memory");
+	ImGui::Text("Subsystem");
+	ImGui::NextColumn();
+	ImGui::Text("KB");
+	ImGui::NextColumn();
+	ImGui::Text("Bytes per cell");
+	ImGui::NextColumn();
+	ImGui::Separator();
+	for (const MemoryAccount& m_account : this->memoryAccounts)
+	{
+		ImGui::Text("%s", m_account.name);
+		ImGui::NextColumn();
+		ImGui::Text("%zu", m_account.bytes / 1024);
+		ImGui::NextColumn();
+		ImGui::Text("%.1f", this->memoryCells > 0 ? (double)m_account.bytes / this->memoryCells : 0.0);
+		ImGui::NextColumn();
+	}
+	ImGui::Separator();
+	ImGui::Text("Total");
+	ImGui::NextColumn();
+	ImGui::Text("%zu", this->memoryTotal / 1024);
+	ImGui::NextColumn();
+	ImGui::Text("%.1f", this->memoryCells > 0 ? (double)this->memoryTotal / this->memoryCells : 0.0);
+	ImGui::NextColumn();
+	ImGui::Columns(1);
+	ImGui::TextDisabled("Estimated from the sizes of the structures, without allocator overhead and GPU memory");
+}
+
+void SimulatorPage::RenderReplayWindow()
+{
+	if (!this->tracePlayer.IsOpen())
+		return;
+
+	if (ImGui::Begin("Replay", nullptr, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize))
+	{
+		World::generationType m_position = this->tracePlayer.GetPosition();
+		World::generationType m_first = this->tracePlayer.GetFirstPosition();
+		World::generationType m_last = this->tracePlayer.GetLastPosition();
+
+		if (ImGui::Button("<") && m_position > m_first)
+			this->tracePlayer.Seek(m_position - 1);
+		ImGui::SameLine();
+		if (ImGui::Button(this->tracePlayer.GetIsPlaying() ? "Pause" : "Play"))
+			this->tracePlayer.SetPlaying(!this->tracePlayer.GetIsPlaying());
+		ImGui::SameLine();
+		if (ImGui::Button(">") && m_position < m_last)
+			this->tracePlayer.Seek(m_position + 1);
+		ImGui::SameLine();
+		if (ImGui::Button("Close replay"))
+			this->tracePlayer.Close();
+
+		// Scrubbing, seeks straight to the position under the slider. That is the generation, unless the
+		// world was reset to an earlier one during the recording.
+		ImGui::SetNextItemWidth(300);
+		if (ImGui::SliderScalar("Position", ImGuiDataType_U64, &m_position, &m_first, &m_last, "%llu"))
+			this->tracePlayer.Seek(m_position);
+
+		float m_speed = this->tracePlayer.GetPlaybackSpeed();
+		ImGui::SetNextItemWidth(300);
+		if (ImGui::SliderFloat("Speed (gen/s)", &m_speed, -100000.0f, 100000.0f, "%.0f", 5.0f))
+			this->tracePlayer.SetPlaybackSpeed(m_speed);
+	}
+	// Legacy API style not yet fixed by ImGui
+	ImGui::End();
+}
+
+void SimulatorPage::RenderServerWindow()
+{
+	// The server went away, the world keeps what it got last
+	if (this->wasConnected && !this->remoteClient.IsConnected())
+		this->DisconnectFromServer();
+
+	const char* m_confirmName = "Replace the world";
+	if (this->confirmConnect)
+	{
+		ImGui::OpenPopup(m_confirmName);
+		this->confirmConnect = false;
+	}
+	if (ImGui::BeginPopupModal(m_confirmName, nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+	{
+		ImGui::Text("Connecting replaces the world with the one of the server.");
+		ImGui::Text("Edits that weren't saved are lost.");
+		if (ImGui::Button("Connect"))
+		{
+			this->ConnectToServer();
+			ImGui::CloseCurrentPopup();
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Cancel"))
+			ImGui::CloseCurrentPopup();
+		ImGui::EndPopup();
+	}
+
+	if (!this->serverWindowOpen)
+		return;
+
+	if (ImGui::Begin("Server", &this->serverWindowOpen, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize))
+	{
+		if (this->remoteClient.IsConnected())
+		{
+			ImGui::Text("Connected to %s:%d", this->serverHost, this->serverPort);
+			ImGui::Text("Generation %llu", this->remoteClient.GetGeneration());
+			ImGui::Text("%llu frames, %llu KB", this->remoteClient.GetFramesReceived(), this->remoteClient.GetBytesReceived() / 1024);
+			ImGui::Text("%llu generations skipped", this->remoteClient.GetGenerationsSkipped());
+			if (ImGui::Button("Disconnect"))
+				this->DisconnectFromServer();
+		}
+		else
+		{
+			ImGui::InputText("Host", this->serverHost, sizeof(this->serverHost));
+			ImGui::InputInt("Port", &this->serverPort);
+			if (ImGui::Button("Connect"))
+			{
+				// An empty world has nothing to lose
+				std::array<cellCountType, 3> m_statistics = this->worldCells.GetStatistics();
+				if (m_statistics[0] + m_statistics[1] + m_statistics[2] > 0)
+					this->confirmConnect = true;
+				else
+					this->ConnectToServer();
+			}
+			if (this->mirroredWorld)
+				ImGui::Text("The world is a copy of the server's, open a world to autosave edits again");
+		}
+	}
+	// Legacy API style not yet fixed by ImGui
+	ImGui::End();
+}
+
+void SimulatorPage::ConnectToServer()
+{
+	this->worldCells.PauzeSimulation();
+	// What the server sends isn't work of the user, it doesn't go in the autosave
+	this->editJournal.Detach();
+	if (!this->remoteClient.Connect(this->serverHost, (unsigned short)this->serverPort, 2000))
+	{
+		std::cout << "Could not connect to " << this->serverHost << ":" << this->serverPort << std::endl;
+		this->remoteClient.Disconnect();
+		this->AttachJournal();
+		return;
+	}
+	// The user chose to let the local world go, so its autosave goes too
+	if (!this->recoveryPending)
+		this->editJournal.Discard();
+	this->wasConnected = true;
+	this->mirroredWorld = true;
+	this->worldCells.LoadSnapshot(std::vector<CellSnapshot>(), 0);
+}
+
+void SimulatorPage::DisconnectFromServer()
+{
+	this->remoteClient.Disconnect();
+	this->wasConnected = false;
+	// The world keeps the copy of the server, it is autosaved again once the user opens a world of their own
+	this->AttachJournal();
+}
+
+void SimulatorPage::AttachJournal()
+{
+	if (!this->editJournal.IsAttached() && !this->recoveryPending && !this->mirroredWorld && !this->remoteClient.IsConnected())
+		this->editJournal.Attach(&this->worldCells);
+}
+
 void SimulatorPage::MouseHover(GLFWwindow* a_window, double a_posX, double a_posY)
 {
 	int m_cellSizeInPx = this->pixeledView ? 1 : this->cellSizeInPx;
-	coordinatePart m_curCellXHovered = (((coordinatePart)this->gridLineSizeInPx + (coordinatePart)a_posX) / (coordinatePart)m_cellSizeInPx);
-	coordinatePart m_curCellYHovered = (((coordinatePart)this->gridLineSizeInPx + (coordinatePart)a_posY) / (coordinatePart)m_cellSizeInPx);
+	// In the overview a pixel is more than one cell
+	coordinatePart m_cellsPerPixel = this->pixeledView ? (coordinatePart)1 << this->overviewLevel : 1;
+	coordinatePart m_curCellXHovered = (((coordinatePart)this->gridLineSizeInPx + (coordinatePart)a_posX) / (coordinatePart)m_cellSizeInPx) * m_cellsPerPixel;
+	coordinatePart m_curCellYHovered = (((coordinatePart)this->gridLineSizeInPx + (coordinatePart)a_posY) / (coordinatePart)m_cellSizeInPx) * m_cellsPerPixel;
 	
 	static coordinatePart m_lastCellX = 0;
 	static coordinatePart m_lastCellY = 0;
@@ -533,6 +1189,16 @@ void SimulatorPage::MouseScroll(GLFWwindow* a_window, double a_xOffset, double a
 {
 	if (this->isInImguiWindow)
 		return;
+
+	// At a pixel per cell, zooming goes on with the overview
+	if (this->pixeledView)
+	{
+		if (a_yOffset < 0 && this->overviewLevel < this->maxOverviewLevel)
+			this->overviewLevel++;
+		else if (a_yOffset > 0 && this->overviewLevel > 0)
+			this->overviewLevel--;
+		return;
+	}
 	
 	// Zoom in
 	if (a_yOffset > 0 && this->cellSizeInPx < 128)
@@ -592,9 +1258,9 @@ void SimulatorPage::KeyPress(GLFWwindow* a_window, int a_key, int a_scancode, in
 	}
 }
 
-void SimulatorPage::RenderCells()
+void SimulatorPage::RenderCells(bool a_reuseRenderData)
 {
-	// Get all of the cells that are located within the view port
+	// The view port in cells
 	coordinatePart m_viewportOriginX = -1 - this->scrollOffsetX;
 	coordinatePart m_viewportOriginY = -1 - this->scrollOffsetY;
 
@@ -603,89 +1269,266 @@ void SimulatorPage::RenderCells()
 	long m_viewportWidth = (this->screenWidth / m_cellSizeInPx) + 2;
 	long m_viewportHeight = (this->screenHeight / m_cellSizeInPx) + 2;
 
-	static std::vector<Cell*> m_cellsInViewport;
-	m_cellsInViewport.clear();
-	this->worldCells.InViewport(&m_cellsInViewport, m_viewportOriginX, m_viewportOriginY, m_viewportWidth, m_viewportHeight);
-
-	// Set the projection matrix
+	// Set the projection matrix, the cell size and the colors, the shader calculates the rest
 	this->gridCellShader.Use();
 	this->gridCellShader.SetMatrixValue("u_ProjectionMatrix", &this->projectionMatrix[0][0]);
+	this->gridCellShader.SetInt("u_CellSizeInPx", m_cellSizeInPx);
+	glm::vec3 m_palette[3] = { Config::instance->conductorColor, Config::instance->headColor, Config::instance->tailColor };
+	this->gridCellShader.SetVec3Array("u_Palette", m_palette, 3);
+	GLint m_originUniform = this->gridCellShader.GetUniformLocation("u_Origin");
 
-	// Set the scaling matrix for the cell
-	glm::mat4 m_scaleMatrix = glm::scale(glm::vec3(m_cellSizeInPx, m_cellSizeInPx, 0.0f));
-	this->gridCellShader.SetMatrixValue("u_ModelMatrix", &m_scaleMatrix[0][0]);
-	
-	// Render all of the world cells
-	int m_pendingCellRenders = 0;
-	for (auto m_worldCell : m_cellsInViewport)
+	// The chunks and electrons of the last frame are kept when nothing changed
+	if (!a_reuseRenderData && this->tracePlayer.IsOpen())
 	{
-		if(m_worldCell != nullptr)
+		// A replay has no cached layer, send every cell
+		this->cellInstances.clear();
+		static std::vector<Cell*> m_cellsInViewport;
+		m_cellsInViewport.clear();
+		this->tracePlayer.InViewport(&m_cellsInViewport, m_viewportOriginX, m_viewportOriginY, m_viewportWidth, m_viewportHeight);
+		for (auto m_worldCell : m_cellsInViewport)
 		{
-			// Set the VAO
-			glBindVertexArray(this->cellVaoBuffer);
-			
-			// Get the latest color and offsets at their place in the array
-			m_worldCell->Render(m_cellSizeInPx, this->scrollOffsetX, this->scrollOffsetY, &this->cellOffsets[m_pendingCellRenders], &this->cellColors[m_pendingCellRenders]);
-			m_pendingCellRenders++;
-
-			if (m_pendingCellRenders == InstanceBufferSize)
-			{
-				// If we filled all the buffers, copy them to the GPU, render them and start over again
-				this->UpdateAndRenderPendingCells(m_pendingCellRenders);
-				m_pendingCellRenders = 0;
-			}
+			if (m_worldCell != nullptr)
+				this->cellInstances.push_back(CellInstance{ (short)(m_worldCell->x - m_viewportOriginX), (short)(m_worldCell->y - m_viewportOriginY), (unsigned char)m_worldCell->cellState });
 		}
 	}
+	else if (!a_reuseRenderData)
+	{
+		this->conductorChunks.clear();
+		this->conductorLayer.GetChunksInViewport(&this->conductorChunks, m_viewportOriginX, m_viewportOriginY, m_viewportWidth, m_viewportHeight);
+		this->frameUploadBytes += this->conductorLayer.GetLastUploadBytes();
+
+		// Only the heads and tails are sent every frame
+		this->cellInstances.clear();
+		this->conductorLayer.GetElectronsInViewport(&this->cellInstances, m_viewportOriginX, m_viewportOriginY, m_viewportWidth, m_viewportHeight);
+	}
 
-	// If there are any cells that where left in the buffer, send them to GPU and render them
-	if (m_pendingCellRenders > 0)
+	// Draw the conductors straight from the buffers of their chunks, they only change with edits
+	if (!this->tracePlayer.IsOpen())
 	{
-		this->UpdateAndRenderPendingCells(m_pendingCellRenders);
-		m_pendingCellRenders = 0;
+		glBindVertexArray(this->cellVaoBuffer);
+		for (const ConductorChunkDraw& m_chunk : this->conductorChunks)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, m_chunk.buffer);
+			glVertexAttribIPointer(2, 2, GL_SHORT, sizeof(CellInstance), (GLvoid*)offsetof(CellInstance, x));
+			glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, sizeof(CellInstance), (GLvoid*)offsetof(CellInstance, state));
+			glUniform2i(m_originUniform, (GLint)(m_chunk.originX - m_viewportOriginX - 1), (GLint)(m_chunk.originY - m_viewportOriginY - 1));
+			glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0, m_chunk.cellCount);
+			this->frameDrawCalls++;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
 	}
+
+	// Send them to the GPU and render them, in one go unless they don't fit in the ring buffer.
+	// Their positions are relative to the viewport origin, the first cell left of and above the screen
+	glUniform2i(m_originUniform, -1, -1);
+	int m_pendingCellRenders = (int)this->cellInstances.size();
+	const int m_maxInstancesPerDraw = InstanceRingBufferSize / sizeof(CellInstance);
+	for (int m_first = 0; m_first < m_pendingCellRenders; m_first += m_maxInstancesPerDraw)
+		this->UpdateAndRenderPendingCells(&this->cellInstances[m_first], std::min(m_pendingCellRenders - m_first, m_maxInstancesPerDraw));
 }
 
-void SimulatorPage::UpdateAndRenderPendingCells(int a_pendingCellRenders)
+void SimulatorPage::UpdateAndRenderPendingCells(const CellInstance* a_instances, int a_pendingCellRenders)
 {
+	PROFILE_ZONE("upload");
 	glBindVertexArray(this->cellVaoBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, this->cellInstanceBuffer);
+
+	// When the rest of the ring is too small, orphan the buffer. The driver hands out new memory 
+	// while the GPU still draws from the old, so nothing waits
+	size_t m_uploadSize = sizeof(CellInstance) * a_pendingCellRenders;
+	if (this->cellInstanceBufferOffset + m_uploadSize > InstanceRingBufferSize)
+	{
+		glBufferData(GL_ARRAY_BUFFER, InstanceRingBufferSize, nullptr, GL_STREAM_DRAW);
+		this->cellInstanceBufferOffset = 0;
+	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, this->cellOffsetBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * InstanceBufferSize, &this->cellOffsets[0], GL_DYNAMIC_DRAW);
+	// Only the used part is written, it was never written since the last orphaning so no synchronization is needed
+	void* m_mapped = glMapBufferRange(GL_ARRAY_BUFFER, this->cellInstanceBufferOffset, m_uploadSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (m_mapped != nullptr)
+	{
+		memcpy(m_mapped, a_instances, m_uploadSize);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+
+		// Point the instance data at the part we just wrote
+		glVertexAttribIPointer(2, 2, GL_SHORT, sizeof(CellInstance), (GLvoid*)(this->cellInstanceBufferOffset + offsetof(CellInstance, x)));
+		glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, sizeof(CellInstance), (GLvoid*)(this->cellInstanceBufferOffset + offsetof(CellInstance, state)));
+		glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0, a_pendingCellRenders);
 
-	glBindBuffer(GL_ARRAY_BUFFER, this->cellColorBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * InstanceBufferSize, &this->cellColors[0], GL_DYNAMIC_DRAW);
-	glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0, a_pendingCellRenders);
+		this->cellInstanceBufferOffset += m_uploadSize;
+		this->frameUploadBytes += m_uploadSize;
+		this->frameDrawCalls++;
+	}
 
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 }
 
+void SimulatorPage::RenderCellsAsTexture(bool a_reuseRenderData)
+{
+	// Get all of the cells that are located within the view port
+	coordinatePart m_viewportOriginX = -1 - this->scrollOffsetX;
+	coordinatePart m_viewportOriginY = -1 - this->scrollOffsetY;
+
+	int m_cellSizeInPx = this->pixeledView ? 1 : this->cellSizeInPx;
+
+	int m_viewportWidth = (this->screenWidth / m_cellSizeInPx) + 2;
+	int m_viewportHeight = (this->screenHeight / m_cellSizeInPx) + 2;
+
+	glBindTexture(GL_TEXTURE_2D, this->cellStateTexture);
+
+	// The texture of the last frame still holds the right states when nothing changed
+	if (!a_reuseRenderData)
+	{
+		// The states are written by the stager threads, the world is prepared ahead during the last frame.
+		// A recording is changed on this thread, so it can only be prepared while we wait for it
+		bool m_replay = this->tracePlayer.IsOpen();
+		if (m_replay || this->stagedWorldVersion != this->drawnWorldVersion || !this->viewportStager.IsPreparing(m_viewportOriginX, m_viewportOriginY, m_viewportWidth, m_viewportHeight))
+		{
+			this->stagedWorldVersion = this->drawnWorldVersion;
+			this->viewportStager.Start(this->GetStateSource(), m_viewportOriginX, m_viewportOriginY, m_viewportWidth, m_viewportHeight);
+		}
+		const std::vector<unsigned char>& m_cellStates = this->viewportStager.Wait();
+		size_t m_textureSize = m_cellStates.size();
+
+		PROFILE_ZONE("upload");
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		// A different zoom or screen size needs a differently sized texture
+		if (m_viewportWidth != this->cellStateTextureWidth || m_viewportHeight != this->cellStateTextureHeight)
+		{
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, m_viewportWidth, m_viewportHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+			this->cellStateTextureWidth = m_viewportWidth;
+			this->cellStateTextureHeight = m_viewportHeight;
+		}
+
+		// Stream the states through the pixel buffer, orphaning it so we never wait on the upload of the last frame
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->cellStatePixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, m_textureSize, nullptr, GL_STREAM_DRAW);
+		void* m_mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_textureSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (m_mapped != nullptr)
+		{
+			memcpy(m_mapped, m_cellStates.data(), m_textureSize);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_viewportWidth, m_viewportHeight, GL_RED_INTEGER, GL_UNSIGNED_BYTE, (void*)0);
+			this->frameUploadBytes += m_textureSize;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		this->GetError(__LINE__);
+
+		// Start on the next frame, it is most likely the same viewport.
+		// Anything the world does after this point makes the next frame prepare again
+		if (!m_replay)
+		{
+			this->stagedWorldVersion = this->worldVersion.load();
+			this->viewportStager.Start(this->GetStateSource(), m_viewportOriginX, m_viewportOriginY, m_viewportWidth, m_viewportHeight);
+		}
+	}
+
+	// Set the uniforms
+	this->cellTextureShader.Use();
+	glm::vec3 m_palette[3] = { Config::instance->conductorColor, Config::instance->headColor, Config::instance->tailColor };
+	this->cellTextureShader.SetVec3Array("u_Palette", m_palette, 3);
+	this->cellTextureShader.SetVec4("u_GridColor", glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+	this->cellTextureShader.SetInt("u_CellSizeInPx", m_cellSizeInPx);
+	this->cellTextureShader.SetInt("u_GridLineSizeInPx", this->pixeledView ? 0 : this->gridLineSizeInPx);
+	this->cellTextureShader.SetInt("u_ScreenHeight", this->screenHeight);
+	this->cellTextureShader.SetInt("u_CellStates", 0);
+
+	// Draw the whole screen at once
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(this->cellTextureVaoBuffer);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	this->frameDrawCalls++;
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+ViewportStager::StateSource SimulatorPage::GetStateSource()
+{
+	if (this->tracePlayer.IsOpen())
+		return [this](unsigned char* a_output, size_t a_stride, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height) {
+			this->tracePlayer.StatesInViewport(a_output, a_stride, a_x, a_y, a_width, a_height);
+		};
+	return [this](unsigned char* a_output, size_t a_stride, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height) {
+		this->worldCells.StatesInViewport(a_output, a_stride, a_x, a_y, a_width, a_height);
+	};
+}
+
+void SimulatorPage::RenderOverview(bool a_reuseRenderData)
+{
+	// Use the finest level the pyramid keeps, its blocks may be bigger than a pixel
+	unsigned int m_level = std::max(this->overviewLevel, (unsigned int)DensityFirstLevel);
+	int m_blockSizeInPx = 1 << (m_level - this->overviewLevel);
+	coordinatePart m_cellsPerBlock = (coordinatePart)1 << m_level;
+
+	// The block under the top left corner of the screen
+	coordinatePart m_topLeftX = -this->scrollOffsetX;
+	coordinatePart m_topLeftY = -this->scrollOffsetY;
+	coordinatePart m_firstBlockX = (m_topLeftX >= 0 ? m_topLeftX : m_topLeftX - (m_cellsPerBlock - 1)) / m_cellsPerBlock;
+	coordinatePart m_firstBlockY = (m_topLeftY >= 0 ? m_topLeftY : m_topLeftY - (m_cellsPerBlock - 1)) / m_cellsPerBlock;
+
+	int m_textureWidth = (this->screenWidth / m_blockSizeInPx) + 2;
+	int m_textureHeight = (this->screenHeight / m_blockSizeInPx) + 2;
+	glBindTexture(GL_TEXTURE_2D, this->densityTexture);
+
+	// The texture of the last frame is still right when nothing changed
+	if (!a_reuseRenderData)
+	{
+		this->densityTexels.resize((size_t)m_textureWidth * m_textureHeight * 4);
+		{
+			PROFILE_ZONE("render prep");
+			this->densityPyramid.FillDensityImage(m_level, m_firstBlockX, m_firstBlockY, m_textureWidth, m_textureHeight, this->densityTexels.data());
+		}
+
+		PROFILE_ZONE("upload");
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		if (m_textureWidth != this->densityTextureWidth || m_textureHeight != this->densityTextureHeight)
+		{
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_textureWidth, m_textureHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			this->densityTextureWidth = m_textureWidth;
+			this->densityTextureHeight = m_textureHeight;
+		}
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_textureWidth, m_textureHeight, GL_RGBA, GL_UNSIGNED_BYTE, this->densityTexels.data());
+		this->frameUploadBytes += this->densityTexels.size();
+	}
+
+	// Set the uniforms
+	this->densityShader.Use();
+	glm::vec3 m_palette[3] = { Config::instance->conductorColor, Config::instance->headColor, Config::instance->tailColor };
+	this->densityShader.SetVec3Array("u_Palette", m_palette, 3);
+	this->densityShader.SetInt("u_BlockSizeInPx", m_blockSizeInPx);
+	this->densityShader.SetInt("u_ScreenHeight", this->screenHeight);
+	this->densityShader.SetInt("u_Density", 0);
+
+	// Draw the whole screen at once
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(this->cellTextureVaoBuffer);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	this->frameDrawCalls++;
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void SimulatorPage::RenderGrid()
 {
 	if (this->pixeledView)
 		return;
 
-	this->gridLineShader.Use();
-	
-	// Get the uniforms
-	int m_projectionMatrixUniform = this->gridLineShader.GetUniformLocation("u_ProjectionMatrix");
-	int m_drawHorizontalUniform = this->gridLineShader.GetUniformLocation("u_DrawHorizontal");
-	int m_cellSizeInPxUniform = this->gridLineShader.GetUniformLocation("u_CellSizeInPx");
-	int m_colorUniform = this->gridLineShader.GetUniformLocation("u_Color");
-
 	// Set the grid line size
 	glLineWidth((GLfloat)this->gridLineSizeInPx);
 
 	// Set the projection matrix
-	glUniformMatrix4fv(m_projectionMatrixUniform, 1, GL_FALSE, &this->projectionMatrix[0][0]);
+	this->gridLineShader.SetMatrixValue("u_ProjectionMatrix", &this->projectionMatrix[0][0]);
 
 	// Set the line color
-	glUniform4f(m_colorUniform, 0.5f, 0.5f, 0.5f, 1.0f);
+	this->gridLineShader.SetVec4("u_Color", glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
 
 	// Set the cell size in pixels
-	glUniform1i(m_cellSizeInPxUniform, this->cellSizeInPx);
+	this->gridLineShader.SetInt("u_CellSizeInPx", this->cellSizeInPx);
 
 	// Draw horizontal grid lines
-	glUniform1i(m_drawHorizontalUniform, 1);
+	this->gridLineShader.SetInt("u_DrawHorizontal", 1);
 
 	int m_lineCount = this->screenHeight / this->cellSizeInPx;
 
@@ -694,7 +1537,7 @@ void SimulatorPage::RenderGrid()
 	glDrawArraysInstanced(GL_LINES, 0, 2, m_lineCount + 2);
 
 	// Draw vertical grid lines
-	glUniform1i(m_drawHorizontalUniform, 0);
+	this->gridLineShader.SetInt("u_DrawHorizontal", 0);
 
 	glBindVertexArray(this->gridVerticalLineVaoBuffer);
 
@@ -707,30 +1550,40 @@ void SimulatorPage::RenderGrid()
 
 void SimulatorPage::AddCellToWorld(coordinatePart a_x, coordinatePart a_y)
 {
+	// A recorded run can't be edited, and single cells can't be seen in the overview
+	if (this->tracePlayer.IsOpen() || (this->pixeledView && this->overviewLevel > 0))
+		return;
+
 	CellState m_cellState = this->cellDrawState; 
 	if (m_cellState == Background)
 		this->RemoveCellFromWorld(a_x, a_y);
+	else if (this->remoteClient.IsConnected())
+	{
+		// The edit goes to the server, it comes back with the next frame
+		this->remoteClient.SendEdits(std::vector<CellSnapshot>{ CellSnapshot{ a_x, a_y, m_cellState } });
+	}
 	else
 	{
-		bool m_doInit = false;
-		if (this->worldCells.TryInsertCellAt(a_x, a_y, m_cellState))
-			m_doInit = true;
-
-		Shader* m_shader = &this->gridCellShader;
-		this->worldCells.TryUpdateCell(a_x, a_y, 
-			[m_cellState, m_doInit, m_shader](Cell* a_foundCell) -> bool 
-			{ 
-				if (m_doInit)
-					a_foundCell->InitRender(*m_shader);
-
-				a_foundCell->cellState = m_cellState;
-				return true;
-			}
-		);
+		// Change the state of the cell if there already is one
+		if (!this->worldCells.TryInsertCellAt(a_x, a_y, m_cellState))
+		{
+			this->worldCells.TryUpdateCell(a_x, a_y, 
+				[m_cellState](Cell* a_foundCell) -> bool 
+				{ 
+					a_foundCell->cellState = m_cellState;
+					return true;
+				}
+			);
+		}
 	}
 }
 
 void SimulatorPage::RemoveCellFromWorld(coordinatePart a_x, coordinatePart a_y)
 {
-	this->worldCells.TryDeleteCell(a_x, a_y);
+	if (this->tracePlayer.IsOpen() || (this->pixeledView && this->overviewLevel > 0))
+		return;
+	if (this->remoteClient.IsConnected())
+		this->remoteClient.SendEdits(std::vector<CellSnapshot>{ CellSnapshot{ a_x, a_y, Background } });
+	else
+		this->worldCells.TryDeleteCell(a_x, a_y);
 }
\ No newline at end of file
@@ -27,6 +27,8 @@ SOFTWARE.
 #include <iostream>
 #include <thread>
 #include <map>
+#include <atomic>
+#include <algorithm>
 
 // GLAD, GLM and GLFW
 #include <glad\glad.h>
@@ -50,16 +52,42 @@ SOFTWARE.
 #include "cell.h"
 #include "shader.h"
 #include "config.h"
+#include "editJournal.h"
+#include "traceRecorder.h"
+#include "tracePlayer.h"
+#include "conductorLayerCache.h"
+#include "densityPyramid.h"
+#include "viewportStager.h"
+#include "statsRing.h"
+#include "lockStats.h"
+#include "simulationClient.h"
 
 #ifndef __SIMULATORPAGE__
 #define __SIMULATORPAGE__
-#define InstanceBufferSize 1024*24
+// Size in bytes of the buffer that cell instances are streamed through
+#define InstanceRingBufferSize 1024*1024*4
 
 class SimulatorPage : public Page
 {
 private:
 	const char* glsl_version = "#version 330 core";
 	World worldCells;
+	// Autosave of all the edits, so a crash doesn't lose any work
+	EditJournal editJournal{ Config::instance->autosaveFolder };
+	bool askForRecovery = false; // Opens the recovery popup on the next frame
+	bool recoveryPending = false; // Until the user chose to recover or discard, nothing is journaled over the autosave
+	bool recoveryStarted = false;
+	TraceRecorder traceRecorder;
+	// When a recording is opened, it is shown instead of the world
+	TracePlayer tracePlayer;
+	// Connected to a simulation server, the world only holds what the server sends of the view
+	SimulationClient remoteClient;
+	bool serverWindowOpen = false;
+	bool confirmConnect = false; // Opens the popup that asks before the world is replaced
+	bool wasConnected = false; // Tells a lost connection apart from never having connected
+	bool mirroredWorld = false; // A copy of the world of the server, not work of the user so it isn't autosaved
+	char serverHost[128] = "127.0.0.1";
+	int serverPort = ServerDefaultPort;
 
 	// ImGUI
 	ImGuiIO* imguiIO;
@@ -70,6 +98,8 @@ private:
 	// Shaders
 	Shader gridLineShader;
 	Shader gridCellShader;
+	Shader cellTextureShader;
+	Shader densityShader;
 
 	// Vertices, Indices and Matrices
 	glm::vec2 cellVertices[6] = {
@@ -94,8 +124,10 @@ private:
 		glm::vec2(0.0f, this->screenHeight),
 	};
 
-	glm::vec2 cellOffsets[InstanceBufferSize];
-	glm::vec3 cellColors[InstanceBufferSize];
+	// The data of every visible cell, or only the heads and tails when the conductor layer is cached
+	std::vector<CellInstance> cellInstances;
+	ConductorLayerCache conductorLayer;
+	std::vector<ConductorChunkDraw> conductorChunks;
 	
 	// OpenGL objects
 
@@ -106,9 +138,94 @@ private:
 	GLuint cellVaoBuffer = -1;
 	GLuint cellVboBuffer = -1;
 	GLuint cellEboBuffer = -1;
-	GLuint cellOffsetBuffer = -1;
-	GLuint cellColorBuffer = -1;
+	GLuint cellInstanceBuffer = -1;
+	size_t cellInstanceBufferOffset = 0; // Where the next upload goes in the ring buffer
+
+	// What it took to draw this frame
+	size_t frameUploadBytes = 0;
+	int frameDrawCalls = 0;
 	
+	// Counted up by the world for every generation and edit, a frame is only drawn when it changed
+	std::atomic<unsigned long long> worldVersion{ 0 };
+	std::atomic<bool> redrawPosted{ false };
+	unsigned long long drawnWorldVersion = (unsigned long long)-1;
+	unsigned int worldListenerId = 0;
+
+	// What the last frame was drawn from, when none of it changed the render data of that frame is drawn again
+	struct RenderedView
+	{
+		coordinatePart scrollOffsetX;
+		coordinatePart scrollOffsetY;
+		int cellSizeInPx;
+		bool pixeledView;
+		unsigned int overviewLevel;
+		bool textureRendering;
+		int screenWidth;
+		int screenHeight;
+		World::generationType replayGeneration; // -1 without a replay
+
+		bool operator==(const RenderedView& a_other) const
+		{
+			return this->scrollOffsetX == a_other.scrollOffsetX && this->scrollOffsetY == a_other.scrollOffsetY &&
+				this->cellSizeInPx == a_other.cellSizeInPx && this->pixeledView == a_other.pixeledView &&
+				this->overviewLevel == a_other.overviewLevel && this->textureRendering == a_other.textureRendering &&
+				this->screenWidth == a_other.screenWidth && this->screenHeight == a_other.screenHeight &&
+				this->replayGeneration == a_other.replayGeneration;
+		}
+	};
+	RenderedView renderedView{};
+
+	// Texture rendering, the visible cells are uploaded as one byte per cell
+	bool textureRendering = false;
+	// Prepares the states of the next frame while the current one is drawn
+	ViewportStager viewportStager{ std::max(std::thread::hardware_concurrency() / 2, 1u) };
+	unsigned long long stagedWorldVersion = 0;
+	int cellStateTextureWidth = 0;
+	int cellStateTextureHeight = 0;
+
+	GLuint cellTextureVaoBuffer = -1;
+	GLuint cellStateTexture = -1;
+	GLuint cellStatePixelBuffer = -1;
+
+	// Overview rendering, zoomed out past one pixel per cell every pixel shows 2^overviewLevel cells per side (4^overviewLevel cells)
+	DensityPyramid densityPyramid;
+	unsigned int overviewLevel = 0;
+	const unsigned int maxOverviewLevel = 20;
+	std::vector<unsigned char> densityTexels;
+	int densityTextureWidth = 0;
+	int densityTextureHeight = 0;
+	GLuint densityTexture = -1;
+
+	// Performance panel, the world only collects its phase timings while the panel is open
+	bool performancePanelOpen = false;
+	StatsRing<StepStatsSize> frameTimes;
+	double lastFrameTime = 0;
+	std::vector<float> scatterSamples;
+	std::vector<float> syncSamples;
+	std::vector<float> commitSamples;
+	std::vector<float> stepSamples;
+	std::vector<float> frameSamples;
+	std::vector<float> sortedSamples;
+	std::vector<float> histogramBins;
+	std::vector<unsigned long long> workerBusyNs;
+	std::vector<float> workerBusyRatios;
+	double workerSampleTime = 0;
+	World::generationType workerSampleGeneration = 0;
+	float achievedSimulationSpeed = 0;
+	std::vector<LockSiteStats> lockSites;
+
+	// Memory accounting, checked against the budget about once a second
+	struct MemoryAccount
+	{
+		const char* name;
+		size_t bytes;
+	};
+	std::vector<MemoryAccount> memoryAccounts;
+	size_t memoryTotal = 0;
+	cellCountType memoryCells = 0;
+	double memoryCheckTime = -1;
+	bool memoryOverBudget = false;
+
 	// Grid line rendering
 	GLuint gridHorizontalLineVaoBuffer = -1; // Horizontal line rendering
 	GLuint gridHorizontalLineVboBuffer = -1;
@@ -143,6 +260,7 @@ private:
 	bool worldDetailsWindowOpen = false;
 	bool pixeledView = false;
 	bool debugWindowOpen = true;
+	bool saveStarted = false;
 	float targetSimulationSpeed = this->worldCells.GetTargetSpeed();
 	bool manuallyAddKeycodesToImgui = false;
 	
@@ -156,6 +274,21 @@ private:
 	void InitSimulator();
 	void RenderOpenGL();
 	void RenderImGui();
+	void RenderRecoveryPopup();
+	void RenderReplayWindow();
+	void RenderServerWindow();
+	void ConnectToServer();
+	void DisconnectFromServer();
+	// Journals the edits again once the world is the user's own and there is no autosave left to recover
+	void AttachJournal();
+	void RenderPerformancePanel();
+	void RenderPhaseStats(const char* a_label, const std::vector<float>& a_samples);
+	void RenderLockPanel();
+	void RenderMemoryPanel();
+	void UpdateMemoryAccounts();
+	void CheckMemoryBudget();
+	// Gives back the memory of the render caches, they are filled again for the next frame
+	void CompactMemory();
 	void DisposeOpenGL();
 	void DisposeImGui();
 	
@@ -167,8 +300,11 @@ private:
 
 	// Grid
 	void RenderGrid();
-	void RenderCells();
-	void UpdateAndRenderPendingCells(int a_pendingCellRenders);
+	void RenderCells(bool a_reuseRenderData);
+	void RenderCellsAsTexture(bool a_reuseRenderData);
+	ViewportStager::StateSource GetStateSource();
+	void RenderOverview(bool a_reuseRenderData);
+	void UpdateAndRenderPendingCells(const CellInstance* a_instances, int a_pendingCellRenders);
 
 
 	void AddCellToWorld(coordinatePart a_x, coordinatePart a_y);
@@ -0,0 +1,234 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
+
+#include "socketUtils.h"
+
+#ifdef _WIN32
+#define poll WSAPoll
+#endif
+
+bool InitializeSockets()
+{
+#ifdef _WIN32
+	static bool s_initialized = false;
+	if (!s_initialized)
+	{
+		WSADATA m_data;
+		s_initialized = WSAStartup(MAKEWORD(2, 2), &m_data) == 0;
+	}
+	return s_initialized;
+#else
+	return true;
+#endif
+}
+
+socketHandle ListenOnPort(unsigned short a_port, bool a_anyInterface)
+{
+	if (!InitializeSockets())
+		return InvalidSocket;
+	socketHandle m_socket = (socketHandle)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (m_socket == InvalidSocket)
+		return InvalidSocket;
+
+	// A port of a run that just ended can be used again right away
+	int m_reuse = 1;
+	setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&m_reuse, sizeof(m_reuse));
+
+	sockaddr_in m_address;
+	memset(&m_address, 0, sizeof(m_address));
+	m_address.sin_family = AF_INET;
+	m_address.sin_port = htons(a_port);
+	m_address.sin_addr.s_addr = htonl(a_anyInterface ? INADDR_ANY : INADDR_LOOPBACK);
+	if (bind(m_socket, (sockaddr*)&m_address, sizeof(m_address)) != 0 || listen(m_socket, 16) != 0)
+	{
+		CloseSocket(m_socket);
+		return InvalidSocket;
+	}
+	return m_socket;
+}
+
+unsigned short GetSocketPort(socketHandle a_socket)
+{
+	sockaddr_in m_address;
+	socklen_t m_size = sizeof(m_address);
+	if (getsockname(a_socket, (sockaddr*)&m_address, &m_size) != 0)
+		return 0;
+	return ntohs(m_address.sin_port);
+}
+
+socketHandle AcceptConnection(socketHandle a_listener, int a_timeoutInMs)
+{
+	if (a_timeoutInMs >= 0 && !WaitForData(a_listener, a_timeoutInMs))
+		return InvalidSocket;
+	socketHandle m_socket = (socketHandle)accept(a_listener, nullptr, nullptr);
+	if (m_socket != InvalidSocket)
+		SetNoDelay(m_socket);
+	return m_socket;
+}
+
+socketHandle ConnectToHost(const std::string& a_host, unsigned short a_port, int a_timeoutInMs)
+{
+	if (!InitializeSockets())
+		return InvalidSocket;
+	addrinfo m_hints;
+	memset(&m_hints, 0, sizeof(m_hints));
+	m_hints.ai_family = AF_INET;
+	m_hints.ai_socktype = SOCK_STREAM;
+	addrinfo* m_addresses = nullptr;
+	if (getaddrinfo(a_host.c_str(), std::to_string(a_port).c_str(), &m_hints, &m_addresses) != 0 || m_addresses == nullptr)
+		return InvalidSocket;
+
+	auto m_giveUp = std::chrono::steady_clock::now() + std::chrono::milliseconds(a_timeoutInMs);
+	socketHandle m_socket = InvalidSocket;
+	while (m_socket == InvalidSocket)
+	{
+		m_socket = (socketHandle)socket(m_addresses->ai_family, m_addresses->ai_socktype, m_addresses->ai_protocol);
+		if (m_socket != InvalidSocket && connect(m_socket, m_addresses->ai_addr, (int)m_addresses->ai_addrlen) != 0)
+		{
+			CloseSocket(m_socket);
+			m_socket = InvalidSocket;
+			if (std::chrono::steady_clock::now() >= m_giveUp)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+	}
+	freeaddrinfo(m_addresses);
+	if (m_socket != InvalidSocket)
+		SetNoDelay(m_socket);
+	return m_socket;
+}
+
+void CloseSocket(socketHandle a_socket)
+{
+	if (a_socket == InvalidSocket)
+		return;
+#ifdef _WIN32
+	closesocket(a_socket);
+#else
+	close(a_socket);
+#endif
+}
+
+void ShutdownSocket(socketHandle a_socket)
+{
+	if (a_socket == InvalidSocket)
+		return;
+#ifdef _WIN32
+	shutdown(a_socket, SD_BOTH);
+#else
+	shutdown(a_socket, SHUT_RDWR);
+#endif
+}
+
+void SetNoDelay(socketHandle a_socket)
+{
+	int m_noDelay = 1;
+	setsockopt(a_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&m_noDelay, sizeof(m_noDelay));
+}
+
+bool SendAll(socketHandle a_socket, const void* a_data, size_t a_size)
+{
+	const char* m_data = (const char*)a_data;
+	while (a_size > 0)
+	{
+#ifdef _WIN32
+		int m_sent = send(a_socket, m_data, (int)std::min<size_t>(a_size, 1 << 30), 0);
+#else
+		// A viewer that went away shouldn't kill the process with SIGPIPE
+		ssize_t m_sent = send(a_socket, m_data, a_size, MSG_NOSIGNAL);
+#endif
+		if (m_sent <= 0)
+			return false;
+		m_data += m_sent;
+		a_size -= m_sent;
+	}
+	return true;
+}
+
+bool ReceiveAll(socketHandle a_socket, void* a_data, size_t a_size)
+{
+	char* m_data = (char*)a_data;
+	while (a_size > 0)
+	{
+#ifdef _WIN32
+		int m_received = recv(a_socket, m_data, (int)std::min<size_t>(a_size, 1 << 30), 0);
+#else
+		ssize_t m_received = recv(a_socket, m_data, a_size, 0);
+#endif
+		if (m_received <= 0)
+			return false;
+		m_data += m_received;
+		a_size -= m_received;
+	}
+	return true;
+}
+
+bool SendSizedMessage(socketHandle a_socket, const std::vector<unsigned char>& a_message)
+{
+	unsigned char m_size[4];
+	for (int m_byte = 0; m_byte < 4; m_byte++)
+		m_size[m_byte] = (unsigned char)(a_message.size() >> (m_byte * 8));
+	return SendAll(a_socket, m_size, sizeof(m_size)) && SendAll(a_socket, a_message.data(), a_message.size());
+}
+
+bool ReceiveSizedMessage(socketHandle a_socket, std::vector<unsigned char>* a_message, size_t a_maxSize)
+{
+	unsigned char m_size[4];
+	if (!ReceiveAll(a_socket, m_size, sizeof(m_size)))
+		return false;
+	size_t m_messageSize = 0;
+	for (int m_byte = 0; m_byte < 4; m_byte++)
+		m_messageSize |= (size_t)m_size[m_byte] << (m_byte * 8);
+	if (m_messageSize > a_maxSize)
+		return false;
+	a_message->resize(m_messageSize);
+	return ReceiveAll(a_socket, a_message->data(), m_messageSize);
+}
+
+bool WaitForData(socketHandle a_socket, int a_timeoutInMs)
+{
+	pollfd m_poll;
+	m_poll.fd = a_socket;
+	m_poll.events = POLLIN;
+	m_poll.revents = 0;
+	return poll(&m_poll, 1, a_timeoutInMs) > 0;
+}
@@ -0,0 +1,66 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <cstddef>
+#include <vector>
+
+#ifndef __SOCKETUTILS__
+#define __SOCKETUTILS__
+
+#ifdef _WIN32
+typedef unsigned long long socketHandle; // SOCKET, without pulling in winsock2.h everywhere
+#else
+typedef int socketHandle;
+#endif
+#define InvalidSocket ((socketHandle)-1)
+
+// Starts the socket library where that is needed (Windows), safe to call more than once
+bool InitializeSockets();
+
+// Listens for TCP connections on 127.0.0.1, or on every interface when a_anyInterface is set.
+// Port 0 picks a free port, GetSocketPort tells which.
+socketHandle ListenOnPort(unsigned short a_port, bool a_anyInterface = false);
+unsigned short GetSocketPort(socketHandle a_socket);
+// Blocks until someone connects, or until a_timeoutInMs passed when it isn't negative
+socketHandle AcceptConnection(socketHandle a_listener, int a_timeoutInMs = -1);
+// Tries again until a_timeoutInMs passed, so the other side may still be starting
+socketHandle ConnectToHost(const std::string& a_host, unsigned short a_port, int a_timeoutInMs);
+void CloseSocket(socketHandle a_socket);
+// Stops blocked sends and receives on the socket from another thread
+void ShutdownSocket(socketHandle a_socket);
+
+// Send small messages right away instead of waiting to fill a packet
+void SetNoDelay(socketHandle a_socket);
+// Whole buffers, false when the connection is gone
+bool SendAll(socketHandle a_socket, const void* a_data, size_t a_size);
+bool ReceiveAll(socketHandle a_socket, void* a_data, size_t a_size);
+// A message with its size in front, so the other side knows where it ends. A message larger than
+// a_maxSize is treated as a broken connection.
+bool SendSizedMessage(socketHandle a_socket, const std::vector<unsigned char>& a_message);
+bool ReceiveSizedMessage(socketHandle a_socket, std::vector<unsigned char>* a_message, size_t a_maxSize);
+// Waits up to a_timeoutInMs for something to read, false on timeout
+bool WaitForData(socketHandle a_socket, int a_timeoutInMs);
+
+#endif // !__SOCKETUTILS__
@@ -0,0 +1,78 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#ifndef __STATS_RING__
+#define __STATS_RING__
+
+// The latest samples of a value, written by a single thread and read by any thread without locks.
+// A reader racing the writer can see a sample of the next lap, which is fine for statistics.
+template <size_t Size>
+class StatsRing
+{
+private:
+	std::atomic<float> samples[Size];
+	std::atomic<unsigned long long> written;
+public:
+	StatsRing()
+	{
+		this->written.store(0);
+	};
+
+	void Push(float a_value)
+	{
+		unsigned long long m_index = this->written.load(std::memory_order_relaxed);
+		this->samples[m_index % Size].store(a_value, std::memory_order_relaxed);
+		this->written.store(m_index + 1, std::memory_order_release);
+	};
+
+	// Replaces the content of a_output with the samples in the ring, the oldest first
+	void CopyTo(std::vector<float>* a_output) const
+	{
+		unsigned long long m_written = this->written.load(std::memory_order_acquire);
+		unsigned long long m_count = std::min<unsigned long long>(m_written, Size);
+		a_output->resize((size_t)m_count);
+		for (unsigned long long m_i = 0; m_i < m_count; m_i++)
+			(*a_output)[(size_t)m_i] = this->samples[(m_written - m_count + m_i) % Size].load(std::memory_order_relaxed);
+	};
+
+	void Clear()
+	{
+		this->written.store(0, std::memory_order_release);
+	};
+};
+
+// The value below which a_fraction of the samples fall, a_sorted has to be sorted
+inline float GetPercentile(const std::vector<float>& a_sorted, float a_fraction)
+{
+	if (a_sorted.empty())
+		return 0.0f;
+	size_t m_index = (size_t)(a_fraction * (a_sorted.size() - 1) + 0.5f);
+	return a_sorted[std::min(m_index, a_sorted.size() - 1)];
+}
+
+#endif // !__STATS_RING__
@@ -0,0 +1,105 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <thread>
+#include <string>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <cstring>
+#include <cstdlib>
+#endif
+
+#include "threadPlacement.h"
+
+unsigned int GetProcessorCount()
+{
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+unsigned int GetProcessorNode(unsigned int a_processor)
+{
+#ifdef _WIN32
+	PROCESSOR_NUMBER m_processor;
+	m_processor.Group = (WORD)(a_processor / 64);
+	m_processor.Number = (BYTE)(a_processor % 64);
+	m_processor.Reserved = 0;
+	USHORT m_node = 0;
+	if (!GetNumaProcessorNodeEx(&m_processor, &m_node) || m_node == 0xffff)
+		return 0;
+	return m_node;
+#else
+	// The processor directory has a nodeN entry for the node it belongs to
+	std::string m_path = "/sys/devices/system/cpu/cpu" + std::to_string(a_processor);
+	DIR* m_directory = opendir(m_path.c_str());
+	if (m_directory == nullptr)
+		return 0;
+	unsigned int m_node = 0;
+	while (dirent* m_entry = readdir(m_directory))
+	{
+		if (strncmp(m_entry->d_name, "node", 4) == 0 && m_entry->d_name[4] >= '0' && m_entry->d_name[4] <= '9')
+		{
+			m_node = (unsigned int)strtoul(m_entry->d_name + 4, nullptr, 10);
+			break;
+		}
+	}
+	closedir(m_directory);
+	return m_node;
+#endif
+}
+
+std::vector<unsigned int> GetProcessorsByNode()
+{
+	std::vector<unsigned int> m_processors(GetProcessorCount());
+	std::vector<unsigned int> m_nodes(m_processors.size());
+	for (unsigned int m_processor = 0; m_processor < m_processors.size(); m_processor++)
+	{
+		m_processors[m_processor] = m_processor;
+		m_nodes[m_processor] = GetProcessorNode(m_processor);
+	}
+	std::stable_sort(m_processors.begin(), m_processors.end(), [&m_nodes](unsigned int a_left, unsigned int a_right) {
+		return m_nodes[a_left] < m_nodes[a_right];
+	});
+	return m_processors;
+}
+
+bool PinCurrentThreadToProcessor(unsigned int a_processor)
+{
+#ifdef _WIN32
+	GROUP_AFFINITY m_affinity = {};
+	m_affinity.Group = (WORD)(a_processor / 64);
+	m_affinity.Mask = (KAFFINITY)1 << (a_processor % 64);
+	return SetThreadGroupAffinity(GetCurrentThread(), &m_affinity, nullptr) != 0;
+#else
+	cpu_set_t m_set;
+	CPU_ZERO(&m_set);
+	CPU_SET(a_processor, &m_set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(m_set), &m_set) == 0;
+#endif
+}
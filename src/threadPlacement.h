@@ -0,0 +1,43 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <vector>
+
+#ifndef __THREADPLACEMENT__
+#define __THREADPLACEMENT__
+
+// The number of logical processors, at least 1
+unsigned int GetProcessorCount();
+
+// The NUMA node of a logical processor, 0 when it can't be found out
+unsigned int GetProcessorNode(unsigned int a_processor);
+
+// All logical processors, those of the same NUMA node next to each other.
+// Giving neighbouring parts of the work to neighbouring entries keeps them on one node.
+std::vector<unsigned int> GetProcessorsByNode();
+
+// Keeps the calling thread on one logical processor, returns false when that isn't possible
+bool PinCurrentThreadToProcessor(unsigned int a_processor);
+
+#endif // !__THREADPLACEMENT__
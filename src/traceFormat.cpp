@@ -0,0 +1,101 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include "traceFormat.h"
+
+static void EncodeVarint(unsigned long long a_value, std::vector<unsigned char>* a_output)
+{
+	while (a_value >= 0x80)
+	{
+		a_output->push_back((unsigned char)(a_value | 0x80));
+		a_value >>= 7;
+	}
+	a_output->push_back((unsigned char)a_value);
+}
+
+static bool DecodeVarint(const unsigned char** a_position, const unsigned char* a_end, unsigned long long* a_value)
+{
+	unsigned long long m_result = 0;
+	unsigned int m_shift = 0;
+	while (*a_position < a_end && m_shift < 64)
+	{
+		unsigned char m_byte = **a_position;
+		(*a_position)++;
+		m_result |= (unsigned long long)(m_byte & 0x7F) << m_shift;
+		if ((m_byte & 0x80) == 0)
+		{
+			*a_value = m_result;
+			return true;
+		}
+		m_shift += 7;
+	}
+	return false;
+}
+
+// Maps signed values to unsigned ones so small negative numbers stay small (0, -1, 1, -2 -> 0, 1, 2, 3)
+static unsigned long long ZigZagEncode(long long a_value)
+{
+	return ((unsigned long long)a_value << 1) ^ (unsigned long long)(a_value >> 63);
+}
+
+static long long ZigZagDecode(unsigned long long a_value)
+{
+	return (long long)(a_value >> 1) ^ -(long long)(a_value & 1);
+}
+
+void EncodeCellChanges(const std::vector<CellChange>& a_changes, std::vector<unsigned char>* a_output)
+{
+	coordinatePart m_lastX = 0;
+	coordinatePart m_lastY = 0;
+	for (const CellChange& m_change : a_changes)
+	{
+		EncodeVarint(ZigZagEncode(m_change.x - m_lastX), a_output);
+		// The states take 2 bits each, and are stored in the low bits of the y difference
+		unsigned long long m_states = ((unsigned long long)m_change.oldState << 2) | (unsigned long long)m_change.newState;
+		EncodeVarint((ZigZagEncode(m_change.y - m_lastY) << 4) | m_states, a_output);
+		m_lastX = m_change.x;
+		m_lastY = m_change.y;
+	}
+}
+
+bool DecodeCellChanges(const unsigned char* a_payload, size_t a_payloadSize, unsigned int a_entryCount, std::vector<CellChange>* a_output)
+{
+	const unsigned char* m_position = a_payload;
+	const unsigned char* m_end = a_payload + a_payloadSize;
+	coordinatePart m_lastX = 0;
+	coordinatePart m_lastY = 0;
+	a_output->reserve(a_output->size() + a_entryCount);
+	for (unsigned int m_index = 0; m_index < a_entryCount; m_index++)
+	{
+		unsigned long long m_xPart = 0;
+		unsigned long long m_yPart = 0;
+		if (!DecodeVarint(&m_position, m_end, &m_xPart) || !DecodeVarint(&m_position, m_end, &m_yPart))
+			return false;
+
+		m_lastX += ZigZagDecode(m_xPart);
+		m_lastY += ZigZagDecode(m_yPart >> 4);
+		a_output->push_back(CellChange{ m_lastX, m_lastY, (CellState)((m_yPart >> 2) & 3), (CellState)(m_yPart & 3) });
+	}
+	return true;
+}
@@ -0,0 +1,80 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <vector>
+
+#include "cell.h"
+#include "coordinateType.h"
+
+#ifndef __TRACEFORMAT__
+#define __TRACEFORMAT__
+
+// Binary layout of a recorded run (a delta trace).
+//
+// The file starts with a TraceFileHeader, followed by frames. Every frame starts with a 
+// TraceFrameHeader and holds a list of cell changes. The changes are sorted on x and then y,
+// each one is stored as the varint encoded difference with the previous cell plus the old and
+// new state, which makes most entries only 2 or 3 bytes.
+// A keyframe holds every cell of the world (with its state as the new state), a delta frame 
+// only the cells that changed. The state after generation G is the last keyframe of a
+// generation <= G with all following frames applied up to and including G.
+// A reset frame is a keyframe written because the world was replaced, unlike a normal keyframe
+// it doesn't match the state before it, so it can't be stepped over backwards. Its generation
+// can be lower than that of the frames before it, the generations only go up between resets.
+
+const unsigned int traceFileMagic = 0x52545757; // "WWTR"
+const unsigned int traceFileVersion = 1;
+
+enum class TraceFrameType : unsigned char
+{
+	Keyframe = 0,
+	Delta = 1,
+	Reset = 2
+};
+
+#pragma pack(push, 1)
+struct TraceFileHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int keyframeInterval;
+	unsigned int reserved;
+};
+
+struct TraceFrameHeader
+{
+	unsigned char type;
+	unsigned long long generation;
+	unsigned int entryCount;
+	unsigned int payloadSize;
+};
+#pragma pack(pop)
+
+// Appends the (sorted) changes to the output buffer
+void EncodeCellChanges(const std::vector<CellChange>& a_changes, std::vector<unsigned char>* a_output);
+
+// Decodes a payload of a_entryCount changes, returns false if the payload is broken
+bool DecodeCellChanges(const unsigned char* a_payload, size_t a_payloadSize, unsigned int a_entryCount, std::vector<CellChange>* a_output);
+
+#endif // !__TRACEFORMAT__
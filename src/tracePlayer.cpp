@@ -0,0 +1,304 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "tracePlayer.h"
+#include "viewportQuery.h"
+
+TracePlayer::~TracePlayer()
+{
+	this->Close();
+}
+
+bool TracePlayer::Open(std::string a_filePath)
+{
+	this->Close();
+	if (!this->traceFile.Open(a_filePath))
+		return false;
+
+	if (!this->BuildIndex() || this->keyframes.empty())
+	{
+		this->Close();
+		return false;
+	}
+
+	this->Seek(this->GetFirstPosition());
+	return true;
+}
+
+void TracePlayer::Close()
+{
+	this->ClearCells();
+	this->frames.clear();
+	this->keyframes.clear();
+	this->appliedFrame = -1;
+	this->pendingGenerations = 0;
+	this->playing = false;
+	this->traceFile.Close();
+}
+
+bool TracePlayer::BuildIndex()
+{
+	const unsigned char* m_data = this->traceFile.GetData();
+	size_t m_size = this->traceFile.GetSize();
+	if (m_size < sizeof(TraceFileHeader))
+		return false;
+
+	TraceFileHeader m_fileHeader;
+	memcpy(&m_fileHeader, m_data, sizeof(m_fileHeader));
+	if (m_fileHeader.magic != traceFileMagic || m_fileHeader.version != traceFileVersion)
+		return false;
+	this->keyframeInterval = m_fileHeader.keyframeInterval;
+
+	// Only the frame headers are read, the payloads are decoded when they are needed
+	size_t m_offset = sizeof(TraceFileHeader);
+	while (m_offset + sizeof(TraceFrameHeader) <= m_size)
+	{
+		TraceFrameHeader m_header;
+		memcpy(&m_header, m_data + m_offset, sizeof(m_header));
+		m_offset += sizeof(m_header);
+		// A recording that was cut short ends with a partial frame
+		if (m_offset + m_header.payloadSize > m_size)
+			break;
+
+		// After a reset the generation can go back, the position goes on from the last frame
+		TraceFrameType m_type = (TraceFrameType)m_header.type;
+		World::generationType m_position = m_header.generation;
+		if (!this->frames.empty())
+		{
+			const FrameInfo& m_previous = this->frames.back();
+			if (m_header.generation >= m_previous.generation)
+				m_position = m_previous.position + (m_header.generation - m_previous.generation);
+			else if (m_type == TraceFrameType::Reset)
+				m_position = m_previous.position + 1;
+			else
+				break; // Going back in time without a reset, the rest of the trace can't be trusted
+			// A reset gets a position of its own, so the world before it can still be shown
+			if (m_type == TraceFrameType::Reset && m_position == m_previous.position)
+				m_position++;
+		}
+
+		if (m_type != TraceFrameType::Delta)
+			this->keyframes.push_back(this->frames.size());
+		this->frames.push_back(FrameInfo{ m_offset, m_type, m_header.generation, m_position, m_header.entryCount, m_header.payloadSize });
+		m_offset += m_header.payloadSize;
+	}
+	return true;
+}
+
+void TracePlayer::ClearCells()
+{
+	for (auto& m_cell : this->cells)
+		delete m_cell.second;
+	this->cells.clear();
+	this->cellStatistics[0] = 0;
+	this->cellStatistics[1] = 0;
+	this->cellStatistics[2] = 0;
+}
+
+void TracePlayer::CountCell(CellState a_state, int a_change)
+{
+	if (a_state == Head)
+		this->cellStatistics[0] += a_change;
+	else if (a_state == Tail)
+		this->cellStatistics[1] += a_change;
+	else if (a_state == Conductor)
+		this->cellStatistics[2] += a_change;
+}
+
+void TracePlayer::SetCell(coordinatePart a_x, coordinatePart a_y, CellState a_state)
+{
+	auto m_key = std::make_pair(a_x, a_y);
+	auto m_found = this->cells.find(m_key);
+	if (a_state == Background)
+	{
+		if (m_found != this->cells.end())
+		{
+			this->CountCell(m_found->second->cellState, -1);
+			delete m_found->second;
+			this->cells.erase(m_found);
+		}
+		return;
+	}
+	if (m_found == this->cells.end())
+		this->cells.emplace(m_key, new Cell(a_x, a_y, a_state));
+	else
+	{
+		this->CountCell(m_found->second->cellState, -1);
+		m_found->second->cellState = a_state;
+	}
+	this->CountCell(a_state, 1);
+}
+
+void TracePlayer::ApplyFrame(size_t a_frame, bool a_reverse)
+{
+	const FrameInfo& m_frame = this->frames[a_frame];
+	this->decodedChanges.clear();
+	if (!DecodeCellChanges(this->traceFile.GetData() + m_frame.offset, m_frame.payloadSize, m_frame.entryCount, &this->decodedChanges))
+		return;
+
+	if (m_frame.type != TraceFrameType::Delta)
+	{
+		// Going backwards over a normal keyframe changes nothing, it matches the state before it
+		if (a_reverse)
+			return;
+		this->ClearCells();
+		for (const CellChange& m_change : this->decodedChanges)
+			this->SetCell(m_change.x, m_change.y, m_change.newState);
+		return;
+	}
+
+	for (const CellChange& m_change : this->decodedChanges)
+		this->SetCell(m_change.x, m_change.y, a_reverse ? m_change.oldState : m_change.newState);
+}
+
+void TracePlayer::Seek(World::generationType a_position)
+{
+	if (this->frames.empty())
+		return;
+
+	// The last frame that belongs to the target position
+	auto m_after = std::upper_bound(this->frames.begin(), this->frames.end(), a_position,
+		[](World::generationType a_value, const FrameInfo& a_frame) { return a_value < a_frame.position; });
+	long long m_targetFrame = (long long)(m_after - this->frames.begin()) - 1;
+	if (m_targetFrame < 0)
+		m_targetFrame = 0;
+
+	// The keyframe we would have to start from
+	auto m_keyframe = std::upper_bound(this->keyframes.begin(), this->keyframes.end(), (size_t)m_targetFrame);
+	size_t m_startFrame = *(m_keyframe == this->keyframes.begin() ? m_keyframe : m_keyframe - 1);
+
+	if (this->appliedFrame >= (long long)m_startFrame && this->appliedFrame <= m_targetFrame)
+	{
+		// Forward, continue from where we are
+		for (long long m_frame = this->appliedFrame + 1; m_frame <= m_targetFrame; m_frame++)
+			this->ApplyFrame((size_t)m_frame, false);
+	}
+	else if (this->appliedFrame > m_targetFrame && this->appliedFrame - m_targetFrame <= (long long)(m_targetFrame - m_startFrame) &&
+		std::none_of(this->frames.begin() + m_targetFrame + 1, this->frames.begin() + this->appliedFrame + 1,
+			[](const FrameInfo& a_frame) { return a_frame.type == TraceFrameType::Reset; }))
+	{
+		// Backwards, undoing the deltas is less work than starting at the keyframe
+		for (long long m_frame = this->appliedFrame; m_frame > m_targetFrame; m_frame--)
+			this->ApplyFrame((size_t)m_frame, true);
+	}
+	else
+	{
+		for (size_t m_frame = m_startFrame; m_frame <= (size_t)m_targetFrame; m_frame++)
+			this->ApplyFrame(m_frame, false);
+	}
+	this->appliedFrame = m_targetFrame;
+}
+
+void TracePlayer::Update(float a_deltaTimeInSeconds)
+{
+	if (!this->playing || !this->IsOpen())
+		return;
+
+	this->pendingGenerations += (double)this->playbackSpeed * a_deltaTimeInSeconds;
+	double m_wholeGenerations = std::trunc(this->pendingGenerations);
+	if (m_wholeGenerations == 0)
+		return;
+	this->pendingGenerations -= m_wholeGenerations;
+
+	long long m_target = (long long)this->GetPosition() + (long long)m_wholeGenerations;
+	long long m_first = (long long)this->GetFirstPosition();
+	long long m_last = (long long)this->GetLastPosition();
+	if (m_target <= m_first || m_target >= m_last)
+	{
+		m_target = m_target <= m_first ? m_first : m_last;
+		this->playing = false;
+	}
+	this->Seek((World::generationType)m_target);
+}
+
+World::generationType TracePlayer::GetPosition()
+{
+	if (this->appliedFrame < 0)
+		return this->GetFirstPosition();
+	return this->frames[(size_t)this->appliedFrame].position;
+}
+
+World::generationType TracePlayer::GetFirstPosition()
+{
+	return this->frames.empty() ? 0 : this->frames.front().position;
+}
+
+World::generationType TracePlayer::GetLastPosition()
+{
+	return this->frames.empty() ? 0 : this->frames.back().position;
+}
+
+World::generationType TracePlayer::GetGeneration()
+{
+	if (this->appliedFrame < 0)
+		return this->frames.empty() ? 0 : this->frames.front().generation;
+	return this->frames[(size_t)this->appliedFrame].generation;
+}
+
+size_t TracePlayer::GetMemoryUsage()
+{
+	return this->frames.capacity() * sizeof(FrameInfo) + this->keyframes.capacity() * sizeof(size_t) +
+		this->cells.size() * (CellStorageBytes + CellMapNodeBytes) + this->decodedChanges.capacity() * sizeof(CellChange);
+}
+
+std::array<cellCountType, 3> TracePlayer::GetStatistics()
+{
+	return std::array<cellCountType, 3>{ this->cellStatistics[0], this->cellStatistics[1], this->cellStatistics[2] };
+}
+
+void TracePlayer::InViewport(std::vector<Cell*>* a_output, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height)
+{
+	ForEachInViewport(this->cells, a_x, a_y, a_width, a_height, [a_output](coordinatePart, coordinatePart, Cell* a_cell) {
+		a_output->push_back(a_cell);
+	});
+}
+
+void TracePlayer::StatesInViewport(unsigned char* a_output, size_t a_stride, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height)
+{
+	ForEachInViewport(this->cells, a_x, a_y, a_width, a_height, [a_output, a_stride, a_x, a_y](coordinatePart a_cellX, coordinatePart a_cellY, Cell* a_cell) {
+		a_output[(size_t)(a_cellY - a_y - 1) * a_stride + (size_t)(a_cellX - a_x - 1)] = (unsigned char)a_cell->cellState;
+	});
+}
+
+std::pair<coordinatePart, coordinatePart> TracePlayer::GetCenterCoordinates()
+{
+	if (this->cells.empty())
+		return std::make_pair(0, 0);
+
+	coordinatePart m_minY = std::numeric_limits<coordinatePart>::max();
+	coordinatePart m_maxY = std::numeric_limits<coordinatePart>::min();
+	for (auto& m_cell : this->cells)
+	{
+		m_minY = std::min(m_minY, m_cell.first.second);
+		m_maxY = std::max(m_maxY, m_cell.first.second);
+	}
+	coordinatePart m_minX = this->cells.begin()->first.first;
+	coordinatePart m_maxX = this->cells.rbegin()->first.first;
+	return std::make_pair(m_minX + ((m_maxX - m_minX) / 2), m_minY + ((m_maxY - m_minY) / 2));
+}
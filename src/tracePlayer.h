@@ -0,0 +1,110 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+#include <map>
+
+#include "cell.h"
+#include "world.h"
+#include "traceFormat.h"
+#include "fileUtils.h"
+
+#ifndef __TRACEPLAYER__
+#define __TRACEPLAYER__
+
+// Plays back a recorded run (see traceFormat.h) without simulating it.
+// The trace is memory mapped and indexed once. Seeking jumps to the closest keyframe before 
+// the target and applies the deltas from there, small steps back are done by undoing deltas.
+// Playback goes by position, which is the recorded generation until a reset takes the world
+// back to an earlier generation. From there the positions keep counting up from where they were.
+class TracePlayer
+{
+private:
+	struct FrameInfo
+	{
+		size_t offset; // Offset of the payload in the file
+		TraceFrameType type;
+		World::generationType generation; // As recorded
+		World::generationType position; // Never lower than that of the frame before
+		unsigned int entryCount;
+		unsigned int payloadSize;
+	};
+
+	MappedFile traceFile;
+	std::vector<FrameInfo> frames;
+	std::vector<size_t> keyframes; // Indices in frames
+	unsigned int keyframeInterval = 0;
+
+	std::map<std::pair<coordinatePart, coordinatePart>, Cell*> cells;
+	// Heads, tails and conductors among the cells, kept up to date with every change like in World
+	cellCountType cellStatistics[3] = { 0, 0, 0 };
+	// The index of the last frame applied to the cells, -1 if none
+	long long appliedFrame = -1;
+	std::vector<CellChange> decodedChanges;
+
+	float playbackSpeed = 10.0f; // Generations per second, negative plays backwards
+	double pendingGenerations = 0;
+	bool playing = false;
+
+public:
+	TracePlayer() {};
+	~TracePlayer();
+
+	bool Open(std::string a_filePath);
+	void Close();
+	bool IsOpen() { return this->traceFile.IsOpen(); };
+
+	// Shows the state at the given position
+	void Seek(World::generationType a_position);
+	// Advances the playback by the elapsed time at the current speed
+	void Update(float a_deltaTimeInSeconds);
+
+	void SetPlaying(bool a_playing) { this->playing = a_playing; };
+	bool GetIsPlaying() { return this->playing; };
+	void SetPlaybackSpeed(float a_generationsPerSecond) { this->playbackSpeed = a_generationsPerSecond; };
+	float GetPlaybackSpeed() { return this->playbackSpeed; };
+
+	World::generationType GetPosition();
+	World::generationType GetFirstPosition();
+	World::generationType GetLastPosition();
+	// The generation the world had at the current position
+	World::generationType GetGeneration();
+	std::array<cellCountType, 3> GetStatistics();
+	// The index of the frames and the cells of the current generation, the mapped file is not counted
+	size_t GetMemoryUsage();
+
+	void InViewport(std::vector<Cell*>* a_output, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height);
+	void StatesInViewport(unsigned char* a_output, size_t a_stride, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height);
+	std::pair<coordinatePart, coordinatePart> GetCenterCoordinates();
+
+private:
+	bool BuildIndex();
+	void ClearCells();
+	void ApplyFrame(size_t a_frame, bool a_reverse);
+	void SetCell(coordinatePart a_x, coordinatePart a_y, CellState a_state);
+	void CountCell(CellState a_state, int a_change);
+};
+
+#endif // !__TRACEPLAYER__
@@ -0,0 +1,242 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <algorithm>
+
+#include "traceRecorder.h"
+
+TraceRecorder::TraceRecorder()
+{
+	this->recordedGenerations.store(0);
+	this->recordedBytes.store(0);
+	this->memoryUsage.store(0);
+	this->writeFailed.store(false);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	this->Stop();
+}
+
+bool TraceRecorder::Start(World* a_world, std::string a_filePath, unsigned int a_keyframeInterval)
+{
+	this->Stop();
+	this->writeFailed.store(false);
+	this->traceFile = fopen(a_filePath.c_str(), "wb");
+	if (this->traceFile == nullptr)
+		return false;
+
+	// Writes are large and sequential, give them a big buffer
+	setvbuf(this->traceFile, nullptr, _IOFBF, 1 << 20);
+
+	this->keyframeInterval = a_keyframeInterval > 0 ? a_keyframeInterval : 1;
+	TraceFileHeader m_header{ traceFileMagic, traceFileVersion, this->keyframeInterval, 0 };
+	if (fwrite(&m_header, sizeof(m_header), 1, this->traceFile) != 1)
+	{
+		fclose(this->traceFile);
+		this->traceFile = nullptr;
+		this->writeFailed.store(true);
+		return false;
+	}
+	this->recordedGenerations.store(0);
+	this->recordedBytes.store(sizeof(m_header));
+
+	// Start listening before taking the first keyframe, changes that happen in between are 
+	// applied on top of the keyframe, which gives the same result.
+	this->world = a_world;
+	this->stopRecording = false;
+	this->listenerId = a_world->AddChangeListener(
+		[this](World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+		{
+			this->OnWorldChanged(a_generation, a_source, a_changes);
+		}
+	);
+
+	World::generationType m_generation = 0;
+	this->LoadWorldIntoRecordedCells(&m_generation);
+	this->WriteKeyframe(m_generation, TraceFrameType::Keyframe);
+	this->recorderThread = std::thread(&TraceRecorder::RecorderThread, this);
+	return true;
+}
+
+bool TraceRecorder::Stop()
+{
+	if (this->world == nullptr)
+		return !this->writeFailed.load();
+
+	this->world->RemoveChangeListener(this->listenerId);
+	{
+		std::lock_guard<std::mutex> m_lk(this->pendingLock);
+		this->stopRecording = true;
+	}
+	this->pendingCv.notify_all();
+	if (this->recorderThread.joinable())
+		this->recorderThread.join();
+
+	// The last of the buffer is only written now
+	if (fclose(this->traceFile) != 0)
+		this->writeFailed.store(true);
+	this->traceFile = nullptr;
+	this->recordedCells.clear();
+	this->memoryUsage.store(0);
+	this->world = nullptr;
+	return !this->writeFailed.load();
+}
+
+void TraceRecorder::OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes)
+{
+	// Runs on the simulation thread, so only hand the changes over. The world can't change while we
+	// are told about a reset, so that is when the cells of the new world are read.
+	if (this->writeFailed.load())
+		return;
+	PendingFrame m_frame{ a_generation, a_source, a_changes };
+	if (a_source == World::ChangeSource::Reset)
+	{
+		std::vector<CellSnapshot> m_snapshot;
+		this->world->TakeSnapshot(&m_snapshot, &m_frame.generation);
+		m_frame.changes.reserve(m_snapshot.size());
+		for (const CellSnapshot& m_cell : m_snapshot)
+			m_frame.changes.push_back(CellChange{ m_cell.x, m_cell.y, Background, m_cell.state });
+	}
+	{
+		std::lock_guard<std::mutex> m_lk(this->pendingLock);
+		this->pendingBytes += sizeof(PendingFrame) + m_frame.changes.capacity() * sizeof(CellChange);
+		this->pendingFrames.push_back(std::move(m_frame));
+	}
+	this->pendingCv.notify_one();
+}
+
+size_t TraceRecorder::GetMemoryUsage()
+{
+	std::lock_guard<std::mutex> m_lk(this->pendingLock);
+	return this->memoryUsage.load() + this->pendingBytes;
+}
+
+void TraceRecorder::RecorderThread()
+{
+	std::vector<PendingFrame> m_frames;
+	std::unique_lock<std::mutex> m_lk(this->pendingLock);
+	while (true)
+	{
+		this->pendingCv.wait(m_lk, [this] { return this->stopRecording || !this->pendingFrames.empty(); });
+		m_frames.clear();
+		m_frames.swap(this->pendingFrames);
+		this->pendingBytes = 0;
+		bool m_stop = this->stopRecording;
+		m_lk.unlock();
+
+		for (PendingFrame& m_frame : m_frames)
+		{
+			if (this->writeFailed.load())
+				break;
+			if (m_frame.source == World::ChangeSource::Reset)
+			{
+				// The whole world was replaced, start over from a fresh keyframe
+				this->recordedCells.clear();
+				for (const CellChange& m_change : m_frame.changes)
+					this->recordedCells.emplace(std::make_pair(m_change.x, m_change.y), m_change.newState);
+				this->WriteKeyframe(m_frame.generation, TraceFrameType::Reset);
+				continue;
+			}
+
+			// Edits come in the order they were made, the trace wants them sorted
+			if (m_frame.source == World::ChangeSource::Edit)
+			{
+				std::sort(m_frame.changes.begin(), m_frame.changes.end(), [](const CellChange& a_left, const CellChange& a_right) {
+					return a_left.x < a_right.x || (a_left.x == a_right.x && a_left.y < a_right.y);
+				});
+			}
+
+			for (const CellChange& m_change : m_frame.changes)
+			{
+				if (m_change.newState == Background)
+					this->recordedCells.erase(std::make_pair(m_change.x, m_change.y));
+				else
+					this->recordedCells[std::make_pair(m_change.x, m_change.y)] = m_change.newState;
+			}
+			this->WriteFrame(TraceFrameType::Delta, m_frame.generation, m_frame.changes);
+
+			if (m_frame.source == World::ChangeSource::Simulation)
+			{
+				this->recordedGenerations.fetch_add(1);
+				if (m_frame.generation >= this->lastKeyframeGeneration + this->keyframeInterval)
+					this->WriteKeyframe(m_frame.generation, TraceFrameType::Keyframe);
+			}
+		}
+
+		// The copy of the world, the encoding buffer and the batch that was just written
+		size_t m_memoryUsage = this->recordedCells.size() * (sizeof(std::pair<std::pair<coordinatePart, coordinatePart>, CellState>) + MapNodeOverhead) + this->encodeBuffer.capacity();
+		for (const PendingFrame& m_frame : m_frames)
+			m_memoryUsage += sizeof(PendingFrame) + m_frame.changes.capacity() * sizeof(CellChange);
+		this->memoryUsage.store(m_memoryUsage);
+
+		m_lk.lock();
+		if (this->writeFailed.load())
+		{
+			// A trace with a gap is of no use, stop and let go of what was still waiting
+			this->pendingFrames.clear();
+			this->pendingBytes = 0;
+			break;
+		}
+		if (m_stop && this->pendingFrames.empty())
+			break;
+	}
+}
+
+void TraceRecorder::LoadWorldIntoRecordedCells(World::generationType* a_generation)
+{
+	std::vector<CellSnapshot> m_snapshot;
+	this->world->TakeSnapshot(&m_snapshot, a_generation);
+	this->recordedCells.clear();
+	for (const CellSnapshot& m_cell : m_snapshot)
+		this->recordedCells.emplace(std::make_pair(m_cell.x, m_cell.y), m_cell.state);
+}
+
+void TraceRecorder::WriteKeyframe(World::generationType a_generation, TraceFrameType a_type)
+{
+	std::vector<CellChange> m_cells;
+	m_cells.reserve(this->recordedCells.size());
+	for (auto& m_cell : this->recordedCells)
+		m_cells.push_back(CellChange{ m_cell.first.first, m_cell.first.second, Background, m_cell.second });
+	this->WriteFrame(a_type, a_generation, m_cells);
+	this->lastKeyframeGeneration = a_generation;
+}
+
+void TraceRecorder::WriteFrame(TraceFrameType a_type, World::generationType a_generation, const std::vector<CellChange>& a_changes)
+{
+	if (this->writeFailed.load())
+		return;
+	this->encodeBuffer.clear();
+	EncodeCellChanges(a_changes, &this->encodeBuffer);
+
+	TraceFrameHeader m_header{ (unsigned char)a_type, a_generation, (unsigned int)a_changes.size(), (unsigned int)this->encodeBuffer.size() };
+	bool m_success = fwrite(&m_header, sizeof(m_header), 1, this->traceFile) == 1;
+	m_success = m_success && fwrite(this->encodeBuffer.data(), 1, this->encodeBuffer.size(), this->traceFile) == this->encodeBuffer.size();
+	if (!m_success)
+	{
+		this->writeFailed.store(true);
+		return;
+	}
+	this->recordedBytes.fetch_add(sizeof(m_header) + this->encodeBuffer.size());
+}
@@ -0,0 +1,101 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+
+#include "cell.h"
+#include "world.h"
+#include "traceFormat.h"
+
+#ifndef __TRACERECORDER__
+#define __TRACERECORDER__
+
+// Records a run of the world to a delta trace (see traceFormat.h).
+// The simulation only hands over the cells that changed in a generation, the encoding and
+// writing happens on the thread of the recorder. The recorder keeps its own copy of the
+// world to write the keyframes from, so it only goes through the cells of the world when it
+// starts and when the world is replaced.
+class TraceRecorder
+{
+private:
+	struct PendingFrame
+	{
+		World::generationType generation;
+		World::ChangeSource source;
+		std::vector<CellChange> changes;
+	};
+
+	World* world = nullptr;
+	unsigned int listenerId = 0;
+	unsigned int keyframeInterval = 256;
+	FILE* traceFile = nullptr;
+
+	std::thread recorderThread;
+	std::mutex pendingLock;
+	std::condition_variable pendingCv;
+	std::vector<PendingFrame> pendingFrames;
+	size_t pendingBytes = 0; // Of pendingFrames, they pile up when writing can't keep up with the simulation
+	bool stopRecording = false;
+
+	// The state of every cell as the trace has it so far
+	std::map<std::pair<coordinatePart, coordinatePart>, CellState> recordedCells;
+	World::generationType lastKeyframeGeneration = 0;
+	std::vector<unsigned char> encodeBuffer;
+
+	std::atomic<unsigned long long> recordedGenerations;
+	std::atomic<unsigned long long> recordedBytes;
+	std::atomic<size_t> memoryUsage; // Updated by the recorder thread after every batch
+	std::atomic<bool> writeFailed; // Nothing is written after the first failed write, the trace ends there
+
+public:
+	TraceRecorder();
+	~TraceRecorder();
+
+	bool Start(World* a_world, std::string a_filePath, unsigned int a_keyframeInterval);
+	// Returns false if anything failed to write
+	bool Stop();
+	bool IsRecording() { return this->world != nullptr; };
+	unsigned long long GetRecordedGenerations() { return this->recordedGenerations.load(); };
+	unsigned long long GetRecordedBytes() { return this->recordedBytes.load(); };
+	// Stays set after stopping, until the next recording starts
+	bool GetWriteFailed() { return this->writeFailed.load(); };
+	// Estimated, the copy of the world, the last batch and the frames waiting to be written
+	size_t GetMemoryUsage();
+
+private:
+	void OnWorldChanged(World::generationType a_generation, World::ChangeSource a_source, const std::vector<CellChange>& a_changes);
+	void RecorderThread();
+	void WriteKeyframe(World::generationType a_generation, TraceFrameType a_type);
+	void WriteFrame(TraceFrameType a_type, World::generationType a_generation, const std::vector<CellChange>& a_changes);
+	void LoadWorldIntoRecordedCells(World::generationType* a_generation);
+};
+
+#endif // !__TRACERECORDER__
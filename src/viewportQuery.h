@@ -0,0 +1,56 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <utility>
+
+#include "coordinateType.h"
+
+#ifndef __VIEWPORTQUERY__
+#define __VIEWPORTQUERY__
+
+// Calls a_visit(x, y, value) for every entry of a map that is sorted on x and then y, with x between a_x and
+// a_x + a_width and y between a_y and a_y + a_height (both ends left out). Every column in view is a single
+// range of the map, so it jumps from one column to the next instead of walking the cells above and below.
+template<typename Map, typename Visitor>
+void ForEachInViewport(Map& a_map, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height, Visitor a_visit)
+{
+	coordinatePart m_endX = a_x + (coordinatePart)a_width;
+	coordinatePart m_endY = a_y + (coordinatePart)a_height;
+	auto m_iterator = a_map.lower_bound(std::make_pair(a_x + 1, a_y + 1));
+	auto m_end = a_map.end();
+	while (m_iterator != m_end && m_iterator->first.first < m_endX)
+	{
+		if (m_iterator->first.second <= a_y)
+			m_iterator = a_map.lower_bound(std::make_pair(m_iterator->first.first, a_y + 1));
+		else if (m_iterator->first.second >= m_endY)
+			m_iterator = a_map.lower_bound(std::make_pair(m_iterator->first.first + 1, a_y + 1));
+		else
+		{
+			a_visit(m_iterator->first.first, m_iterator->first.second, m_iterator->second);
+			m_iterator++;
+		}
+	}
+}
+
+#endif // !__VIEWPORTQUERY__
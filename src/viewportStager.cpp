@@ -0,0 +1,121 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <cstring>
+#include <algorithm>
+
+#include "viewportStager.h"
+#include "cell.h"
+#include "profiler.h"
+
+ViewportStager::ViewportStager(unsigned int a_threadCount)
+{
+	unsigned int m_threadCount = std::max(a_threadCount, 1u);
+	for (unsigned int m_thread = 0; m_thread < m_threadCount; m_thread++)
+		this->workers.emplace_back(&ViewportStager::Worker, this, m_thread, m_threadCount);
+}
+
+ViewportStager::~ViewportStager()
+{
+	{
+		std::unique_lock<std::mutex> m_lk(this->jobLock);
+		this->doneCv.wait(m_lk, [this] { return this->workersBusy == 0; });
+		this->stopWorkers = true;
+	}
+	this->jobCv.notify_all();
+	for (std::thread& m_worker : this->workers)
+		m_worker.join();
+}
+
+void ViewportStager::Start(StateSource a_source, coordinatePart a_x, coordinatePart a_y, int a_width, int a_height)
+{
+	std::unique_lock<std::mutex> m_lk(this->jobLock);
+	// The states are shared, so the last preparation has to be finished first
+	this->doneCv.wait(m_lk, [this] { return this->workersBusy == 0; });
+
+	this->source = a_source;
+	this->originX = a_x;
+	this->originY = a_y;
+	this->width = a_width;
+	this->height = a_height;
+	this->states.resize((size_t)a_width * a_height);
+	this->workersBusy = (unsigned int)this->workers.size();
+	this->jobNumber++;
+	m_lk.unlock();
+	this->jobCv.notify_all();
+}
+
+bool ViewportStager::IsPreparing(coordinatePart a_x, coordinatePart a_y, int a_width, int a_height)
+{
+	std::lock_guard<std::mutex> m_lk(this->jobLock);
+	return this->jobNumber > 0 && this->originX == a_x && this->originY == a_y && this->width == a_width && this->height == a_height;
+}
+
+size_t ViewportStager::GetMemoryUsage()
+{
+	std::lock_guard<std::mutex> m_lk(this->jobLock);
+	return this->states.capacity();
+}
+
+const std::vector<unsigned char>& ViewportStager::Wait()
+{
+	std::unique_lock<std::mutex> m_lk(this->jobLock);
+	this->doneCv.wait(m_lk, [this] { return this->workersBusy == 0; });
+	return this->states;
+}
+
+void ViewportStager::Worker(unsigned int a_workerId, unsigned int a_workerCount)
+{
+	PROFILE_THREAD("render prep " + std::to_string(a_workerId));
+	unsigned long long m_lastJob = 0;
+	while (true)
+	{
+		std::unique_lock<std::mutex> m_lk(this->jobLock);
+		this->jobCv.wait(m_lk, [this, m_lastJob] { return this->stopWorkers || this->jobNumber != m_lastJob; });
+		if (this->stopWorkers)
+			return;
+		m_lastJob = this->jobNumber;
+		m_lk.unlock();
+
+		// This worker's strip of columns
+		int m_firstColumn = (int)((long long)this->width * a_workerId / a_workerCount);
+		int m_endColumn = (int)((long long)this->width * (a_workerId + 1) / a_workerCount);
+		if (m_endColumn > m_firstColumn)
+		{
+			PROFILE_ZONE("render prep");
+			unsigned char* m_strip = this->states.data() + m_firstColumn;
+			for (int m_row = 0; m_row < this->height; m_row++)
+				memset(m_strip + (size_t)m_row * this->width, (unsigned char)Background, m_endColumn - m_firstColumn);
+
+			this->source(m_strip, this->width, this->originX + m_firstColumn - 1, this->originY - 1, m_endColumn - m_firstColumn + 1, this->height + 1);
+		}
+
+		m_lk.lock();
+		this->workersBusy--;
+		bool m_done = this->workersBusy == 0;
+		m_lk.unlock();
+		if (m_done)
+			this->doneCv.notify_all();
+	}
+}
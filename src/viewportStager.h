@@ -0,0 +1,79 @@
+/*
+MIT License
+
+Copyright (c) 2020 Guylian Gilsing & Giel Willemsen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "coordinateType.h"
+
+#ifndef __VIEWPORTSTAGER__
+#define __VIEWPORTSTAGER__
+
+// Prepares the cell states of the viewport, one byte per cell, on worker threads.
+// Every worker fills its own strip of columns, so they never write to the same bytes.
+// A preparation can be started right after a frame is drawn and picked up by the next frame,
+// so the work overlaps with the GPU and the rendering thread only uploads and draws.
+class ViewportStager
+{
+public:
+	// Writes the states of the cells in a viewport, see World::StatesInViewport
+	typedef std::function<void(unsigned char*, size_t, coordinatePart, coordinatePart, unsigned int, unsigned int)> StateSource;
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex jobLock;
+	std::condition_variable jobCv;
+	std::condition_variable doneCv;
+	unsigned long long jobNumber = 0;
+	unsigned int workersBusy = 0;
+	bool stopWorkers = false;
+
+	// The current preparation
+	StateSource source;
+	coordinatePart originX = 0;
+	coordinatePart originY = 0;
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> states;
+
+public:
+	ViewportStager(unsigned int a_threadCount);
+	~ViewportStager();
+
+	// Starts preparing the states of a_width by a_height cells, the first at a_x, a_y
+	void Start(StateSource a_source, coordinatePart a_x, coordinatePart a_y, int a_width, int a_height);
+	// Returns true if the last started preparation is for this viewport
+	bool IsPreparing(coordinatePart a_x, coordinatePart a_y, int a_width, int a_height);
+	// Waits for the preparation and returns the states, row by row
+	const std::vector<unsigned char>& Wait();
+	size_t GetMemoryUsage();
+
+private:
+	void Worker(unsigned int a_workerId, unsigned int a_workerCount);
+};
+
+#endif // !__VIEWPORTSTAGER__
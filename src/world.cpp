@@ -29,9 +29,39 @@ SOFTWARE.
 #include <fstream>
 #include <string>
 #include <array>
+#include <cstdio>
+#include <limits>
+#include <algorithm>
 
 #include "world.h"
 #include "cell.h"
+#include "fileUtils.h"
+#include "profiler.h"
+#include "lockStats.h"
+#include "threadPlacement.h"
+#include "viewportQuery.h"
+
+// Where the locks of the simulation are taken, for the lock statistics in the debug window
+static LockSite s_emptyWorldSite("cellsEditLock", "EmptyWorld");
+static LockSite s_takeSnapshotSite("cellsEditLock", "TakeSnapshot");
+static LockSite s_saveSite("cellsEditLock", "Save");
+static LockSite s_loadSnapshotSite("cellsEditLock", "LoadSnapshot");
+static LockSite s_setStatesSite("cellsEditLock", "SetStates");
+static LockSite s_commitSite("cellsEditLock", "commit");
+static LockSite s_scatterSite("cellsEditLock", "scatter");
+static LockSite s_getCopyOfCellSite("cellsEditLock", "GetCopyOfCellAt");
+static LockSite s_insertCellSite("cellsEditLock", "TryInsertCellAt");
+static LockSite s_updateCellSite("cellsEditLock", "TryUpdateCell");
+static LockSite s_deleteCellSite("cellsEditLock", "TryDeleteCell");
+static LockSite s_inViewportSite("cellsEditLock", "InViewport");
+static LockSite s_statesInViewportSite("cellsEditLock", "StatesInViewport");
+static LockSite s_centerSite("cellsEditLock", "GetCenterCoordinates");
+static LockSite s_resetToConductorsSite("cellsEditLock", "ResetToConductors");
+static LockSite s_memoryUsageSite("cellsEditLock", "GetMemoryUsage");
+static LockSite s_placeCellsSite("cellsEditLock", "PlaceCellsOnThreads");
+static LockSite s_nextGenerationSite("currentGenerationLock", "next generation");
+static LockSite s_waitForLastPartSite("lastPartLock", "wait for last part");
+static LockSite s_lastPartDoneSite("lastPartLock", "last part done");
 
 // Private methods
 void World::LoadFile()
@@ -49,8 +79,7 @@ void World::LoadFile()
 
 	// Read the header
 	std::getline(m_in, m_buffer); // Line breaker is implicitly defined using a function overload to '\n'
-	this->PauzeSimulation();
-	this->EmptyWorld();
+	generationType m_generation = 0;
 	auto m_worldNamePart = m_buffer.find(",", 0);
 	if (m_worldNamePart > 0)
 	{
@@ -63,9 +92,11 @@ void World::LoadFile()
 		this->description = m_buffer.substr(m_authorPart, m_descriptionPart - m_authorPart);
 		m_descriptionPart++;
 		std::string m_currentGenerationData = m_buffer.substr(m_descriptionPart, m_buffer.length() - m_descriptionPart);
-		this->loadedWorldGenerationOffset = std::stoull(m_currentGenerationData);
+		m_generation = std::stoull(m_currentGenerationData);
 	}
 	m_buffer.clear();
+
+	std::vector<CellSnapshot> m_readCells;
 	// Evaluates to true while it a success
 	while (std::getline(m_in, m_buffer))
 	{
@@ -89,34 +120,83 @@ void World::LoadFile()
 		if (m_readState > CellState::Background)
 			m_readState = CellState::Background;
 
-		this->TryInsertCellAt(m_readX, m_readY, (CellState)m_readState);
+		m_readCells.push_back(CellSnapshot{ m_readX, m_readY, (CellState)m_readState });
 		m_buffer.clear();
 	}
 	m_in.close();
+
+	this->LoadSnapshot(m_readCells, m_generation);
 }
 
 void World::EmptyWorld()
 {
 	// Empties the contents of a world
-	this->cellsEditLock.lock();
+	std::lock_guard<std::mutex> m_notifyLk(this->changeListenersLock);
+	TimedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_emptyWorldSite);
+	for (auto& m_cell : this->cells)
+		delete m_cell.second;
 	this->cells.clear();
+	this->cellsLayoutVersion++;
 	this->cellStatistics[0] = 0;
 	this->cellStatistics[1] = 0;
 	this->cellStatistics[2] = 0;
-	this->cellsEditLock.unlock();
+	m_lock.unlock();
+	this->NotifyChange(ChangeSource::Reset, std::vector<CellChange>());
+}
+
+void World::NotifyChange(ChangeSource a_source, const std::vector<CellChange>& a_changes)
+{
+	// The caller holds changeListenersLock
+	if (!this->hasChangeListeners.load())
+		return;
+
+	generationType m_generation = this->committedGeneration + this->loadedWorldGenerationOffset;
+	for (auto& m_listener : this->changeListeners)
+		m_listener.second(m_generation, a_source, a_changes);
+}
+
+void World::NotifyEdit(coordinatePart a_x, coordinatePart a_y, CellState a_oldState, CellState a_newState)
+{
+	if (!this->hasChangeListeners.load() || a_oldState == a_newState)
+		return;
+	this->NotifyChange(ChangeSource::Edit, std::vector<CellChange>{ CellChange{ a_x, a_y, a_oldState, a_newState } });
 }
 
 // Public methods
 
-World::World()
+World::World() : World(ThreadOptions())
+{
+}
+
+World::World(unsigned int a_simulationThreads) : World(ThreadOptions{ a_simulationThreads, false, false })
+{
+}
+
+World::World(ThreadOptions a_threadOptions)
 {
 	this->totalThreads = 0;
+	this->threadOptions = a_threadOptions;
+	this->threadsStarted.store(false);
+	this->cellPlacementRequested.store(false);
+	this->pinFailures.store(0);
 	this->cancelSimulation = false;
 	this->pauzeSimulation = true;
 	this->currentGeneration = 0;
 	this->lastPartGeneration = 0;
 	this->lastUpdateDuration = 0;
 	this->targetSimulationSpeed = 1.0f;
+	this->saveInProgress.store(false);
+	this->lastSaveSucceeded.store(true);
+	this->saveCellsWritten.store(0);
+	this->saveCellsTotal.store(0);
+	this->saveSnapshotBytes.store(0);
+	this->hasChangeListeners.store(false);
+	this->collectStepStats.store(false);
+	this->lastPartTotalBusyNs.store(0);
+	this->lockWaitNs.store(0);
+	this->metricsSequence.store(0);
+	for (auto& m_value : this->publishedMetrics)
+		m_value.store(0);
 	this->name = "Hello world";
 	this->author = "John Doe";
 	this->description = "A description";
@@ -131,8 +211,6 @@ World::World()
 
 void World::InitializeThreads()
 {
-	using std::pair;
-	using std::make_pair;
 	// Returns 0 when not able to detect, otherwise, the number of (logical) processors
 	this->totalThreads = std::thread::hardware_concurrency();
 	// Failsafe if not working properly
@@ -145,72 +223,155 @@ void World::InitializeThreads()
 		this->totalThreads = 1;
 	else
 		this->totalThreads -= 2;
-	
-	// Calculate the number of thread that are extra (those will be created in the for loop below).
+
+	// Unless a number was asked for
+	if (this->threadOptions.threads > 0)
+		this->totalThreads = this->threadOptions.threads;
+	if (this->threadOptions.stepOnCaller)
+		this->totalThreads = 1;
+}
+
+void World::StartThreads()
+{
+	// Only started when the world is simulated, so copies and worlds that are only looked at cost no threads
+	std::lock_guard<std::mutex> m_lk(this->threadsStartLock);
+	if (this->threadsStarted.load())
+		return;
+
+	// Only the timer, for when the world is started instead of stepped
+	if (this->threadOptions.stepOnCaller)
+	{
+		this->timerThread = std::thread(&World::TimerThread, this);
+		this->threadsStarted.store(true);
+		return;
+	}
+
+	// Every thread continues from the current generation, a copied world doesn't start at 0
 	for (unsigned int m_threadId = 0; m_threadId < this->totalThreads - 1; m_threadId++)
 	{
-		this->simUpdaters.emplace_back(std::thread(&World::ProcessPartContinuesly, this, m_threadId, this->totalThreads));
-		this->threadComboData.emplace(make_pair(m_threadId, new ThreadCombo()));
+		ThreadCombo* m_threadData = new ThreadCombo();
+		m_threadData->current_generation = this->currentGeneration;
+		this->threadComboData.emplace(std::make_pair(m_threadId, m_threadData));
 	}
-	// Set the total thread count to the number that we will actually be using.
+	this->lastPartGeneration = this->currentGeneration;
+
+	// Calculate the number of thread that are extra (those will be created in the for loop below).
+	for (unsigned int m_threadId = 0; m_threadId < this->totalThreads - 1; m_threadId++)
+		this->simUpdaters.emplace_back(std::thread(&World::ProcessPartContinuesly, this, m_threadId, this->totalThreads));
 	this->lastPartProcessor = std::thread(&World::ProcessLastPart, this);
 
 	// Start the timer
 	this->timerThread = std::thread(&World::TimerThread, this);
+
+	// The cells made so far were allocated by whoever added them
+	if (this->threadOptions.nodeLocalCells)
+		this->cellPlacementRequested.store(true);
+	this->threadsStarted.store(true);
 }
 
-// 1. copy constructor
-World::World(const World& that) : author(that.author), filePath(that.filePath), description(that.description) 
+bool World::PinSimulationThread(unsigned int a_threadId)
 {
-	this->cancelSimulation = that.cancelSimulation;
-	this->lastUpdateDuration = 0;
+	if (!this->threadOptions.pinThreads)
+		return true;
+	// Neighbouring threads simulate neighbouring parts of the map, keep them on one node
+	std::vector<unsigned int> m_processors = GetProcessorsByNode();
+	unsigned int m_processor = m_processors[a_threadId % m_processors.size()];
+	if (PinCurrentThreadToProcessor(m_processor))
+		return true;
+	this->pinFailures.fetch_add(1);
+	return false;
+}
+
+void World::RequestCellPlacement()
+{
+	if (this->threadOptions.nodeLocalCells)
+		this->cellPlacementRequested.store(true);
+}
+
+void World::PlaceCellsOnThreads()
+{
+	PROFILE_ZONE("place cells");
+	// The threads allocate while we hold the lock for them, nobody can look at the cells in the meantime
+	TimedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_placeCellsSite);
+	std::unique_lock<std::mutex> m_lk(this->currentGenerationLock);
+	this->cellPlacementJob++;
+	this->cellPlacementsDone = 0;
+	m_lk.unlock();
+	this->nextUpdateCv.notify_all();
+	m_lk.lock();
+	this->cellPlacementDoneCv.wait(m_lk, [this] { return this->cellPlacementsDone >= this->totalThreads; });
+}
 
-	this->pauzeSimulation = that.pauzeSimulation;
-	InitializeThreads();
-	for (auto m_cell : that.cells)
+void World::AllocateOwnCells(unsigned int a_threadId)
+{
+	// The same part of the map the thread simulates, the last thread also gets what is left
+	mapSizeType m_cellCount = this->cells.size();
+	mapSizeType m_perThread = m_cellCount > this->totalThreads ? m_cellCount / this->totalThreads : 0;
+	auto m_iterator = this->cells.begin();
+	std::advance(m_iterator, m_perThread * a_threadId);
+	auto m_sectionEnd = this->cells.end();
+	if (a_threadId < this->totalThreads - 1)
 	{
-		this->cells.insert(
-			std::make_pair(
-				std::make_pair(m_cell.first.first, m_cell.first.second),
-				new Cell(m_cell.second->x, m_cell.second->y, m_cell.second->cellState)
-			)
-		);
+		m_sectionEnd = m_iterator;
+		std::advance(m_sectionEnd, m_perThread);
 	}
-	this->currentGeneration = that.currentGeneration;
+
+	// Memory is placed on the node of the thread that first writes to it
+	while (m_iterator != m_sectionEnd)
+	{
+		Cell* m_oldCell = m_iterator->second;
+		Cell* m_newCell = new Cell(m_oldCell->x, m_oldCell->y, m_oldCell->cellState);
+		m_newCell->decayState = m_oldCell->decayState;
+		m_iterator->second = m_newCell;
+		delete m_oldCell;
+		std::advance(m_iterator, 1);
+	}
+}
+
+// 1. copy constructor
+World::World(const World& that) : World(that.threadOptions)
+{
+	this->author = that.author;
+	this->filePath = that.filePath;
+	this->description = that.description;
+	this->name = that.name;
 	this->targetSimulationSpeed = that.targetSimulationSpeed;
-	this->lastPartGeneration = that.lastPartGeneration;
+	this->CopyCellsFrom(that);
+	// The threads are only started when the copy is simulated
+	if (!that.pauzeSimulation)
+		this->StartSimulation();
 }
 
 // 2. copy assignment operator
 World& World::operator=(const World& that) 
 {
-	this->cancelSimulation = that.cancelSimulation;
-	this->lastUpdateDuration = 0;
-	
+	if (this == &that)
+		return *this;
 	this->author = that.author;
 	this->filePath = that.filePath;
 	this->description = that.description;
-
-	this->pauzeSimulation = that.pauzeSimulation;
-	InitializeThreads();
-	for (auto m_cell : that.cells)
-	{
-		this->cells.insert(
-			std::make_pair(
-				std::make_pair(m_cell.first.first, m_cell.first.second),
-				new Cell(m_cell.second->x, m_cell.second->y, m_cell.second->cellState)
-			)
-		);
-	}
-	this->currentGeneration = that.currentGeneration;
+	this->name = that.name;
 	this->targetSimulationSpeed = that.targetSimulationSpeed;
-	this->lastPartGeneration = that.lastPartGeneration;
+	// Keeps the threads this world already has
+	this->CopyCellsFrom(that);
+	if (!that.pauzeSimulation)
+		this->StartSimulation();
 	return *this;
 }
 
+void World::CopyCellsFrom(const World& a_that)
+{
+	std::vector<CellSnapshot> m_cells;
+	generationType m_generation = 0;
+	const_cast<World&>(a_that).TakeSnapshot(&m_cells, &m_generation);
+	this->LoadSnapshot(m_cells, m_generation);
+}
+
 // 3. destructor
 World::~World()
 {
+	this->WaitForSave();
+	this->StopMetricsStream();
 	this->PauzeSimulation();
 	// Start canceling the simulator updater's
 	{
@@ -230,8 +391,13 @@ World::~World()
 		std::advance(m_begining, 1);
 	}
 	this->simUpdaters.clear();
-	this->timerThread.join();
-	this->lastPartProcessor.join();
+	if (this->timerThread.joinable())
+		this->timerThread.join();
+	if (this->lastPartProcessor.joinable())
+		this->lastPartProcessor.join();
+	for (auto& m_threadData : this->threadComboData)
+		delete m_threadData.second;
+	this->threadComboData.clear();
 
 	// Remove all cell data
 	for (auto m_cell : this->cells)
@@ -241,48 +407,186 @@ World::~World()
 	this->cells.clear();
 }
 
-void World::Save()
+bool World::Save()
+{
+	// Only one save at a time, the previous one has to finish first
+	bool m_expected = false;
+	if (!this->saveInProgress.compare_exchange_strong(m_expected, true))
+		return false;
+
+	// Join the finished thread of the previous save
+	if (this->saveThread.joinable())
+		this->saveThread.join();
+
+	// Copy the strings now, the UI thread is free to edit them while we are saving
+	std::string m_header = this->name + "," + this->author + "," + this->description + ",";
+	this->saveCellsWritten.store(0);
+	this->saveCellsTotal.store(0);
+	this->saveSnapshotBytes.store(0);
+	this->saveThread = std::thread(&World::SaveSnapshotToFile, this, this->filePath, m_header);
+	return true;
+}
+
+void World::WaitForSave()
+{
+	if (this->saveThread.joinable())
+		this->saveThread.join();
+}
+
+float World::GetSaveProgress()
 {
-	// Saves the world to a file
-	std::ofstream m_out;
-	m_out.open(this->filePath, std::ios::out);
-	if (!m_out.is_open())
+	cellCountType m_total = this->saveCellsTotal.load();
+	if (m_total == 0)
+		return this->saveInProgress.load() ? 0.0f : 1.0f;
+	return (float)this->saveCellsWritten.load() / (float)m_total;
+}
+
+void World::SaveSnapshotToFile(std::string a_filePath, std::string a_header)
+{
+	PROFILE_THREAD("save");
+	PROFILE_ZONE("save");
+	// Copy the cells to a flat list so that the simulation only waits for the copy and not the disk
+	std::vector<CellSnapshot> m_snapshot;
+	generationType m_generation = 0;
+	this->TakeSnapshot(&m_snapshot, &m_generation, s_saveSite);
+	this->saveCellsTotal.store(m_snapshot.size());
+	this->saveSnapshotBytes.store(m_snapshot.capacity() * sizeof(CellSnapshot));
+
+	// Write to a temporary file first so a crash halfway never destroys the previous save
+	std::string m_tempPath = a_filePath + ".tmp";
+	FILE* m_out = fopen(m_tempPath.c_str(), "wb");
+	if (m_out == nullptr)
+	{
+		this->saveSnapshotBytes.store(0);
+		this->lastSaveSucceeded.store(false);
+		this->saveInProgress.store(false);
 		return;
-	m_out.write(&this->name[0], this->name.length());
-	m_out.write(",", 1);
-	m_out.write(&this->author[0], this->author.length());
-	m_out.write(",", 1);
-	m_out.write(&this->description[0], this->description.length());
-	m_out.write(",", 1);
-	unsigned long long m_toWriteGeneration = this->GetDisplayGeneration();
-	auto m_str = std::to_string(m_toWriteGeneration);
-	m_out.write(m_str.c_str(), m_str.length());
-	m_out.write("\n", 1);
-
-	this->cellsEditLock.lock();
-	auto m_start = this->cells.begin();
-	auto m_end = this->cells.end();
-	while (m_start != m_end)
+	}
+
+	bool m_success = true;
+	std::string m_buffer = a_header + std::to_string(m_generation) + "\n";
+	const std::string::size_type m_flushSize = 1 << 20;
+	m_buffer.reserve(m_flushSize + 64);
+
+	cellCountType m_written = 0;
+	for (const CellSnapshot& m_cell : m_snapshot)
+	{
+		m_buffer.append(std::to_string(m_cell.x));
+		m_buffer.push_back(',');
+		m_buffer.append(std::to_string(m_cell.y));
+		m_buffer.push_back(',');
+		m_buffer.append(std::to_string((int)m_cell.state));
+		m_buffer.push_back('\n');
+		m_written++;
+
+		if (m_buffer.size() >= m_flushSize)
+		{
+			m_success = m_success && fwrite(m_buffer.data(), 1, m_buffer.size(), m_out) == m_buffer.size();
+			m_buffer.clear();
+			this->saveCellsWritten.store(m_written);
+		}
+	}
+	m_success = m_success && fwrite(m_buffer.data(), 1, m_buffer.size(), m_out) == m_buffer.size();
+	this->saveCellsWritten.store(m_written);
+
+	m_success = SyncAndCloseFile(m_out) && m_success;
+	if (m_success)
+		m_success = ReplaceFileWith(a_filePath, m_tempPath);
+	else
+		std::remove(m_tempPath.c_str());
+
+	this->saveSnapshotBytes.store(0);
+	this->lastSaveSucceeded.store(m_success);
+	this->saveInProgress.store(false);
+}
+
+void World::TakeSnapshot(std::vector<CellSnapshot>* a_output, generationType* a_generation)
+{
+	this->TakeSnapshot(a_output, a_generation, s_takeSnapshotSite);
+}
+
+void World::TakeSnapshot(std::vector<CellSnapshot>* a_output, generationType* a_generation, LockSite& a_site)
+{
+	// The commit step takes the lock exclusively, so with a shared lock we always see a complete generation
+	TimedSharedLock<std::shared_mutex> m_lock(this->cellsEditLock, a_site);
+	a_output->reserve(a_output->size() + this->cells.size());
+	for (auto& m_cellPair : this->cells)
+	{
+		Cell* m_cell = m_cellPair.second;
+		if (m_cell->cellState != Background)
+			a_output->push_back(CellSnapshot{ m_cell->x, m_cell->y, m_cell->cellState });
+	}
+	if (a_generation != nullptr)
+		*a_generation = this->committedGeneration + this->loadedWorldGenerationOffset;
+}
+
+void World::LoadSnapshot(const std::vector<CellSnapshot>& a_cells, generationType a_generation)
+{
+	this->PauzeSimulation();
+	std::lock_guard<std::mutex> m_notifyLk(this->changeListenersLock);
+	TimedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_loadSnapshotSite);
+	for (auto& m_cell : this->cells)
+		delete m_cell.second;
+	this->cells.clear();
+	this->cellsLayoutVersion++;
+	this->cellStatistics[0] = 0;
+	this->cellStatistics[1] = 0;
+	this->cellStatistics[2] = 0;
+	for (const CellSnapshot& m_cell : a_cells)
 	{
-		if (m_start->second->cellState == Background)
+		auto m_inserted = this->cells.insert(std::make_pair(std::make_pair(m_cell.x, m_cell.y), (Cell*)nullptr));
+		if (!m_inserted.second)
 			continue;
-		std::string m_x = std::to_string(m_start->second->x);
-		m_out.write(&(m_x[0]), m_x.length());
-		m_out.write(",", 1);
-		
-		std::string m_y = std::to_string(m_start->second->y);
-		m_out.write(&(m_y[0]), m_y.length());
-		m_out.write(",", 1);
-		
-		std::string m_state = std::to_string((int)m_start->second->cellState);
-		m_out.write(&(m_state[0]), m_state.length());
-		m_out.write("\n", 1);
+		m_inserted.first->second = new Cell(m_cell.x, m_cell.y, m_cell.state);
+		if (m_cell.state < Background)
+			this->cellStatistics[m_cell.state == Conductor ? 2 : m_cell.state - 1] += 1;
+	}
+	// The display generation is the current generation plus this offset (it wraps around when the loaded generation is lower)
+	this->loadedWorldGenerationOffset = a_generation - this->committedGeneration;
+	m_lock.unlock();
+	this->RequestCellPlacement();
+	this->NotifyChange(ChangeSource::Reset, std::vector<CellChange>());
+}
 
-		std::advance(m_start, 1);
+void World::SetStates(const std::vector<CellSnapshot>& a_cells)
+{
+	std::vector<CellChange> m_changes;
+	std::lock_guard<std::mutex> m_notifyLk(this->changeListenersLock);
+	TimedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_setStatesSite);
+	for (const CellSnapshot& m_cell : a_cells)
+	{
+		auto m_found = this->cells.find(std::make_pair(m_cell.x, m_cell.y));
+		if (m_found == this->cells.end() || m_found->second->cellState == m_cell.state)
+			continue;
+		CellState m_oldState = m_found->second->cellState;
+		if (m_oldState < Background && this->cellStatistics[m_oldState == Conductor ? 2 : m_oldState - 1] > 0)
+			this->cellStatistics[m_oldState == Conductor ? 2 : m_oldState - 1] -= 1;
+		if (m_cell.state < Background)
+			this->cellStatistics[m_cell.state == Conductor ? 2 : m_cell.state - 1] += 1;
+		m_found->second->cellState = m_cell.state;
+		m_found->second->decayState = m_cell.state;
+		if (this->hasChangeListeners.load())
+			m_changes.push_back(CellChange{ m_cell.x, m_cell.y, m_oldState, m_cell.state });
 	}
-	m_out.close();
-	this->cellsEditLock.unlock();
+	m_lock.unlock();
+	if (!m_changes.empty())
+		this->NotifyChange(ChangeSource::Edit, m_changes);
+}
+
+unsigned int World::AddChangeListener(ChangeListener a_listener)
+{
+	std::lock_guard<std::mutex> m_lk(this->changeListenersLock);
+	unsigned int m_id = this->nextChangeListenerId++;
+	this->changeListeners.emplace(m_id, a_listener);
+	this->hasChangeListeners.store(true);
+	return m_id;
+}
 
+void World::RemoveChangeListener(unsigned int a_id)
+{
+	std::lock_guard<std::mutex> m_lk(this->changeListenersLock);
+	this->changeListeners.erase(a_id);
+	this->hasChangeListeners.store(!this->changeListeners.empty());
 }
 
 void World::Open(std::string a_filePath)
@@ -294,11 +598,13 @@ void World::Open(std::string a_filePath)
 
 void World::StartSimulation()
 {
+	this->StartThreads();
 	{
 		std::lock_guard<std::mutex> m_lk(this->simCalcUpdateLock);
 		this->pauzeSimulation = false;
 	}
 	this->lastPartGenerationCv.notify_all();
+	this->simCalcUpdate.notify_all();
 }
 
 void World::PauzeSimulation()
@@ -308,6 +614,7 @@ void World::PauzeSimulation()
 		this->pauzeSimulation = true;
 	}
 	this->lastPartGenerationCv.notify_all();
+	this->simCalcUpdate.notify_all();
 }
 
 void World::ResetSimulation()
@@ -321,110 +628,334 @@ void World::ResetSimulation()
 
 void World::UpdateSimulationWithSingleGeneration()
 {
+	PROFILE_ZONE("generation");
+	if (!this->threadsStarted.load() && !this->threadOptions.stepOnCaller)
+		this->StartThreads();
+	if (this->cellPlacementRequested.exchange(false) && !this->threadOptions.stepOnCaller)
+		this->PlaceCellsOnThreads();
+	auto m_stepStart = std::chrono::high_resolution_clock::now();
 	{
-		std::lock_guard<std::mutex> m_lk(this->currentGenerationLock);
+		TimedLock<std::mutex> m_lk(this->currentGenerationLock, s_nextGenerationSite);
 		this->currentGeneration++;
 	}
 	this->nextUpdateCv.notify_all();
 
-	auto m_begining = this->threadComboData.begin();
-	auto m_ending = this->threadComboData.end();
-	
-	// Wait for the processing threads to catch up to the current generation
-	while (m_begining != m_ending)
+	unsigned long long m_slowestWorkNs = 0;
+	if (this->threadOptions.stepOnCaller)
+		m_slowestWorkNs = this->ScatterOnCallingThread();
+	else
 	{
-		ThreadCombo* m_threadData = m_begining->second;
-		generationType m_lastGenerationValue = m_threadData->current_generation;
-		if (m_lastGenerationValue != this->currentGeneration)
+		PROFILE_ZONE("wait for workers");
+		auto m_begining = this->threadComboData.begin();
+		auto m_ending = this->threadComboData.end();
+
+		// Wait for the processing threads to catch up to the current generation
+		while (m_begining != m_ending)
+		{
+			ThreadCombo* m_threadData = m_begining->second;
+			generationType m_lastGenerationValue = m_threadData->current_generation;
+			if (m_lastGenerationValue != this->currentGeneration)
+			{
+				std::unique_lock<std::mutex> m_locker(m_threadData->lock);
+				m_begining->second->cv.wait(m_locker, [this, m_threadData] {
+					return m_threadData->current_generation >= this->currentGeneration;
+				});
+			}
+			{
+				std::lock_guard<std::mutex> m_locker(m_threadData->lock);
+				m_slowestWorkNs = std::max(m_slowestWorkNs, m_threadData->lastBusyNs);
+			}
+			std::advance(m_begining, 1);
+		}
+
+		// Check that the last part thread also is finished
+		// Only go into wait if the thread hasn't already caught up
+		bool m_wait = false;
 		{
-			std::unique_lock<std::mutex> m_locker(m_threadData->lock);
-			m_begining->second->cv.wait(m_locker, [this, m_threadData] {
-				return m_threadData->current_generation >= this->currentGeneration;
+			TimedLock<std::mutex> m_locker(this->lastPartLock, s_waitForLastPartSite);
+			if (this->lastPartGeneration != this->currentGeneration)
+				m_wait = true;
+		}
+
+		if (m_wait)
+		{
+			std::unique_lock<std::mutex> m_locker(this->lastPartLock);
+			this->lastPartGenerationCv.wait(m_locker, [this] {
+				return this->lastPartGeneration >= this->currentGeneration;
 			});
+			m_locker.unlock();
+		}
+		{
+			TimedLock<std::mutex> m_locker(this->lastPartLock, s_waitForLastPartSite);
+			m_slowestWorkNs = std::max(m_slowestWorkNs, this->lastPartBusyNs);
 		}
-		std::advance(m_begining, 1);
 	}
-	
-	// Check that the last part thread also is finished
-	// Only go into wait if the thread hasn't already caught up
-	bool m_wait = false;
+	auto m_workersDone = std::chrono::high_resolution_clock::now();
+	cellCountType m_cellCount = 0;
+
+	{
+		PROFILE_ZONE("commit");
+		//TODO multi thread this too?
+		// Process the calculated results
+		std::lock_guard<std::mutex> m_notifyLk(this->changeListenersLock);
+		TimedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_commitSite);
+		this->lockWaitNs.fetch_add(m_lock.GetWaitNs(), std::memory_order_relaxed);
+		cellCountType m_newHeadCount = 0;
+		cellCountType m_newTailCount = 0;
+		cellCountType m_newConductorCount = 0;
+		// Only collect the changed cells when someone is listening for them
+		bool m_collectChanges = this->hasChangeListeners.load();
+		this->generationChanges.clear();
+		for (auto m_cellPair : this->cells)
+		{
+			unsigned char m_neighborCount = m_cellPair.second->atomic_neighborCount.load();
+			if ((m_neighborCount == 1 || m_neighborCount == 2) &&
+				 m_cellPair.second->cellState != Background &&
+				 m_cellPair.second->cellState != Tail)
+			{
+				m_cellPair.second->decayState = Head;
+				m_newHeadCount += 1;
+			}
+
+			m_newTailCount += (m_cellPair.second->cellState == Tail);
+			m_newConductorCount += (m_cellPair.second->cellState == Conductor);
+			if (m_collectChanges && m_cellPair.second->cellState != m_cellPair.second->decayState)
+				this->generationChanges.push_back(CellChange{ m_cellPair.second->x, m_cellPair.second->y, m_cellPair.second->cellState, m_cellPair.second->decayState });
+			m_cellPair.second->cellState = m_cellPair.second->decayState;
+			m_cellPair.second->atomic_neighborCount.store(0);
+		}
+		this->cellStatistics[0] = m_newHeadCount;
+		this->cellStatistics[1] = m_newTailCount;
+		this->cellStatistics[2] = m_newConductorCount;
+		this->committedGeneration = this->currentGeneration;
+		m_cellCount = this->cells.size();
+		m_lock.unlock();
+
+		if (m_collectChanges)
+			this->NotifyChange(ChangeSource::Simulation, this->generationChanges);
+	}
+	auto m_stepEnd = std::chrono::high_resolution_clock::now();
+	unsigned long long m_waitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(m_workersDone - m_stepStart).count();
+	unsigned long long m_syncNs = m_waitNs > m_slowestWorkNs ? m_waitNs - m_slowestWorkNs : 0;
+	unsigned long long m_commitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(m_stepEnd - m_workersDone).count();
+	unsigned long long m_totalNs = std::chrono::duration_cast<std::chrono::nanoseconds>(m_stepEnd - m_stepStart).count();
+	this->stepTimings.generations++;
+	this->stepTimings.totalNs += m_totalNs;
+	this->stepTimings.workNs += m_slowestWorkNs;
+	this->stepTimings.syncNs += m_syncNs;
+	this->stepTimings.commitNs += m_commitNs;
+
+	if (this->collectStepStats.load(std::memory_order_relaxed))
 	{
-		std::lock_guard<std::mutex> m_locker(this->lastPartLock);
-		if (this->lastPartGeneration != this->currentGeneration)
-			m_wait = true;
+		this->scatterStats.Push(m_slowestWorkNs / 1000000.0f);
+		this->syncStats.Push(m_syncNs / 1000000.0f);
+		this->commitStats.Push(m_commitNs / 1000000.0f);
+		this->stepStats.Push(m_totalNs / 1000000.0f);
 	}
 
-	if (m_wait)
+	this->PublishMetrics(m_cellCount);
+}
+
+void World::PublishMetrics(cellCountType a_cellCount)
+{
+	unsigned long long m_values[] = {
+		this->committedGeneration + this->loadedWorldGenerationOffset,
+		this->cellStatistics[0], this->cellStatistics[1], this->cellStatistics[2], a_cellCount,
+		this->stepTimings.generations, this->stepTimings.totalNs, this->stepTimings.workNs, this->stepTimings.syncNs, this->stepTimings.commitNs,
+		this->lockWaitNs.load(std::memory_order_relaxed)
+	};
+	// Only this thread writes, readers retry when the sequence changed or was odd while they read
+	unsigned long long m_sequence = this->metricsSequence.load(std::memory_order_relaxed);
+	this->metricsSequence.store(m_sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (size_t m_index = 0; m_index < sizeof(m_values) / sizeof(m_values[0]); m_index++)
+		this->publishedMetrics[m_index].store(m_values[m_index], std::memory_order_relaxed);
+	this->metricsSequence.store(m_sequence + 2, std::memory_order_release);
+}
+
+World::Metrics World::GetMetrics()
+{
+	unsigned long long m_values[sizeof(this->publishedMetrics) / sizeof(this->publishedMetrics[0])];
+	unsigned long long m_sequence;
+	do
 	{
-		std::unique_lock<std::mutex> m_locker(this->lastPartLock);
-		this->lastPartGenerationCv.wait(m_locker, [this] {
-			return this->lastPartGeneration >= this->currentGeneration;
-		});
-		m_locker.unlock();
+		m_sequence = this->metricsSequence.load(std::memory_order_acquire);
+		for (size_t m_index = 0; m_index < sizeof(m_values) / sizeof(m_values[0]); m_index++)
+			m_values[m_index] = this->publishedMetrics[m_index].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((m_sequence & 1) != 0 || m_sequence != this->metricsSequence.load(std::memory_order_relaxed));
+
+	Metrics m_metrics;
+	m_metrics.generation = m_values[0];
+	m_metrics.heads = (cellCountType)m_values[1];
+	m_metrics.tails = (cellCountType)m_values[2];
+	m_metrics.conductors = (cellCountType)m_values[3];
+	m_metrics.cells = (cellCountType)m_values[4];
+	m_metrics.generations = m_values[5];
+	m_metrics.totalNs = m_values[6];
+	m_metrics.workNs = m_values[7];
+	m_metrics.syncNs = m_values[8];
+	m_metrics.commitNs = m_values[9];
+	m_metrics.lockWaitNs = m_values[10];
+	m_metrics.memoryBytes = m_metrics.cells * (unsigned long long)(CellStorageBytes + CellMapNodeBytes);
+	return m_metrics;
+}
+
+bool World::StartMetricsStream(std::string a_filePath, MetricsFormat a_format, float a_intervalInSeconds)
+{
+	this->StopMetricsStream();
+	this->metricsFile.open(a_filePath, std::ios::out | std::ios::app);
+	if (!this->metricsFile.is_open())
+		return false;
+	this->stopMetrics = false;
+	this->metricsThread = std::thread(&World::MetricsThread, this, a_format, std::max(a_intervalInSeconds, 0.01f));
+	return true;
+}
+
+void World::StopMetricsStream()
+{
+	if (!this->metricsThread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> m_lk(this->metricsLock);
+		this->stopMetrics = true;
 	}
+	this->metricsCv.notify_all();
+	this->metricsThread.join();
+	this->metricsFile.close();
+}
 
-	//TODO multi thread this too?
-	// Process the calculated results
-	this->cellsEditLock.lock();
-	cellCountType m_newHeadCount = 0;
-	cellCountType m_newTailCount = 0;
-	cellCountType m_newConductorCount = 0;
-	for (auto m_cellPair : this->cells)
+void World::MetricsThread(MetricsFormat a_format, double a_intervalInSeconds)
+{
+	PROFILE_THREAD("metrics");
+	if (a_format == MetricsFormat::Csv && this->metricsFile.tellp() == 0)
+		this->metricsFile << "time,generation,heads,tails,conductors,cells,gensPerSecond,scatterMs,syncMs,commitMs,generationMs,lockWaitMs,memoryBytes" << std::endl;
+
+	auto m_start = std::chrono::steady_clock::now();
+	auto m_lastTime = m_start;
+	Metrics m_last = this->GetMetrics();
+	std::unique_lock<std::mutex> m_lk(this->metricsLock);
+	while (!this->metricsCv.wait_for(m_lk, std::chrono::duration<double>(a_intervalInSeconds), [this] { return this->stopMetrics; }))
 	{
-		unsigned char m_neighborCount = m_cellPair.second->atomic_neighborCount.load();
-		if ((m_neighborCount == 1 || m_neighborCount == 2) &&
-			 m_cellPair.second->cellState != Background &&
-			 m_cellPair.second->cellState != Tail)
+		m_lk.unlock();
+		auto m_now = std::chrono::steady_clock::now();
+		Metrics m_metrics = this->GetMetrics();
+
+		// The rates and phase times are over the last interval, the phases are averages per generation
+		double m_seconds = std::chrono::duration<double>(m_now - m_lastTime).count();
+		double m_generations = (double)(m_metrics.generations - m_last.generations);
+		double m_perGeneration = m_generations > 0 ? 1.0 / (m_generations * 1000000.0) : 0.0;
+		double m_gensPerSecond = m_seconds > 0 ? m_generations / m_seconds : 0.0;
+		double m_scatterMs = (m_metrics.workNs - m_last.workNs) * m_perGeneration;
+		double m_syncMs = (m_metrics.syncNs - m_last.syncNs) * m_perGeneration;
+		double m_commitMs = (m_metrics.commitNs - m_last.commitNs) * m_perGeneration;
+		double m_generationMs = (m_metrics.totalNs - m_last.totalNs) * m_perGeneration;
+		double m_lockWaitMs = (m_metrics.lockWaitNs - m_last.lockWaitNs) / 1000000.0;
+		double m_time = std::chrono::duration<double>(m_now - m_start).count();
+
+		if (a_format == MetricsFormat::Csv)
 		{
-			m_cellPair.second->decayState = Head;
-			m_newHeadCount += 1;
+			this->metricsFile << m_time << "," << m_metrics.generation << "," << m_metrics.heads << "," << m_metrics.tails << "," << m_metrics.conductors << ","
+				<< m_metrics.cells << "," << m_gensPerSecond << "," << m_scatterMs << "," << m_syncMs << "," << m_commitMs << "," << m_generationMs << ","
+				<< m_lockWaitMs << "," << m_metrics.memoryBytes << std::endl;
 		}
+		else
+		{
+			this->metricsFile << "{\"time\": " << m_time << ", \"generation\": " << m_metrics.generation
+				<< ", \"heads\": " << m_metrics.heads << ", \"tails\": " << m_metrics.tails << ", \"conductors\": " << m_metrics.conductors
+				<< ", \"cells\": " << m_metrics.cells << ", \"gensPerSecond\": " << m_gensPerSecond
+				<< ", \"phasesMs\": {\"scatter\": " << m_scatterMs << ", \"sync\": " << m_syncMs << ", \"commit\": " << m_commitMs << ", \"generation\": " << m_generationMs << "}"
+				<< ", \"lockWaitMs\": " << m_lockWaitMs << ", \"memoryBytes\": " << m_metrics.memoryBytes << "}" << std::endl;
+		}
+		m_last = m_metrics;
+		m_lastTime = m_now;
+		m_lk.lock();
+	}
+}
 
-		m_newTailCount += (m_cellPair.second->cellState == Tail);
-		m_newConductorCount += (m_cellPair.second->cellState == Conductor);
-		m_cellPair.second->cellState = m_cellPair.second->decayState;
-		m_cellPair.second->atomic_neighborCount.store(0);
+void World::SetCollectStepStats(bool a_collect)
+{
+	// Start over so the panel doesn't show old generations after it was closed for a while
+	if (a_collect && !this->collectStepStats.load())
+	{
+		this->scatterStats.Clear();
+		this->syncStats.Clear();
+		this->commitStats.Clear();
+		this->stepStats.Clear();
 	}
-	this->cellStatistics[0] = m_newHeadCount;
-	this->cellStatistics[1] = m_newTailCount;
-	this->cellStatistics[2] = m_newConductorCount;
-	this->cellsEditLock.unlock();
+	this->collectStepStats.store(a_collect);
+}
+
+void World::GetStepStats(std::vector<float>* a_scatter, std::vector<float>* a_sync, std::vector<float>* a_commit, std::vector<float>* a_step)
+{
+	this->scatterStats.CopyTo(a_scatter);
+	this->syncStats.CopyTo(a_sync);
+	this->commitStats.CopyTo(a_commit);
+	this->stepStats.CopyTo(a_step);
+}
+
+void World::GetWorkerBusyNs(std::vector<unsigned long long>* a_output)
+{
+	a_output->clear();
+	if (!this->threadsStarted.load())
+		return;
+	for (auto& m_threadData : this->threadComboData)
+		a_output->push_back(m_threadData.second->totalBusyNs.load(std::memory_order_relaxed));
+	a_output->push_back(this->lastPartTotalBusyNs.load(std::memory_order_relaxed));
 }
 
 void World::ProcessPartContinuesly(unsigned int a_threadId, unsigned int a_threadCount)
 {
-	generationType m_nextToGenerateGeneration = 1;
+	PROFILE_THREAD("simulation worker " + std::to_string(a_threadId));
+	this->PinSimulationThread(a_threadId);
+	generationType m_nextToGenerateGeneration = this->threadComboData.find(a_threadId)->second->current_generation + 1;
+	unsigned long long m_cellPlacementJob = 0;
 	std::unique_lock<std::mutex> m_lk(this->currentGenerationLock);
 	auto m_iterator = this->cells.begin();
 	auto m_sectionEnd = this->cells.end();
-	mapSizeType  m_lastCellCount = this->cells.size();
+	// The threads can start after the cells were added, so the section is always found on the first generation
+	unsigned long long m_lastLayoutVersion = (unsigned long long)-1;
 
 	while (!this->cancelSimulation)
 	{
 		// m_lk is only locked when the predicate is checked and if it returns true. 
 		// otherwise it will unlock m_lk allowing other threads to check the condition as well
 
-		this->nextUpdateCv.wait(m_lk, [this, m_nextToGenerateGeneration] {
-			return m_nextToGenerateGeneration <= this->currentGeneration || this->cancelSimulation;
+		this->nextUpdateCv.wait(m_lk, [this, m_nextToGenerateGeneration, m_cellPlacementJob] {
+			return m_nextToGenerateGeneration <= this->currentGeneration || this->cancelSimulation || this->cellPlacementJob != m_cellPlacementJob;
 		});
 
+		if (this->cellPlacementJob != m_cellPlacementJob)
+		{
+			m_cellPlacementJob = this->cellPlacementJob;
+			m_lk.unlock();
+			this->AllocateOwnCells(a_threadId);
+			m_lk.lock();
+			this->cellPlacementsDone++;
+			this->cellPlacementDoneCv.notify_all();
+			continue;
+		}
+
 		// unlock m_lk. we only needed the lock to check the currentGeneration.
 		m_lk.unlock();
 		if (!this->cancelSimulation)
 		{
+			PROFILE_ZONE("scatter");
+			auto m_workStart = std::chrono::high_resolution_clock::now();
 			// Lock editing to the map
-			this->cellsEditLock.lock_shared();
+			TimedSharedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_scatterSite);
+			this->lockWaitNs.fetch_add(m_lock.GetWaitNs(), std::memory_order_relaxed);
 
 			mapSizeType m_cellCount = this->cells.size();
 			mapSizeType m_perThread = m_cellCount / a_threadCount;
 			mapSizeType m_nextPosition = m_perThread * a_threadId;
 			if (m_cellCount > a_threadCount)
 			{
-				// Update the ending of the end processor
-				if (m_cellCount != m_lastCellCount)
+				// Find the section again when cells were added or removed (or the whole map was replaced), the old iterators may point to freed nodes
+				if (this->cellsLayoutVersion != m_lastLayoutVersion)
 				{
 					m_iterator = this->cells.begin();
-					m_lastCellCount = m_cellCount;
+					m_lastLayoutVersion = this->cellsLayoutVersion;
 
 					m_sectionEnd = this->cells.begin();
 					std::advance(m_sectionEnd, m_nextPosition + m_perThread);
@@ -453,11 +984,14 @@ void World::ProcessPartContinuesly(unsigned int a_threadId, unsigned int a_threa
 				}
 			}
 			// Done with editing the map, unlock it again
-			this->cellsEditLock.unlock_shared();
+			m_lock.unlock();
 			// Notify main
 			auto m_threadCombo = this->threadComboData.find(a_threadId);
 			ThreadCombo* m_threadData = m_threadCombo->second;
+			auto m_workNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - m_workStart).count();
 			m_threadData->lock.lock();
+			m_threadData->lastBusyNs = m_workNs;
+			m_threadData->totalBusyNs.fetch_add(m_workNs, std::memory_order_relaxed);
 			m_threadData->current_generation++;
 			m_threadData->lock.unlock();
 			m_threadData->cv.notify_all();
@@ -470,11 +1004,14 @@ void World::ProcessPartContinuesly(unsigned int a_threadId, unsigned int a_threa
 
 void World::ProcessLastPart()
 {
-	generationType m_nextToGenerateGeneration = 1;
+	PROFILE_THREAD("simulation last part");
+	this->PinSimulationThread(this->totalThreads - 1);
+	generationType m_nextToGenerateGeneration = this->lastPartGeneration + 1;
+	unsigned long long m_cellPlacementJob = 0;
 	std::unique_lock<std::mutex> m_lk(this->currentGenerationLock);
 	auto m_iterator = this->cells.begin();
 	auto m_sectionEnd = this->cells.end();
-	mapSizeType  m_lastCellCount = this->cells.size();
+	unsigned long long m_lastLayoutVersion = (unsigned long long)-1;
 	long m_lastIteratorPos = 0;
 
 	while (!this->cancelSimulation)
@@ -482,13 +1019,29 @@ void World::ProcessLastPart()
 		// m_lk is only locked when the predicate is checked and if it returns true. 
 		// otherwise it will unlock m_lk allowing other threads to check the condition as well
 
-		this->nextUpdateCv.wait(m_lk, [this, m_nextToGenerateGeneration] {return m_nextToGenerateGeneration <= this->currentGeneration || this->cancelSimulation; });
+		this->nextUpdateCv.wait(m_lk, [this, m_nextToGenerateGeneration, m_cellPlacementJob] {
+			return m_nextToGenerateGeneration <= this->currentGeneration || this->cancelSimulation || this->cellPlacementJob != m_cellPlacementJob;
+		});
+
+		if (this->cellPlacementJob != m_cellPlacementJob)
+		{
+			m_cellPlacementJob = this->cellPlacementJob;
+			m_lk.unlock();
+			this->AllocateOwnCells(this->totalThreads - 1);
+			m_lk.lock();
+			this->cellPlacementsDone++;
+			this->cellPlacementDoneCv.notify_all();
+			continue;
+		}
 		// unlock m_lk. we only needed the lock to check the currentGeneration.
 		m_lk.unlock();
 		if (!this->cancelSimulation)
 		{
+			PROFILE_ZONE("scatter");
+			auto m_workStart = std::chrono::high_resolution_clock::now();
 			// Lock editing to the map
-			this->cellsEditLock.lock_shared();
+			TimedSharedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_scatterSite);
+			this->lockWaitNs.fetch_add(m_lock.GetWaitNs(), std::memory_order_relaxed);
 			
 			mapSizeType m_cellCount = this->cells.size();
 			mapSizeType m_perThread = m_cellCount / this->totalThreads;
@@ -497,12 +1050,12 @@ void World::ProcessLastPart()
 				m_perThread = 0;
 
 			mapSizeType m_nextPosition = m_perThread * (this->totalThreads - 1);
-			// Update the ending of the end processor
-			if (m_cellCount != m_lastCellCount)
+			// Find the section again when cells were added or removed (or the whole map was replaced)
+			if (this->cellsLayoutVersion != m_lastLayoutVersion)
 			{
 				m_sectionEnd = this->cells.end();
 				m_iterator = this->cells.begin();
-				m_lastCellCount = m_cellCount;
+				m_lastLayoutVersion = this->cellsLayoutVersion;
 			}
 			
 			// Calculate what number to move (negative or positive) to get to the m_nextPosition value
@@ -528,12 +1081,15 @@ void World::ProcessLastPart()
 			}
 
 			// Done with map, unlock it
-			this->cellsEditLock.unlock_shared();
+			m_lock.unlock();
 
 			// Notify main
-			this->lastPartLock.lock();
+			auto m_workNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - m_workStart).count();
+			TimedLock<std::mutex> m_doneLock(this->lastPartLock, s_lastPartDoneSite);
+			this->lastPartBusyNs = m_workNs;
+			this->lastPartTotalBusyNs.fetch_add(m_workNs, std::memory_order_relaxed);
 			this->lastPartGeneration++;
-			this->lastPartLock.unlock();
+			m_doneLock.unlock();
 			this->lastPartGenerationCv.notify_all();
 			m_nextToGenerateGeneration++;
 		}
@@ -542,6 +1098,29 @@ void World::ProcessLastPart()
 	}
 }
 
+unsigned long long World::ScatterOnCallingThread()
+{
+	PROFILE_ZONE("scatter");
+	auto m_workStart = std::chrono::high_resolution_clock::now();
+	TimedSharedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_scatterSite);
+	this->lockWaitNs.fetch_add(m_lock.GetWaitNs(), std::memory_order_relaxed);
+	for (auto m_cellPair : this->cells)
+	{
+		Cell* m_cell = m_cellPair.second;
+		if (m_cell->cellState == Tail)
+		{
+			m_cell->decayState = Conductor;
+		}
+		else if (m_cell->cellState == Head)
+		{
+			this->IncrementNeighbors(m_cell->x, m_cell->y);
+			m_cell->decayState = Tail;
+		}
+	}
+	m_lock.unlock();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - m_workStart).count();
+}
+
 void World::IncrementNeighbors(coordinatePart a_x, coordinatePart a_y)
 {
 	std::pair<coordinatePart, coordinatePart> m_toFindPair;
@@ -578,6 +1157,7 @@ void World::SetTargetSpeed(float a_targetSpeed)
 
 void World::TimerThread()
 {
+	PROFILE_THREAD("simulation timer");
 	const float m_defaultDurationOfOneFrameInMs = 1000.0;
 	bool m_stop = false;
 	std::chrono::time_point<std::chrono::high_resolution_clock> m_lastUpdatePoint = std::chrono::high_resolution_clock::now();
@@ -593,16 +1173,12 @@ void World::TimerThread()
 		this->simCalcUpdateLock.unlock();
 
 		// Check if we should update the simulation (based on the paused state)
-		if (m_pauzed)
-		{
-			m_interval = 1000; // just force it to a interval of 1s
-		}
-		else
+		if (!m_pauzed)
 		{
 			bool m_allowUpdate = true;
 			if (m_fromTimeChangeEvent)
 			{
-				if (m_lastUpdatePoint + std::chrono::milliseconds(m_interval) > std::chrono::steady_clock::now())
+				if (m_lastUpdatePoint + std::chrono::milliseconds(m_interval) > std::chrono::high_resolution_clock::now())
 				{
 					m_allowUpdate = false;
 				}
@@ -632,18 +1208,25 @@ void World::TimerThread()
 		// Keep looping until we are suppose to wake up. 
 		// 1) That is either a the wait time has passed. 
 		// 2) A new target speed has been set and we should start updating at the new speed.
-		// 3) Or we are to cancel the simulation
+		// 3) The simulation is started or paused.
+		// 4) Or we are to cancel the simulation
+		// While paused there is nothing to time, so it only wakes up for 2 to 4
 		auto m_nextWake = m_nowTime + std::chrono::milliseconds(m_interval);
 		bool m_nextRun = false;
 		while (!m_nextRun)
 		{
 			std::unique_lock<std::mutex> m_lk(this->simCalcUpdateLock);
+			auto m_wakeCondition = [this, m_targetSpeed, m_pauzed] {
+				return this->cancelSimulation || this->targetSimulationSpeed != m_targetSpeed || this->pauzeSimulation != m_pauzed;
+			};
 			
 			// wait for either the simulation to be canceled or the speed to be changed
 			// returns false if timeout has expired and _pred() is still false. otherwise it will return true
-			bool m_waitResult = this->simCalcUpdate.wait_until(m_lk, m_nextWake, [this, m_targetSpeed] {
-				return this->cancelSimulation || this->targetSimulationSpeed != m_targetSpeed;
-			});
+			bool m_waitResult = true;
+			if (m_pauzed)
+				this->simCalcUpdate.wait(m_lk, m_wakeCondition);
+			else
+				m_waitResult = this->simCalcUpdate.wait_until(m_lk, m_nextWake, m_wakeCondition);
 			m_lk.unlock();
 			m_fromTimeChangeEvent = false;
 			if (m_waitResult)
@@ -669,7 +1252,7 @@ void World::TimerThread()
 
 Cell* World::GetCopyOfCellAt(coordinatePart a_cellX, coordinatePart a_cellY)
 {
-	std::lock_guard<std::shared_mutex> m_lk(this->cellsEditLock);
+	TimedLock<std::shared_mutex> m_lk(this->cellsEditLock, s_getCopyOfCellSite);
 	// Retrieves the pointer of a cell at a specific grid coordinate
 	auto m_found = this->cells.find(std::make_pair(a_cellX, a_cellY));
 	if (m_found == this->cells.end())
@@ -684,38 +1267,46 @@ Cell* World::GetCopyOfCellAt(coordinatePart a_cellX, coordinatePart a_cellY)
 
 bool World::TryInsertCellAt(coordinatePart a_cellX, coordinatePart a_cellY, CellState a_state)
 {
-	this->cellsEditLock.lock_shared();
+	TimedSharedLock<std::shared_mutex> m_readLock(this->cellsEditLock, s_insertCellSite);
 	if (this->cells.find(std::make_pair(a_cellX, a_cellY)) != this->cells.end())
-	{
-		this->cellsEditLock.unlock_shared();
 		return false;
-	}
-	this->cellsEditLock.unlock_shared();
-	this->cellsEditLock.lock();
-	this->cells.insert(std::make_pair(std::make_pair(a_cellX, a_cellY), new Cell(a_cellX, a_cellY, a_state)));
+	m_readLock.unlock();
+	std::lock_guard<std::mutex> m_notifyLk(this->changeListenersLock);
+	TimedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_insertCellSite);
+	// Someone else may have put one there while no lock was held
+	auto m_inserted = this->cells.emplace(std::make_pair(a_cellX, a_cellY), nullptr);
+	if (!m_inserted.second)
+		return false;
+	m_inserted.first->second = new Cell(a_cellX, a_cellY, a_state);
+	this->cellsLayoutVersion++;
 	if (a_state == Head)
 		this->cellStatistics[0] += 1;
 	else if (a_state== Tail)
 		this->cellStatistics[1] += 1;
 	else if (a_state == Conductor)
 		this->cellStatistics[2] += 1;
-	this->cellsEditLock.unlock();
+	m_lock.unlock();
+	this->NotifyEdit(a_cellX, a_cellY, Background, a_state);
 	return true;
 }
 
 bool World::TryUpdateCell(coordinatePart a_cellX, coordinatePart a_cellY, std::function<bool (Cell*)> a_updater)
 {
-	this->cellsEditLock.lock_shared();
+	TimedSharedLock<std::shared_mutex> m_readLock(this->cellsEditLock, s_updateCellSite);
 	auto m_found = this->cells.find(std::make_pair(a_cellX, a_cellY));
 	if (m_found == this->cells.end())
 	{
-		this->cellsEditLock.unlock_shared();
 		return false;
 	}
 	else
 	{
-		this->cellsEditLock.unlock_shared();
-		this->cellsEditLock.lock();
+		m_readLock.unlock();
+		std::lock_guard<std::mutex> m_notifyLk(this->changeListenersLock);
+		TimedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_updateCellSite);
+		// Someone else may have deleted it while no lock was held
+		m_found = this->cells.find(std::make_pair(a_cellX, a_cellY));
+		if (m_found == this->cells.end())
+			return false;
 		if (m_found->second->cellState == Head && this->cellStatistics[0] > 0)
 			this->cellStatistics[0] -= 1;
 		else if (m_found->second->cellState == Tail && this->cellStatistics[1] > 0)
@@ -723,7 +1314,9 @@ bool World::TryUpdateCell(coordinatePart a_cellX, coordinatePart a_cellY, std::f
 		else if (m_found->second->cellState == Conductor && this->cellStatistics[2] > 0)
 			this->cellStatistics[2] -= 1;
 		
+		CellState m_oldState = m_found->second->cellState;
 		bool m_result = a_updater(m_found->second);
+		CellState m_newState = m_found->second->cellState;
 		
 		if (m_found->second->cellState == Head)
 			this->cellStatistics[0] += 1;
@@ -732,62 +1325,65 @@ bool World::TryUpdateCell(coordinatePart a_cellX, coordinatePart a_cellY, std::f
 		else if (m_found->second->cellState == Conductor)
 			this->cellStatistics[2] += 1;
 
-		this->cellsEditLock.unlock();
+		m_lock.unlock();
+		this->NotifyEdit(a_cellX, a_cellY, m_oldState, m_newState);
 		return m_result;
 	}
 }
 
 void World::InViewport(std::vector<Cell*>* a_output, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height)
 {
+	PROFILE_ZONE("viewport query");
 	long m_preCalcSize = (a_width * a_height) / 4;
 	if (m_preCalcSize > 20)
 		m_preCalcSize = 20;
 	a_output->reserve(a_output->size() + m_preCalcSize);
 
-	this->cellsEditLock.lock_shared();
-	auto m_iterator = this->cells.begin();
-	auto m_end = this->cells.end();
-	coordinatePart m_endX = a_width + a_x;
-	coordinatePart m_endY = a_height + a_y;
-	while (m_iterator != m_end)
-	{
-		Cell* m_cell = m_iterator->second;
-		if (m_cell->x > a_x&& m_cell->y > a_y)
-		{
-			if (m_cell->x < m_endX)
-			{
-				if (m_cell->y < m_endY)
-				{
-					a_output->push_back(m_cell);
-				}
-			}
-		}
-		std::advance(m_iterator, 1);
-	}
-	this->cellsEditLock.unlock_shared();
+	TimedSharedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_inViewportSite);
+	ForEachInViewport(this->cells, a_x, a_y, a_width, a_height, [a_output](coordinatePart, coordinatePart, Cell* a_cell) {
+		a_output->push_back(a_cell);
+	});
+}
+
+void World::StatesInViewport(unsigned char* a_output, size_t a_stride, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height)
+{
+	PROFILE_ZONE("viewport query");
+	// Same as InViewport, but the states are read while the cells can't be deleted
+	TimedSharedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_statesInViewportSite);
+	ForEachInViewport(this->cells, a_x, a_y, a_width, a_height, [a_output, a_stride, a_x, a_y](coordinatePart a_cellX, coordinatePart a_cellY, Cell* a_cell) {
+		a_output[(size_t)(a_cellY - a_y - 1) * a_stride + (size_t)(a_cellX - a_x - 1)] = (unsigned char)a_cell->cellState;
+	});
 }
 
 bool World::TryDeleteCell(coordinatePart a_cellX, coordinatePart a_cellY)
 {
-	this->cellsEditLock.lock_shared();
+	TimedSharedLock<std::shared_mutex> m_readLock(this->cellsEditLock, s_deleteCellSite);
 	auto m_found = this->cells.find(std::make_pair(a_cellX, a_cellY));
 	if (m_found == this->cells.end())
 	{
-		this->cellsEditLock.unlock_shared();
 		return false;
 	}
 	else
 	{
-		this->cellsEditLock.unlock_shared();
-		this->cellsEditLock.lock();
+		m_readLock.unlock();
+		std::lock_guard<std::mutex> m_notifyLk(this->changeListenersLock);
+		TimedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_deleteCellSite);
+		// Someone else may have deleted it while no lock was held
+		m_found = this->cells.find(std::make_pair(a_cellX, a_cellY));
+		if (m_found == this->cells.end())
+			return false;
 		if (m_found->second->cellState == Head && this->cellStatistics[0] > 0)
 			this->cellStatistics[0] -= 1;
 		else if (m_found->second->cellState == Tail && this->cellStatistics[1] > 0)
 			this->cellStatistics[1] -= 1;
 		else if (m_found->second->cellState == Conductor && this->cellStatistics[2] > 0)
 			this->cellStatistics[2] -= 1;
+		CellState m_oldState = m_found->second->cellState;
+		delete m_found->second;
 		this->cells.erase(m_found);
-		this->cellsEditLock.unlock();
+		this->cellsLayoutVersion++;
+		m_lock.unlock();
+		this->NotifyEdit(a_cellX, a_cellY, m_oldState, Background);
 		return true;
 	}
 }
@@ -797,6 +1393,19 @@ coordinatePart World::ParseCoordinatePartFromString(char* a_input, std::string::
 	return std::stoll(a_input, &a_from, 10);
 }
 
+World::MemoryUsage World::GetMemoryUsage()
+{
+	MemoryUsage m_usage;
+	{
+		TimedSharedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_memoryUsageSite);
+		m_usage.cells = this->cells.size();
+	}
+	m_usage.cellStorage = m_usage.cells * CellStorageBytes;
+	m_usage.mapNodes = m_usage.cells * CellMapNodeBytes;
+	m_usage.snapshots = this->saveSnapshotBytes.load();
+	return m_usage;
+}
+
 std::array<cellCountType, 3> World::GetStatistics()
 {
 	return std::array<cellCountType, 3>{ this->cellStatistics[0], this->cellStatistics[1], this->cellStatistics[2] };
@@ -804,7 +1413,7 @@ std::array<cellCountType, 3> World::GetStatistics()
 
 std::pair<coordinatePart, coordinatePart> World::GetCenterCoordinates()
 {
-	this->cellsEditLock.lock_shared();
+	TimedSharedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_centerSite);
 	auto m_beginning = this->cells.cbegin();
 	auto m_ending = this->cells.cend();
 	coordinatePart m_minX = std::numeric_limits<coordinatePart>::max();
@@ -825,7 +1434,7 @@ std::pair<coordinatePart, coordinatePart> World::GetCenterCoordinates()
 			m_maxX = m_beginning->second->x;
 		std::advance(m_beginning, 1);
 	}
-	this->cellsEditLock.unlock_shared();
+	m_lock.unlock();
 	coordinatePart m_centerX = m_minX + ((m_maxX - m_minX) / 2);
 	coordinatePart m_centerY = m_minY + ((m_maxY - m_minY) / 2);
 
@@ -834,7 +1443,9 @@ std::pair<coordinatePart, coordinatePart> World::GetCenterCoordinates()
 
 void World::ResetToConductors()
 {
-	this->cellsEditLock.lock();
+	std::vector<CellChange> m_changes;
+	std::lock_guard<std::mutex> m_notifyLk(this->changeListenersLock);
+	TimedLock<std::shared_mutex> m_lock(this->cellsEditLock, s_resetToConductorsSite);
 	auto m_beginning = this->cells.begin();
 	auto m_ending = this->cells.end();
 	while (m_beginning != m_ending)
@@ -848,6 +1459,9 @@ void World::ResetToConductors()
 			else if (m_cell->cellState == Tail && this->cellStatistics[1] > 0)
 				this->cellStatistics[1] -= 1;
 
+			if (this->hasChangeListeners.load())
+				m_changes.push_back(CellChange{ m_cell->x, m_cell->y, m_cell->cellState, Conductor });
+
 			// Actually change the cell state
 			if (m_cell->cellState < Background)
 				m_cell->cellState = Conductor;
@@ -861,7 +1475,9 @@ void World::ResetToConductors()
 		}
 		std::advance(m_beginning, 1);
 	}
-	this->cellsEditLock.unlock();
+	m_lock.unlock();
+	if (!m_changes.empty())
+		this->NotifyChange(ChangeSource::Edit, m_changes);
 }
 
 unsigned long long World::GetDisplayGeneration()
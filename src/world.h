@@ -26,30 +26,108 @@ SOFTWARE.
 #include <map>
 #include <functional> // create your own lambda
 #include <vector>
+#include <thread>
 #include <condition_variable>
 #include <shared_mutex>
+#include <atomic>
+#include <array>
+#include <fstream>
 
 #include "cell.h"
 #include "config.h"
 #include "coordinateType.h"
+#include "statsRing.h"
+#include "lockStats.h"
 
 #ifndef __WORLD__
 #define __WORLD__
+// Generations of which the phase timings are kept for the performance panel
+#define StepStatsSize 512
+// The pointers and color a std::map node has next to its value
+#define MapNodeOverhead (4 * sizeof(void*))
+// What a cell of a world costs, its own allocation and its node in the map
+#define CellStorageBytes sizeof(Cell)
+#define CellMapNodeBytes (sizeof(std::pair<std::pair<coordinatePart, coordinatePart>, Cell*>) + MapNodeOverhead)
 
 class World
 {
+public:
+	typedef unsigned long long generationType;
+
+	// Where a batch of cell changes came from
+	enum class ChangeSource
+	{
+		Edit,		// A single cell was drawn, changed or erased by the user
+		Simulation,	// The cells that changed state in a generation
+		Reset		// The world was replaced as a whole, listeners should start over
+	};
+	// Called with the (display) generation, the source and the changed cells. 
+	// Listeners run on the thread that made the change, so keep them short.
+	typedef std::function<void(generationType, ChangeSource, const std::vector<CellChange>&)> ChangeListener;
+
+	// Where the time of UpdateSimulationWithSingleGeneration went, summed over every generation
+	struct StepTimings
+	{
+		generationType generations = 0;
+		unsigned long long totalNs = 0;		// The whole step
+		unsigned long long workNs = 0;		// The slowest worker of each generation
+		unsigned long long syncNs = 0;		// Waking the workers and waiting for them, without the slowest worker's work
+		unsigned long long commitNs = 0;	// Applying the new states after the workers are done
+	};
+
+	enum class MetricsFormat
+	{
+		JsonLines,	// One JSON object per line
+		Csv		// A header line and one row per sample
+	};
+	// The state of the simulation after a generation, the times are summed over every generation
+	struct Metrics
+	{
+		generationType generation = 0;	// The display generation
+		cellCountType heads = 0;
+		cellCountType tails = 0;
+		cellCountType conductors = 0;
+		cellCountType cells = 0;
+		generationType generations = 0;	// Generations stepped since the world was created
+		unsigned long long totalNs = 0;
+		unsigned long long workNs = 0;
+		unsigned long long syncNs = 0;
+		unsigned long long commitNs = 0;
+		unsigned long long lockWaitNs = 0;	// Waiting for cellsEditLock while stepping, summed over the threads
+		unsigned long long memoryBytes = 0;	// Estimated from the number of cells
+	};
+	// How the simulation threads are made, they start when the world is first simulated
+	struct ThreadOptions
+	{
+		unsigned int threads = 0;	// 0 picks a number based on the processor
+		bool pinThreads = false;	// Keeps every simulation thread on its own logical processor, filling one NUMA node first
+		bool nodeLocalCells = false;	// Every simulation thread allocates the cells it simulates, so they end up on its NUMA node
+		bool stepOnCaller = false;	// No simulation threads, whoever calls UpdateSimulationWithSingleGeneration calculates it (for running many worlds on one pool)
+	};
+	// The heap memory of the world in bytes
+	// Estimated from the number of cells and the size of a cell and its map node, without allocator overhead
+	struct MemoryUsage
+	{
+		size_t cellStorage = 0;
+		size_t mapNodes = 0;
+		size_t snapshots = 0;	// The copy of the cells a save is writing
+		cellCountType cells = 0;
+	};
 
 private:
-	typedef unsigned long long generationType;
 	typedef std::map<std::pair<coordinatePart, coordinatePart>, Cell*>::size_type mapSizeType;
 	class ThreadCombo {
 		public:
 			std::mutex lock;
 			std::condition_variable cv;
 			generationType current_generation;
+			unsigned long long lastBusyNs; // How long the last generation took this thread
+			std::atomic<unsigned long long> totalBusyNs; // Summed over every generation
 			ThreadCombo()
 			{
 				this->current_generation = 0;
+				this->lastBusyNs = 0;
+				this->totalBusyNs.store(0);
 			};
 	};
 
@@ -65,10 +143,29 @@ private:
 	std::condition_variable nextUpdateCv;
 	std::map<unsigned int, ThreadCombo*> threadComboData;
 	unsigned int totalThreads;
+	ThreadOptions threadOptions;
+	std::mutex threadsStartLock;
+	std::atomic<bool> threadsStarted;
+	// Simulation threads that should have been pinned, but the system didn't let them
+	std::atomic<unsigned int> pinFailures;
+	// Moving the cells to the threads that simulate them, the jobs are counted under currentGenerationLock
+	std::atomic<bool> cellPlacementRequested;
+	unsigned long long cellPlacementJob = 0;
+	unsigned int cellPlacementsDone = 0;
+	std::condition_variable cellPlacementDoneCv;
+	StepTimings stepTimings;
+	// Per generation phase timings in ms, only pushed while someone looks at them
+	std::atomic<bool> collectStepStats;
+	StatsRing<StepStatsSize> scatterStats;
+	StatsRing<StepStatsSize> syncStats;
+	StatsRing<StepStatsSize> commitStats;
+	StatsRing<StepStatsSize> stepStats;
 
 	std::mutex lastPartLock;
 	std::condition_variable lastPartGenerationCv;
 	generationType lastPartGeneration;
+	unsigned long long lastPartBusyNs = 0;
+	std::atomic<unsigned long long> lastPartTotalBusyNs;
 	// The thread that processes the last parts of the cells list
 	std::thread lastPartProcessor;
 	// Simulation speed in Hz
@@ -76,14 +173,47 @@ private:
 
 	// Lock for when you need to edit the cells
 	std::shared_mutex cellsEditLock;
+	// Goes up whenever map nodes are added or removed (only while holding cellsEditLock exclusively),
+	// the simulation threads find their section again when it changed
+	unsigned long long cellsLayoutVersion = 0;
+	std::atomic<unsigned long long> lockWaitNs;
+
+	// The metrics of the last generation, odd sequence numbers mean they are being written
+	std::atomic<unsigned long long> metricsSequence;
+	std::atomic<unsigned long long> publishedMetrics[11];
+	// Metrics stream
+	std::thread metricsThread;
+	std::mutex metricsLock;
+	std::condition_variable metricsCv;
+	bool stopMetrics = false;
+	std::ofstream metricsFile;
 
 	cellCountType cellStatistics[3] = { 0,0,0 };
 	generationType currentGeneration = 0;
+	// The generation the cells are currently showing (only changes while holding cellsEditLock)
+	generationType committedGeneration = 0;
 	generationType loadedWorldGenerationOffset = 0;
 	
 	float deltaTime[30];
 	unsigned int deltaTimeIndex = 0;
 	float totalTime = 0;
+
+	// Background saving
+	std::thread saveThread;
+	std::atomic<bool> saveInProgress;
+	std::atomic<bool> lastSaveSucceeded;
+	std::atomic<cellCountType> saveCellsWritten;
+	std::atomic<cellCountType> saveCellsTotal;
+	std::atomic<size_t> saveSnapshotBytes;
+
+	// Change notification. Whoever changes cells takes this before cellsEditLock and keeps it until the
+	// listeners heard of it, so they hear of the changes in the order they were made.
+	std::mutex changeListenersLock;
+	std::map<unsigned int, ChangeListener> changeListeners;
+	unsigned int nextChangeListenerId = 0;
+	std::atomic<bool> hasChangeListeners;
+	// The cells that changed in the last generation, kept around so the memory can be reused
+	std::vector<CellChange> generationChanges;
 public:
 	std::map<std::pair<coordinatePart, coordinatePart>, Cell*> cells;
 
@@ -101,10 +231,26 @@ private:
 	void ProcessPartContinuesly(unsigned int a_threadId, unsigned int a_maxThreads);
 	void ProcessLastPart();
 	void TimerThread();
-	void World::InitializeThreads();
+	void SaveSnapshotToFile(std::string a_filePath, std::string a_header);
+	void TakeSnapshot(std::vector<CellSnapshot>* a_output, generationType* a_generation, LockSite& a_site);
+	void PublishMetrics(cellCountType a_cellCount);
+	void MetricsThread(MetricsFormat a_format, double a_intervalInSeconds);
+	void NotifyChange(ChangeSource a_source, const std::vector<CellChange>& a_changes);
+	void NotifyEdit(coordinatePart a_x, coordinatePart a_y, CellState a_oldState, CellState a_newState);
+	void InitializeThreads();
+	void StartThreads();
+	// False when the thread should have been pinned but couldn't be
+	bool PinSimulationThread(unsigned int a_threadId);
+	void PlaceCellsOnThreads();
+	void AllocateOwnCells(unsigned int a_threadId);
+	void CopyCellsFrom(const World& a_that);
+	unsigned long long ScatterOnCallingThread();
 	coordinatePart ParseCoordinatePartFromString(char* a_input, std::string::size_type a_from);
 public:
 	World();
+	// Simulates with a_simulationThreads threads, 0 picks a number based on the processor
+	World(unsigned int a_simulationThreads);
+	World(ThreadOptions a_threadOptions);
 	// Copy constructor
 	World(const World& a_that);
 	// Copy assignment operator
@@ -112,8 +258,20 @@ public:
 	
 	~World();
 
-	void Save();
+	// Starts saving the world in the background, returns false if a save is already running
+	bool Save();
+	void WaitForSave();
+	bool IsSaving() { return this->saveInProgress.load(); };
+	bool GetLastSaveSucceeded() { return this->lastSaveSucceeded.load(); };
+	float GetSaveProgress();
 	void Open(std::string a_filePath);
+	void TakeSnapshot(std::vector<CellSnapshot>* a_output, generationType* a_generation);
+	void LoadSnapshot(const std::vector<CellSnapshot>& a_cells, generationType a_generation);
+	// Changes the state of many existing cells at once, cells that don't exist are skipped
+	void SetStates(const std::vector<CellSnapshot>& a_cells);
+
+	unsigned int AddChangeListener(ChangeListener a_listener);
+	void RemoveChangeListener(unsigned int a_id);
 	
 	void UpdateSimulationWithSingleGeneration();
 	void StartSimulation();
@@ -122,11 +280,38 @@ public:
 
 	void SetTargetSpeed(float a_targetSpeed);
 	float GetTargetSpeed() { return this->targetSimulationSpeed; };
+	unsigned int GetSimulationThreadCount() { return this->totalThreads; };
+	ThreadOptions GetThreadOptions() { return this->threadOptions; };
+	// The simulation threads that stay wherever the system puts them, although pinThreads was set
+	unsigned int GetPinFailures() { return this->pinFailures.load(); };
+	// Lets every simulation thread allocate the cells it simulates again, after many edits. 
+	// Only does something with nodeLocalCells, the cells handed out by InViewport are no longer valid afterwards.
+	void RequestCellPlacement();
+	// Only up to date on the thread that steps the simulation
+	StepTimings GetStepTimings() { return this->stepTimings; };
+	// Turns the per generation phase rings on or off, they cost nothing while off
+	void SetCollectStepStats(bool a_collect);
+	bool GetCollectStepStats() { return this->collectStepStats.load(); };
+	// Copies the last generations of the slowest worker, the barrier wait and the commit in ms
+	void GetStepStats(std::vector<float>* a_scatter, std::vector<float>* a_sync, std::vector<float>* a_commit, std::vector<float>* a_step);
+	// The time every simulation thread spent working so far, the last part thread is the last entry
+	void GetWorkerBusyNs(std::vector<unsigned long long>* a_output);
+	// Never blocks the simulation, only has the values of the last stepped generation
+	Metrics GetMetrics();
+	// Appends the metrics to a_filePath every a_intervalInSeconds from a background thread, returns false if the file can't be opened
+	bool StartMetricsStream(std::string a_filePath, MetricsFormat a_format, float a_intervalInSeconds);
+	void StopMetricsStream();
+	bool IsStreamingMetrics() { return this->metricsThread.joinable(); };
+	MemoryUsage GetMemoryUsage();
 
 	Cell* GetCopyOfCellAt(coordinatePart a_cellX, coordinatePart a_cellY);
 	bool TryUpdateCell(coordinatePart a_cellX, coordinatePart a_cellY, std::function<bool (Cell*)> a_updater);
 	bool TryInsertCellAt(coordinatePart a_cellX, coordinatePart a_cellY, CellState a_state);
+	// The cells stay valid until they are deleted, the world is loaded or the cells are placed on the simulation threads
 	void InViewport(std::vector<Cell*>* a_output, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height);
+	// Writes the state of every cell in the viewport (same bounds as InViewport) to a_output, 
+	// the cell at a_x + 1, a_y + 1 goes to the first byte
+	void StatesInViewport(unsigned char* a_output, size_t a_stride, coordinatePart a_x, coordinatePart a_y, unsigned int a_width, unsigned int a_height);
 	bool TryDeleteCell(coordinatePart a_cellX, coordinatePart a_cellY);
 
 	bool GetIsRunning() { return !this->pauzeSimulation; };